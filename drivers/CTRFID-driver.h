@@ -22,6 +22,9 @@
  * Changelog:
  * - 0.1: Initial release
  * - 0.2: Partial rewrite by Xander Soldaat to simplify API
+ * - 0.3: Register reads use I2CreadRegisters() instead of building the request every time
+ * - 0.4: Include common.h from the same directory like the other drivers
+ * - 0.5: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * Credits:
  * - Big thanks to Xander Soldaat for giving his work on other sensors's drivers code for ROBOTC.<br>
@@ -34,7 +37,7 @@
  * \author Sylvain CACHEUX (sylcalego@cacheux.info)
  * \author Xander Soldaat (mightor@gmail.com), version 0.2
  * \date 15 february 2010
- * \version 0.2
+ * \version 0.5
  * \example CTRFID-test1.c
  * \example CTRFID-test2.c
  */
@@ -42,7 +45,7 @@
 #pragma systemFile
 
 #ifndef __COMMON_H__
-#include "drivers/common.h"
+#include "common.h"
 #endif
 
 // I2C ADDRESS
@@ -94,8 +97,13 @@ bool _CTRFIDreadStatus(tSensors link, ubyte &_status);
 
 // ---------------------------- Global variables ---------------------------------
 /*!< Global variables */
-tByteArray CTRFID_I2CRequest;    /*!< Array to hold I2C command data */
-tByteArray CTRFID_I2CReply;      /*!< Array to hold I2C reply data   */
+#ifdef __COMMON_H_I2C_ARENA__
+#define CTRFID_I2CRequest    I2CArenaRequest
+#define CTRFID_I2CReply      I2CArenaReply
+#else
+tByteArray CTRFID_I2CRequest;       /*!< Array to hold I2C command data */
+tByteArray CTRFID_I2CReply;         /*!< Array to hold I2C reply data   */
+#endif // __COMMON_H_I2C_ARENA__
 
 bool CTRFIDreadContinuous[4] = {false, false, false, false};  /*!< Is the sensor configured for Continuous mode? */
 bool CTRFIDinitialised[4] = {false, false, false, false};     /*!< Has the sensor been initialised? */
@@ -265,14 +273,7 @@ bool CTRFIDreadTransponder(tSensors link, string &transponderID) {
   }
 
   // Retrieve the transponder's address
-  memset(CTRFID_I2CRequest, 0, sizeof(tByteArray));
-  CTRFID_I2CRequest.arr[0] = 2;                                        // Message size
-  CTRFID_I2CRequest.arr[1] = CTRFID_I2C_ADDR;                     // I2C Address of RFID sensor
-  CTRFID_I2CRequest.arr[2] = CTRFID_OFFSET + CTRFID_BYTE1;   // Address byte1 registry
-  if (!writeI2C(link, CTRFID_I2CRequest, 5))
-    return false;
-
-  if (!readI2C(link, CTRFID_I2CReply, 5))
+  if (!I2CreadRegisters(link, I2C_DESC(CTRFID_I2C_ADDR, CTRFID_OFFSET + CTRFID_BYTE1), CTRFID_I2CReply, 5))
     return false;
 
   // formating the value read into a string of 10 chars
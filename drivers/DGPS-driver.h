@@ -19,6 +19,8 @@
  * Changelog:
  * - 0.1: Initial release
  * - 0.2: Added DGPSreadDistToDestination()
+ * - 0.3: Register reads use I2CreadRegisters() instead of building the request every time
+ * - 0.4: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * Credits:
  * - Big thanks to Dexter Industries for providing me with the hardware necessary to write and test this.
@@ -28,7 +30,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 23 November 2010
- * \version 0.2
+ * \version 0.4
  * \example DGPS-test1.c
  */
 
@@ -62,20 +64,16 @@ int DGPSreadRelHeading(tSensors link);
 bool DGPSsetDestination(tSensors link, long latitude, long longitude);
 int DGPSreadDistToDestination(tSensors link);
 
-tByteArray DGPS_I2CRequest;    /*!< Array to hold I2C command data */
-tByteArray DGPS_I2CReply;      /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define DGPS_I2CRequest      I2CArenaRequest
+#define DGPS_I2CReply        I2CArenaReply
+#else
+tByteArray DGPS_I2CRequest;       /*!< Array to hold I2C command data */
+tByteArray DGPS_I2CReply;         /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
 
 long _DGPSreadRegister(tSensors link, unsigned byte command, int replysize) {
-  memset(DGPS_I2CRequest, 0, sizeof(tByteArray));
-
-  DGPS_I2CRequest.arr[0] = 2;               // Message size
-  DGPS_I2CRequest.arr[1] = DGPS_I2C_ADDR;   // I2C Address
-  DGPS_I2CRequest.arr[2] = command;
-
-  if (!writeI2C(link, DGPS_I2CRequest, 4))
-    return -1;
-
-  if (!readI2C(link, DGPS_I2CReply, 4))
+  if (!I2CreadRegisters(link, I2C_DESC(DGPS_I2C_ADDR, command), DGPS_I2CReply, 4))
     return -1;
 
   // Reassemble the messages, depending on their expected size.
@@ -34,8 +34,13 @@
 /*! Page for the AT24C512 */
 #define EEPROM_PAGE_SIZE   128
 
-tByteArray EEPROM_I2CRequest;    /*!< Array to hold I2C command data */
-tByteArray EEPROM_I2CReply;      /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define EEPROM_I2CRequest    I2CArenaRequest
+#define EEPROM_I2CReply      I2CArenaReply
+#else
+tByteArray EEPROM_I2CRequest;       /*!< Array to hold I2C command data */
+tByteArray EEPROM_I2CReply;         /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
 
 /*
 <function prototypes>
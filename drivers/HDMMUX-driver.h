@@ -18,6 +18,15 @@
  *
  * Changelog:
  * - 0.1: Initial release
+ * - 0.2: Sensor port is flagged as an MMUX in the I2C port registry
+ * - 0.3: Fixed HDMMotorEncoder() passing the address of its dummy status byte
+ * - 0.4: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined<br>
+ *        mmuxData is declared here instead of in common.h
+ * - 0.5: Repeated motor commands are left out when __COMMON_H_MMUX_SHADOW__ is defined
+ * - 0.6: Status and tacho counts are kept in a snapshot shared by HDMMotorEncoder() and HDMMotorBusy()<br>
+ *        Added HDMMUXreadStatusAge() and, with __COMMON_H_MMUX_REFRESH__, HDMMUXstartRefresh()
+ * - 0.7: While the refresh task reads an MMUX, HDMMUXreadStatus() waits for its snapshot instead of
+ *        reading alongside it, and gives up on one older than the rate plus HDMMUX_REFRESH_SLACK
  *
  * Credits:
  * - Big thanks to Holit Data Systems for providing me with the hardware necessary to write and test this.
@@ -32,7 +41,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 30 March 2010
- * \version 0.1
+ * \version 0.7
  * \example HDMMUX-test1.c
  * \example HDMMUX-test2.c
  */
@@ -81,12 +90,39 @@
 #define HDMMUX_ROT_BRAKE        0x01
 #define HDMMUX_ROT_FLOAT        0x00
 
-tByteArray HDMMUX_I2CRequest;    /*!< Array to hold I2C command data */
-tByteArray HDMMUX_I2CReply;      /*!< Array to hold I2C reply data */
+#define HDMMUX_STATUS_SIZE      13    /*!< Status byte and three tacho counts */
+#define HDMMUX_REFRESH_IDLE     20    /*!< Longest time in ms the refresh task sleeps between rounds */
+#define HDMMUX_REFRESH_SLACK    20    /*!< Time in ms a refreshed status may be late before it counts as stale */
+
+#ifdef __COMMON_H_I2C_ARENA__
+#define HDMMUX_I2CRequest    I2CArenaRequest
+#define HDMMUX_I2CReply      I2CArenaReply
+#else
+tByteArray HDMMUX_I2CRequest;       /*!< Array to hold I2C command data */
+tByteArray HDMMUX_I2CReply;         /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
+#ifndef __MMUX_DATA__
+#define __MMUX_DATA__
+mmuxDataT mmuxData[4];  /*!< Holds all the MMUX info, one for each sensor port */
+#endif // __MMUX_DATA__
+tI2CSnapshot HDMMUX_StatusSnapshot[4];  /*!< Cached status and tacho counts of all three motors */
+ubyte HDMMUX_Commands[4];               /*!< Number of commands sent to each MMUX, wraps around */
+#ifdef __COMMON_H_MMUX_REFRESH__
+int HDMMUX_RefreshRate[4];              /*!< Interval in ms at which the refresh task reads each MMUX, 0 if it doesn't */
+bool HDMMUX_Refreshing = false;         /*!< Whether the refresh task is running */
+bool HDMMUX_RefreshBusy[4];             /*!< Whether the refresh task is reading each MMUX right now */
+#endif // __COMMON_H_MMUX_REFRESH__
 
 // Function prototypes
 void HDMMUXinit();
 bool HDMMUXreadStatus(tSensors link, byte &motorStatus, long &tachoA, long &tachoB, long &tachoC);
+long HDMMUXreadStatusAge(tSensors link);
+bool _HDMMUXreadSnapshot(tSensors link, tByteArray &request, tByteArray &reply);
+#ifdef __COMMON_H_MMUX_REFRESH__
+bool _HDMMUXrefreshOwns(tSensors link);
+void HDMMUXstartRefresh(tSensors link, int rate);
+void HDMMUXstopRefresh();
+#endif // __COMMON_H_MMUX_REFRESH__
 bool HDMMUXsendCommand(tSensors link, ubyte mode, ubyte channel, ubyte rotparams, long duration, byte power, byte steering);
 bool HDMMotor(tMUXmotor muxmotor, byte power);
 bool HDMotorStop(tMUXmotor muxmotor);
@@ -114,11 +150,50 @@ void HDMMUXinit(){
     memset(mmuxData[i].target, 0, 4*4);
     memset(mmuxData[i].ramping[0], HDMMUX_ROT_CONSTSPEED, 4);
     memset(mmuxData[i].targetUnit[0], HDMMUX_ROT_UNLIMITED, 4);
+#ifdef __COMMON_H_MMUX_SHADOW__
+    MMUXinvalidateShadow(mmuxData[i]);
+#endif // __COMMON_H_MMUX_SHADOW__
     mmuxData[i].initialised = true;
   }
 }
 
 
+/**
+ * Read the status byte and tacho counts of the MMUX into its snapshot.
+ *
+ * Note: this is an internal function and shouldn't be used directly
+ * @param link the MMUX port number
+ * @param request the buffer to build the request in
+ * @param reply the buffer to read the reply into
+ * @return true if no error occured, false if it did
+ */
+bool _HDMMUXreadSnapshot(tSensors link, tByteArray &request, tByteArray &reply) {
+  ubyte commands = HDMMUX_Commands[link];
+
+  memset(request, 0, sizeof(tByteArray));
+
+  request.arr[0]  = 10;               // Message size
+  request.arr[1]  = HDMMUX_I2C_ADDR; // I2C Address
+
+  if (!writeI2C(link, request, HDMMUX_STATUS_SIZE))
+    return false;
+
+  if (!readI2C(link, reply, HDMMUX_STATUS_SIZE))
+    return false;
+
+  hogCPU();
+  memcpy(HDMMUX_StatusSnapshot[link].data, reply, sizeof(tByteArray));
+  HDMMUX_StatusSnapshot[link].timestamp = nPgmTime;
+  HDMMUX_StatusSnapshot[link].address = HDMMUX_I2C_ADDR;
+  HDMMUX_StatusSnapshot[link].size = HDMMUX_STATUS_SIZE;
+  // A command sent while the status was on its way makes it stale
+  HDMMUX_StatusSnapshot[link].valid = (HDMMUX_Commands[link] == commands);
+  releaseCPU();
+
+  return true;
+}
+
+
 /**
  * Read the status of the motors and tacho counts of the MMUX
  *
@@ -127,6 +202,14 @@ void HDMMUXinit(){
  * bit 1: motor B\n
  * bit 2: motor C\n
  *
+ * The values come from a snapshot that is shared by HDMMotorEncoder() and
+ * HDMMotorBusy().  It is read again once it is older than the port's snapshot
+ * TTL, see I2CsetSnapshotTTL(), or after a command was sent to the MMUX.  While
+ * the refresh task keeps it up to date, see HDMMUXstartRefresh(), the bus is
+ * left alone: a snapshot that is older than the refresh rate plus
+ * HDMMUX_REFRESH_SLACK ms is waited for, and if none turns up in that time,
+ * false is returned.
+ *
  * @param link the MMUX port number
  * @param motorStatus status of the motors
  * @param tachoA Tacho count for motor A
@@ -135,28 +218,142 @@ void HDMMUXinit(){
  * @return true if no error occured, false if it did
  */
 bool HDMMUXreadStatus(tSensors link, byte &motorStatus, long &tachoA, long &tachoB, long &tachoC) {
-  memset(HDMMUX_I2CRequest, 0, sizeof(tByteArray));
-
-  HDMMUX_I2CRequest.arr[0]  = 10;               // Message size
-  HDMMUX_I2CRequest.arr[1]  = HDMMUX_I2C_ADDR; // I2C Address
+  bool fresh = false;
+
+#ifdef __COMMON_H_MMUX_REFRESH__
+  // Reading alongside the refresh task would mix up its request and reply
+  long start = nPgmTime;
+  while (_HDMMUXrefreshOwns(link)) {
+    if (HDMMUX_StatusSnapshot[link].valid &&
+        ((nPgmTime - HDMMUX_StatusSnapshot[link].timestamp) <= (HDMMUX_RefreshRate[link] + HDMMUX_REFRESH_SLACK))) {
+      fresh = true;
+      break;
+    }
+    if ((nPgmTime - start) > (HDMMUX_RefreshRate[link] + HDMMUX_REFRESH_SLACK))
+      return false;
+    wait1Msec(1);
+  }
+#endif // __COMMON_H_MMUX_REFRESH__
 
-  if (!writeI2C(link, HDMMUX_I2CRequest, 13))
-    return false;
+  if (!fresh)
+    fresh = HDMMUX_StatusSnapshot[link].valid && ((nPgmTime - HDMMUX_StatusSnapshot[link].timestamp) < I2CSnapshotTTL[link]);
 
-  if (!readI2C(link, HDMMUX_I2CReply, 13))
+  if (!fresh && !_HDMMUXreadSnapshot(link, HDMMUX_I2CRequest, HDMMUX_I2CReply))
     return false;
 
-  motorStatus = HDMMUX_I2CReply.arr[0];
+  hogCPU();
+  motorStatus = HDMMUX_StatusSnapshot[link].data.arr[0];
 
   // Assemble and assign the encoder values
-  tachoA = (HDMMUX_I2CReply.arr[1] << 24) + (HDMMUX_I2CReply.arr[2] << 16) + (HDMMUX_I2CReply.arr[3] << 8) + (HDMMUX_I2CReply.arr[4] << 0);
-  tachoB = (HDMMUX_I2CReply.arr[5] << 24) + (HDMMUX_I2CReply.arr[6] << 16) + (HDMMUX_I2CReply.arr[7] << 8) + (HDMMUX_I2CReply.arr[8] << 0);
-  tachoC = (HDMMUX_I2CReply.arr[9] << 24) + (HDMMUX_I2CReply.arr[10] << 16) + (HDMMUX_I2CReply.arr[11] << 8) + (HDMMUX_I2CReply.arr[12] << 0);
+  tachoA = (HDMMUX_StatusSnapshot[link].data.arr[1] << 24) + (HDMMUX_StatusSnapshot[link].data.arr[2] << 16) + (HDMMUX_StatusSnapshot[link].data.arr[3] << 8) + (HDMMUX_StatusSnapshot[link].data.arr[4] << 0);
+  tachoB = (HDMMUX_StatusSnapshot[link].data.arr[5] << 24) + (HDMMUX_StatusSnapshot[link].data.arr[6] << 16) + (HDMMUX_StatusSnapshot[link].data.arr[7] << 8) + (HDMMUX_StatusSnapshot[link].data.arr[8] << 0);
+  tachoC = (HDMMUX_StatusSnapshot[link].data.arr[9] << 24) + (HDMMUX_StatusSnapshot[link].data.arr[10] << 16) + (HDMMUX_StatusSnapshot[link].data.arr[11] << 8) + (HDMMUX_StatusSnapshot[link].data.arr[12] << 0);
+  releaseCPU();
 
   return true;
 }
 
 
+/**
+ * Get the age of the snapshot HDMMUXreadStatus() reads from.
+ *
+ * @param link the MMUX port number
+ * @return the time in ms since the status was last read, -1 if there's no valid snapshot
+ */
+long HDMMUXreadStatusAge(tSensors link) {
+  if (!HDMMUX_StatusSnapshot[link].valid)
+    return -1;
+  return nPgmTime - HDMMUX_StatusSnapshot[link].timestamp;
+}
+
+
+#ifdef __COMMON_H_MMUX_REFRESH__
+/**
+ * Check whether the refresh task reads the MMUX, or is still busy reading it.
+ *
+ * Note: this is an internal function and shouldn't be used directly
+ * @param link the MMUX port number
+ * @return true if only the refresh task may read the status, false if not
+ */
+bool _HDMMUXrefreshOwns(tSensors link) {
+  bool owns = false;
+
+  hogCPU();
+  owns = (HDMMUX_Refreshing && (HDMMUX_RefreshRate[link] > 0)) || HDMMUX_RefreshBusy[link];
+  releaseCPU();
+  return owns;
+}
+
+
+/**
+ * Read the status of the MMUXes that are due.  An MMUX is marked busy while
+ * it's being read, so HDMMUXreadStatus() doesn't read it at the same time
+ * after its refresh was stopped.
+ *
+ * Note: this task is started by HDMMUXstartRefresh() and should not be started directly
+ */
+task _HDMMUXrefreshTask() {
+  tByteArray request;
+  tByteArray reply;
+  long due[4];
+  long next = 0;
+
+  memset(due, 0, sizeof(due));
+
+  while (HDMMUX_Refreshing) {
+    next = nPgmTime + HDMMUX_REFRESH_IDLE;
+
+    for (int i = 0; i < 4; i++) {
+      hogCPU();
+      HDMMUX_RefreshBusy[i] = HDMMUX_Refreshing && (HDMMUX_RefreshRate[i] > 0) &&
+                              (!HDMMUX_StatusSnapshot[i].valid || (nPgmTime >= due[i]));
+      releaseCPU();
+
+      if (HDMMUX_RefreshBusy[i]) {
+        // Keep to the rate no matter how long the bus takes
+        due[i] = nPgmTime + HDMMUX_RefreshRate[i];
+        _HDMMUXreadSnapshot((tSensors)i, request, reply);
+        HDMMUX_RefreshBusy[i] = false;
+      }
+      if ((HDMMUX_RefreshRate[i] > 0) && (due[i] < next))
+        next = due[i];
+    }
+
+    wait1Msec(max(1, next - nPgmTime));
+  }
+}
+
+
+/**
+ * Have a background task read the status and tacho counts of an MMUX at a
+ * fixed rate, so odometry sees evenly spaced encoder values.  While it does,
+ * HDMMUXreadStatus(), HDMMotorEncoder() and HDMMotorBusy() return the
+ * latest values without touching the bus.
+ *
+ * @param link the MMUX port number
+ * @param rate the interval in ms, 0 to stop refreshing this MMUX
+ */
+void HDMMUXstartRefresh(tSensors link, int rate) {
+  HDMMUX_RefreshRate[link] = rate;
+
+  if (HDMMUX_Refreshing || (rate == 0))
+    return;
+
+  HDMMUX_Refreshing = true;
+  StartTask(_HDMMUXrefreshTask);
+}
+
+
+/**
+ * Stop the refresh task once it's done with the current round.  Queries read
+ * from the bus again once the snapshots are older than the port's TTL.
+ */
+void HDMMUXstopRefresh() {
+  HDMMUX_Refreshing = false;
+}
+#endif // __COMMON_H_MMUX_REFRESH__
+
+
 /**
  * Send a command to the MMUX.
  *
@@ -185,7 +382,31 @@ bool HDMMUXsendCommand(tSensors link, ubyte mode, ubyte channel, ubyte rotparams
   HDMMUX_I2CRequest.arr[9]  = power;
   HDMMUX_I2CRequest.arr[10] = (byte)(steering & 0xFF);
 
+  hogCPU();
+  HDMMUX_Commands[link]++;
+  I2CinvalidateSnapshot(HDMMUX_StatusSnapshot[link]);
+  releaseCPU();
+
+  I2CsetPortMux(link, I2C_PORT_MMUX);
+
+#ifdef __COMMON_H_MMUX_SHADOW__
+  // The MMUX takes whole commands, so only a repeat of the last one can be
+  // left out, and only when it has no target, which would restart the move.
+  if (mode != HDMMUX_CMD_MOTOR || channel < HDMMUX_MOTOR_A || channel > HDMMUX_MOTOR_C) {
+    MMUXinvalidateShadow(mmuxData[link]);
+  } else if (MMUXcheckShadow(mmuxData[link], channel - 1, duration, power, steering, rotparams,
+                             (rotparams & HDMMUX_ROT_SECONDS) == HDMMUX_ROT_UNLIMITED) == MMUX_SHADOW_NONE) {
+    return true;
+  }
+
+  if (!writeI2C(link, HDMMUX_I2CRequest, 0)) {
+    MMUXinvalidateShadow(mmuxData[link]);
+    return false;
+  }
+  return true;
+#else
   return writeI2C(link, HDMMUX_I2CRequest, 0);
+#endif // __COMMON_H_MMUX_SHADOW__
 }
 
 
@@ -318,7 +539,7 @@ long HDMMotorEncoder(tMUXmotor muxmotor) {
   long encC  = 0;
   byte dummy = 0;
 
-  HDMMUXreadStatus((tSensors)SPORT(muxmotor), &dummy, encA, encB, encC);
+  HDMMUXreadStatus((tSensors)SPORT(muxmotor), dummy, encA, encB, encC);
 
   switch ((ubyte)MPORT(muxmotor)) {
     case 0: return encA;
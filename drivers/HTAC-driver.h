@@ -26,6 +26,9 @@
  * - 0.4: Removed HTAC_SMUXData, reused HTAC_I2CReply to save memory
  * - 0.5: Use new calls in common.h that don't require SPORT/MPORT macros<br>
  *        Fixed massive bug in HTACreadAllAxes() in the way values are calculated
+ * - 0.6: Register reads use I2CreadRegisters() instead of building the request every time
+ * - 0.7: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
+ * - 0.8: Added HTACsetSMUXWindow() so the SMUX only copies the axis registers
  *
  * Credits:
  * - Big thanks to HiTechnic for providing me with the hardware necessary to write and test this.
@@ -35,7 +38,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 28 November 2009
- * \version 0.5
+ * \version 0.8
  * \example HTAC-test1.c
  * \example HTAC-SMUX-test1.c
  */
@@ -57,6 +60,7 @@
 
 bool HTACreadAllAxes(tSensors link, int &x, int &y, int &z);
 bool HTACreadAllAxes(tMUXSensor muxsensor, int &x, int &y, int &z);
+bool HTACsetSMUXWindow(tMUXSensor muxsensor);
 bool HTACreadX(tSensors link, int &x);
 bool HTACreadX(tMUXSensor muxsensor, int &x);
 bool HTACreadY(tSensors link, int &y);
@@ -64,8 +68,11 @@ bool HTACreadY(tMUXSensor muxsensor, int &y);
 bool HTACreadZ(tSensors link, int &z);
 bool HTACreadZ(tMUXSensor muxsensor, int &z);
 
-tByteArray HTAC_I2CRequest;    /*!< Array to hold I2C command data */
-tByteArray HTAC_I2CReply;      /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define HTAC_I2CReply        I2CArenaReply
+#else
+tByteArray HTAC_I2CReply;         /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
 
 /**
  * Read the value of all the axes registers return by reference
@@ -76,16 +83,7 @@ tByteArray HTAC_I2CReply;      /*!< Array to hold I2C reply data */
  * @return true if no error occured, false if it did
  */
 bool HTACreadAllAxes(tSensors link, int &x, int &y, int &z) {
-  memset(HTAC_I2CRequest, 0, sizeof(tByteArray));
-
-  HTAC_I2CRequest.arr[0] = 2;                       // Message size
-  HTAC_I2CRequest.arr[1] = HTAC_I2C_ADDR;           // I2C Address
-  HTAC_I2CRequest.arr[2] = HTAC_OFFSET + HTAC_X_UP; // X axis upper 8 bits register
-
-  if (!writeI2C(link, HTAC_I2CRequest, 6))
-    return false;
-
-  if (!readI2C(link, HTAC_I2CReply, 6))
+  if (!I2CreadRegisters(link, I2C_DESC(HTAC_I2C_ADDR, HTAC_OFFSET + HTAC_X_UP), HTAC_I2CReply, 6))
     return false;
 
   // Convert 2 bytes into a signed 10 bit value.  If the 8 high bits are more than 127, make
@@ -138,6 +136,20 @@ bool HTACreadAllAxes(tMUXSensor muxsensor, int &x, int &y, int &z) {
 }
 
 
+/**
+ * Have the SMUX copy only the 6 axis registers from the sensor, which lets it
+ * refresh all its channels more often, see HTSMUXsetWindow().
+ * @param muxsensor the SMUX sensor port number
+ * @return true if no error occured, false if it did
+ */
+bool HTACsetSMUXWindow(tMUXSensor muxsensor) {
+  if (HTSMUXreadSensorType(muxsensor) != HTSMUXAccel)
+    return false;
+
+  return HTSMUXsetWindow(muxsensor, HTAC_I2C_ADDR, HTAC_OFFSET + HTAC_X_UP, 6);
+}
+
+
 /**
  * Read the value of the X axis register and return by reference
  * @param link the HTIRS port number
@@ -18,6 +18,8 @@
  *
  * Changelog:
  * - 0.1: Initial release
+ * - 0.2: Register reads use I2CreadRegisters() instead of building the request every time
+ * - 0.3: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * Credits:
  * - Big thanks to HiTechnic for providing me with the hardware necessary to write and test this.
@@ -27,7 +29,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 12 November 2009
- * \version 0.1
+ * \version 0.3
  * \example HTANG-test1.c
  * \example HTANG-SMUX-test1.c
  */
@@ -67,8 +69,13 @@ bool HTANGresetAngle(tSensors link);
 bool HTANGresetAccumulatedAngle(tSensors link);
 bool _HTANGsendCommand(tSensors link, byte command);
 
-tByteArray HTANG_I2CRequest;             /*!< Array to hold I2C command data */
-tByteArray HTANG_I2CReply;               /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define HTANG_I2CRequest     I2CArenaRequest
+#define HTANG_I2CReply       I2CArenaReply
+#else
+tByteArray HTANG_I2CRequest;                /*!< Array to hold I2C command data */
+tByteArray HTANG_I2CReply;                  /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
 
 
 /**
@@ -77,16 +84,7 @@ tByteArray HTANG_I2CReply;               /*!< Array to hold I2C reply data */
  * @return current angle or -1 if an error occurred.
  */
 int HTANGreadAngle(tSensors link) {
-  memset(HTANG_I2CRequest, 0, sizeof(tByteArray));
-
-  HTANG_I2CRequest.arr[0] = 2;                         // Message size
-  HTANG_I2CRequest.arr[1] = HTANG_I2C_ADDR;            // I2C Address
-  HTANG_I2CRequest.arr[2] = HTANG_OFFSET + HTANG_ANG2; // Start Current angle
-
-  if (!writeI2C(link, HTANG_I2CRequest, 2))
-    return -1;
-
-  if (!readI2C(link, HTANG_I2CReply, 2))
+  if (!I2CreadRegisters(link, I2C_DESC(HTANG_I2C_ADDR, HTANG_OFFSET + HTANG_ANG2), HTANG_I2CReply, 2))
     return -1;
 
   return HTANG_I2CReply.arr[0] * 2 + HTANG_I2CReply.arr[1];
@@ -118,16 +116,7 @@ int HTANGreadAngle(tMUXSensor muxsensor) {
  * @return current angle or -1 if an error occurred.
  */
 long HTANGreadAccumulatedAngle(tSensors link) {
-  memset(HTANG_I2CRequest, 0, sizeof(tByteArray));
-
-  HTANG_I2CRequest.arr[0] = 2;                                // Message size
-  HTANG_I2CRequest.arr[1] = HTANG_I2C_ADDR;                   // I2C Address
-  HTANG_I2CRequest.arr[2] = HTANG_OFFSET + HTANG_ACC_ANG_B4;  // Start accumulated angle
-
-  if (!writeI2C(link, HTANG_I2CRequest, 4))
-    return -1;
-
-  if (!readI2C(link, HTANG_I2CReply, 4))
+  if (!I2CreadRegisters(link, I2C_DESC(HTANG_I2C_ADDR, HTANG_OFFSET + HTANG_ACC_ANG_B4), HTANG_I2CReply, 4))
     return -1;
 
   return (HTANG_I2CReply.arr[0] << 24) +
@@ -164,16 +153,7 @@ long HTANGreadAccumulatedAngle(tMUXSensor muxsensor) {
  * @return the current rpm of the shaft or -1 if an error occurred.
  */
 int HTANGreadRPM(tSensors link) {
-  memset(HTANG_I2CRequest, 0, sizeof(tByteArray));
-
-  HTANG_I2CRequest.arr[0] = 2;                           // Message size
-  HTANG_I2CRequest.arr[1] = HTANG_I2C_ADDR;              // I2C Address
-  HTANG_I2CRequest.arr[2] = HTANG_OFFSET + HTANG_RPM_H;  // Start of rpm
-
-  if (!writeI2C(link, HTANG_I2CRequest, 2))
-    return -1;
-
-  if (!readI2C(link, HTANG_I2CReply, 2))
+  if (!I2CreadRegisters(link, I2C_DESC(HTANG_I2C_ADDR, HTANG_OFFSET + HTANG_RPM_H), HTANG_I2CReply, 2))
     return -1;
 
   return (HTANG_I2CReply.arr[0] <<  8) +
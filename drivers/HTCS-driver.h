@@ -23,6 +23,8 @@
  *        Removed SMUX data array
  * - 0.4: Use new calls in common.h that don't require SPORT/MPORT macros <br>
  *        Removed calls to ubyteToInt()
+ * - 0.5: Register reads use I2CreadRegisters() instead of building the request every time
+ * - 0.6: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * Credits:
  * - Big thanks to HiTechnic for providing me with the hardware necessary to write and test this.
@@ -32,7 +34,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 28 November 2009
- * \version 0.4
+ * \version 0.6
  * \example HTCS-test1.c
  * \example HTCS-test2.c
  * \example HTCS-SMUX-test1.c
@@ -69,8 +71,13 @@ bool HTCSreadNormRGB(tSensors link, int &red, int &green, int &blue);
 bool HTCSreadRawRGB(tSensors link, int &red, int &green, int &blue);
 bool HTCScalWhite(tSensors link);
 
-tByteArray HTCS_I2CRequest;           /*!< Array to hold I2C command data */
-tByteArray HTCS_I2CReply;             /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define HTCS_I2CRequest      I2CArenaRequest
+#define HTCS_I2CReply        I2CArenaReply
+#else
+tByteArray HTCS_I2CRequest;              /*!< Array to hold I2C command data */
+tByteArray HTCS_I2CReply;                /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
 
 /**
  * Return the color number currently detected.
@@ -78,16 +85,7 @@ tByteArray HTCS_I2CReply;             /*!< Array to hold I2C reply data */
  * @return color index number or -1 if an error occurred.
  */
 int HTCSreadColor(tSensors link) {
-  memset(HTCS_I2CRequest, 0, sizeof(tByteArray));
-
-  HTCS_I2CRequest.arr[0] = 2;                             // Message size
-  HTCS_I2CRequest.arr[1] = HTCS_I2C_ADDR;                 // I2C Address
-  HTCS_I2CRequest.arr[2] = HTCS_OFFSET + HTCS_COLNUM_REG; // Start colour number register
-
-  if (!writeI2C(link, HTCS_I2CRequest, 1))
-    return -1;
-
-  if (!readI2C(link, HTCS_I2CReply, 1))
+  if (!I2CreadRegisters(link, I2C_DESC(HTCS_I2C_ADDR, HTCS_OFFSET + HTCS_COLNUM_REG), HTCS_I2CReply, 1))
     return -1;
 
   return HTCS_I2CReply.arr[0];
@@ -123,16 +121,7 @@ int HTCSreadColor(tMUXSensor muxsensor) {
  * @return true if no error occured, false if it did
  */
 bool HTCSreadRGB(tSensors link, int &red, int &green, int &blue) {
-  memset(HTCS_I2CRequest, 0, sizeof(tByteArray));
-
-  HTCS_I2CRequest.arr[0] = 2;                           // Message size
-  HTCS_I2CRequest.arr[1] = HTCS_I2C_ADDR;               // I2C Address
-  HTCS_I2CRequest.arr[2] = HTCS_OFFSET + HTCS_RED_REG;  // Start red sensor value
-
-  if (!writeI2C(link, HTCS_I2CRequest, 3))
-    return false;
-
-  if (!readI2C(link, HTCS_I2CReply, 3))
+  if (!I2CreadRegisters(link, I2C_DESC(HTCS_I2C_ADDR, HTCS_OFFSET + HTCS_RED_REG), HTCS_I2CReply, 3))
     return false;
 
   red = HTCS_I2CReply.arr[0];
@@ -180,16 +169,7 @@ bool HTCSreadRGB(tMUXSensor muxsensor, int &red, int &green, int &blue) {
  * @return true if no error occured, false if it did
  */
 bool HTCSreadNormRGB(tSensors link, int &red, int &green, int &blue) {
-  memset(HTCS_I2CRequest, 0, sizeof(tByteArray));
-
-  HTCS_I2CRequest.arr[0] = 2;                               // Message size
-  HTCS_I2CRequest.arr[1] = HTCS_I2C_ADDR;                   // I2C Address
-  HTCS_I2CRequest.arr[2] = HTCS_OFFSET + HTSC_RED_NORM_REG; // Start red normalised sensor values
-
-  if (!writeI2C(link, HTCS_I2CRequest, 3))
-    return false;
-
-  if (!readI2C(link, HTCS_I2CReply, 3))
+  if (!I2CreadRegisters(link, I2C_DESC(HTCS_I2C_ADDR, HTCS_OFFSET + HTSC_RED_NORM_REG), HTCS_I2CReply, 3))
     return false;
 
   red = HTCS_I2CReply.arr[0];
@@ -209,16 +189,7 @@ bool HTCSreadNormRGB(tSensors link, int &red, int &green, int &blue) {
  */
 
 bool HTCSreadRawRGB(tSensors link, int &red, int &green, int &blue) {
-  memset(HTCS_I2CRequest, 0, sizeof(tByteArray));
-
-  HTCS_I2CRequest.arr[0] = 2;                               // Message size
-  HTCS_I2CRequest.arr[1] = HTCS_I2C_ADDR;                   // I2C Address
-  HTCS_I2CRequest.arr[2] = HTCS_OFFSET + HTCS_RED_RAW_REG;  // Start red raw sensor value
-
-  if (!writeI2C(link, HTCS_I2CRequest, 6))
-    return false;
-
-  if (!readI2C(link, HTCS_I2CReply, 6))
+  if (!I2CreadRegisters(link, I2C_DESC(HTCS_I2C_ADDR, HTCS_OFFSET + HTCS_RED_RAW_REG), HTCS_I2CReply, 6))
     return false;
 
   red = HTCS_I2CReply.arr[0];
@@ -237,16 +208,7 @@ bool HTCSreadRawRGB(tSensors link, int &red, int &green, int &blue) {
  * @return color index number or -1 if an error occurred.
  */
 int HTCSreadColorIndex(tSensors link) {
-  memset(HTCS_I2CRequest, 0, sizeof(tByteArray));
-
-  HTCS_I2CRequest.arr[0] = 2;                                // Message size
-  HTCS_I2CRequest.arr[1] = HTCS_I2C_ADDR;                    // I2C Address
-  HTCS_I2CRequest.arr[2] = HTCS_OFFSET + HTSC_COL_INDEX_REG; // Start colour index register
-
-  if (!writeI2C(link, HTCS_I2CRequest, 1))
-    return -1;
-
-  if (!readI2C(link, HTCS_I2CReply, 1))
+  if (!I2CreadRegisters(link, I2C_DESC(HTCS_I2C_ADDR, HTCS_OFFSET + HTSC_COL_INDEX_REG), HTCS_I2CReply, 1))
     return -1;
 
   return HTCS_I2CReply.arr[0];
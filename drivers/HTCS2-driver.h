@@ -20,6 +20,10 @@
  * - 0.1: Initial release
  * - 0.2: Use new calls in common.h that don't require SPORT/MPORT macros
  *        Removed usage of ubyteToInt();
+ * - 0.3: Active mode registers are read in one snapshot shared by all functions<br>
+ *        HTCS2readWhite() now reads the white channel instead of red
+ * - 0.4: Register reads use I2CreadRegisters() instead of building the request every time
+ * - 0.5: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * Credits:
  * - Big thanks to HiTechnic for providing me with the hardware necessary to write and test this.
@@ -29,7 +33,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 28 November 2009
- * \version 0.2
+ * \version 0.5
  * \example HTCS2-test1.c
  * \example HTCS2-test2.c
  * \example HTCS2-SMUX-test1.c
@@ -55,6 +59,7 @@
 #define HTCS2_RED_NORM_REG    0x06      /*!< Normalised red reading */
 #define HTCS2_GREEN_NORM_REG  0x07      /*!< Normalised green reading */
 #define HTCS2_BLUE_NORM_REG   0x08      /*!< Normalised blue reading */
+#define HTCS2_SNAPSHOT_SIZE   9         /*!< Number of active mode registers read in one snapshot */
 
 // Values contained by registers in passive and raw mode
 #define HTCS2_RED_MSB         0x00      /*!< Raw red reading - MSB */
@@ -84,8 +89,14 @@ bool HTCS2readRawRGB(tSensors link, bool passive, long &red, long &green, long &
 bool HTCS2readRawWhite(tSensors link, bool passive, long &white);
 bool _HTCSsendCommand(tSensors link, byte command);
 
-tByteArray HTCS2_I2CRequest;           /*!< Array to hold I2C command data */
-tByteArray HTCS2_I2CReply;             /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define HTCS2_I2CRequest     I2CArenaRequest
+#define HTCS2_I2CReply       I2CArenaReply
+#else
+tByteArray HTCS2_I2CRequest;              /*!< Array to hold I2C command data */
+tByteArray HTCS2_I2CReply;                /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
+tI2CSnapshot HTCS2_Snapshot[4];           /*!< Cached active mode registers */
 
 /*!< Array to hold sensor modes */
 byte active_mode[4] = {-1, -1, -1, -1};
@@ -97,22 +108,13 @@ byte active_mode[4] = {-1, -1, -1, -1};
  * @return color index number or -1 if an error occurred.
  */
 int HTCS2readColor(tSensors link) {
-  memset(HTCS2_I2CRequest, 0, sizeof(tByteArray));
-
   if (active_mode[link] != HTCS2_MODE_ACTIVE)
     _HTCSsendCommand(link, HTCS2_MODE_ACTIVE);
 
-  HTCS2_I2CRequest.arr[0] = 2;                                // Message size
-  HTCS2_I2CRequest.arr[1] = HTCS2_I2C_ADDR;                   // I2C Address
-  HTCS2_I2CRequest.arr[2] = HTCS2_OFFSET + HTCS2_COLNUM_REG;  // Start colour number register
-
-  if (!writeI2C(link, HTCS2_I2CRequest, 1))
+  if (!I2CreadSnapshot(link, HTCS2_Snapshot[link], HTCS2_I2C_ADDR, HTCS2_OFFSET, HTCS2_SNAPSHOT_SIZE))
     return -1;
 
-  if (!readI2C(link, HTCS2_I2CReply, 1))
-    return -1;
-
-  return HTCS2_I2CReply.arr[0];
+  return HTCS2_Snapshot[link].data.arr[HTCS2_COLNUM_REG];
 }
 
 
@@ -144,24 +146,15 @@ int HTCS2readColor(tMUXSensor muxsensor) {
  * @return true if no error occured, false if it did
  */
 bool HTCS2readRGB(tSensors link, int &red, int &green, int &blue) {
-  memset(HTCS2_I2CRequest, 0, sizeof(tByteArray));
-
   if (active_mode[link] != HTCS2_MODE_ACTIVE)
     _HTCSsendCommand(link, HTCS2_MODE_ACTIVE);
 
-  HTCS2_I2CRequest.arr[0] = 2;                           // Message size
-  HTCS2_I2CRequest.arr[1] = HTCS2_I2C_ADDR;               // I2C Address
-  HTCS2_I2CRequest.arr[2] = HTCS2_OFFSET + HTCS2_RED_REG;  // Start red sensor value
-
-  if (!writeI2C(link, HTCS2_I2CRequest, 3))
-    return false;
-
-  if (!readI2C(link, HTCS2_I2CReply, 3))
+  if (!I2CreadSnapshot(link, HTCS2_Snapshot[link], HTCS2_I2C_ADDR, HTCS2_OFFSET, HTCS2_SNAPSHOT_SIZE))
     return false;
 
-  red = HTCS2_I2CReply.arr[0];
-  green = HTCS2_I2CReply.arr[1];
-  blue = HTCS2_I2CReply.arr[2];
+  red = HTCS2_Snapshot[link].data.arr[HTCS2_RED_REG];
+  green = HTCS2_Snapshot[link].data.arr[HTCS2_RED_REG + 1];
+  blue = HTCS2_Snapshot[link].data.arr[HTCS2_RED_REG + 2];
 
   return true;
 }
@@ -200,22 +193,13 @@ bool HTCS2readRGB(tMUXSensor muxsensor, int &red, int &green, int &blue) {
  * @return true if no error occured, false if it did
  */
 bool HTCS2readWhite(tSensors link, int &white) {
-  memset(HTCS2_I2CRequest, 0, sizeof(tByteArray));
-
   if (active_mode[link] != HTCS2_MODE_ACTIVE)
     _HTCSsendCommand(link, HTCS2_MODE_ACTIVE);
 
-  HTCS2_I2CRequest.arr[0] = 2;                           // Message size
-  HTCS2_I2CRequest.arr[1] = HTCS2_I2C_ADDR;               // I2C Address
-  HTCS2_I2CRequest.arr[2] = HTCS2_OFFSET + HTCS2_RED_REG;  // Start red sensor value
-
-  if (!writeI2C(link, HTCS2_I2CRequest, 1))
+  if (!I2CreadSnapshot(link, HTCS2_Snapshot[link], HTCS2_I2C_ADDR, HTCS2_OFFSET, HTCS2_SNAPSHOT_SIZE))
     return false;
 
-  if (!readI2C(link, HTCS2_I2CReply, 1))
-    return false;
-
-  white = HTCS2_I2CReply.arr[0];
+  white = HTCS2_Snapshot[link].data.arr[HTCS2_WHITE_REG];
 
   return true;
 }
@@ -232,21 +216,12 @@ bool HTCS2readWhite(tSensors link, int &white) {
  * @return true if no error occured, false if it did
  */
 bool HTCS2readNormRGB(tSensors link, int &red, int &green, int &blue) {
-  memset(HTCS2_I2CRequest, 0, sizeof(tByteArray));
-
-  HTCS2_I2CRequest.arr[0] = 2;                               // Message size
-  HTCS2_I2CRequest.arr[1] = HTCS2_I2C_ADDR;                   // I2C Address
-  HTCS2_I2CRequest.arr[2] = HTCS2_OFFSET + HTCS2_RED_NORM_REG; // Start red normalised sensor values
-
-  if (!writeI2C(link, HTCS2_I2CRequest, 3))
+  if (!I2CreadSnapshot(link, HTCS2_Snapshot[link], HTCS2_I2C_ADDR, HTCS2_OFFSET, HTCS2_SNAPSHOT_SIZE))
     return false;
 
-  if (!readI2C(link, HTCS2_I2CReply, 3))
-    return false;
-
-  red = HTCS2_I2CReply.arr[0];
-  green = HTCS2_I2CReply.arr[1];
-  blue = HTCS2_I2CReply.arr[2];
+  red = HTCS2_Snapshot[link].data.arr[HTCS2_RED_NORM_REG];
+  green = HTCS2_Snapshot[link].data.arr[HTCS2_RED_NORM_REG + 1];
+  blue = HTCS2_Snapshot[link].data.arr[HTCS2_RED_NORM_REG + 2];
 
   return true;
 }
@@ -263,21 +238,12 @@ bool HTCS2readNormRGB(tSensors link, int &red, int &green, int &blue) {
  * @return true if no error occured, false if it did
  */
 bool HTCS2readRawRGB(tSensors link, bool passive, long &red, long &green, long &blue) {
-  memset(HTCS2_I2CRequest, 0, sizeof(tByteArray));
-
   if (passive && (active_mode[link] != HTCS2_MODE_PASSIVE))
     _HTCSsendCommand(link, HTCS2_MODE_PASSIVE);
   else if (!passive && (active_mode[link] != HTCS2_MODE_RAW))
     _HTCSsendCommand(link, HTCS2_MODE_RAW);
 
-  HTCS2_I2CRequest.arr[0] = 2;                               // Message size
-  HTCS2_I2CRequest.arr[1] = HTCS2_I2C_ADDR;                   // I2C Address
-  HTCS2_I2CRequest.arr[2] = HTCS2_OFFSET + HTCS2_RED_MSB;  // Start red raw sensor value
-
-  if (!writeI2C(link, HTCS2_I2CRequest, 8))
-    return false;
-
-  if (!readI2C(link, HTCS2_I2CReply, 8))
+  if (!I2CreadRegisters(link, I2C_DESC(HTCS2_I2C_ADDR, HTCS2_OFFSET + HTCS2_RED_MSB), HTCS2_I2CReply, 8))
     return false;
 
   red =   (long)HTCS2_I2CReply.arr[0] * 256 + HTCS2_I2CReply.arr[1];
@@ -297,21 +263,12 @@ bool HTCS2readRawRGB(tSensors link, bool passive, long &red, long &green, long &
  * @return true if no error occured, false if it did
  */
 bool HTCS2readRawWhite(tSensors link, bool passive, long &white) {
-  memset(HTCS2_I2CRequest, 0, sizeof(tByteArray));
-
   if (passive && (active_mode[link] != HTCS2_MODE_PASSIVE))
     _HTCSsendCommand(link, HTCS2_MODE_PASSIVE);
   else if (!passive && (active_mode[link] != HTCS2_MODE_RAW))
     _HTCSsendCommand(link, HTCS2_MODE_RAW);
 
-  HTCS2_I2CRequest.arr[0] = 2;                               // Message size
-  HTCS2_I2CRequest.arr[1] = HTCS2_I2C_ADDR;                   // I2C Address
-  HTCS2_I2CRequest.arr[2] = HTCS2_OFFSET + HTCS2_WHITE_MSB;  // Start red raw sensor value
-
-  if (!writeI2C(link, HTCS2_I2CRequest, 2))
-    return false;
-
-  if (!readI2C(link, HTCS2_I2CReply, 2))
+  if (!I2CreadRegisters(link, I2C_DESC(HTCS2_I2C_ADDR, HTCS2_OFFSET + HTCS2_WHITE_MSB), HTCS2_I2CReply, 2))
     return false;
 
   white = (long)HTCS2_I2CReply.arr[0] * 256 + HTCS2_I2CReply.arr[1];
@@ -329,22 +286,13 @@ bool HTCS2readRawWhite(tSensors link, bool passive, long &white) {
  * @return color index number or -1 if an error occurred.
  */
 int HTCS2readColorIndex(tSensors link) {
-  memset(HTCS2_I2CRequest, 0, sizeof(tByteArray));
-
   if (active_mode[link] != HTCS2_MODE_ACTIVE)
     _HTCSsendCommand(link, HTCS2_MODE_ACTIVE);
 
-  HTCS2_I2CRequest.arr[0] = 2;                                // Message size
-  HTCS2_I2CRequest.arr[1] = HTCS2_I2C_ADDR;                    // I2C Address
-  HTCS2_I2CRequest.arr[2] = HTCS2_OFFSET + HTCS2_COL_INDEX_REG; // Start colour index register
-
-  if (!writeI2C(link, HTCS2_I2CRequest, 1))
-    return -1;
-
-  if (!readI2C(link, HTCS2_I2CReply, 1))
+  if (!I2CreadSnapshot(link, HTCS2_Snapshot[link], HTCS2_I2C_ADDR, HTCS2_OFFSET, HTCS2_SNAPSHOT_SIZE))
     return -1;
 
-  return HTCS2_I2CReply.arr[0];
+  return HTCS2_Snapshot[link].data.arr[HTCS2_COL_INDEX_REG];
 }
 
 
@@ -369,6 +317,8 @@ bool _HTCSsendCommand(tSensors link, byte command) {
   else if (command == HTCS2_MODE_RAW)
     active_mode[link] = HTCS2_MODE_RAW;
 
+  I2CinvalidateSnapshot(HTCS2_Snapshot[link]);
+
   return writeI2C(link, HTCS2_I2CRequest, 0);
 }
 
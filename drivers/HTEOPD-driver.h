@@ -27,6 +27,7 @@
  *        Changed the underlying sensor types for RobotC 1.57A and higher.
  * - 0.5: Now only supports ROBOTC 2.00<br>
  *        Make use of the new analogue sensor calls for SMUX sensors in common.h
+ * - 0.6: Analogue sensors sharing an SMUX are read in a single transaction, see HTSMUXreadSharedAnalogue()
  *
  * Credits:
  * - Big thanks to HiTechnic for providing me with the hardware necessary to write and test this.
@@ -36,7 +37,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 29 November 2009
- * \version 0.5
+ * \version 0.6
  * \example HTEOPD-test1.c
  * \example HTEOPD-SMUX-test1.c
  */
@@ -78,7 +79,7 @@ int HTEOPDreadRaw(tSensors link) {
  * @return raw value of the sensor
  */
 int HTEOPDreadRaw(tMUXSensor muxsensor) {
-  return 1023 - HTSMUXreadAnalogue(muxsensor);
+  return 1023 - HTSMUXreadSharedAnalogue(muxsensor);
 }
 
 
@@ -23,6 +23,8 @@
  *        Renamed HTGYROcalibrate to HTGYROstartCal<br>
  *        Added SMUX functions
  * - 0.3: Removed some of the functions requiring SPORT/MPORT macros
+ * - 0.4: Offset arrays have both dimensions declared
+ * - 0.5: Analogue sensors sharing an SMUX are read in a single transaction, see HTSMUXreadSharedAnalogue()
  *
  * Credits:
  * - Big thanks to HiTechnic for providing me with the hardware necessary to write and test this.
@@ -32,7 +34,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 29 November 2009
- * \version 0.3
+ * \version 0.5
  * \example HTGYRO-test1.c
  * \example HTGYRO-SMUX-test1.c
  */
@@ -52,7 +54,7 @@ int HTGYROreadCal(tMUXSensor muxsensor);
 void HTGYROsetCal(tSensors link, int offset);
 void HTGYROsetCal(tMUXSensor muxsensor, int offset);
 
-int HTGYRO_offsets[][] = {{620, 620, 620, 620}, /*!< Array for offset values.  Default is 620 */
+int HTGYRO_offsets[][4] = {{620, 620, 620, 620}, /*!< Array for offset values.  Default is 620 */
                           {620, 620, 620, 620},
                           {620, 620, 620, 620},
                           {620, 620, 620, 620}};
@@ -79,7 +81,7 @@ int HTGYROreadRot(tSensors link) {
  * @return the value of the gyro
  */
 int HTGYROreadRot(tMUXSensor muxsensor) {
-  return HTSMUXreadAnalogue(muxsensor) - HTGYRO_offsets[SPORT(muxsensor)][MPORT(muxsensor)];
+  return HTSMUXreadSharedAnalogue(muxsensor) - HTGYRO_offsets[SPORT(muxsensor)][MPORT(muxsensor)];
 }
 
 
@@ -26,6 +26,7 @@
  *        Added PFmotor() as a wrapper for PFsinglePinOutputMode()\n
  *        eCPMMotorCommand has been replaced with more generic ePWMMotorCommand\n
  *        transmitIR() now works according to the specs\n
+ * - 1.5: Removed cast of the output buffer when encoding PF commands
  *
  * Credits:
  * - Big thanks to HiTechnic for providing me with the hardware necessary to write and test this.
@@ -35,7 +36,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 25 May 2010
- * \version 1.4
+ * \version 1.5
  * \example HTIRL-NG-test1.c
  */
 
@@ -219,7 +220,7 @@ void PFcomboDirectMode(tSensors link, int channel, eCDMMotorCommand _motorB, eCD
   _oBuffer.arr[2] = 0x42;  // Internal register
 
   // Generate the data payload
-  encodeBuffer(_iBuffer, (tByteArray)_oBuffer);                       // Encode PF command
+  encodeBuffer(_iBuffer, _oBuffer);                       // Encode PF command
 
   // Setup the tail end of the packet
   _oBuffer.arr[BUF_HEADSIZE + BUF_DATASIZE] = 11;         // Total IR command length
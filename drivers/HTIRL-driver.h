@@ -23,6 +23,7 @@
  * - 1.2: Rewrite to make use of the new common.h API
  * - 1.3: Clarified port numbering
  * - 1.4: Removed inline functions
+ * - 1.5: Removed cast of the output buffer when encoding PF commands
  *
  * Credits:
  * - Big thanks to HiTechnic for providing me with the hardware necessary to write and test this.
@@ -32,7 +33,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 25 May 2010
- * \version 1.4
+ * \version 1.5
  * \example HTIRL-test1.c
  */
 
@@ -171,7 +172,7 @@ void PFcomboDirectMode(tSensors link, int channel, eCDMMotorCommand _motorB, eCD
   _oBuffer.arr[2] = 0x42;  // Internal register
 
   // Generate the data payload
-  encodeBuffer(_iBuffer, (tByteArray)_oBuffer);                       // Encode PF command
+  encodeBuffer(_iBuffer, _oBuffer);                       // Encode PF command
 
   // Setup the tail end of the packet
   _oBuffer.arr[BUF_HEADSIZE + BUF_DATASIZE] = 11;         // Total IR command length
@@ -19,6 +19,8 @@
  * Changelog:
  * - 0.1: Initial release
  * - 0.2: Changed HTIRRreadChannel() proto to use signed bytes like function.
+ * - 0.3: Register reads use I2CreadRegisters() instead of building the request every time
+ * - 0.4: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * Credits:
  * - Big thanks to HiTechnic for providing me with the hardware necessary to write and test this.
@@ -28,7 +30,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 03 November 2009
- * \version 0.2
+ * \version 0.4
  * \example HTIRR-test1.c
  */
 
@@ -60,8 +62,11 @@
 bool HTIRRreadChannel(tSensors link, byte channel, sbyte &motA, sbyte &motB);
 bool HTIRRreadAllChannels(tSensors link, tsByteArray &motorSpeeds);
 
-tByteArray HTIRR_I2CRequest;           /*!< Array to hold I2C command data */
-tByteArray HTIRR_I2CReply;             /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define HTIRR_I2CReply       I2CArenaReply
+#else
+tByteArray HTIRR_I2CReply;                /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
 
 
 /**
@@ -73,16 +78,7 @@ tByteArray HTIRR_I2CReply;             /*!< Array to hold I2C reply data */
  * @return true if no error occured, false if it did
  */
 bool HTIRRreadChannel(tSensors link, byte channel, sbyte &motA, sbyte &motB) {
-  memset(HTIRR_I2CRequest, 0, sizeof(tByteArray));
-
-  HTIRR_I2CRequest.arr[0] = 2;                                // Message size
-  HTIRR_I2CRequest.arr[1] = HTIRR_I2C_ADDR;                   // I2C Address
-  HTIRR_I2CRequest.arr[2] = HTIRR_OFFSET + ((channel - 1) * 2); // Start of speed registry
-
-  if (!writeI2C(link, HTIRR_I2CRequest, 2))
-    return false;
-
-  if (!readI2C(link, HTIRR_I2CReply, 2))
+  if (!I2CreadRegisters(link, I2C_DESC(HTIRR_I2C_ADDR, HTIRR_OFFSET + ((channel - 1) * 2)), HTIRR_I2CReply, 2))
     return false;
 
   memcpy(motA, HTIRR_I2CReply.arr[0], 1);
@@ -101,16 +97,7 @@ bool HTIRRreadChannel(tSensors link, byte channel, sbyte &motA, sbyte &motB) {
  */
 bool HTIRRreadAllChannels(tSensors link, tsByteArray &motorSpeeds){
   memset(motorSpeeds, 0, sizeof(tsByteArray));
-  memset(HTIRR_I2CRequest, 0, sizeof(tByteArray));
-
-  HTIRR_I2CRequest.arr[0] = 2;                // Message size
-  HTIRR_I2CRequest.arr[1] = HTIRR_I2C_ADDR;   // I2C Address
-  HTIRR_I2CRequest.arr[2] = HTIRR_OFFSET;     // Start of speed registry
-
-  if (!writeI2C(link, HTIRR_I2CRequest, 8))
-    return false;
-
-  if (!readI2C(link, HTIRR_I2CReply, 8))
+  if (!I2CreadRegisters(link, I2C_DESC(HTIRR_I2C_ADDR, HTIRR_OFFSET), HTIRR_I2CReply, 8))
     return false;
 
   memcpy(motorSpeeds, HTIRR_I2CReply, 8);
@@ -29,6 +29,8 @@
  * - 0.7: HTIRSreadAllStrength() is now pass by reference to reduce memory<br>
  *        SMUX tByteArray removed, reuses HTIRS_I2CReply
  * - 0.8: Use new calls in common.h that don't require SPORT/MPORT macros
+ * - 0.9: Register reads use I2CreadRegisters() instead of building the request every time
+ * - 0.10: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * Credits:
  * - Big thanks to HiTechnic for providing me with the hardware necessary to write and test this.
@@ -39,7 +41,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 25 November 2009
- * \version 0.8
+ * \version 0.10
  * \example HTIRS-test1.c
  * \example HTIRS-SMUX-test1.c
  */
@@ -66,8 +68,11 @@ int HTIRSreadStrength(tMUXSensor muxsensor, byte sensorNr);
 bool HTIRSreadAllStrength(tSensors link, int &dcS1, int &dcS2, int &dcS3, int &dcS4, int &dcS5);
 bool HTIRSreadAllStrength(tMUXSensor muxsensor, int &dcS1, int &dcS2, int &dcS3, int &dcS4, int &dcS5);
 
-tByteArray HTIRS_I2CRequest;    /*!< Array to hold I2C command data */
-tByteArray HTIRS_I2CReply;      /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define HTIRS_I2CReply       I2CArenaReply
+#else
+tByteArray HTIRS_I2CReply;         /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
 
 /**
  * Read the value of the Direction data register and return it.
@@ -75,16 +80,7 @@ tByteArray HTIRS_I2CReply;      /*!< Array to hold I2C reply data */
  * @return value of 0-9, the direction index of the detected IR signal or -1 if an error occurred.
  */
 int HTIRSreadDir(tSensors link) {
-  memset(HTIRS_I2CRequest, 0, sizeof(tByteArray));
-
-  HTIRS_I2CRequest.arr[0] = 2;                        // Message size
-  HTIRS_I2CRequest.arr[1] = HTIRS_I2C_ADDR;           // I2C Address
-  HTIRS_I2CRequest.arr[2] = HTIRS_OFFSET + HTIRS_DIR; // Start direction register
-
-  if (!writeI2C(link, HTIRS_I2CRequest, 1))
-    return -1;
-
-  if (!readI2C(link, HTIRS_I2CReply, 1))
+  if (!I2CreadRegisters(link, I2C_DESC(HTIRS_I2C_ADDR, HTIRS_OFFSET + HTIRS_DIR), HTIRS_I2CReply, 1))
     return -1;
 
   return ubyteToInt(HTIRS_I2CReply.arr[0]);
@@ -116,16 +112,7 @@ int HTIRSreadDir(tMUXSensor muxsensor) {
  * @return the signal strength value of the specified sensor or -1 if an error occurred.
  */
 int HTIRSreadStrength(tSensors link, byte sensorNr) {
-  memset(HTIRS_I2CRequest, 0, sizeof(tByteArray));
-
-  HTIRS_I2CRequest.arr[0] = 2;                                     // Message size
-  HTIRS_I2CRequest.arr[1] = HTIRS_I2C_ADDR;                        // I2C Address
-  HTIRS_I2CRequest.arr[2] = HTIRS_OFFSET + HTIRS_SSTR1 + sensorNr; // Address of Sensor <sensorNr> signal strength
-
-  if (!writeI2C(link, HTIRS_I2CRequest, 1))
-    return -1;
-
-  if (!readI2C(link, HTIRS_I2CReply, 1))
+  if (!I2CreadRegisters(link, I2C_DESC(HTIRS_I2C_ADDR, HTIRS_OFFSET + HTIRS_SSTR1 + sensorNr), HTIRS_I2CReply, 1))
     return -1;
 
   return ubyteToInt(HTIRS_I2CReply.arr[0]);
@@ -162,16 +149,7 @@ int HTIRSreadStrength(tMUXSensor muxsensor, byte sensorNr) {
  * @return true if no error occured, false if it did
  */
 bool HTIRSreadAllStrength(tSensors link, int &dcS1, int &dcS2, int &dcS3, int &dcS4, int &dcS5) {
-  memset(HTIRS_I2CRequest, 0, sizeof(tByteArray));
-
-  HTIRS_I2CRequest.arr[0] = 2;                          // Message size
-  HTIRS_I2CRequest.arr[1] = HTIRS_I2C_ADDR;             // I2C Address
-  HTIRS_I2CRequest.arr[2] = HTIRS_OFFSET + HTIRS_SSTR1; // Address of Sensor 0 signal strength
-
-  if (!writeI2C(link, HTIRS_I2CRequest, 5))
-    return false;
-
-  if (!readI2C(link, HTIRS_I2CReply, 5))
+  if (!I2CreadRegisters(link, I2C_DESC(HTIRS_I2C_ADDR, HTIRS_OFFSET + HTIRS_SSTR1), HTIRS_I2CReply, 5))
     return false;
 
   dcS1 = ubyteToInt(HTIRS_I2CReply.arr[0]);
@@ -24,6 +24,9 @@
  * - 0.4: Removed all calls to ubyteToInt()<br>
  *        Replaced all functions that used SPORT/MPORT macros
  * - 0.5: Driver renamed to HTIRS2
+ * - 0.6: All DC and AC registers are read in one snapshot shared by all functions
+ * - 0.7: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
+ * - 0.8: Added HTIRS2setSMUXWindow() so the SMUX only copies the DC and AC data registers
  *
  * Credits:
  * - Big thanks to HiTechnic for providing me with the hardware necessary to write and test this.
@@ -33,7 +36,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 06 April 2010
- * \version 0.5
+ * \version 0.8
  * \example HTIRS2-test1.c
  * \example HTIRS2-SMUX-test1.c
  */
@@ -60,6 +63,7 @@
 #define HTIRS2_AC_SSTR3    0x0A      /*!< DC Sensor 2 signal strength above average */
 #define HTIRS2_AC_SSTR4    0x0B      /*!< DC Sensor 3 signal strength above average */
 #define HTIRS2_AC_SSTR5    0x0C      /*!< DC Sensor 4 signal strength above average */
+#define HTIRS2_SNAPSHOT_SIZE 13      /*!< Number of data registers read in one snapshot */
 
 
 /*!< AC DSP modes */
@@ -85,9 +89,16 @@ int HTIRS2readACStrength(tSensors link, byte sensorNr);
 int HTIRS2readACStrength(tMUXSensor muxsensor, byte sensorNr);
 bool HTIRS2readAllACStrength(tSensors link, int &acS1, int &acS2, int &acS3, int &acS4, int &acS5);
 bool HTIRS2readAllACStrength(tMUXSensor muxsensor, int &acS1, int &acS2, int &acS3, int &acS4, int &acS5);
+bool HTIRS2setSMUXWindow(tMUXSensor muxsensor);
 
-tByteArray HTIRS2_I2CRequest;    /*!< Array to hold I2C command data */
-tByteArray HTIRS2_I2CReply;      /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define HTIRS2_I2CRequest    I2CArenaRequest
+#define HTIRS2_I2CReply      I2CArenaReply
+#else
+tByteArray HTIRS2_I2CRequest;       /*!< Array to hold I2C command data */
+tByteArray HTIRS2_I2CReply;         /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
+tI2CSnapshot HTIRS2_Snapshot[4];    /*!< Cached data registers */
 
 // ---------------------------- DC Signal processing -----------------------------
 
@@ -97,19 +108,10 @@ tByteArray HTIRS2_I2CReply;      /*!< Array to hold I2C reply data */
  * @return value of 0-9, the direction index of the detected IR signal or -1 if an error occurred.
  */
 int HTIRS2readDCDir(tSensors link) {
-  memset(HTIRS2_I2CRequest, 0, sizeof(tByteArray));
-
-  HTIRS2_I2CRequest.arr[0] = 2;              // Message size
-  HTIRS2_I2CRequest.arr[1] = HTIRS2_I2C_ADDR; // I2C Address
-  HTIRS2_I2CRequest.arr[2] = HTIRS2_OFFSET + HTIRS2_DC_DIR;  // Start direction register
-
-  if (!writeI2C(link, HTIRS2_I2CRequest, 1))
+  if (!I2CreadSnapshot(link, HTIRS2_Snapshot[link], HTIRS2_I2C_ADDR, HTIRS2_OFFSET, HTIRS2_SNAPSHOT_SIZE))
     return -1;
 
-  if (!readI2C(link, HTIRS2_I2CReply, 1))
-    return -1;
-
-  return HTIRS2_I2CReply.arr[0];
+  return HTIRS2_Snapshot[link].data.arr[HTIRS2_DC_DIR];
 }
 
 
@@ -139,19 +141,10 @@ int HTIRS2readDCDir(tMUXSensor muxsensor) {
  * @return the signal strength value of the specified sensor or -1 if an error occurred.
  */
 int HTIRS2readDCStrength(tSensors link, byte sensorNr) {
-  memset(HTIRS2_I2CRequest, 0, sizeof(tByteArray));
-
-  HTIRS2_I2CRequest.arr[0] = 2;                      // Message size
-  HTIRS2_I2CRequest.arr[1] = HTIRS2_I2C_ADDR;         // I2C Address
-  HTIRS2_I2CRequest.arr[2] = HTIRS2_OFFSET + HTIRS2_DC_SSTR1 + sensorNr; // Address of Sensor <sensorNr> signal strength
-
-  if (!writeI2C(link, HTIRS2_I2CRequest, 1))
-    return -1;
-
-  if (!readI2C(link, HTIRS2_I2CReply, 1))
+  if (!I2CreadSnapshot(link, HTIRS2_Snapshot[link], HTIRS2_I2C_ADDR, HTIRS2_OFFSET, HTIRS2_SNAPSHOT_SIZE))
     return -1;
 
-  return HTIRS2_I2CReply.arr[0];
+  return HTIRS2_Snapshot[link].data.arr[HTIRS2_DC_SSTR1 + sensorNr];
 }
 
 
@@ -186,23 +179,14 @@ int HTIRS2readDCStrength(tMUXSensor muxsensor, byte sensorNr) {
  * @return true if no error occured, false if it did
  */
 bool HTIRS2readAllDCStrength(tSensors link, int &dcS1, int &dcS2, int &dcS3, int &dcS4, int &dcS5) {
-  memset(HTIRS2_I2CRequest, 0, sizeof(tByteArray));
-
-  HTIRS2_I2CRequest.arr[0] = 2;                      // Message size
-  HTIRS2_I2CRequest.arr[1] = HTIRS2_I2C_ADDR;         // I2C Address
-  HTIRS2_I2CRequest.arr[2] = HTIRS2_OFFSET + HTIRS2_DC_SSTR1;         // Sensor 0 signal strength
-
-  if (!writeI2C(link, HTIRS2_I2CRequest, 5))
+  if (!I2CreadSnapshot(link, HTIRS2_Snapshot[link], HTIRS2_I2C_ADDR, HTIRS2_OFFSET, HTIRS2_SNAPSHOT_SIZE))
     return false;
 
-  if (!readI2C(link, HTIRS2_I2CReply, 5))
-    return false;
-
-  dcS1 = HTIRS2_I2CReply.arr[0];
-  dcS2 = HTIRS2_I2CReply.arr[1];
-  dcS3 = HTIRS2_I2CReply.arr[2];
-  dcS4 = HTIRS2_I2CReply.arr[3];
-  dcS5 = HTIRS2_I2CReply.arr[4];
+  dcS1 = HTIRS2_Snapshot[link].data.arr[HTIRS2_DC_SSTR1];
+  dcS2 = HTIRS2_Snapshot[link].data.arr[HTIRS2_DC_SSTR1 + 1];
+  dcS3 = HTIRS2_Snapshot[link].data.arr[HTIRS2_DC_SSTR1 + 2];
+  dcS4 = HTIRS2_Snapshot[link].data.arr[HTIRS2_DC_SSTR1 + 3];
+  dcS5 = HTIRS2_Snapshot[link].data.arr[HTIRS2_DC_SSTR1 + 4];
 
   return true;
 }
@@ -244,19 +228,10 @@ bool HTIRS2readAllDCStrength(tMUXSensor muxsensor, int &dcS1, int &dcS2, int &dc
  * @return value of 0-9, the direction index of the detected IR signal or -1 if an error occurred.
  */
 int HTIRS2readDCAverage(tSensors link) {
-  memset(HTIRS2_I2CRequest, 0, sizeof(tByteArray));
-
-  HTIRS2_I2CRequest.arr[0] = 2;              // Message size
-  HTIRS2_I2CRequest.arr[1] = HTIRS2_I2C_ADDR; // I2C Address
-  HTIRS2_I2CRequest.arr[2] = HTIRS2_OFFSET + HTIRS2_DC_SAVG;  // DC sensor signal strength average
-
-  if (!writeI2C(link, HTIRS2_I2CRequest, 1))
-    return -1;
-
-  if (!readI2C(link, HTIRS2_I2CReply, 1))
+  if (!I2CreadSnapshot(link, HTIRS2_Snapshot[link], HTIRS2_I2C_ADDR, HTIRS2_OFFSET, HTIRS2_SNAPSHOT_SIZE))
     return -1;
 
-  return HTIRS2_I2CReply.arr[0];
+  return HTIRS2_Snapshot[link].data.arr[HTIRS2_DC_SAVG];
 }
 
 
@@ -299,6 +274,8 @@ bool HTIRS2setDSPMode(tSensors link, tHTIRS2DSPMode mode) {
   HTIRS2_I2CRequest.arr[2] = HTIRS2_DSP_MODE; // Start direction register
   HTIRS2_I2CRequest.arr[3] = mode;
 
+  I2CinvalidateSnapshot(HTIRS2_Snapshot[link]);
+
   return writeI2C(link, HTIRS2_I2CRequest, 0);
 }
 
@@ -308,19 +285,10 @@ bool HTIRS2setDSPMode(tSensors link, tHTIRS2DSPMode mode) {
  * @return value of 0-9, the direction index of the detected IR signal or -1 if an error occurred.
  */
 int HTIRS2readACDir(tSensors link) {
-  memset(HTIRS2_I2CRequest, 0, sizeof(tByteArray));
-
-  HTIRS2_I2CRequest.arr[0] = 2;              // Message size
-  HTIRS2_I2CRequest.arr[1] = HTIRS2_I2C_ADDR; // I2C Address
-  HTIRS2_I2CRequest.arr[2] = HTIRS2_OFFSET + HTIRS2_AC_DIR;      // Start direction register
-
-  if (!writeI2C(link, HTIRS2_I2CRequest, 1))
-    return -1;
-
-  if (!readI2C(link, HTIRS2_I2CReply, 1))
+  if (!I2CreadSnapshot(link, HTIRS2_Snapshot[link], HTIRS2_I2C_ADDR, HTIRS2_OFFSET, HTIRS2_SNAPSHOT_SIZE))
     return -1;
 
-  return HTIRS2_I2CReply.arr[0];
+  return HTIRS2_Snapshot[link].data.arr[HTIRS2_AC_DIR];
 }
 
 
@@ -350,19 +318,10 @@ int HTIRS2readACDir(tMUXSensor muxsensor) {
  * @return the signal strength value of the specified sensor or -1 if an error occurred.
  */
 int HTIRS2readACStrength(tSensors link, byte sensorNr) {
-  memset(HTIRS2_I2CRequest, 0, sizeof(tByteArray));
-
-  HTIRS2_I2CRequest.arr[0] = 2;                      // Message size
-  HTIRS2_I2CRequest.arr[1] = HTIRS2_I2C_ADDR;         // I2C Address
-  HTIRS2_I2CRequest.arr[2] = HTIRS2_OFFSET + HTIRS2_AC_SSTR1 + sensorNr; // Address of Sensor <sensorNr> signal strength
-
-  if (!writeI2C(link, HTIRS2_I2CRequest, 1))
-    return -1;
-
-  if (!readI2C(link, HTIRS2_I2CReply, 1))
+  if (!I2CreadSnapshot(link, HTIRS2_Snapshot[link], HTIRS2_I2C_ADDR, HTIRS2_OFFSET, HTIRS2_SNAPSHOT_SIZE))
     return -1;
 
-  return HTIRS2_I2CReply.arr[0];
+  return HTIRS2_Snapshot[link].data.arr[HTIRS2_AC_SSTR1 + sensorNr];
 }
 
 
@@ -397,23 +356,14 @@ int HTIRS2readACStrength(tMUXSensor muxsensor, byte sensorNr) {
  * @return true if no error occured, false if it did
  */
 bool HTIRS2readAllACStrength(tSensors link, int &acS1, int &acS2, int &acS3, int &acS4, int &acS5) {
-  memset(HTIRS2_I2CRequest, 0, sizeof(tByteArray));
-
-  HTIRS2_I2CRequest.arr[0] = 2;                      // Message size
-  HTIRS2_I2CRequest.arr[1] = HTIRS2_I2C_ADDR;         // I2C Address
-  HTIRS2_I2CRequest.arr[2] = HTIRS2_OFFSET + HTIRS2_AC_SSTR1;         // Sensor 0 signal strength
-
-  if (!writeI2C(link, HTIRS2_I2CRequest, 5))
-    return false;
-
-  if (!readI2C(link, HTIRS2_I2CReply, 5))
+  if (!I2CreadSnapshot(link, HTIRS2_Snapshot[link], HTIRS2_I2C_ADDR, HTIRS2_OFFSET, HTIRS2_SNAPSHOT_SIZE))
     return false;
 
-  acS1 = HTIRS2_I2CReply.arr[0];
-  acS2 = HTIRS2_I2CReply.arr[1];
-  acS3 = HTIRS2_I2CReply.arr[2];
-  acS4 = HTIRS2_I2CReply.arr[3];
-  acS5 = HTIRS2_I2CReply.arr[4];
+  acS1 = HTIRS2_Snapshot[link].data.arr[HTIRS2_AC_SSTR1];
+  acS2 = HTIRS2_Snapshot[link].data.arr[HTIRS2_AC_SSTR1 + 1];
+  acS3 = HTIRS2_Snapshot[link].data.arr[HTIRS2_AC_SSTR1 + 2];
+  acS4 = HTIRS2_Snapshot[link].data.arr[HTIRS2_AC_SSTR1 + 3];
+  acS5 = HTIRS2_Snapshot[link].data.arr[HTIRS2_AC_SSTR1 + 4];
 
   return true;
 }
@@ -448,6 +398,20 @@ bool HTIRS2readAllACStrength(tMUXSensor muxsensor, int &acS1, int &acS2, int &ac
   return true;
 }
 
+
+/**
+ * Have the SMUX copy only the DC and AC data registers from the sensor, which
+ * lets it refresh all its channels more often, see HTSMUXsetWindow().
+ * @param muxsensor the SMUX sensor port number
+ * @return true if no error occured, false if it did
+ */
+bool HTIRS2setSMUXWindow(tMUXSensor muxsensor) {
+  if (HTSMUXreadSensorType(muxsensor) != HTSMUXIRSeekerNew)
+    return false;
+
+  return HTSMUXsetWindow(muxsensor, HTIRS2_I2C_ADDR, HTIRS2_OFFSET, HTIRS2_SNAPSHOT_SIZE);
+}
+
 #endif // __HTIRS2_H__
 
 /*
@@ -18,6 +18,8 @@
  *
  * Changelog:
  * - 0.1: Initial release
+ * - 0.2: Bias arrays have both dimensions declared
+ * - 0.3: Analogue sensors sharing an SMUX are read in a single transaction, see HTSMUXreadSharedAnalogue()
  *
  * Credits:
  * - Big thanks to HiTechnic for providing me with the hardware necessary to write and test this.
@@ -27,7 +29,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 27 July 2010
- * \version 0.1
+ * \version 0.3
  * \example HTMAG-test1.c
  * \example HTMAG-SMUX-test1.c
  */
@@ -49,7 +51,7 @@ int HTMAGreadCal(tMUXSensor muxsensor);
 void HTMAGsetCal(tSensors link, int bias);
 void HTMAGsetCal(tMUXSensor muxsensor, int bias);
 
-int HTMAG_bias[][] = {{512, 512, 512, 512}, /*!< Array for bias values.  Default is 512 */
+int HTMAG_bias[][4] = {{512, 512, 512, 512}, /*!< Array for bias values.  Default is 512 */
                           {512, 512, 512, 512},
                           {512, 512, 512, 512},
                           {512, 512, 512, 512}};
@@ -76,7 +78,7 @@ int HTMAGreadVal(tSensors link) {
  * @return the value of the Magnetic Field Sensor (-200 to +200)
  */
 int HTMAGreadVal(tMUXSensor muxsensor) {
-  return HTSMUXreadAnalogue(muxsensor) - HTMAG_bias[SPORT(muxsensor)][MPORT(muxsensor)];
+  return HTSMUXreadSharedAnalogue(muxsensor) - HTMAG_bias[SPORT(muxsensor)][MPORT(muxsensor)];
 }
 
 
@@ -102,7 +104,7 @@ int HTMAGreadRaw(tSensors link) {
  * @return the value of the Magnetic Field Sensor (approx 300 to 700)
  */
 int HTMAGreadRaw(tMUXSensor muxsensor) {
-  return HTSMUXreadAnalogue(muxsensor);
+  return HTSMUXreadSharedAnalogue(muxsensor);
 }
 
 
@@ -21,13 +21,17 @@
  * - 0.4: Replaced hex values in calibration functions with #define's
  * - 0.5: Replaced functions requiring SPORT/MPORT macros
  * - 0.6: simplified relative heading calculations - Thanks Gus!
+ * - 0.7: Heading is read through a snapshot so repeated reads share one transaction
+ * - 0.8: Target array has both dimensions declared
+ * - 0.9: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
+ * - 0.10: Added HTMCsetSMUXWindow() so the SMUX only copies the heading registers
  *
  * License: You may use this code as you wish, provided you give credit where its due.
  *
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 27 February 2010
- * \version 0.6
+ * \version 0.10
  * \example HTMC-test1.c
  * \example HTMC-test2.c
  * \example HTMC-SMUX-test1.c
@@ -53,6 +57,7 @@ bool HTMCstartCal(tSensors link);
 bool HTMCstopCal(tSensors link);
 int HTMCreadHeading(tSensors link);
 int HTMCreadHeading(tMUXSensor muxsensor);
+bool HTMCsetSMUXWindow(tMUXSensor muxsensor);
 int HTMCreadRelativeHeading(tSensors link);
 int HTMCreadRelativeHeading(tMUXSensor muxsensor);
 int HTMCsetTarget(tSensors link);
@@ -60,10 +65,16 @@ int HTMCsetTarget(tMUXSensor muxsensor);
 int HTMCsetTarget(tSensors link, int offset);
 int HTMCsetTarget(tMUXSensor muxsensor, int offset);
 
-tByteArray HTMC_I2CRequest;       /*!< Array to hold I2C command data */
-tByteArray HTMC_I2CReply;         /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define HTMC_I2CRequest      I2CArenaRequest
+#define HTMC_I2CReply        I2CArenaReply
+#else
+tByteArray HTMC_I2CRequest;          /*!< Array to hold I2C command data */
+tByteArray HTMC_I2CReply;            /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
+tI2CSnapshot HTMC_Snapshot[4];       /*!< Cached heading registers */
 
-int target[][] = {{0, 0, 0, 0},   /*!< Offsets for the compass sensor relative readings */
+int target[][4] = {{0, 0, 0, 0},   /*!< Offsets for the compass sensor relative readings */
                   {0, 0, 0, 0},
                   {0, 0, 0, 0},
                   {0, 0, 0, 0}};
@@ -86,6 +97,8 @@ bool HTMCstartCal(tSensors link) {
   HTMC_I2CRequest.arr[2] = HTMC_MODE;           // Set write address to sensor mode register
   HTMC_I2CRequest.arr[3] = HTMC_CALIBRATE_CMD;  // The calibration mode command
 
+  I2CinvalidateSnapshot(HTMC_Snapshot[link]);
+
   // Start the calibration
   return writeI2C(link, HTMC_I2CRequest, 0);
 }
@@ -105,6 +118,8 @@ bool HTMCstopCal(tSensors link) {
   HTMC_I2CRequest.arr[2] = HTMC_MODE;         // Set write address to sensor mode register
   HTMC_I2CRequest.arr[3] = HTMC_MEASURE_CMD;  // The measurement mode command
 
+  I2CinvalidateSnapshot(HTMC_Snapshot[link]);
+
   // Stop the calibration by setting the mode register back to measurement.
   if (!writeI2C(link, HTMC_I2CRequest, 1))
     return false;
@@ -127,20 +142,11 @@ bool HTMCstopCal(tSensors link) {
  * @return heading in degrees (0 - 359) or -1 if an error occurred.
  */
 int HTMCreadHeading(tSensors link) {
-  memset(HTMC_I2CRequest, 0, sizeof(tByteArray));
-
-  HTMC_I2CRequest.arr[0] = 2;               // Number of bytes in I2C command
-  HTMC_I2CRequest.arr[1] = HTMC_I2C_ADDR;   // I2C address of compass sensor
-  HTMC_I2CRequest.arr[2] = HTMC_HEAD_U;     // Set write address to sensor mode register
-
-  if (!writeI2C(link, HTMC_I2CRequest, 2))
-    return -1;
-
-  if (!readI2C(link, HTMC_I2CReply, 2))
+  if (!I2CreadSnapshot(link, HTMC_Snapshot[link], HTMC_I2C_ADDR, HTMC_HEAD_U, 2))
     return -1;
 
   // Result is made up of two bytes.  Reassemble for final heading.
-  return HTMC_I2CReply.arr[0] * 2 + HTMC_I2CReply.arr[1];
+  return HTMC_Snapshot[link].data.arr[0] * 2 + HTMC_Snapshot[link].data.arr[1];
 }
 
 
@@ -164,6 +170,20 @@ int HTMCreadHeading(tMUXSensor muxsensor) {
 }
 
 
+/**
+ * Have the SMUX copy only the 2 heading registers from the sensor, which lets
+ * it refresh all its channels more often, see HTSMUXsetWindow().
+ * @param muxsensor the SMUX sensor port number
+ * @return true if no error occured, false if it did
+ */
+bool HTMCsetSMUXWindow(tMUXSensor muxsensor) {
+  if (HTSMUXreadSensorType(muxsensor) != HTSMUXCompass)
+    return false;
+
+  return HTSMUXsetWindow(muxsensor, HTMC_I2C_ADDR, HTMC_HEAD_U, 2);
+}
+
+
 /**
  * Return the current relative heading, value between -179 and 180
  * @param link the HTMC port number
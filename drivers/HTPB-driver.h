@@ -32,13 +32,15 @@
  *        Removed HTPB_SMUXData, reuses HTPB_I2CReply to reduce memory overhead.
  * - 0.8: Changed type of masks from signed byte to unsigned byte to prevent truncation in ROBOTC 1.9x
  * - 0.9: Replaced functions requiring SPORT/MPORT macros
+ * - 0.10: Register reads use I2CreadRegisters() instead of building the request every time
+ * - 0.11: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * License: You may use this code as you wish, provided you give credit where its due.
  *
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 24 September 2009
- * \version 0.9
+ * \version 0.11
  * \example HTPB-test1.c
  * \example HTPB-test2.c
  * \example HTPB-test3.c
@@ -70,8 +72,13 @@
 #define HTPB_DIGCTRL  0x0C      /*!< Controls direction of digital ports */
 #define HTPB_SRATE    0x0D      /*!< Controls sample rate, default set to 10ms */
 
-tByteArray HTPB_I2CRequest;    /*!< Array to hold I2C command data */
-tByteArray HTPB_I2CReply;      /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define HTPB_I2CRequest      I2CArenaRequest
+#define HTPB_I2CReply        I2CArenaReply
+#else
+tByteArray HTPB_I2CRequest;       /*!< Array to hold I2C command data */
+tByteArray HTPB_I2CReply;         /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
 
 byte HTPBreadIO(tSensors link, ubyte mask);
 byte HTPBreadIO(tMUXSensor muxsensor, ubyte mask);
@@ -90,15 +97,7 @@ bool HTPBsetSamplingTime(tSensors link, byte interval);
  * @param mask the specified digital ports
  */
 byte HTPBreadIO(tSensors link, ubyte mask) {
-  memset(HTPB_I2CRequest, 0, sizeof(tByteArray));
-
-  HTPB_I2CRequest.arr[0] = 2;                         // Message size
-  HTPB_I2CRequest.arr[1] = HTPB_I2C_ADDR;             // I2C Address
-  HTPB_I2CRequest.arr[2] = HTPB_OFFSET + HTPB_DIGIN;  // Start digital output read address
-
-  writeI2C(link, HTPB_I2CRequest, 1);
-
-  readI2C(link, HTPB_I2CReply, 1);
+  I2CreadRegisters(link, I2C_DESC(HTPB_I2C_ADDR, HTPB_OFFSET + HTPB_DIGIN), HTPB_I2CReply, 1);
 
   return HTPB_I2CReply.arr[0] & mask;
 }
@@ -167,17 +166,10 @@ bool HTPBsetupIO(tSensors link, ubyte mask) {
  * @return the value of the ADC channel, or -1 if an error occurred
  */
 int HTPBreadADC(tSensors link, byte channel, byte width) {
-  memset(HTPB_I2CRequest, 0, sizeof(tByteArray));
-
   int _adcVal = 0;
-  HTPB_I2CRequest.arr[0] = 2;                                       // Message size
-  HTPB_I2CRequest.arr[1] = HTPB_I2C_ADDR;                           // I2C Address
-  HTPB_I2CRequest.arr[2] = HTPB_OFFSET + HTPB_A0_U + (channel * 2); // Start digital output read address
-                                                                    // with channel offset
-  if (!writeI2C(link, HTPB_I2CRequest, 2))
-    return -1;
 
-  if (!readI2C(link, HTPB_I2CReply, 2))
+  // Start ADC read address with channel offset
+  if (!I2CreadRegisters(link, I2C_DESC(HTPB_I2C_ADDR, HTPB_OFFSET + HTPB_A0_U + (channel * 2)), HTPB_I2CReply, 2))
     return -1;
 
   // Convert the bytes into and int
@@ -237,16 +229,7 @@ int HTPBreadADC(tMUXSensor muxsensor, byte channel, byte width) {
  * @return true if no error occured, false if it did
  */
 bool HTPBreadAllADC(tSensors link, int &adch0, int &adch1, int &adch2, int &adch3, int &adch4, byte width) {
-  memset(HTPB_I2CRequest, 0, sizeof(tByteArray));
-
-  HTPB_I2CRequest.arr[0] = 2;                       // Message size
-  HTPB_I2CRequest.arr[1] = HTPB_I2C_ADDR;           // I2C Address
-  HTPB_I2CRequest.arr[2] = HTPB_OFFSET + HTPB_A0_U; // Start digital output read address
-
-  if (!writeI2C(link, HTPB_I2CRequest, 10))
-    return false;
-
-  if(!readI2C(link, HTPB_I2CReply, 10))
+  if (!I2CreadRegisters(link, I2C_DESC(HTPB_I2C_ADDR, HTPB_OFFSET + HTPB_A0_U), HTPB_I2CReply, 10))
     return false;
 
   // Convert the bytes into and int
@@ -20,6 +20,7 @@
  * Changelog:
  * - 1.0: Initial release
  * - 1.1: HTRCXreadResp now clears entire IR read buffer after read
+ * - 1.2: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * Credits:
  * - Big thanks to HiTechnic for providing me with the hardware necessary to write and test this.
@@ -29,7 +30,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 31 October 2010
- * \version 1.1
+ * \version 1.2
  * \example HTRCX-test1.c
  */
 
@@ -39,8 +40,13 @@
 #include "common.h"
 #endif
 
-tByteArray HTRCXI2CRequest;
-tByteArray HTRCXI2CReply;
+#ifdef __COMMON_H_I2C_ARENA__
+#define HTRCXI2CRequest      I2CArenaRequest
+#define HTRCXI2CReply        I2CArenaReply
+#else
+tByteArray HTRCXI2CRequest;   
+tByteArray HTRCXI2CReply;   
+#endif // __COMMON_H_I2C_ARENA__
 tByteArray HTRCXIRMsg;
 
 byte HTRCXCmdToggle = 0;
@@ -19,6 +19,8 @@
  *
  * Changelog:
  * - 0.1: Initial release
+ * - 0.2: Register reads use I2CreadRegisters() instead of building the request every time
+ * - 0.3: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * Credits :
  * - David Cosimano for sending me one of these.
@@ -29,7 +31,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor@gmail.com)
  * \date 22 August 2010
- * \version 0.1
+ * \version 0.3
  * \example LEGOEM-test1.c
  */
 
@@ -54,8 +56,11 @@ bool LEGOEMreadData(tSensors link, float &voltageIn, float &currentIn, float &vo
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // global variables
-tByteArray       LEGOEM_I2CRequest;    /*!< Array to hold I2C command data */
-tByteArray       LEGOEM_I2CReply;      /*!< Array to hold I2C reply data   */
+#ifdef __COMMON_H_I2C_ARENA__
+#define LEGOEM_I2CReply      I2CArenaReply
+#else
+tByteArray       LEGOEM_I2CReply;         /*!< Array to hold I2C reply data   */
+#endif // __COMMON_H_I2C_ARENA__
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -75,16 +80,7 @@ tByteArray       LEGOEM_I2CReply;      /*!< Array to hold I2C reply data   */
  * @return true if no error occured, false if it did
  */
 bool LEGOEMreadData(tSensors link, float &voltageIn, float &currentIn, float &voltageOut, float &currentOut, int &joule, float &wattIn, float &wattOut) {
-  memset(LEGOEM_I2CRequest, 0, sizeof(tByteArray));
-
-  LEGOEM_I2CRequest.arr[0] = 2;                // Message size
-  LEGOEM_I2CRequest.arr[1] = LEGOEM_I2C_ADDR;  // I2C Address
-  LEGOEM_I2CRequest.arr[2] = LEGOEM_I2C_REG;   // Value address
-
-  if (!writeI2C(link, LEGOEM_I2CRequest, LEGOEM_I2C_SIZE))
-    return false;
-
-  if (!readI2C(link, LEGOEM_I2CReply, LEGOEM_I2C_SIZE))
+  if (!I2CreadRegisters(link, I2C_DESC(LEGOEM_I2C_ADDR, LEGOEM_I2C_REG), LEGOEM_I2CReply, LEGOEM_I2C_SIZE))
     return false;
 
   voltageIn  = (float)(LEGOEM_I2CReply.arr[0]  + (LEGOEM_I2CReply.arr[1]  << 8)) / 1000;
@@ -19,13 +19,14 @@
  * Changelog:
  * - 0.1: Initial release
  * - 0.2: Make use of new calls for analogue SMUX sensors in common.h
+ * - 0.3: Analogue sensors sharing an SMUX are read in a single transaction, see HTSMUXreadSharedAnalogue()
  *
  * License: You may use this code as you wish, provided you give credit where its due.
  *
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 25 November 2009
- * \version 0.2
+ * \version 0.3
  * \example LEGOLS-test1.c
  * \example LEGOLS-test2.c
  * \example LEGOLS-SMUX-test1.c
@@ -86,7 +87,7 @@ int LSvalRaw(tSensors link) {
  * @return the raw value of the Light Sensor
  */
 int LSvalRaw(tMUXSensor muxsensor) {
-  return 1023 - HTSMUXreadAnalogue(muxsensor);
+  return 1023 - HTSMUXreadSharedAnalogue(muxsensor);
 }
 
 
@@ -17,13 +17,14 @@
  * Changelog:
  * - 0.1: Initial release
  * - 0.2: Make use of new calls for analogue SMUX sensors in common.h
+ * - 0.3: Analogue sensors sharing an SMUX are read in a single transaction, see HTSMUXreadSharedAnalogue()
  *
  * License: You may use this code as you wish, provided you give credit where its due.
  *
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 25 November 2009
- * \version 0.2
+ * \version 0.3
  * \example LEGOSND-SMUX-test1.c
  */
 
@@ -44,7 +45,7 @@ void SNDsetDB(tMUXSensor muxsensor);
  * @return the raw value of the Sound Sensor
  */
 int SNDreadRaw(tMUXSensor muxsensor) {
-  return 1023 - HTSMUXreadAnalogue(muxsensor);
+  return 1023 - HTSMUXreadSharedAnalogue(muxsensor);
 }
 
 
@@ -20,6 +20,10 @@
  * Changelog:
  * - 0.1: Initial release
  * - 0.2: Partial rewrite by Xander Soldaat to simplify API
+ * - 0.3: Register reads use I2CreadRegisters() instead of building the request every time
+ * - 0.4: LEGOTMPreadAccuracy() reads the config register into a ubyte
+ * - 0.5: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
+ * - 0.6: Parenthesised the shutdown mode check in LEGOTMPreadTemp()
  *
  * Credits :
  * - Based on http://focus.ti.com/lit/ds/symlink/tmp275.pdf (Thank to Xander Soldaat who found the internal design)
@@ -31,7 +35,7 @@
  * \author Sylvain CACHEUX (sylcalego@cacheux.info)
  * \author Xander Soldaat (mightor@gmail.com), version 0.2
  * \date 15 february 2010
- * \version 0.2
+ * \version 0.6
  * \example LEGOTMP-test1.c
  * \example LEGOTMP-test2.c
  */
@@ -74,8 +78,13 @@ tLEGOTMPAccuracy _LEGOTMPconvertAccuracy(ubyte config);
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // global variables
-tByteArray       LEGOTMP_I2CRequest;    /*!< Array to hold I2C command data */
-tByteArray       LEGOTMP_I2CReply;      /*!< Array to hold I2C reply data   */
+#ifdef __COMMON_H_I2C_ARENA__
+#define LEGOTMP_I2CRequest   I2CArenaRequest
+#define LEGOTMP_I2CReply     I2CArenaReply
+#else
+tByteArray       LEGOTMP_I2CRequest;       /*!< Array to hold I2C command data */
+tByteArray       LEGOTMP_I2CReply;         /*!< Array to hold I2C reply data   */
+#endif // __COMMON_H_I2C_ARENA__
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -89,16 +98,7 @@ tByteArray       LEGOTMP_I2CReply;      /*!< Array to hold I2C reply data   */
  * @return true if no error occured, false if it did
  */
 bool _LEGOTMPreadConfig(tSensors link, ubyte &config) {
-  memset(LEGOTMP_I2CRequest, 0, sizeof(tByteArray));
-
-  LEGOTMP_I2CRequest.arr[0] = 2;                // Message size
-  LEGOTMP_I2CRequest.arr[1] = LEGOTMP_I2C_ADDR; // I2C Address
-  LEGOTMP_I2CRequest.arr[2] = LEGOTMP_CONFIG;   // Value address
-
-  if (!writeI2C(link, LEGOTMP_I2CRequest, 1))
-    return false;
-
-  if (!readI2C(link, LEGOTMP_I2CReply, 1))
+  if (!I2CreadRegisters(link, I2C_DESC(LEGOTMP_I2C_ADDR, LEGOTMP_CONFIG), LEGOTMP_I2CReply, 1))
     return false;
 
   config = LEGOTMP_I2CReply.arr[0];
@@ -184,7 +184,7 @@ bool LEGOTMPreadTemp(tSensors link, float &temp) {
 
   // Check if we're in shutdown mode, if so, we're doing
   // one-shotted readings.
-  if (config & 1 == 1) {
+  if ((config & 1) == 1) {
     config |= (1<<7); // set bit 7 for one-shot mode
 
     if (!_LEGOTMPsetConfig(link, config))
@@ -214,15 +214,7 @@ bool LEGOTMPreadTemp(tSensors link, float &temp) {
   }
 
   // clear the array again
-  memset(LEGOTMP_I2CRequest, 0, sizeof(tByteArray));
-  LEGOTMP_I2CRequest.arr[0] = 2;                // Message size
-  LEGOTMP_I2CRequest.arr[1] = LEGOTMP_I2C_ADDR; // I2C Address
-  LEGOTMP_I2CRequest.arr[2] = LEGOTMP_TEMP;     // Value address
-
-  if (!writeI2C(link, LEGOTMP_I2CRequest, 2))
-    return false;
-
-  if (!readI2C(link, LEGOTMP_I2CReply, 2))
+  if (!I2CreadRegisters(link, I2C_DESC(LEGOTMP_I2C_ADDR, LEGOTMP_TEMP), LEGOTMP_I2CReply, 2))
     return false;
 
   b1 = ubyteToInt(LEGOTMP_I2CReply.arr[0]);
@@ -261,7 +253,7 @@ bool LEGOTMPreadTemp(tSensors link, float &temp) {
  */
 bool LEGOTMPreadAccuracy(tSensors link, tLEGOTMPAccuracy &accuracy) {
   memset(LEGOTMP_I2CRequest, 0, sizeof(tByteArray));
-  byte config;
+  ubyte config;
 
   if (!_LEGOTMPreadConfig(link, config))
     return false;
@@ -22,10 +22,12 @@
  * Changelog:
  * - 0.1: Initial release
  * - 0.2: Added support for additional commands
+ * - 0.3: Register reads use I2CreadRegisters() instead of building the request every time
+ * - 0.4: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 10 December 2010
- * \version 0.2
+ * \version 0.4
  * \example LEGOUS-SMUX-test1.c
  */
 
@@ -57,8 +59,13 @@ bool USsetEventCapture(tSensors link);
 bool USreset(tSensors link);
 
 tByteArray LEGOUS_SMUXData;      /*!< Array to hold SMUX data */
-tByteArray LEGOUS_I2CRequest;
-tByteArray LEGOUS_I2CReply;
+#ifdef __COMMON_H_I2C_ARENA__
+#define LEGOUS_I2CRequest    I2CArenaRequest
+#define LEGOUS_I2CReply      I2CArenaReply
+#else
+tByteArray LEGOUS_I2CRequest;   
+tByteArray LEGOUS_I2CReply;   
+#endif // __COMMON_H_I2C_ARENA__
 
 
 /**
@@ -86,16 +93,7 @@ int USreadDist(tMUXSensor muxsensor) {
  * @return distance from the sensor or 255 if no valid range has been specified.
  */
 int USreadDist(tSensors link) {
-  memset(LEGOUS_I2CRequest, 0, sizeof(tByteArray));
-
-  LEGOUS_I2CRequest.arr[0] = 2;                // Message size
-  LEGOUS_I2CRequest.arr[1] = LEGOUS_I2C_ADDR;  // I2C Address
-  LEGOUS_I2CRequest.arr[2] = LEGOUS_REG_DATA;  // Start direction register
-
-  if (!writeI2C(link, LEGOUS_I2CRequest, 1))
-    return -1;
-
-  if (!readI2C(link, LEGOUS_I2CReply, 1))
+  if (!I2CreadRegisters(link, I2C_DESC(LEGOUS_I2C_ADDR, LEGOUS_REG_DATA), LEGOUS_I2CReply, 1))
     return -1;
 
   return LEGOUS_I2CReply.arr[0];
@@ -110,20 +108,9 @@ int USreadDist(tSensors link) {
  * @return distance from the sensor or 255 if no valid range has been specified.
  */
 bool USreadDistances(tSensors link, tByteArray &distances) {
-  memset(LEGOUS_I2CRequest, 0, sizeof(tByteArray));
-
-  LEGOUS_I2CRequest.arr[0] = 2;                // Message size
-  LEGOUS_I2CRequest.arr[1] = LEGOUS_I2C_ADDR;  // I2C Address
-  LEGOUS_I2CRequest.arr[2] = LEGOUS_REG_DATA;  // Start direction register
-
-  if (!writeI2C(link, LEGOUS_I2CRequest, 8))
-    return false;
-
-  if (!readI2C(link, LEGOUS_I2CReply, 8))
-    return false;
+  memset(distances, 0, sizeof(tByteArray));
 
-  memcpy(distances, LEGOUS_I2CReply, sizeof(tByteArray));
-  return true;
+  return I2CreadRegisters(link, I2C_DESC(LEGOUS_I2C_ADDR, LEGOUS_REG_DATA), distances, 8);
 }
 
 
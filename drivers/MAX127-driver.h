@@ -19,13 +19,14 @@
  * Changelog:
  * - 0.1: Initial release
  * - 0.5: Major rewrite of code, uses common.h for most functions
+ * - 0.6: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * License: You may use this code as you wish, provided you give credit where its due.
  *
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 08 March 2009
- * \version 0.5
+ * \version 0.6
  * \example MAX127-test1.c
  */
 
@@ -37,8 +38,13 @@
 
 #define MAX127_I2C_ADDR 0x50     /*!< MAX127 default I2C device address */
 
-tByteArray MAX127_I2CRequest;    /*!< Array to hold I2C command data */
-tByteArray MAX127_I2CReply;      /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define MAX127_I2CRequest    I2CArenaRequest
+#define MAX127_I2CReply      I2CArenaReply
+#else
+tByteArray MAX127_I2CRequest;       /*!< Array to hold I2C command data */
+tByteArray MAX127_I2CReply;         /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
 
 int MAX127readChan(tSensors link, byte i2caddress, byte adcchannel);
 
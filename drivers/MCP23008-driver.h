@@ -20,13 +20,16 @@
  * Changelog:
  * - 0.3 Rewrite to make use of standard common.h framework.
  * - 0.4 Renamed functions to be inline with new naming standard
+ * - 0.5 Register writes are combined through I2CwriteRegister()<br>
+ *       Fixed MCP23008writeReg() and MCP23008readReg() putting every byte of the request in the same place
+ * - 0.6 Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * License: You may use this code as you wish, provided you give credit where it's due.
  *
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat
  * \date 18 June 2009
- * \version 0.4
+ * \version 0.6
  */
 
 #pragma systemFile
@@ -56,8 +59,13 @@
 
 #define MCP_I2C_ADDR    0x40    /*!< Default base address (A0-A2 tied to gnd) */
 
-tByteArray MCP23008_I2CRequest;    /*!< Array to hold I2C command data */
-tByteArray MCP23008_I2CReply;      /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define MCP23008_I2CRequest  I2CArenaRequest
+#define MCP23008_I2CReply    I2CArenaReply
+#else
+tByteArray MCP23008_I2CRequest;       /*!< Array to hold I2C command data */
+tByteArray MCP23008_I2CReply;         /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
 
 bool MCP23008setupIO(tSensors link, byte addr, byte mask, byte pullup);
 bool MCP23008setupIO(tSensors link, byte addr, byte mask);
@@ -79,14 +87,10 @@ byte MCP23008readReg(tSensors link, byte addr, byte reg);
  * @return true if no error occured, false if it did
  */
 bool MCP23008writeReg(tSensors link, byte addr, byte reg, byte data) {
-  memset(MCP23008_I2CRequest, 0, sizeof(tByteArray));
-
-  MCP23008_I2CRequest.arr[0] = 3;     // Message size
-  MCP23008_I2CRequest.arr[1] = addr;  //I2C Address
-  MCP23008_I2CRequest.arr[1] = reg;   // Register address
-  MCP23008_I2CRequest.arr[1] = data;  // Data to be sent
+  if (!I2CwriteRegister(link, addr, reg, data))
+    return false;
 
-  return writeI2C(link, MCP23008_I2CRequest, 0);
+  return I2CsyncWrites(link);
 }
 
 /**
@@ -103,9 +107,9 @@ byte MCP23008readReg(tSensors link, byte addr, byte reg) {
 
   MCP23008_I2CRequest.arr[0] = 2;     // Message size
   MCP23008_I2CRequest.arr[1] = addr;  //I2C Address
-  MCP23008_I2CRequest.arr[1] = reg;   // Register address
+  MCP23008_I2CRequest.arr[2] = reg;   // Register address
 
-  writeI2C(link, MCP23008_I2CRequest, 0);
+  writeI2C(link, MCP23008_I2CRequest, 1);
   readI2C(link, MCP23008_I2CReply, 1);
 
   return MCP23008_I2CReply.arr[0];
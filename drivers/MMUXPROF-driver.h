@@ -0,0 +1,443 @@
+/*!@addtogroup other
+ * @{
+ * @defgroup mmuxprof Motor MUX Motion Profiles
+ * Motor MUX Motion Profiles
+ * @{
+ */
+
+#ifndef __MMUXPROF_H__
+#define __MMUXPROF_H__
+/** \file MMUXPROF-driver.h
+ * \brief Motion profiles for the Mindsensors and Holit Data Systems Motor MUXes
+ *
+ * MMUXPROF-driver.h moves motor MUX motors along trapezoidal or S-curve
+ * profiles.  A single task works out where every moving motor should be by
+ * the next tick and sends that to the MMUX as an encoder target, the MMUX's
+ * own position control does the rest.  When both motors of an MSMMUX move,
+ * their targets are written together and started with one START_BOTH command.
+ * The HDMMUX only takes relative moves, so its targets are sent as the
+ * distance from the encoder count in its status snapshot, which
+ * HDMMUXstartRefresh() can keep up to date without extra reads.
+ *
+ * Only the profile task talks to the attached MMUXes: MMUXprofileMove() just
+ * queues the move and the task reads where the motor starts from when it
+ * picks the move up.  While the task runs, don't call the MSMMUX or HDMMUX
+ * drivers for an attached port from another task, they would share the
+ * driver's request and reply buffers with it.
+ *
+ * Include MSMMUX-driver.h and/or HDMMUX-driver.h before this file, if neither
+ * is included, both are.
+ *
+ * Changelog:
+ * - 0.1: Initial release
+ * - 0.2: MMUXprofileMove() no longer reads the encoder, the task reads it when it starts the move and drops
+ *        the move if that fails, see MMUXprofileFailed()<br>
+ *        A tick skips an HDMMUX motor whose encoder can't be read instead of moving it relative to 0
+ * - 0.3: A target that can't be sent, or an MSMMUX START_BOTH that fails, keeps the previous target and
+ *        marks the profile failed, the next tick sends it again
+ *
+ * License: You may use this code as you wish, provided you give credit where its due.
+ *
+ * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
+ * \author Xander Soldaat (mightor_at_gmail.com)
+ * \date 17 October 2026
+ * \version 0.3
+ */
+
+#pragma systemFile
+
+#ifndef __MSMMUX_H__
+#ifndef __HDMMUX_H__
+#include "MSMMUX-driver.h"
+#include "HDMMUX-driver.h"
+#endif // __HDMMUX_H__
+#endif // __MSMMUX_H__
+
+#define MMUXPROF_TRAPEZOID    1     /*!< Constant acceleration, cruise, constant deceleration */
+#define MMUXPROF_SCURVE       2     /*!< Acceleration rises and falls smoothly, so there are no jerks */
+
+#define MMUXPROF_TICK         50    /*!< Default time in ms between two targets */
+#define MMUXPROF_FULL_SPEED   900   /*!< Rough encoder counts per second of an NXT motor at full power */
+#define MMUXPROF_MIN_POWER    10    /*!< Lowest power used to chase a target */
+#define MMUXPROF_MARGIN       125   /*!< Power used to chase a target, in % of what the distance needs */
+
+ubyte mmuxProfAddress[4];           /*!< I2C address of the MMUX on each port, 0 if there's none */
+bool mmuxProfMoving[16];            /*!< Whether the motor is following a profile */
+byte mmuxProfShape[16];             /*!< Shape of the motor's last profile */
+long mmuxProfOrigin[16];            /*!< Encoder count at the start of the profile */
+long mmuxProfDistance[16];          /*!< Encoder counts to travel, negative to go backwards */
+float mmuxProfPeak[16];             /*!< Top speed in counts/s */
+float mmuxProfRamp[16];             /*!< Time in s it takes to reach the top speed */
+float mmuxProfCruise[16];           /*!< Time in s spent at the top speed */
+long mmuxProfStarted[16];           /*!< nPgmTime at the start of the profile, -1 until the task picks it up */
+bool mmuxProfFailed[16];            /*!< Whether the last profile was dropped or a target couldn't be sent */
+long mmuxProfSent[16];              /*!< Last target sent to the MMUX */
+int mmuxProfRate = MMUXPROF_TICK;   /*!< Time in ms between two ticks of the task */
+bool mmuxProfRunning = false;       /*!< Whether the task is running */
+
+// Function prototypes
+void MMUXprofileAttach(tSensors link, ubyte address);
+bool MMUXprofileMove(tMUXmotor muxmotor, long distance, int speed, int accel, byte shape);
+long MMUXprofilePosition(tMUXmotor muxmotor, long elapsed);
+long MMUXprofileDuration(tMUXmotor muxmotor);
+bool MMUXprofileDone(tMUXmotor muxmotor);
+bool MMUXprofileFailed(tMUXmotor muxmotor);
+void MMUXprofileStart(int rate);
+void MMUXprofileStop();
+float _MMUXprofileRamp(byte shape, float peak, float ramp, float t);
+bool _MMUXprofileEncoder(tMUXmotor muxmotor, long &count);
+bool _MMUXprofileSend(tSensors link, ubyte channel, long target, long previous, bool go);
+void _MMUXprofileTick(tSensors link, long now);
+
+
+/**
+ * Tell the profile task which MMUX is attached to a port.
+ *
+ * @param link the MMUX port number
+ * @param address MSMMUX_I2C_ADDR or HDMMUX_I2C_ADDR, 0 to leave the port alone
+ */
+void MMUXprofileAttach(tSensors link, ubyte address) {
+  hogCPU();
+  mmuxProfAddress[link] = address;
+  for (int i = 0; i < 4; i++) {
+    mmuxProfMoving[(link * 4) + i] = false;
+    mmuxProfFailed[(link * 4) + i] = false;
+  }
+  releaseCPU();
+}
+
+
+/**
+ * Have a motor travel a distance along a profile, starting from where it is
+ * when the move starts.  The move starts at the next tick of the profile
+ * task, moves queued before the same tick start together.  This doesn't
+ * touch the bus, the task reads the motor's encoder when it starts the move
+ * and drops the move if it can't, see MMUXprofileFailed().
+ *
+ * @param muxmotor the motor-MUX motor
+ * @param distance the encoder counts to travel, negative to go backwards
+ * @param speed the top speed in counts/s
+ * @param accel the largest acceleration in counts/s/s
+ * @param shape MMUXPROF_TRAPEZOID or MMUXPROF_SCURVE
+ * @return true if the move was queued, false if the motor is still moving or no MMUX is attached
+ */
+bool MMUXprofileMove(tMUXmotor muxmotor, long distance, int speed, int accel, byte shape) {
+  float k = (shape == MMUXPROF_SCURVE) ? (PI / 2) : 1.0;
+  float peak = speed;
+  float ramp = 0;
+
+  if ((mmuxProfAddress[SPORT(muxmotor)] == 0) || mmuxProfMoving[muxmotor] || (speed <= 0) || (accel <= 0))
+    return false;
+
+  mmuxProfFailed[muxmotor] = false;
+  if (distance == 0)
+    return true;
+
+  // An S-curve needs PI/2 times as long as a trapezoid to reach the same speed
+  // with the same peak acceleration.  Short moves never reach the top speed.
+  if (k * peak * peak / accel > abs(distance))
+    peak = sqrt((float)accel * abs(distance) / k);
+  ramp = k * peak / accel;
+
+  hogCPU();
+  mmuxProfDistance[muxmotor] = distance;
+  mmuxProfPeak[muxmotor] = peak;
+  mmuxProfRamp[muxmotor] = ramp;
+  mmuxProfCruise[muxmotor] = (abs(distance) - (peak * ramp)) / peak;
+  mmuxProfStarted[muxmotor] = -1;
+  mmuxProfShape[muxmotor] = shape;
+  mmuxProfMoving[muxmotor] = true;
+  releaseCPU();
+
+  return true;
+}
+
+
+/**
+ * Distance covered while speeding up along a profile.
+ *
+ * Note: this is an internal function and shouldn't be used directly
+ * @param shape MMUXPROF_TRAPEZOID or MMUXPROF_SCURVE
+ * @param peak the top speed in counts/s
+ * @param ramp the time in s it takes to reach the top speed
+ * @param t the time in s since the motor started speeding up
+ * @return the encoder counts covered
+ */
+float _MMUXprofileRamp(byte shape, float peak, float ramp, float t) {
+  if (shape == MMUXPROF_SCURVE)
+    return peak / 2 * (t - (ramp / PI * sin(PI * t / ramp)));
+  return peak * t * t / (2 * ramp);
+}
+
+
+/**
+ * Where a motor should be some time into its profile.
+ *
+ * @param muxmotor the motor-MUX motor
+ * @param elapsed the time in ms since the start of the profile
+ * @return the encoder count
+ */
+long MMUXprofilePosition(tMUXmotor muxmotor, long elapsed) {
+  float t = elapsed / 1000.0;
+  float ramp = mmuxProfRamp[muxmotor];
+  float peak = mmuxProfPeak[muxmotor];
+  float total = (2 * ramp) + mmuxProfCruise[muxmotor];
+  float covered = abs(mmuxProfDistance[muxmotor]);
+
+  if (t <= 0)
+    covered = 0;
+  else if (t < ramp)
+    covered = _MMUXprofileRamp(mmuxProfShape[muxmotor], peak, ramp, t);
+  else if (t < total - ramp)
+    covered = (peak * ramp / 2) + (peak * (t - ramp));
+  else if (t < total)
+    covered = covered - _MMUXprofileRamp(mmuxProfShape[muxmotor], peak, ramp, total - t);
+
+  if (mmuxProfDistance[muxmotor] < 0)
+    return mmuxProfOrigin[muxmotor] - (long)covered;
+  return mmuxProfOrigin[muxmotor] + (long)covered;
+}
+
+
+/**
+ * How long a motor's profile takes.
+ *
+ * @param muxmotor the motor-MUX motor
+ * @return the time in ms
+ */
+long MMUXprofileDuration(tMUXmotor muxmotor) {
+  return (long)(((2 * mmuxProfRamp[muxmotor]) + mmuxProfCruise[muxmotor]) * 1000);
+}
+
+
+/**
+ * Check if a motor has been sent the last target of its profile.
+ *
+ * @param muxmotor the motor-MUX motor
+ * @return true if the motor isn't following a profile
+ */
+bool MMUXprofileDone(tMUXmotor muxmotor) {
+  return !mmuxProfMoving[muxmotor];
+}
+
+
+/**
+ * Check if a motor's last profile was dropped because the profile task
+ * couldn't read where the motor started from, or if one of its targets
+ * couldn't be sent.  A target that wasn't sent is sent again at the next
+ * tick, so the profile only ends once the last one made it to the MMUX.
+ *
+ * @param muxmotor the motor-MUX motor
+ * @return true if the profile was dropped or a target failed, false if not
+ */
+bool MMUXprofileFailed(tMUXmotor muxmotor) {
+  return mmuxProfFailed[muxmotor];
+}
+
+
+/**
+ * Read a motor's encoder count.  Unlike MSMMotorEncoder() and
+ * HDMMotorEncoder(), this tells a failed read from a count of 0.
+ *
+ * Note: this is an internal function and shouldn't be used directly
+ * @param muxmotor the motor-MUX motor
+ * @param count the encoder count
+ * @return true if no error occured, false if it did
+ */
+bool _MMUXprofileEncoder(tMUXmotor muxmotor, long &count) {
+  tSensors link = (tSensors)SPORT(muxmotor);
+
+#ifdef __MSMMUX_H__
+  if (mmuxProfAddress[link] == MSMMUX_I2C_ADDR) {
+    int i = MPORT(muxmotor) * 4;
+    if (!I2CreadSnapshot(link, MSMMUX_TachoSnapshot[link], MSMMUX_I2C_ADDR, MSMMUX_TACHO_MOT1, 8))
+      return false;
+    count = MSMMUX_TachoSnapshot[link].data.arr[i] + (MSMMUX_TachoSnapshot[link].data.arr[i + 1] << 8) +
+            (MSMMUX_TachoSnapshot[link].data.arr[i + 2] << 16) + (MSMMUX_TachoSnapshot[link].data.arr[i + 3] << 24);
+    return true;
+  }
+#endif // __MSMMUX_H__
+#ifdef __HDMMUX_H__
+  if (mmuxProfAddress[link] == HDMMUX_I2C_ADDR) {
+    long tacho[3];
+    byte motorStatus = 0;
+    if (!HDMMUXreadStatus(link, motorStatus, tacho[0], tacho[1], tacho[2]))
+      return false;
+    count = tacho[MPORT(muxmotor)];
+    return true;
+  }
+#endif // __HDMMUX_H__
+  return false;
+}
+
+
+/**
+ * Send a motor the target it should reach by the next tick, with just enough
+ * power to get there in time.
+ *
+ * Note: this is an internal function and shouldn't be used directly
+ * @param link the MMUX port number
+ * @param channel the motor channel
+ * @param target the encoder count to move to
+ * @param previous the encoder count the motor is at or was last sent
+ * @param go false to only write the registers of an MSMMUX and start it later
+ * @return true if no error occured, false if it did
+ */
+bool _MMUXprofileSend(tSensors link, ubyte channel, long target, long previous, bool go) {
+  long step = abs(target - previous);
+  long power = (step * 10 * MMUXPROF_MARGIN) / (((long)mmuxProfRate * MMUXPROF_FULL_SPEED) / 100);
+
+  if (power > 100)
+    power = 100;
+  else if (power < MMUXPROF_MIN_POWER)
+    power = MMUXPROF_MIN_POWER;
+
+#ifdef __MSMMUX_H__
+  if (mmuxProfAddress[link] == MSMMUX_I2C_ADDR)
+    return MSMMUXsendCommand(link, channel, target, power, 0,
+                             MSMMUX_CMD_SPEED + MSMMUX_CMD_TACHO + MSMMUX_CMD_BRK + MSMMUX_CMD_HOLDPOS + (go ? MSMMUX_CMD_GO : 0));
+#endif // __MSMMUX_H__
+#ifdef __HDMMUX_H__
+  if ((mmuxProfAddress[link] == HDMMUX_I2C_ADDR) && (step > 0))
+    return HDMMUXsendCommand(link, HDMMUX_CMD_MOTOR, channel + 1,
+                             HDMMUX_ROT_BRAKE + HDMMUX_ROT_CONSTSPEED + HDMMUX_ROT_POWERCONTROL + HDMMUX_ROT_DEGREES +
+                             ((target > previous) ? HDMMUX_ROT_FORWARD : HDMMUX_ROT_REVERSE),
+                             step, power, 0);
+#endif // __HDMMUX_H__
+  return true;
+}
+
+
+/**
+ * Send the next targets of all moving motors on one MMUX.
+ *
+ * Note: this is an internal function and shouldn't be used directly
+ * @param link the MMUX port number
+ * @param now the time of this tick
+ */
+void _MMUXprofileTick(tSensors link, long now) {
+  long target[3];
+  long previous[3];
+  bool moving[3];
+  bool sent[3];
+  int channels = 2;
+  int count = 0;
+  int m = 0;
+
+#ifdef __HDMMUX_H__
+  if (mmuxProfAddress[link] == HDMMUX_I2C_ADDR)
+    channels = 3;
+#endif // __HDMMUX_H__
+
+  for (int i = 0; i < channels; i++) {
+    m = (link * 4) + i;
+    moving[i] = mmuxProfMoving[m];
+    if (!moving[i])
+      continue;
+
+    // A new move starts from wherever the motor is now
+    if (mmuxProfStarted[m] < 0) {
+      if (!_MMUXprofileEncoder((tMUXmotor)m, mmuxProfOrigin[m])) {
+        mmuxProfFailed[m] = true;
+        mmuxProfMoving[m] = false;
+        moving[i] = false;
+        continue;
+      }
+      mmuxProfSent[m] = mmuxProfOrigin[m];
+      mmuxProfStarted[m] = now;
+    }
+
+    // Aim for where the motor should be by the next tick
+    target[i] = MMUXprofilePosition((tMUXmotor)m, now + mmuxProfRate - mmuxProfStarted[m]);
+    previous[i] = mmuxProfSent[m];
+#ifdef __HDMMUX_H__
+    // Its moves are relative, try again next tick rather than move from the wrong place
+    if ((mmuxProfAddress[link] == HDMMUX_I2C_ADDR) && !_MMUXprofileEncoder((tMUXmotor)m, previous[i])) {
+      moving[i] = false;
+      continue;
+    }
+#endif // __HDMMUX_H__
+    count++;
+  }
+
+  if (count == 0)
+    return;
+
+  // Two MSMMUX motors get their targets written first and start together
+  for (int i = 0; i < channels; i++) {
+    if (moving[i])
+      sent[i] = _MMUXprofileSend(link, i, target[i], previous[i], count < 2);
+  }
+
+#ifdef __MSMMUX_H__
+  if ((mmuxProfAddress[link] == MSMMUX_I2C_ADDR) && (count == 2) && !MSMMUXsendCommand(link, MSMMUX_CMD_START_BOTH)) {
+    sent[0] = false;
+    sent[1] = false;
+  }
+#endif // __MSMMUX_H__
+
+  for (int i = 0; i < channels; i++) {
+    if (!moving[i])
+      continue;
+
+    // The motor is still after the previous target, the next tick tries again
+    m = (link * 4) + i;
+    if (!sent[i]) {
+      mmuxProfFailed[m] = true;
+      continue;
+    }
+    mmuxProfSent[m] = target[i];
+    if (now + mmuxProfRate - mmuxProfStarted[m] >= MMUXprofileDuration((tMUXmotor)m))
+      mmuxProfMoving[m] = false;
+  }
+}
+
+
+/**
+ * Send the next targets of all moving motors.
+ *
+ * Note: this task is started by MMUXprofileStart() and should not be started directly
+ */
+task _MMUXprofileTask() {
+  long now = 0;
+
+  while (mmuxProfRunning) {
+    now = nPgmTime;
+    for (int i = 0; i < 4; i++) {
+      if (mmuxProfAddress[i] != 0)
+        _MMUXprofileTick((tSensors)i, now);
+    }
+    wait1Msec(max(1, now + mmuxProfRate - nPgmTime));
+  }
+}
+
+
+/**
+ * Start the profile task.  A shorter interval follows the profiles more
+ * closely but keeps the bus busier.
+ *
+ * @param rate the time in ms between two targets
+ */
+void MMUXprofileStart(int rate) {
+  mmuxProfRate = rate;
+
+  if (mmuxProfRunning)
+    return;
+
+  mmuxProfRunning = true;
+  StartTask(_MMUXprofileTask);
+}
+
+
+/**
+ * Stop the profile task once it's done with the current tick.  The motors
+ * hold on to their last target.
+ */
+void MMUXprofileStop() {
+  mmuxProfRunning = false;
+}
+
+#endif // __MMUXPROF_H__
+
+/* @} */
+/* @} */
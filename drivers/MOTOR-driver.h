@@ -0,0 +1,469 @@
+/*!@addtogroup other
+ * @{
+ * @defgroup motor Motor Handles
+ * One API for the motors of all drivers
+ * @{
+ */
+
+#ifndef __MOTOR_H__
+#define __MOTOR_H__
+/** \file MOTOR-driver.h
+ * \brief One API for the motors of all drivers
+ *
+ * MOTOR-driver.h drives NXT motors, Mindsensors and Holit Data Systems
+ * motor MUX motors, Power Functions motors through a HiTechnic IR Link or a
+ * Mindsensors PFMate and RCX motors through an IR Link with the same calls.
+ * Each motor gets a handle from MOTORattach(), MOTORset() only notes the new
+ * power and MOTORflush() sends everything that changed since the last flush,
+ * so a control loop sets all its motors and flushes once per tick.
+ *
+ * The flush sends the motors that share an MSMMUX, a PF receiver channel,
+ * a PFMate channel or an RCX together: both motors of an MSMMUX with one
+ * write, both outputs of a PF receiver with one Combo PWM command, both
+ * outputs behind a PFMate with one command and RCX motors running at the same
+ * power with one message.  The HDMMUX only takes commands for one motor at a
+ * time.  Powers are rounded to the speeds the device has first, so changes
+ * it couldn't show aren't sent at all.
+ *
+ * Each backend only works when its driver is included before this file:
+ * MSMMUX-driver.h, HDMMUX-driver.h, HTIRL-driver.h or HTIRL-NG-driver.h,
+ * MSPFM-driver.h and HTRCX-driver.h.  NXT motors always work.
+ *
+ * Changelog:
+ * - 0.1: Initial release
+ *
+ * License: You may use this code as you wish, provided you give credit where its due.
+ *
+ * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
+ * \author Xander Soldaat (mightor_at_gmail.com)
+ * \date 17 October 2026
+ * \version 0.1
+ */
+
+#pragma systemFile
+
+#ifndef __COMMON_H__
+#include "common.h"
+#endif
+
+#define MOTOR_NXT           1     /*!< NXT motor port, driven through motor[] */
+#define MOTOR_MSMMUX        2     /*!< Mindsensors Motor MUX */
+#define MOTOR_HDMMUX        3     /*!< Holit Data Systems Motor MUX */
+#define MOTOR_PF            4     /*!< Power Functions receiver, through a HiTechnic IR Link */
+#define MOTOR_PFMATE        5     /*!< Power Functions receiver, through a Mindsensors PFMate */
+#define MOTOR_RCX           6     /*!< RCX, through a HiTechnic IR Link */
+#define MOTOR_BACKENDS      7
+
+#define MOTOR_MAX_HANDLES   8     /*!< Number of motors that can be attached */
+#define MOTOR_NOT_SENT      127   /*!< Speed of a motor that hasn't been sent anything yet */
+
+// Either IR Link driver will do for Power Functions
+#ifdef __HTIRL_H__
+#define __MOTOR_PF__
+#endif // __HTIRL_H__
+#ifdef _HTIRL_H_
+#define __MOTOR_PF__
+#endif // _HTIRL_H_
+
+// What each backend can do, indexed by backend
+ubyte motorBackendChannels[MOTOR_BACKENDS] = {0, 3, 2, 3, 2, 2, 3};   /*!< Motors per MUX, receiver channel or RCX */
+ubyte motorBackendGroups[MOTOR_BACKENDS] = {0, 1, 1, 1, 4, 4, 1};     /*!< Receiver channels per port */
+byte motorBackendSteps[MOTOR_BACKENDS] = {0, 100, 100, 100, 7, 7, 8}; /*!< Speeds in each direction */
+int motorBackendRefresh[MOTOR_BACKENDS] = {0, 0, 0, 0, 1000, 0, 0};   /*!< Time in ms after which an unchanged speed is sent again, 0 for never */
+
+byte motorBackend[MOTOR_MAX_HANDLES];   /*!< Backend of each handle */
+tSensors motorLink[MOTOR_MAX_HANDLES];  /*!< Port of the MUX, IR Link or PFMate */
+ubyte motorGroup[MOTOR_MAX_HANDLES];    /*!< Receiver channel, 0-3 */
+ubyte motorChannel[MOTOR_MAX_HANDLES];  /*!< Motor on the MUX, receiver or RCX, or the NXT motor port */
+int motorQueued[MOTOR_MAX_HANDLES];     /*!< Power set with MOTORset(), -100 to +100 */
+byte motorSent[MOTOR_MAX_HANDLES];      /*!< Speed sent in the last flush, MOTOR_NOT_SENT if none */
+long motorSentAt[MOTOR_MAX_HANDLES];    /*!< nPgmTime of the last flush that sent the motor */
+bool motorFlushed[MOTOR_MAX_HANDLES];   /*!< Whether the current flush has dealt with the motor */
+int motorUnit[3];                       /*!< Handle of each motor on the device being flushed, -1 if it has none */
+byte motorUnitStep[3];                  /*!< Speed of each motor on the device being flushed */
+bool motorUnitDue[3];                   /*!< Whether each motor on the device being flushed needs to be sent */
+int motorHandles = 0;                   /*!< Number of motors attached */
+
+// Function prototypes
+int MOTORattach(byte backend, tSensors link, ubyte group, ubyte channel);
+int MOTORattachNXT(tMotor nxtmotor);
+int MOTORattachMUX(byte backend, tMUXmotor muxmotor);
+void MOTORset(int handle, int power);
+bool MOTORflush();
+void MOTORinvalidate();
+bool _MOTORavailable(byte backend);
+byte _MOTORstep(byte backend, int power);
+bool _MOTORdue(int handle, long now);
+bool _MOTORflushUnit(int handle, long now);
+bool _MOTORflushRCX(tSensors link);
+
+
+/**
+ * Attach a motor and get its handle.
+ *
+ * @param backend MOTOR_NXT, MOTOR_MSMMUX, MOTOR_HDMMUX, MOTOR_PF, MOTOR_PFMATE or MOTOR_RCX
+ * @param link the port of the MUX, IR Link or PFMate, ignored for NXT motors
+ * @param group the channel of the PF receiver, 0-3, 0 for the other backends
+ * @param channel the motor: 0 for motor A or motor 1, 1 for B, 2 for C
+ * @return the handle, -1 if the backend's driver isn't included, the motor doesn't exist or there are no handles left
+ */
+int MOTORattach(byte backend, tSensors link, ubyte group, ubyte channel) {
+  int handle = motorHandles;
+
+  if ((backend <= 0) || (backend >= MOTOR_BACKENDS) || !_MOTORavailable(backend))
+    return -1;
+
+  if ((channel >= motorBackendChannels[backend]) || (group >= motorBackendGroups[backend]) || (handle >= MOTOR_MAX_HANDLES))
+    return -1;
+
+  motorBackend[handle] = backend;
+  motorLink[handle] = link;
+  motorGroup[handle] = group;
+  motorChannel[handle] = channel;
+  motorQueued[handle] = 0;
+  motorSent[handle] = MOTOR_NOT_SENT;
+  motorSentAt[handle] = 0;
+  motorHandles++;
+
+  return handle;
+}
+
+
+/**
+ * Attach an NXT motor and get its handle.
+ *
+ * @param nxtmotor the motor port
+ * @return the handle, -1 if there are no handles left
+ */
+int MOTORattachNXT(tMotor nxtmotor) {
+  return MOTORattach(MOTOR_NXT, S1, 0, (ubyte)nxtmotor);
+}
+
+
+/**
+ * Attach a motor MUX motor and get its handle.
+ *
+ * @param backend MOTOR_MSMMUX or MOTOR_HDMMUX
+ * @param muxmotor the motor-MUX motor
+ * @return the handle, -1 if the MUX driver isn't included, the motor doesn't exist or there are no handles left
+ */
+int MOTORattachMUX(byte backend, tMUXmotor muxmotor) {
+  return MOTORattach(backend, (tSensors)SPORT(muxmotor), 0, (ubyte)MPORT(muxmotor));
+}
+
+
+/**
+ * Set the power of a motor.  Nothing is sent until MOTORflush().
+ *
+ * @param handle the handle from MOTORattach()
+ * @param power the power, -100 to +100, 0 stops the motor
+ */
+void MOTORset(int handle, int power) {
+  if ((handle < 0) || (handle >= motorHandles))
+    return;
+
+  motorQueued[handle] = clip(power, -100, 100);
+}
+
+
+/**
+ * Send the powers that changed since the last flush, and the ones that are
+ * due to be sent again, grouped per MUX, receiver channel and RCX.
+ *
+ * @return true if no error occured, false if it did
+ */
+bool MOTORflush() {
+  bool retval = true;
+  long now = nPgmTime;
+
+  for (int i = 0; i < motorHandles; i++)
+    motorFlushed[i] = false;
+
+  for (int i = 0; i < motorHandles; i++) {
+    if (motorFlushed[i] || !_MOTORdue(i, now))
+      continue;
+
+    if (!_MOTORflushUnit(i, now))
+      retval = false;
+  }
+
+  return retval;
+}
+
+
+/**
+ * Make the next flush send every motor, whether its power changed or not.
+ * Call this when a device may have lost power.
+ */
+void MOTORinvalidate() {
+  for (int i = 0; i < motorHandles; i++)
+    motorSent[i] = MOTOR_NOT_SENT;
+}
+
+
+/**
+ * Check whether the driver of a backend was included.
+ *
+ * Note: this is an internal function and shouldn't be used directly
+ * @param backend the backend
+ * @return true if the backend can be used
+ */
+bool _MOTORavailable(byte backend) {
+  switch (backend) {
+    case MOTOR_NXT:
+      return true;
+#ifdef __MSMMUX_H__
+    case MOTOR_MSMMUX:
+      return true;
+#endif // __MSMMUX_H__
+#ifdef __HDMMUX_H__
+    case MOTOR_HDMMUX:
+      return true;
+#endif // __HDMMUX_H__
+#ifdef __MOTOR_PF__
+    case MOTOR_PF:
+      return true;
+#endif // __MOTOR_PF__
+#ifdef __MSPFM_H__
+    case MOTOR_PFMATE:
+      return true;
+#endif // __MSPFM_H__
+#ifdef _HTRCX_H_
+    case MOTOR_RCX:
+      return true;
+#endif // _HTRCX_H_
+  }
+  return false;
+}
+
+
+/**
+ * Round a power to the nearest speed a backend has.  Any power other than 0
+ * gives at least the lowest speed.
+ *
+ * Note: this is an internal function and shouldn't be used directly
+ * @param backend the backend
+ * @param power the power, -100 to +100
+ * @return the speed, -steps to +steps
+ */
+byte _MOTORstep(byte backend, int power) {
+  int steps = motorBackendSteps[backend];
+  int speed = ((abs(power) * steps) + 50) / 100;
+
+  if (steps == 100)
+    return power;
+
+  if ((speed == 0) && (power != 0))
+    speed = 1;
+
+  return (power < 0) ? -speed : speed;
+}
+
+
+/**
+ * Check whether a motor needs to be sent.
+ *
+ * Note: this is an internal function and shouldn't be used directly
+ * @param handle the handle
+ * @param now the time of this flush
+ * @return true if its speed changed or it's due to be sent again
+ */
+bool _MOTORdue(int handle, long now) {
+  int refresh = motorBackendRefresh[motorBackend[handle]];
+
+  if (_MOTORstep(motorBackend[handle], motorQueued[handle]) != motorSent[handle])
+    return true;
+
+  return (refresh > 0) && (now - motorSentAt[handle] >= refresh);
+}
+
+
+/**
+ * Send the motors that share a device with a motor that needs to be sent.
+ *
+ * Note: this is an internal function and shouldn't be used directly
+ * @param handle the motor that needs to be sent
+ * @param now the time of this flush
+ * @return true if no error occured, false if it did
+ */
+bool _MOTORflushUnit(int handle, long now) {
+  bool sent[3];
+  byte backend = motorBackend[handle];
+  tSensors link = motorLink[handle];
+  bool retval = true;
+#ifdef __MOTOR_PF__
+  ubyte pfA = 0;
+  ubyte pfB = 0;
+#endif // __MOTOR_PF__
+  int m = 0;
+
+  for (int c = 0; c < 3; c++) {
+    motorUnit[c] = -1;
+    motorUnitStep[c] = 0;
+    motorUnitDue[c] = false;
+  }
+
+  for (int i = 0; i < motorHandles; i++) {
+    if ((motorBackend[i] != backend) || (motorGroup[i] != motorGroup[handle]))
+      continue;
+    if ((backend != MOTOR_NXT) && (motorLink[i] != link))
+      continue;
+    m = motorChannel[i];
+    motorUnit[m] = i;
+    motorUnitStep[m] = _MOTORstep(backend, motorQueued[i]);
+    motorUnitDue[m] = _MOTORdue(i, now);
+    motorFlushed[i] = true;
+  }
+
+  for (int c = 0; c < 3; c++)
+    sent[c] = motorUnitDue[c];
+
+  switch (backend) {
+    case MOTOR_NXT:
+      for (int c = 0; c < 3; c++) {
+        if (motorUnitDue[c])
+          motor[(tMotor)c] = motorUnitStep[c];
+      }
+      break;
+
+#ifdef __MSMMUX_H__
+    case MOTOR_MSMMUX:
+      m = motorUnitDue[0] ? 0 : 1;
+      if (motorUnitDue[0] && motorUnitDue[1])
+        retval = MSMMotorPair(link, motorUnitStep[0], motorUnitStep[1]);
+      else
+        retval = MSMMotor((tMUXmotor)((link * 4) + m), motorUnitStep[m]);
+      break;
+#endif // __MSMMUX_H__
+
+#ifdef __HDMMUX_H__
+    case MOTOR_HDMMUX:
+      for (int c = 0; c < 3; c++) {
+        if (!motorUnitDue[c])
+          continue;
+        if (motorUnitStep[c] == 0)
+          sent[c] = HDMotorStop((tMUXmotor)((link * 4) + c));
+        else
+          sent[c] = HDMMotor((tMUXmotor)((link * 4) + c), motorUnitStep[c]);
+        retval = retval && sent[c];
+      }
+      break;
+#endif // __HDMMUX_H__
+
+#ifdef __MOTOR_PF__
+    case MOTOR_PF:
+      // Combo PWM always sets both outputs, 1-7 is forward and 15-9 reverse
+      sent[0] = (motorUnit[0] >= 0);
+      sent[1] = (motorUnit[1] >= 0);
+      pfA = (motorUnitStep[0] < 0) ? (16 + motorUnitStep[0]) : motorUnitStep[0];
+      pfB = (motorUnitStep[1] < 0) ? (16 + motorUnitStep[1]) : motorUnitStep[1];
+#ifdef __HTIRL_H__
+      PFcomboPwmMode(link, motorGroup[handle], (eCPMMotorCommand)pfB, (eCPMMotorCommand)pfA);
+#else
+#ifdef _HTIRL_H_
+      PFcomboPwmMode(link, motorGroup[handle], (ePWMMotorCommand)pfB, (ePWMMotorCommand)pfA);
+#endif // _HTIRL_H_
+#endif // __HTIRL_H__
+      break;
+#endif // __MOTOR_PF__
+
+#ifdef __MSPFM_H__
+    case MOTOR_PFMATE:
+      m = MSPFM_MOTORAB;
+      if (!motorUnitDue[1])
+        m = MSPFM_MOTORA;
+      else if (!motorUnitDue[0])
+        m = MSPFM_MOTORB;
+      retval = _MSPFMcontrolMotors(link, motorGroup[handle] + 1, m,
+                                   (motorUnitStep[0] > 0) ? MSPFM_FORWARD : ((motorUnitStep[0] < 0) ? MSPFM_REVERSE : MSPFM_FLOAT), abs(motorUnitStep[0]),
+                                   (motorUnitStep[1] > 0) ? MSPFM_FORWARD : ((motorUnitStep[1] < 0) ? MSPFM_REVERSE : MSPFM_FLOAT), abs(motorUnitStep[1])) &&
+               _MSPFMsendCommand(link, MSPFM_GOCMD);
+      break;
+#endif // __MSPFM_H__
+
+#ifdef _HTRCX_H_
+    case MOTOR_RCX:
+      retval = _MOTORflushRCX(link);
+      break;
+#endif // _HTRCX_H_
+  }
+
+  // The HDMMUX motors were sent one by one, the others all or nothing
+  if (!retval && (backend != MOTOR_HDMMUX))
+    return false;
+
+  for (int c = 0; c < 3; c++) {
+    if ((motorUnit[c] < 0) || !sent[c])
+      continue;
+    motorSent[motorUnit[c]] = motorUnitStep[c];
+    motorSentAt[motorUnit[c]] = now;
+  }
+
+  return retval;
+}
+
+
+#ifdef _HTRCX_H_
+/**
+ * Send the motors of an RCX.  Motors that end up at the same power share
+ * the message that sets it, and the ones turning the same way share the one
+ * that sets the direction.
+ *
+ * Note: this is an internal function and shouldn't be used directly
+ * @param link the IR Link port number
+ * @return true if no error occured, false if it did
+ */
+bool _MOTORflushRCX(tSensors link) {
+  ubyte power = 0;
+  ubyte forward = 0;
+  ubyte reverse = 0;
+  ubyte on = 0;
+  ubyte off = 0;
+  byte last = 0;
+
+  for (int speed = 1; speed <= 8; speed++) {
+    power = 0;
+    for (int c = 0; c < 3; c++) {
+      if (!motorUnitDue[c])
+        continue;
+      last = motorSent[motorUnit[c]];
+      if ((abs(motorUnitStep[c]) == speed) && (abs(last) != speed))
+        power |= (1 << c);
+    }
+    if (power != 0)
+      HTRCXmotorPwr(link, power, speed - 1);
+  }
+
+  for (int c = 0; c < 3; c++) {
+    if (!motorUnitDue[c])
+      continue;
+    last = motorSent[motorUnit[c]];
+    if (motorUnitStep[c] == 0) {
+      off |= (1 << c);
+      continue;
+    }
+    if ((motorUnitStep[c] > 0) && ((last <= 0) || (last == MOTOR_NOT_SENT)))
+      forward |= (1 << c);
+    if ((motorUnitStep[c] < 0) && ((last >= 0) || (last == MOTOR_NOT_SENT)))
+      reverse |= (1 << c);
+    if ((last == 0) || (last == MOTOR_NOT_SENT))
+      on |= (1 << c);
+  }
+
+  if (forward != 0)
+    HTRCXmotorFwd(link, forward);
+  if (reverse != 0)
+    HTRCXmotorRev(link, reverse);
+  if (on != 0)
+    HTRCXmotorOn(link, on);
+  if (off != 0)
+    HTRCXmotorOff(link, off);
+
+  return true;
+}
+#endif // _HTRCX_H_
+
+#endif // __MOTOR_H__
+
+/* @} */
+/* @} */
@@ -20,6 +20,8 @@
  * - 0.1: Initial release
  * - 0.2: Added defines for ranges (MSAC_RANGE_2_5 ... MSAC_RANGE_10)<br>
  *        Removed ubyteToInt() calls.
+ * - 0.3: Register reads use I2CreadRegisters() instead of building the request every time
+ * - 0.4: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * Credits:
  * - Big thanks to Mindsensors for providing me with the hardware necessary to write and test this.
@@ -29,7 +31,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 28 November 2009
- * \version 0.2
+ * \version 0.4
  * \example MSAC-test1.c
  */
 
@@ -61,8 +63,13 @@ bool MSACreadAccel(tSensors link, int &x_accel, int &y_accel, int &z_accel);
 bool MSACsendCmd(tSensors link, byte command);
 bool MSACsetRange(tSensors link, int range);
 
-tByteArray MSAC_I2CRequest;       /*!< Array to hold I2C command data */
-tByteArray MSAC_I2CReply;         /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define MSAC_I2CRequest      I2CArenaRequest
+#define MSAC_I2CReply        I2CArenaReply
+#else
+tByteArray MSAC_I2CRequest;          /*!< Array to hold I2C command data */
+tByteArray MSAC_I2CReply;            /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
 
 
 /**
@@ -74,16 +81,7 @@ tByteArray MSAC_I2CReply;         /*!< Array to hold I2C reply data */
  * @return true if no error occured, false if it did
  */
 bool MSACreadTilt(tSensors link, int &x_tilt, int &y_tilt, int &z_tilt) {
-  memset(MSAC_I2CRequest, 0, sizeof(tByteArray));
-
-  MSAC_I2CRequest.arr[0] = 2;               // Number of bytes in I2C command
-  MSAC_I2CRequest.arr[1] = MSAC_I2C_ADDR;   // I2C address of accel sensor
-  MSAC_I2CRequest.arr[2] = MSAC_X_TILT;     // Set write address to sensor mode register
-
-  if (!writeI2C(link, MSAC_I2CRequest, 3))
-    return false;
-
-  if (!readI2C(link, MSAC_I2CReply, 3))
+  if (!I2CreadRegisters(link, I2C_DESC(MSAC_I2C_ADDR, MSAC_X_TILT), MSAC_I2CReply, 3))
     return false;
 
   x_tilt = MSAC_I2CReply.arr[0] - 128;
@@ -103,16 +101,7 @@ bool MSACreadTilt(tSensors link, int &x_tilt, int &y_tilt, int &z_tilt) {
  * @return true if no error occured, false if it did
  */
 bool MSACreadAccel(tSensors link, int &x_accel, int &y_accel, int &z_accel) {
-  memset(MSAC_I2CRequest, 0, sizeof(tByteArray));
-
-  MSAC_I2CRequest.arr[0] = 2;               // Number of bytes in I2C command
-  MSAC_I2CRequest.arr[1] = MSAC_I2C_ADDR;   // I2C address of accel sensor
-  MSAC_I2CRequest.arr[2] = MSAC_X_ACCEL;    // Set write address to sensor mode register
-
-  if (!writeI2C(link, MSAC_I2CRequest, 6))
-    return false;
-
-  if (!readI2C(link, MSAC_I2CReply, 6))
+  if (!I2CreadRegisters(link, I2C_DESC(MSAC_I2C_ADDR, MSAC_X_ACCEL), MSAC_I2CReply, 6))
     return false;
 
   // Each result is made up of two bytes.
@@ -21,6 +21,9 @@
  * - 0.2: More comments
  * - 0.3: Sensor now auto-configures the type
  * - 0.4: Allow I2C address to be specified as an optional argument
+ * - 0.5: Register reads use I2CreadRegisters() instead of building the request every time
+ * - 0.6: Devices found by I2CscanPort() are used when no address is given
+ * - 0.7: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * Credits:
  * - Big thanks to Mindsensors for providing me with the hardware necessary to write and test this.
@@ -30,7 +33,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 18 December 2010
- * \version 0.4
+ * \version 0.7
  * \example MSDIST-test1.c
  */
 
@@ -56,44 +59,42 @@
 #define MSDIST_GP2YA02    0x34  /*!< Sharp IR module GP2YA02 */
 #define MSDIST_CUSTOM     0x35  /*!< Custom IR module */
 
-int MSDISTreadDist(tSensors link, ubyte address = MSDIST_I2C_ADDR);
-int MSDISTreadVoltage(tSensors link, ubyte address = MSDIST_I2C_ADDR);
-int MSDISTreadMinDist(tSensors link, ubyte address = MSDIST_I2C_ADDR);
-int MSDISTreadMaxDist(tSensors link, ubyte address = MSDIST_I2C_ADDR);
-int MSDISTreadModuleType(tSensors link, ubyte address = MSDIST_I2C_ADDR);
-bool MSDISTsendCmd(tSensors link, byte command, ubyte address = MSDIST_I2C_ADDR);
-
-tByteArray MSDIST_I2CRequest;       /*!< Array to hold I2C command data */
-tByteArray MSDIST_I2CReply;         /*!< Array to hold I2C reply data */
+int MSDISTreadDist(tSensors link, ubyte address = 0);
+int MSDISTreadVoltage(tSensors link, ubyte address = 0);
+int MSDISTreadMinDist(tSensors link, ubyte address = 0);
+int MSDISTreadMaxDist(tSensors link, ubyte address = 0);
+int MSDISTreadModuleType(tSensors link, ubyte address = 0);
+bool MSDISTsendCmd(tSensors link, byte command, ubyte address = 0);
+
+#ifdef __COMMON_H_I2C_ARENA__
+#define MSDIST_I2CRequest    I2CArenaRequest
+#define MSDIST_I2CReply      I2CArenaReply
+#else
+tByteArray MSDIST_I2CRequest;          /*!< Array to hold I2C command data */
+tByteArray MSDIST_I2CReply;            /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
 
 bool MSDISTcalibrated[] = {false, false, false, false};  /*!< Has the sensor been calibrated yet? */
 
 /**
  * Read the distance from the sensor
  * @param link the sensor port number
- * @param address the I2C address to use, optional, defaults to 0x02
+ * @param address the I2C address to use, optional, defaults to the one found by I2CscanPort() or 0x02
  * @return distance to object or -1 if an error occurred
  */
 int MSDISTreadDist(tSensors link, ubyte address) {
+  if (address == 0)
+    address = I2CbindAddress(link, I2C_DEV_MSDIST, MSDIST_I2C_ADDR);
 
   // Configure the sensor
   if (!MSDISTcalibrated[link]) {
-    if (!MSDISTsendCmd(link, MSDISTreadModuleType(link)))
+    if (!MSDISTsendCmd(link, MSDISTreadModuleType(link, address), address))
       return -1;
     else
       MSDISTcalibrated[link] = true;
   }
 
-  memset(MSDIST_I2CRequest, 0, sizeof(tByteArray));
-
-  MSDIST_I2CRequest.arr[0] = 2;               // Number of bytes in I2C command
-  MSDIST_I2CRequest.arr[1] = address;         // I2C address of sensor
-  MSDIST_I2CRequest.arr[2] = MSDIST_DIST;     // Set write address to sensor mode register
-
-  if (!writeI2C(link, MSDIST_I2CRequest, 2))
-    return -1;
-
-  if (!readI2C(link, MSDIST_I2CReply, 2))
+  if (!I2CreadRegisters(link, I2C_DESC(address, MSDIST_DIST), MSDIST_I2CReply, 2))
     return -1;
 
   return (0x00FF & MSDIST_I2CReply.arr[0]) + ((0x00FF & MSDIST_I2CReply.arr[1]) <<8);
@@ -103,20 +104,14 @@ int MSDISTreadDist(tSensors link, ubyte address) {
 /**
  * Read tilt data from the sensor
  * @param link the sensor port number
- * @param address the I2C address to use, optional, defaults to 0x02
+ * @param address the I2C address to use, optional, defaults to the one found by I2CscanPort() or 0x02
  * @return voltage reading from IR Sensor -1 if an error occurred
  */
 int MSDISTreadVoltage(tSensors link, ubyte address) {
-  memset(MSDIST_I2CRequest, 0, sizeof(tByteArray));
-
-  MSDIST_I2CRequest.arr[0] = 2;               // Number of bytes in I2C command
-  MSDIST_I2CRequest.arr[1] = address;         // I2C address of sensor
-  MSDIST_I2CRequest.arr[2] = MSDIST_VOLT;     // Set write address to sensor mode register
+  if (address == 0)
+    address = I2CbindAddress(link, I2C_DEV_MSDIST, MSDIST_I2C_ADDR);
 
-  if (!writeI2C(link, MSDIST_I2CRequest, 2))
-    return -1;
-
-  if (!readI2C(link, MSDIST_I2CReply, 2))
+  if (!I2CreadRegisters(link, I2C_DESC(address, MSDIST_VOLT), MSDIST_I2CReply, 2))
     return -1;
 
   // Each result is made up of two bytes.
@@ -127,20 +122,14 @@ int MSDISTreadVoltage(tSensors link, ubyte address) {
 /**
  * Read minumum measuring distance from the sensor
  * @param link the sensor port number
- * @param address the I2C address to use, optional, defaults to 0x02
+ * @param address the I2C address to use, optional, defaults to the one found by I2CscanPort() or 0x02
  * @return minumum measuring distance from the sensor -1 if an error occurred
  */
 int MSDISTreadMinDist(tSensors link, ubyte address) {
-  memset(MSDIST_I2CRequest, 0, sizeof(tByteArray));
-
-  MSDIST_I2CRequest.arr[0] = 2;               // Number of bytes in I2C command
-  MSDIST_I2CRequest.arr[1] = address;         // I2C address of sensor
-  MSDIST_I2CRequest.arr[2] = MSDIST_MINDIST;  // Set write address to sensor mode register
-
-  if (!writeI2C(link, MSDIST_I2CRequest, 2))
-    return -1;
+  if (address == 0)
+    address = I2CbindAddress(link, I2C_DEV_MSDIST, MSDIST_I2C_ADDR);
 
-  if (!readI2C(link, MSDIST_I2CReply, 2))
+  if (!I2CreadRegisters(link, I2C_DESC(address, MSDIST_MINDIST), MSDIST_I2CReply, 2))
     return -1;
 
   // Each result is made up of two bytes.
@@ -151,20 +140,14 @@ int MSDISTreadMinDist(tSensors link, ubyte address) {
 /**
  * Read maximum measuring distance from the sensor
  * @param link the sensor port number
- * @param address the I2C address to use, optional, defaults to 0x02
+ * @param address the I2C address to use, optional, defaults to the one found by I2CscanPort() or 0x02
  * @return maximum measuring distance from the sensor -1 if an error occurred
  */
 int MSDISTreadMaxDist(tSensors link, ubyte address) {
-  memset(MSDIST_I2CRequest, 0, sizeof(tByteArray));
-
-  MSDIST_I2CRequest.arr[0] = 2;               // Number of bytes in I2C command
-  MSDIST_I2CRequest.arr[1] = address;         // I2C address of sensor
-  MSDIST_I2CRequest.arr[2] = MSDIST_MAXDIST;     // Set write address to sensor mode register
-
-  if (!writeI2C(link, MSDIST_I2CRequest, 2))
-    return -1;
+  if (address == 0)
+    address = I2CbindAddress(link, I2C_DEV_MSDIST, MSDIST_I2C_ADDR);
 
-  if (!readI2C(link, MSDIST_I2CReply, 2))
+  if (!I2CreadRegisters(link, I2C_DESC(address, MSDIST_MAXDIST), MSDIST_I2CReply, 2))
     return -1;
 
   // Each result is made up of two bytes.
@@ -175,20 +158,14 @@ int MSDISTreadMaxDist(tSensors link, ubyte address) {
 /**
  * Read Sharp IR module type from the sensor
  * @param link the sensor port number
- * @param address the I2C address to use, optional, defaults to 0x02
+ * @param address the I2C address to use, optional, defaults to the one found by I2CscanPort() or 0x02
  * @return Sharp IR module type from the sensor -1 if an error occurred
  */
 int MSDISTreadModuleType(tSensors link, ubyte address) {
-  memset(MSDIST_I2CRequest, 0, sizeof(tByteArray));
-
-  MSDIST_I2CRequest.arr[0] = 2;               // Number of bytes in I2C command
-  MSDIST_I2CRequest.arr[1] = address;         // I2C address of sensor
-  MSDIST_I2CRequest.arr[2] = MSDIST_MOD_TYPE; // Set write address to sensor mode register
+  if (address == 0)
+    address = I2CbindAddress(link, I2C_DEV_MSDIST, MSDIST_I2C_ADDR);
 
-  if (!writeI2C(link, MSDIST_I2CRequest, 1))
-    return -1;
-
-  if (!readI2C(link, MSDIST_I2CReply, 1))
+  if (!I2CreadRegisters(link, I2C_DESC(address, MSDIST_MOD_TYPE), MSDIST_I2CReply, 1))
     return -1;
 
   return 0x00FF & MSDIST_I2CReply.arr[0];
@@ -199,10 +176,13 @@ int MSDISTreadModuleType(tSensors link, ubyte address) {
  * Send a command to the sensor
  * @param link the sensor port number
  * @param command the command to be sent
- * @param address the I2C address to use, optional, defaults to 0x02
+ * @param address the I2C address to use, optional, defaults to the one found by I2CscanPort() or 0x02
  * @return true if no error occured, false if it did
  */
 bool MSDISTsendCmd(tSensors link, byte command, ubyte address) {
+  if (address == 0)
+    address = I2CbindAddress(link, I2C_DEV_MSDIST, MSDIST_I2C_ADDR);
+
   memset(MSDIST_I2CRequest, 0, sizeof(tByteArray));
 
   MSDIST_I2CRequest.arr[0] = 3;               // Number of bytes in I2C command
@@ -18,6 +18,8 @@
  * - 0.1: Initial release
  * - 0.2: Allow I2C address to be specified as an optional argument\n
  *        Added prototypes
+ * - 0.3: Devices found by I2CscanPort() are used when no address is given
+ * - 0.4: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * Credits:
  * - Big thanks to Mindsensors for providing me with the hardware necessary to write and test this.
@@ -27,7 +29,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 18 December 2010
- * \version 0.2
+ * \version 0.4
  * \example MSHID-test1.c
  */
 
@@ -60,21 +62,28 @@
 #define MSHID_MOD_RALT    0x40
 #define MSHID_MOD_RGUI    0x80
 
-bool MSHIDsendCommand(tSensors link, byte command, ubyte address = MSHID_I2C_ADDR);
-bool MSHIDsendKeyboardData(tSensors link, byte modifier, byte keybdata, ubyte address = MSHID_I2C_ADDR);
-bool MSHIDsendString(tSensors link, string data, ubyte address = MSHID_I2C_ADDR);
+bool MSHIDsendCommand(tSensors link, byte command, ubyte address = 0);
+bool MSHIDsendKeyboardData(tSensors link, byte modifier, byte keybdata, ubyte address = 0);
+bool MSHIDsendString(tSensors link, string data, ubyte address = 0);
 
-tByteArray MSHID_I2CRequest;       /*!< Array to hold I2C command data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define MSHID_I2CRequest     I2CArenaRequest
+#else
+tByteArray MSHID_I2CRequest;          /*!< Array to hold I2C command data */
+#endif // __COMMON_H_I2C_ARENA__
 
 
 /**
  * Send a direct command to the HID sensor
  * @param link the HID port number
  * @param command the command to be sent
- * @param address the I2C address to use, optional, defaults to 0x04
+ * @param address the I2C address to use, optional, defaults to the one found by I2CscanPort() or 0x04
  * @return true if no error occured, false if it did
  */
 bool MSHIDsendCommand(tSensors link, byte command, ubyte address) {
+  if (address == 0)
+    address = I2CbindAddress(link, I2C_DEV_MSHID, MSHID_I2C_ADDR);
+
   memset(MSHID_I2CRequest, 0, sizeof(tByteArray));
   MSHID_I2CRequest.arr[0] = 3;
   MSHID_I2CRequest.arr[1] = address;
@@ -91,10 +100,13 @@ bool MSHIDsendCommand(tSensors link, byte command, ubyte address) {
  * @param link the HID port number
  * @param modifier the keyboard modifier, like shift, control. Can be OR'd together.
  * @param keybdata the keystroke to be sent to the computer
- * @param address the I2C address to use, optional, defaults to 0x04
+ * @param address the I2C address to use, optional, defaults to the one found by I2CscanPort() or 0x04
  * @return true if no error occured, false if it did
  */
 bool MSHIDsendKeyboardData(tSensors link, byte modifier, byte keybdata, ubyte address) {
+  if (address == 0)
+    address = I2CbindAddress(link, I2C_DEV_MSHID, MSHID_I2C_ADDR);
+
   memset(MSHID_I2CRequest, 0, sizeof(tByteArray));
   MSHID_I2CRequest.arr[0] = 4;
   MSHID_I2CRequest.arr[1] = address;
@@ -116,10 +128,13 @@ bool MSHIDsendKeyboardData(tSensors link, byte modifier, byte keybdata, ubyte ad
  * - \": double quote
  * @param link the HID port number
  * @param data the string to be transmitted
- * @param address the I2C address to use, optional, defaults to 0x04
+ * @param address the I2C address to use, optional, defaults to the one found by I2CscanPort() or 0x04
  * @return true if no error occured, false if it did
  */
 bool MSHIDsendString(tSensors link, string data, ubyte address) {
+  if (address == 0)
+    address = I2CbindAddress(link, I2C_DEV_MSHID, MSHID_I2C_ADDR);
+
   byte buffer[19];
   int len = strlen(data);
   if (len < 20) {
@@ -132,23 +147,23 @@ bool MSHIDsendString(tSensors link, string data, ubyte address) {
 		if (buffer[i] == 0x5C && i < (len - 1)) {
 		  switch (buffer[i+1]) {
         case 'r':
-					if (!MSHIDsendKeyboardData(link, MSHID_MOD_NONE, 0x0A))
+					if (!MSHIDsendKeyboardData(link, MSHID_MOD_NONE, 0x0A, address))
 					  return false;
 					break;
         case 'n':
-					if (!MSHIDsendKeyboardData(link, MSHID_MOD_NONE, 0x0D))
+					if (!MSHIDsendKeyboardData(link, MSHID_MOD_NONE, 0x0D, address))
 					  return false;
 					break;
 				case 't':
-					if (!MSHIDsendKeyboardData(link, MSHID_MOD_NONE, 0x09))
+					if (!MSHIDsendKeyboardData(link, MSHID_MOD_NONE, 0x09, address))
 					  return false;
 					break;
 				case 0x5C:
-					if (!MSHIDsendKeyboardData(link, MSHID_MOD_NONE, 0x5C))
+					if (!MSHIDsendKeyboardData(link, MSHID_MOD_NONE, 0x5C, address))
 					  return false;
 					break;
 				case 0x22:
-					if (!MSHIDsendKeyboardData(link, MSHID_MOD_NONE, 0x22))
+					if (!MSHIDsendKeyboardData(link, MSHID_MOD_NONE, 0x22, address))
 					  return false;
 					break;
         default:
@@ -156,10 +171,10 @@ bool MSHIDsendString(tSensors link, string data, ubyte address) {
 			}
 			i++;
 		} else {
-			if (!MSHIDsendKeyboardData(link, MSHID_MOD_NONE, buffer[i]))
+			if (!MSHIDsendKeyboardData(link, MSHID_MOD_NONE, buffer[i], address))
 			  return false;
 	  }
-		if (!MSHIDsendCommand(link, MSHID_XMIT))
+		if (!MSHIDsendCommand(link, MSHID_XMIT, address))
 		  return false;
     wait1Msec(50);
   }
@@ -27,6 +27,8 @@
  *       all direct I2C calls changed to readI2C() and writeI2C() calls.
  *  - 0.5 Bug in LLreadSteering fixed
  *  - 0.6 Added LLreadSensorUncalibrated
+ *  - 0.7 Register reads use I2CreadRegisters() instead of building the request every time<br>
+ *       Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * License: You may use this code as you wish, provided you give credit where it's due.
  *
@@ -34,7 +36,7 @@
  * \author Thom Roach
  * \author Xander Soldaat (version 0.4+)
  * \date 29 October 2009
- * \version 0.6
+ * \version 0.7
  * \example MSLL-test2.c
  * \example MSLL-test3.c
  * \example MSLL-test4.c
@@ -68,8 +70,13 @@
 #define LL_BLACK_LIMIT		0X59  /*!< byte array (8) with raw value of black calibration for each sensor */
 #define LL_SENSOR_UNCAL   0x74  /*!< byte array (16) with uncalibrated sensor data */
 
-tByteArray LL_I2CRequest;       /*!< Array to hold I2C command data */
-tByteArray LL_I2CReply;         /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define LL_I2CRequest        I2CArenaRequest
+#define LL_I2CReply          I2CArenaReply
+#else
+tByteArray LL_I2CRequest;          /*!< Array to hold I2C command data */
+tByteArray LL_I2CReply;            /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
 byte oneByte;
 
 //*******************************************************************************
@@ -185,15 +192,7 @@ bool _lineLeader_write(tSensors link, byte regToWrite, byte data) {
  * @return true if no error occured, false if it did
  */
 bool _lineLeader_read(tSensors link, byte regToRead, byte &retval) {
-	memset(LL_I2CRequest, 0, sizeof(LL_I2CRequest));
-	LL_I2CRequest.arr[0] =  2;
-	LL_I2CRequest.arr[1] =  LL_I2C_ADDR;
-	LL_I2CRequest.arr[2] =  regToRead;
-
-  if (!writeI2C(link, LL_I2CRequest, 1))
-    return false;
-
-  if (!readI2C(link, LL_I2CReply, 1))
+  if (!I2CreadRegisters(link, I2C_DESC(LL_I2C_ADDR, regToRead), LL_I2CReply, 1))
     return false;
 
   retval = ubyteToInt(LL_I2CReply.arr[0]);
@@ -212,23 +211,10 @@ bool _lineLeader_read(tSensors link, byte regToRead, byte &retval) {
  * @return true if no error occured, false if it did
  */
 bool _lineLeader_read(tSensors link, byte regToRead, int numBytes, tByteArray &pDataMsg) {
-	memset(LL_I2CRequest, 0, sizeof(tByteArray));
 	memset(pDataMsg, 0, sizeof(tByteArray));
 
-	LL_I2CRequest.arr[0] =  2;
-	LL_I2CRequest.arr[1] =  LL_I2C_ADDR;
-	LL_I2CRequest.arr[2] =  regToRead;
-
-
-  if (!writeI2C(link, LL_I2CRequest, numBytes))
-    return false;
-
-  if (!readI2C(link, LL_I2CReply, numBytes))
-    return false;
-
-  // copy the result into the array to be returned.
-  memcpy(pDataMsg, LL_I2CReply, sizeof(tByteArray));
-  return true;
+  // read straight into the array to be returned.
+  return I2CreadRegisters(link, I2C_DESC(LL_I2C_ADDR, regToRead), pDataMsg, numBytes);
 }
 
 
@@ -240,7 +226,7 @@ bool _lineLeader_read(tSensors link, byte regToRead, int numBytes, tByteArray &p
  */
 bool LLinit(tSensors link) {
 	nI2CBytesReady[link] = 0;
-	SensorType[link] = sensorI2CCustom9V;
+	I2CconfigurePort(link, sensorI2CCustom9V);
 	if (!LLwakeUp(link))
 	  return false;
 	if (!LLresetLineColor(link))
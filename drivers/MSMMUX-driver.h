@@ -18,6 +18,15 @@
  *
  * Changelog:
  * - 0.1: Initial release
+ * - 0.2: Tacho counts and status of both motors are read in one snapshot each
+ * - 0.3: Register reads use I2CreadRegisters() instead of building the request every time
+ * - 0.4: Sensor port is flagged as an MMUX in the I2C port registry
+ * - 0.5: Fixed MSMotorStop() referring to an undefined MSMMUX port
+ * - 0.6: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined<br>
+ *        mmuxData is declared here instead of in common.h
+ * - 0.7: MSMMotorGroup() and MSMMotorGroupStop() start and stop both motors with one command
+ * - 0.8: Repeated motor commands are left out and power changes only write the speed when __COMMON_H_MMUX_SHADOW__ is defined
+ * - 0.9: MSMMotorPair() sets the speed of both motors with a single write
  *
  * Credits:
  * - Big thanks to Mindsensors for providing me with the hardware necessary to write and test this.
@@ -27,7 +36,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 05 April 2010
- * \version 0.1
+ * \version 0.9
  * \example MSMMUX-test1.c
  */
 
@@ -105,8 +114,19 @@
 #define MSMMUX_ROT_SECONDS      0x03  /*!< Use time target to control motor (ie run for X seconds) */
 
 
-tByteArray MSMMUX_I2CRequest;    /*!< Array to hold I2C command data */
-tByteArray MSMMUX_I2CReply;      /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define MSMMUX_I2CRequest    I2CArenaRequest
+#define MSMMUX_I2CReply      I2CArenaReply
+#else
+tByteArray MSMMUX_I2CRequest;       /*!< Array to hold I2C command data */
+tByteArray MSMMUX_I2CReply;         /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
+#ifndef __MMUX_DATA__
+#define __MMUX_DATA__
+mmuxDataT mmuxData[4];  /*!< Holds all the MMUX info, one for each sensor port */
+#endif // __MMUX_DATA__
+tI2CSnapshot MSMMUX_TachoSnapshot[4];   /*!< Cached tacho counts of both motors */
+tI2CSnapshot MSMMUX_StatusSnapshot[4];  /*!< Cached status of both motors */
 
 // Function prototypes
 void MSMMUXinit();
@@ -115,6 +135,12 @@ bool MSMMUXsendCommand(tSensors link, ubyte channel, long setpoint, byte speed,
 bool MSMMUXsendCommand(tSensors link, ubyte command);
 bool MSMMUXsetPID(tSensors link, int kpTacho, int kiTacho, int kdTacho, int kpSpeed, int kiSpeed, int kdSpeed, ubyte passCount, ubyte tolerance);
 bool MSMMotor(tMUXmotor muxmotor, byte power);
+bool MSMMotorGroup(tSensors link, byte power1, byte power2);
+bool MSMMotorPair(tSensors link, byte power1, byte power2);
+bool MSMMotorGroupStop(tSensors link);
+bool MSMMotorGroupStop(tSensors link, bool brake);
+ubyte _MSMMUXbuildCommand(tMUXmotor muxmotor);
+bool _MSMMUXstageMotor(tMUXmotor muxmotor, byte power, ubyte commandA);
 bool MSMotorStop(tMUXmotor muxmotor);
 bool MSMotorStop(tMUXmotor muxmotor, bool brake);
 void MSMMotorSetRotationTarget(tMUXmotor muxmotor, long target);
@@ -143,6 +169,9 @@ void MSMMUXinit(){
     memset(mmuxData[i].target[0], 0, 4*4);
     memset(mmuxData[i].ramping[0], MSMMUX_RAMP_NONE, 4);
     memset(mmuxData[i].targetUnit[0], MSMMUX_ROT_UNLIMITED, 4);
+#ifdef __COMMON_H_MMUX_SHADOW__
+    MMUXinvalidateShadow(mmuxData[i]);
+#endif // __COMMON_H_MMUX_SHADOW__
     mmuxData[i].initialised = true;
   }
 }
@@ -156,24 +185,11 @@ void MSMMUXinit(){
  * @return true if no error occured, false if it did
  */
 bool MSMMUXreadStatus(tMUXmotor muxmotor, ubyte &motorStatus) {
-
-  memset(MSMMUX_I2CRequest, 0, sizeof(tByteArray));
-
-  MSMMUX_I2CRequest.arr[0] = 2;               // Message size
-  MSMMUX_I2CRequest.arr[1] = MSMMUX_I2C_ADDR; // I2C Address
-
-  switch ((byte)MPORT(muxmotor)) {
-    case 0: MSMMUX_I2CRequest.arr[2] = MSMMUX_STATUS_MOT1; break;
-    case 1: MSMMUX_I2CRequest.arr[2] = MSMMUX_STATUS_MOT2; break;
-  }
-
-  if (!writeI2C((tSensors)SPORT(muxmotor), MSMMUX_I2CRequest, 1))
+  // Both status registers are read in one go
+  if (!I2CreadSnapshot((tSensors)SPORT(muxmotor), MSMMUX_StatusSnapshot[SPORT(muxmotor)], MSMMUX_I2C_ADDR, MSMMUX_STATUS_MOT1, 2))
     return false;
 
-  if (!readI2C((tSensors)SPORT(muxmotor), MSMMUX_I2CReply, 1))
-    return false;
-
-  motorStatus = MSMMUX_I2CReply.arr[0];
+  motorStatus = MSMMUX_StatusSnapshot[SPORT(muxmotor)].data.arr[MPORT(muxmotor)];
 
   return true;
 }
@@ -206,12 +222,41 @@ bool MSMMUXsendCommand(tSensors link, ubyte channel, long setpoint, byte speed,
   MSMMUX_I2CRequest.arr[9] = 0;
   MSMMUX_I2CRequest.arr[10] = commandA;
 
+  I2CinvalidateSnapshot(MSMMUX_TachoSnapshot[link]);
+  I2CinvalidateSnapshot(MSMMUX_StatusSnapshot[link]);
+
   // make sure the targetUnit is reset for the next time
   mmuxData[link].targetUnit[channel] = MSMMUX_ROT_UNLIMITED;
 
   // send the command to the mmux
-  return writeI2C(link, MSMMUX_I2CRequest, 0);
+  I2CsetPortMux(link, I2C_PORT_MMUX);
+
+#ifdef __COMMON_H_MMUX_SHADOW__
+  // Running without a target can be left out when nothing changed.  When only
+  // the power did, the speed is written and the command register again, the
+  // MMUX only picks up the new speed when it sees the GO bit.
+  switch (MMUXcheckShadow(mmuxData[link], channel, setpoint, speed, seconds, commandA,
+                          (commandA & (MSMMUX_CMD_GO | MSMMUX_CMD_TACHO | MSMMUX_CMD_TIME)) == MSMMUX_CMD_GO)) {
+    case MMUX_SHADOW_NONE:
+      return true;
+    case MMUX_SHADOW_POWER:
+      MSMMUX_I2CRequest.arr[0] = 6;
+      MSMMUX_I2CRequest.arr[2] = MSMMUX_MOT_OFFSET + (channel * MSMMUX_ENTRY_SIZE) + MSMMUX_POWER;
+      MSMMUX_I2CRequest.arr[3] = (speed & 0xFF);
+      MSMMUX_I2CRequest.arr[4] = seconds;
+      MSMMUX_I2CRequest.arr[5] = 0;
+      MSMMUX_I2CRequest.arr[6] = commandA;
+      break;
+  }
 
+  if (!writeI2C(link, MSMMUX_I2CRequest, 0)) {
+    MMUXinvalidateShadow(mmuxData[link], channel);
+    return false;
+  }
+  return true;
+#else
+  return writeI2C(link, MSMMUX_I2CRequest, 0);
+#endif // __COMMON_H_MMUX_SHADOW__
 }
 
 
@@ -231,6 +276,15 @@ bool MSMMUXsendCommand(tSensors link, ubyte command) {
   MSMMUX_I2CRequest.arr[2] = MSMMUX_REG_CMD;
   MSMMUX_I2CRequest.arr[3] = command;
 
+  I2CinvalidateSnapshot(MSMMUX_TachoSnapshot[link]);
+  I2CinvalidateSnapshot(MSMMUX_StatusSnapshot[link]);
+#ifdef __COMMON_H_MMUX_SHADOW__
+  // Stops, resets and START_BOTH leave the motors in a state the shadow doesn't know about
+  MMUXinvalidateShadow(mmuxData[link]);
+#endif // __COMMON_H_MMUX_SHADOW__
+
+  I2CsetPortMux(link, I2C_PORT_MMUX);
+
   return writeI2C(link, MSMMUX_I2CRequest, 0);
 }
 
@@ -282,13 +336,14 @@ bool MSMMUXsetPID(tSensors link, int kpTacho, int kiTacho, int kdTacho, int kpSp
 
 
 /**
- * Run motor with specified speed.
+ * Work out command register A for a motor from its settings in mmuxData.
+ * The GO bit is left out.
  *
+ * Note: this is an internal function and shouldn't be used directly
  * @param muxmotor the motor-MUX motor
- * @param power power the amount of power to apply to the motor, value between -100 and +100
- * @return true if no error occured, false if it did
+ * @return the value for command register A
  */
-bool MSMMotor(tMUXmotor muxmotor, byte power) {
+ubyte _MSMMUXbuildCommand(tMUXmotor muxmotor) {
   ubyte commandA = 0;
   commandA += (mmuxData[SPORT(muxmotor)].pidcontrol[MPORT(muxmotor)]) ? MSMMUX_CMD_SPEED : 0;
   commandA += (mmuxData[SPORT(muxmotor)].ramping[MPORT(muxmotor)] != MSMMUX_RAMP_NONE) ? MSMMUX_CMD_RAMP : 0;
@@ -296,8 +351,21 @@ bool MSMMotor(tMUXmotor muxmotor, byte power) {
   commandA += (mmuxData[SPORT(muxmotor)].targetUnit[MPORT(muxmotor)] == MSMMUX_ROT_DEGREES) ? MSMMUX_CMD_TACHO : 0;
   commandA += (mmuxData[SPORT(muxmotor)].targetUnit[MPORT(muxmotor)] == MSMMUX_ROT_SECONDS) ? MSMMUX_CMD_TIME : 0;
   commandA += (mmuxData[SPORT(muxmotor)].relTarget[MPORT(muxmotor)]) ? MSMMUX_CMD_RELATIVE : 0;
-  commandA += MSMMUX_CMD_GO;
+  return commandA;
+}
 
+
+/**
+ * Write the setpoint, speed and command registers of a motor, using the
+ * target set with MSMMotorSetRotationTarget() and friends.
+ *
+ * Note: this is an internal function and shouldn't be used directly
+ * @param muxmotor the motor-MUX motor
+ * @param power power the amount of power to apply to the motor, value between -100 and +100
+ * @param commandA the command to be sent to the motor
+ * @return true if no error occured, false if it did
+ */
+bool _MSMMUXstageMotor(tMUXmotor muxmotor, byte power, ubyte commandA) {
   switch (mmuxData[SPORT(muxmotor)].targetUnit[MPORT(muxmotor)]) {
     case MSMMUX_ROT_UNLIMITED: return MSMMUXsendCommand((tSensors)SPORT(muxmotor), (ubyte)MPORT(muxmotor), 0, power, 0, commandA);
     case MSMMUX_ROT_DEGREES:   return MSMMUXsendCommand((tSensors)SPORT(muxmotor), (ubyte)MPORT(muxmotor), mmuxData[SPORT(muxmotor)].target[MPORT(muxmotor)], power, 0, commandA);
@@ -307,6 +375,120 @@ bool MSMMotor(tMUXmotor muxmotor, byte power) {
 }
 
 
+/**
+ * Run motor with specified speed.
+ *
+ * @param muxmotor the motor-MUX motor
+ * @param power power the amount of power to apply to the motor, value between -100 and +100
+ * @return true if no error occured, false if it did
+ */
+bool MSMMotor(tMUXmotor muxmotor, byte power) {
+  return _MSMMUXstageMotor(muxmotor, power, _MSMMUXbuildCommand(muxmotor) + MSMMUX_CMD_GO);
+}
+
+
+/**
+ * Run both motors of an MMUX at the same time.  The registers of both motors
+ * are written without the GO bit, then a single START_BOTH command sets them
+ * off together, so there's no skew between the two, unlike calling MSMMotor()
+ * twice.  Targets, ramping and braking are taken from each motor's settings,
+ * as with MSMMotor().
+ *
+ * @param link the MMUX port number
+ * @param power1 power to apply to motor 1, value between -100 and +100
+ * @param power2 power to apply to motor 2, value between -100 and +100
+ * @return true if no error occured, false if it did
+ */
+bool MSMMotorGroup(tSensors link, byte power1, byte power2) {
+  tMUXmotor motor1 = (tMUXmotor)(link * 4);
+  tMUXmotor motor2 = (tMUXmotor)(link * 4 + 1);
+
+  if (!_MSMMUXstageMotor(motor1, power1, _MSMMUXbuildCommand(motor1)))
+    return false;
+
+  if (!_MSMMUXstageMotor(motor2, power2, _MSMMUXbuildCommand(motor2)))
+    return false;
+
+  return MSMMUXsendCommand(link, MSMMUX_CMD_START_BOTH);
+}
+
+
+/**
+ * Run both motors of an MMUX at the specified speeds with a single write.
+ * The registers of the two motors follow each other, so the speed and command
+ * of motor 1 and all of motor 2 fit in one message.  This only works for
+ * motors without a target, if either has one, MSMMotorGroup() is used.
+ *
+ * @param link the MMUX port number
+ * @param power1 power to apply to motor 1, value between -100 and +100
+ * @param power2 power to apply to motor 2, value between -100 and +100
+ * @return true if no error occured, false if it did
+ */
+bool MSMMotorPair(tSensors link, byte power1, byte power2) {
+  ubyte commandA1 = _MSMMUXbuildCommand((tMUXmotor)(link * 4)) + MSMMUX_CMD_GO;
+  ubyte commandA2 = _MSMMUXbuildCommand((tMUXmotor)(link * 4 + 1)) + MSMMUX_CMD_GO;
+
+  if ((mmuxData[link].targetUnit[0] != MSMMUX_ROT_UNLIMITED) || (mmuxData[link].targetUnit[1] != MSMMUX_ROT_UNLIMITED))
+    return MSMMotorGroup(link, power1, power2);
+
+  memset(MSMMUX_I2CRequest, 0, sizeof(tByteArray));
+
+  MSMMUX_I2CRequest.arr[0] = 14;              // Message size
+  MSMMUX_I2CRequest.arr[1] = MSMMUX_I2C_ADDR; // I2C Address
+  MSMMUX_I2CRequest.arr[2] = MSMMUX_MOT_OFFSET + MSMMUX_POWER;
+  MSMMUX_I2CRequest.arr[3] = (power1 & 0xFF);
+  MSMMUX_I2CRequest.arr[6] = commandA1;
+  MSMMUX_I2CRequest.arr[11] = (power2 & 0xFF);
+  MSMMUX_I2CRequest.arr[14] = commandA2;
+
+  I2CinvalidateSnapshot(MSMMUX_TachoSnapshot[link]);
+  I2CinvalidateSnapshot(MSMMUX_StatusSnapshot[link]);
+
+  I2CsetPortMux(link, I2C_PORT_MMUX);
+
+#ifdef __COMMON_H_MMUX_SHADOW__
+  // Both shadows have to be brought up to date, so don't let || skip the second one
+  bool same1 = MMUXcheckShadow(mmuxData[link], 0, 0, power1, 0, commandA1, true) == MMUX_SHADOW_NONE;
+  bool same2 = MMUXcheckShadow(mmuxData[link], 1, 0, power2, 0, commandA2, true) == MMUX_SHADOW_NONE;
+  if (same1 && same2)
+    return true;
+
+  if (!writeI2C(link, MSMMUX_I2CRequest, 0)) {
+    MMUXinvalidateShadow(mmuxData[link]);
+    return false;
+  }
+  return true;
+#else
+  return writeI2C(link, MSMMUX_I2CRequest, 0);
+#endif // __COMMON_H_MMUX_SHADOW__
+}
+
+
+/**
+ * Stop both motors of an MMUX at the same time.  Uses the brake method
+ * specified for motor 1 with MSMMotorSetBrake or MSMMotorSetFloat.
+ *
+ * @param link the MMUX port number
+ * @return true if no error occured, false if it did
+ */
+bool MSMMotorGroupStop(tSensors link) {
+  return MSMMotorGroupStop(link, mmuxData[link].brake[0]);
+}
+
+
+/**
+ * Stop both motors of an MMUX at the same time. This function overrides the
+ * preconfigured braking method.
+ *
+ * @param link the MMUX port number
+ * @param brake when set to true: use brake, false: use float
+ * @return true if no error occured, false if it did
+ */
+bool MSMMotorGroupStop(tSensors link, bool brake) {
+  return MSMMUXsendCommand(link, brake ? MSMMUX_CMD_BRAKE_BOTH : MSMMUX_CMD_FLOAT_BOTH);
+}
+
+
 /**
  * Stop the motor. Uses the brake method specified with MSMMotorSetBrake or MSMMotorSetFloat.
  * The default is to use braking.
@@ -332,9 +514,9 @@ bool MSMotorStop(tMUXmotor muxmotor) {
  */
 bool MSMotorStop(tMUXmotor muxmotor, bool brake) {
   if (MPORT(muxmotor) == 0)
-    return MSMMUXsendCommand(MSMMUX, brake ? MSMMUX_CMD_BRAKE_MOT1 : MSMMUX_CMD_FLOAT_MOT1);
+    return MSMMUXsendCommand((tSensors)SPORT(muxmotor), brake ? MSMMUX_CMD_BRAKE_MOT1 : MSMMUX_CMD_FLOAT_MOT1);
   else if (MPORT(muxmotor) == 1)
-    return MSMMUXsendCommand(MSMMUX, brake ? MSMMUX_CMD_BRAKE_MOT2 : MSMMUX_CMD_FLOAT_MOT2);
+    return MSMMUXsendCommand((tSensors)SPORT(muxmotor), brake ? MSMMUX_CMD_BRAKE_MOT2 : MSMMUX_CMD_FLOAT_MOT2);
   return true;
 }
 
@@ -403,24 +585,13 @@ void MSMMotorSetEncoderTarget(tMUXmotor muxmotor, long target, bool relative) {
  */
 long MSMMotorEncoder(tMUXmotor muxmotor) {
   long result;
+  int i = MPORT(muxmotor) * 4;
 
-  memset(MSMMUX_I2CRequest, 0, sizeof(tByteArray));
-
-  MSMMUX_I2CRequest.arr[0] = 2;               // Message size
-  MSMMUX_I2CRequest.arr[1] = MSMMUX_I2C_ADDR; // I2C Address
-
-  switch ((byte)MPORT(muxmotor)) {
-    case 0: MSMMUX_I2CRequest.arr[2] = MSMMUX_TACHO_MOT1; break;
-    case 1: MSMMUX_I2CRequest.arr[2] = MSMMUX_TACHO_MOT2; break;
-  }
-
-  if (!writeI2C((tSensors)SPORT(muxmotor), MSMMUX_I2CRequest, 4))
-    return 0;
-
-  if (!readI2C((tSensors)SPORT(muxmotor), MSMMUX_I2CReply, 4))
+  // Both tacho counts are read in one go
+  if (!I2CreadSnapshot((tSensors)SPORT(muxmotor), MSMMUX_TachoSnapshot[SPORT(muxmotor)], MSMMUX_I2C_ADDR, MSMMUX_TACHO_MOT1, 8))
     return 0;
 
-  result = MSMMUX_I2CReply.arr[0] + (MSMMUX_I2CReply.arr[1]<<8) + (MSMMUX_I2CReply.arr[2]<<16) + (MSMMUX_I2CReply.arr[3]<<24);
+  result = MSMMUX_TachoSnapshot[SPORT(muxmotor)].data.arr[i] + (MSMMUX_TachoSnapshot[SPORT(muxmotor)].data.arr[i + 1]<<8) + (MSMMUX_TachoSnapshot[SPORT(muxmotor)].data.arr[i + 2]<<16) + (MSMMUX_TachoSnapshot[SPORT(muxmotor)].data.arr[i + 3]<<24);
 
   return result;
 }
@@ -470,16 +641,7 @@ bool MSMMotorBusy(tMUXmotor muxmotor) {
   ubyte commandA = 0;
 
   // Fetch the last sent commandA
-  memset(MSMMUX_I2CRequest, 0, sizeof(tByteArray));
-
-  MSMMUX_I2CRequest.arr[0] = 2;               // Message size
-  MSMMUX_I2CRequest.arr[1] = MSMMUX_I2C_ADDR; // I2C Address
-  MSMMUX_I2CRequest.arr[2] = MSMMUX_MOT_OFFSET + (MPORT(muxmotor) * MSMMUX_ENTRY_SIZE) + MSMMUX_CMD_A;
-
-  if (!writeI2C((tSensors)SPORT(muxmotor), MSMMUX_I2CRequest, 1))
-    return false;
-
-  if (!readI2C((tSensors)SPORT(muxmotor), MSMMUX_I2CReply, 1))
+  if (!I2CreadRegisters((tSensors)SPORT(muxmotor), I2C_DESC(MSMMUX_I2C_ADDR, MSMMUX_MOT_OFFSET + (MPORT(muxmotor) * MSMMUX_ENTRY_SIZE) + MSMMUX_CMD_A), MSMMUX_I2CReply, 1))
     return false;
 
   commandA = MSMMUX_I2CReply.arr[0];
@@ -18,6 +18,8 @@
  *
  * Changelog:
  * - 0.1: Initial release
+ * - 0.2: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
+ * - 0.3: Removed an unused variable from MSNPscanKeys()
  *
  * Credits:
  * - Big thanks to Mindsensors for providing me with the hardware necessary to write and test this.
@@ -27,7 +29,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 30 October 2010
- * \version 0.1
+ * \version 0.3
  * \example MSNP-test1.c
  */
 
@@ -40,8 +42,13 @@
 #define MSNP_I2C_ADDR  0xB4     /*!< Numeric Pad I2C device address */
 #define MSNP_DATA_REG  0x00     /*!< Data registers start at 0x00 */
 
-tByteArray MSNP_I2CRequest;     /*!< Array to hold I2C command data */
-tByteArray MSNP_I2CReply;       /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define MSNP_I2CRequest      I2CArenaRequest
+#define MSNP_I2CReply        I2CArenaReply
+#else
+tByteArray MSNP_I2CRequest;        /*!< Array to hold I2C command data */
+tByteArray MSNP_I2CReply;          /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
 
 
 #define KEY_STATUS_REG 0x00
@@ -106,8 +113,6 @@ bool _MSNPinit(tSensors link) {
  * @return true if no error occured, false if it did
  */
 bool MSNPscanKeys(tSensors link, int &pressedKeys, unsigned byte &key, int &number) {
-  int keyPress = 0;
-
   if (!_MSNPinitialised[link]) {
     _MSNPinit(link);
     _MSNPinitialised[link] = true;
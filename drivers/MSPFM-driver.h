@@ -16,6 +16,7 @@
  *
  * Changelog:
  * - 0.1: Initial release
+ * - 0.2: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * Credits:
  * - Big thanks to Mindsensors for providing me with the hardware necessary to write and test this.
@@ -25,7 +26,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 22 July 2009
- * \version 0.1
+ * \version 0.2
  * \example MSPFM-test1.c
  */
 
@@ -58,7 +59,11 @@
 #define MSPFM_REVERSE     0x02
 #define MSPFM_BRAKE       0x03
 
-tByteArray MSPFM_I2CRequest;       /*!< Array to hold I2C command data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define MSPFM_I2CRequest     I2CArenaRequest
+#else
+tByteArray MSPFM_I2CRequest;          /*!< Array to hold I2C command data */
+#endif // __COMMON_H_I2C_ARENA__
 
 
 /**
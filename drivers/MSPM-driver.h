@@ -19,6 +19,8 @@
  *
  * Changelog:
  *  - 0.1 Initial	release.
+ *  - 0.2 Register reads use I2CreadRegisters() instead of building the request every time<br>
+ *       Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * Credits:
  * - Big thanks to Mindsensors for providing me with the hardware necessary to write and test this.
@@ -28,7 +30,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat
  * \date 16 December 2009
- * \version 0.1
+ * \version 0.2
  * \example MSPM-test1.c
  */
 
@@ -49,8 +51,13 @@
 #define MSPM_CAPUSED 			0x46  /*!< Capacity used since last reset in mAh - 2 bytes */
 #define MSPM_TIME         0x56  /*!< Time since last reset  in ms - 4 bytes (long) */
 
-tByteArray MSPM_I2CRequest;       /*!< Array to hold I2C command data */
-tByteArray MSPM_I2CReply;         /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define MSPM_I2CRequest      I2CArenaRequest
+#define MSPM_I2CReply        I2CArenaReply
+#else
+tByteArray MSPM_I2CRequest;          /*!< Array to hold I2C command data */
+tByteArray MSPM_I2CReply;            /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
 
 
 //*******************************************************************************
@@ -91,16 +98,7 @@ bool _MSPMsendCommand(tSensors link, byte command) {
  * @return the present current measured or -1 if an error occurred.
  */
 int MSPMreadCurrent(tSensors link) {
-  memset(MSPM_I2CRequest, 0, sizeof(tByteArray));
-
-  MSPM_I2CRequest.arr[0] = 2;             // Message size
-  MSPM_I2CRequest.arr[1] = MSPM_I2C_ADDR; // I2C Address
-  MSPM_I2CRequest.arr[2] = MSPM_PCURRENT; // Present current register
-
-  if (!writeI2C(link, MSPM_I2CRequest, 2))
-    return -1;
-
-  if (!readI2C(link, MSPM_I2CReply, 2))
+  if (!I2CreadRegisters(link, I2C_DESC(MSPM_I2C_ADDR, MSPM_PCURRENT), MSPM_I2CReply, 2))
     return -1;
 
   return (MSPM_I2CReply.arr[0] + (MSPM_I2CReply.arr[1]<<8));
@@ -113,16 +111,7 @@ int MSPMreadCurrent(tSensors link) {
  * @return the present voltage measured or -1 if an error occurred.
  */
 int MSPMreadVoltage(tSensors link) {
-  memset(MSPM_I2CRequest, 0, sizeof(tByteArray));
-
-  MSPM_I2CRequest.arr[0] = 2;             // Message size
-  MSPM_I2CRequest.arr[1] = MSPM_I2C_ADDR; // I2C Address
-  MSPM_I2CRequest.arr[2] = MSPM_PVOLTAGE; // Present voltage register
-
-  if (!writeI2C(link, MSPM_I2CRequest, 2))
-    return -1;
-
-  if (!readI2C(link, MSPM_I2CReply, 2))
+  if (!I2CreadRegisters(link, I2C_DESC(MSPM_I2C_ADDR, MSPM_PVOLTAGE), MSPM_I2CReply, 2))
     return -1;
 
   return (MSPM_I2CReply.arr[0] + (MSPM_I2CReply.arr[1]<<8));
@@ -138,16 +127,7 @@ int MSPMreadVoltage(tSensors link) {
  * @return the present voltage measured or -1 if an error occurred.
  */
 bool MSPMreadVoltageCurrent(tSensors link, int &voltage, int &current) {
-  memset(MSPM_I2CRequest, 0, sizeof(tByteArray));
-
-  MSPM_I2CRequest.arr[0] = 2;             // Message size
-  MSPM_I2CRequest.arr[1] = MSPM_I2C_ADDR; // I2C Address
-  MSPM_I2CRequest.arr[2] = MSPM_PCURRENT; // Present current register
-
-  if (!writeI2C(link, MSPM_I2CRequest, 4))
-    return false;
-
-  if (!readI2C(link, MSPM_I2CReply, 4))
+  if (!I2CreadRegisters(link, I2C_DESC(MSPM_I2C_ADDR, MSPM_PCURRENT), MSPM_I2CReply, 4))
     return false;
 
   current = MSPM_I2CReply.arr[0] + (MSPM_I2CReply.arr[1]<<8);
@@ -161,16 +141,7 @@ bool MSPMreadVoltageCurrent(tSensors link, int &voltage, int &current) {
  * @return the time elapsed in ms since the last reset.
  */
 long MSPMreadTime(tSensors link) {
-  memset(MSPM_I2CRequest, 0, sizeof(tByteArray));
-
-  MSPM_I2CRequest.arr[0] = 2;             // Message size
-  MSPM_I2CRequest.arr[1] = MSPM_I2C_ADDR; // I2C Address
-  MSPM_I2CRequest.arr[2] = MSPM_TIME; // Present voltage register
-
-  if (!writeI2C(link, MSPM_I2CRequest, 4))
-    return -1;
-
-  if (!readI2C(link, MSPM_I2CReply, 4))
+  if (!I2CreadRegisters(link, I2C_DESC(MSPM_I2C_ADDR, MSPM_TIME), MSPM_I2CReply, 4))
     return -1;
 
   return uByteToLong(MSPM_I2CReply.arr[3], MSPM_I2CReply.arr[2], MSPM_I2CReply.arr[1], MSPM_I2CReply.arr[0]);
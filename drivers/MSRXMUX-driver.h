@@ -16,6 +16,9 @@
  *
  * Changelog:
  * - 0.1: Initial release
+ * - 0.2: Sensor type changes go through I2CconfigurePort()
+ * - 0.3: Fixed sensorLowSpeed9V spelling and initialisation of the channel type and mode arrays
+ * - 0.4: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * Credits:
  * - Big thanks to Mindsensors for providing me with the hardware necessary to write and test this.
@@ -25,7 +28,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 30 August 2009
- * \version 0.1
+ * \version 0.4
  * \example MSRXMUX-test1.c
  */
 
@@ -45,10 +48,16 @@
 #define MSRXMUX_CHAN4     0xF7      /*!< Select MUX channel 4 */
 #define MSRXMUX_NONE      0xFF      /*!< Deselect all MUX channels */
 
-tByteArray MSRXMUX_I2CRequest;       /*!< Array to hold I2C command data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define MSRXMUX_I2CRequest   I2CArenaRequest
+#else
+tByteArray MSRXMUX_I2CRequest;          /*!< Array to hold I2C command data */
+#endif // __COMMON_H_I2C_ARENA__
 
-TSensorTypes RCXSensorTypes[4][4] = {{0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}};
-TSensorModes RCXSensorModes[4][4] = {{0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}};
+TSensorTypes RCXSensorTypes[4][4] = {{sensorNone, sensorNone, sensorNone, sensorNone}, {sensorNone, sensorNone, sensorNone, sensorNone},
+                                     {sensorNone, sensorNone, sensorNone, sensorNone}, {sensorNone, sensorNone, sensorNone, sensorNone}};
+TSensorModes RCXSensorModes[4][4] = {{modeRaw, modeRaw, modeRaw, modeRaw}, {modeRaw, modeRaw, modeRaw, modeRaw},
+                                     {modeRaw, modeRaw, modeRaw, modeRaw}, {modeRaw, modeRaw, modeRaw, modeRaw}};
 byte RCXSensorDelays[4][4] =        {{0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}};
 
 /**
@@ -72,8 +81,8 @@ void MSRXMUXsetupChan(tSensors link, byte chan, TSensorTypes chantype, TSensorMo
 }
 
 int MSRXMUXreadChan(tSensors link, byte chan) {
-  if (SensorType[link] != sensorLowSpeed9v) {
-    SensorType[link] = sensorLowSpeed9v;
+  if (SensorType[link] != sensorLowSpeed9V) {
+    I2CconfigurePort(link, sensorLowSpeed9V);
     wait1Msec(3);
   }
 
@@ -92,7 +101,7 @@ int MSRXMUXreadChan(tSensors link, byte chan) {
     return -1;
 
   wait10Msec(3+RCXSensorDelays[link][chan-1]);
-  SensorType[link] = RCXSensorTypes[link][chan-1];
+  I2CconfigurePort(link, RCXSensorTypes[link][chan-1]);
   SensorMode[link] = RCXSensorModes[link][chan-1];
   return(SensorValue(link));
 }
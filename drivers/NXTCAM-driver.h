@@ -26,6 +26,7 @@
  *        Fixed bug in NXTCAMinit() that did not configure object tracking properly<br>
  *        Added extra wait times after each issued command in init functions
  * - 1.4: Removed printDebugLine from driver
+ * - 1.5: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * License: You may use this code as you wish, provided you give credit where it's due.
  *
@@ -33,7 +34,7 @@
  * \author Xander Soldaat
  * \author Gordon Wyeth
  * \date 03 Dec 2010
- * \version 1.4
+ * \version 1.5
  * \example NXTCAM-test1.c
  */
 
@@ -64,8 +65,13 @@ typedef struct {
 /*! Array of blob as a typedef, this is a work around for RobotC's inability to pass an array to a function */
 typedef blob blob_array[MAX_BLOBS];
 
-tByteArray NXTCAM_I2CRequest;    /*!< Array to hold I2C command data */
-tByteArray NXTCAM_I2CReply;      /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define NXTCAM_I2CRequest    I2CArenaRequest
+#define NXTCAM_I2CReply      I2CArenaReply
+#else
+tByteArray NXTCAM_I2CRequest;       /*!< Array to hold I2C command data */
+tByteArray NXTCAM_I2CReply;         /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
 
 // "public" functions
 bool NXTCAMinit(tSensors link);
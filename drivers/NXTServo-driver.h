@@ -18,6 +18,8 @@
  *
  * Changelog:
  * - 0.1: Initial release
+ * - 0.2: Register reads use I2CreadRegisters() instead of building the request every time
+ * - 0.3: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * Credits:
  * - Big thanks to Mindsensors for providing me with the hardware necessary to write and test this.
@@ -27,7 +29,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 30 September 2009
- * \version 0.1
+ * \version 0.3
  * \example NXTServo-test1.c
  */
 
@@ -88,8 +90,13 @@ bool NXTServoQSetPos(tSensors link, ubyte servochan, ubyte position);
 int NXTServoReadPos(tSensors link, ubyte servochan);
 int NXTServoReadVoltage(tSensors link);
 
-tByteArray NXTSERVO_I2CRequest;         /*!< Array to hold I2C command data */
-tByteArray NXTSERVO_I2CReply;           /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define NXTSERVO_I2CRequest  I2CArenaRequest
+#define NXTSERVO_I2CReply    I2CArenaReply
+#else
+tByteArray NXTSERVO_I2CRequest;            /*!< Array to hold I2C command data */
+tByteArray NXTSERVO_I2CReply;              /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
 
 
 /**
@@ -204,16 +211,7 @@ bool NXTServoQSetPos(tSensors link, ubyte servochan, ubyte position) {
 int NXTServoReadPos(tSensors link, ubyte servochan) {
   int position = 0;
 
-  memset(NXTSERVO_I2CRequest, 0, sizeof(tByteArray));
-
-  NXTSERVO_I2CRequest.arr[0] = 2;                 // Message size
-  NXTSERVO_I2CRequest.arr[1] = NXTSERVO_I2C_ADDR; // I2C Address
-  NXTSERVO_I2CRequest.arr[2] = NXTSERVO_POS_CHAN1 + ((servochan - 1) * 2);
-
-  if (!writeI2C(link, NXTSERVO_I2CRequest, 2))
-    return false;
-
-  if (!readI2C(link, NXTSERVO_I2CReply, 2))
+  if (!I2CreadRegisters(link, I2C_DESC(NXTSERVO_I2C_ADDR, NXTSERVO_POS_CHAN1 + ((servochan - 1) * 2)), NXTSERVO_I2CReply, 2))
     return false;
 
   position = NXTSERVO_I2CReply.arr[1] * 256 + NXTSERVO_I2CReply.arr[0];
@@ -230,16 +228,7 @@ int NXTServoReadPos(tSensors link, ubyte servochan) {
 int NXTServoReadVoltage(tSensors link) {
   long mvs = 0;
 
-  memset(NXTSERVO_I2CRequest, 0, sizeof(tByteArray));
-
-  NXTSERVO_I2CRequest.arr[0] = 2;                 // Message size
-  NXTSERVO_I2CRequest.arr[1] = NXTSERVO_I2C_ADDR; // I2C Address
-  NXTSERVO_I2CRequest.arr[2] = NXTSERVO_CMD;      // Start red sensor value
-
-  if (!writeI2C(link, NXTSERVO_I2CRequest, 1))
-    return -1;
-
-  if (!readI2C(link, NXTSERVO_I2CReply, 1))
+  if (!I2CreadRegisters(link, I2C_DESC(NXTSERVO_I2C_ADDR, NXTSERVO_CMD), NXTSERVO_I2CReply, 1))
     return -1;
 
   mvs = ((long)ubyteToInt(NXTSERVO_I2CReply.arr[0]) * 3886) / 100;
@@ -18,6 +18,7 @@
  *
  * Changelog:
  * - 0.1: Initial release
+ * - 0.2: Request and reply buffers come from the shared arena when __COMMON_H_I2C_ARENA__ is defined
  *
  * Credits:
  * - Big thanks to Mindsensors for providing me with the hardware necessary to write and test this.
@@ -27,7 +28,7 @@
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 30 March 2010
- * \version 0.1
+ * \version 0.2
  * \example PCF8574-test1.c
  */
 
@@ -40,8 +41,13 @@
 #define PCF8574_I2C_ADDR         0x70  /*!< HDMMUX I2C device address */
 
 
-tByteArray PCF8574_I2CRequest;    /*!< Array to hold I2C command data */
-tByteArray PCF8574_I2CReply;      /*!< Array to hold I2C reply data */
+#ifdef __COMMON_H_I2C_ARENA__
+#define PCF8574_I2CRequest   I2CArenaRequest
+#define PCF8574_I2CReply     I2CArenaReply
+#else
+tByteArray PCF8574_I2CRequest;       /*!< Array to hold I2C command data */
+tByteArray PCF8574_I2CReply;         /*!< Array to hold I2C reply data */
+#endif // __COMMON_H_I2C_ARENA__
 
 // Function prototypes
 bool PCF8574sendBytes(tSensors link, ubyte _byte);
@@ -24,10 +24,11 @@
  *
  * Changelog:
  * - 0.1: Initial release
+ * - 0.2: Fixed gaussian() always using 0 as its random input
  *
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 10 October 2010
- * \version 0.1
+ * \version 0.2
  * \example STATS-test1.c
  */
 
@@ -82,8 +83,8 @@ float Phi(float z, float mu, float sigma) {
  * @return random number with standard Gaussian distribution
  */
 float gaussian() {
-  float U = random[32767]/32767;   // should be a number between 0 and 1.0
-  float V = random[32767]/32767;   // should be a number between 0 and 1.0
+  float U = random(32767) / 32767.0;   // should be a number between 0 and 1.0
+  float V = random(32767) / 32767.0;   // should be a number between 0 and 1.0
   return sin(2 * PI * V) * sqrt((-2 * log(1 - U)));  // sin() returns radians, should this be degrees?
 }
 
@@ -11,6 +11,15 @@
  *
  * common.h provides a number of frequently used functions that are useful for writing
  * drivers.
+ *
+ * Every driver, the SMUX functions in here included, keeps a single request and
+ * reply buffer for all ports.  RobotC functions aren't reentrant either, so call
+ * each driver from one task only.  Different drivers can be used from different
+ * tasks, the arbiter keeps their transactions on a shared port apart, see
+ * __COMMON_H_I2C_ARBITER__.  The I2C functions in here keep whatever has to
+ * survive giving up the CPU per task in the I2CTask arrays, or per port in the
+ * I2CTx arrays while the task holds the port, not in locals or parameters.
+ *
  * License: You may use this code as you wish, provided you give credit where its due.
  *
  * THIS CODE WILL ONLY WORK WITH ROBOTC VERSION 2.00 AND HIGHER.
@@ -45,10 +54,78 @@
  * - 0.13: Added motor mux types and data structs
  * - 0.14: Added check for digital sensors to prevent conflict with built-in drivers\n
  *         Changed clearI2CError to take ubyte for address, thanks Aswin
+ * - 0.15: waitForI2CBus() now yields the CPU while the bus is busy, see __COMMON_H_I2C_YIELD__<br>
+ *         Added non-blocking I2C transaction queues: I2Csubmit(), I2Cservice(), I2Cpoll(),
+ *         I2Cwait(), I2Creap() and I2Ctransfer()
+ * - 0.16: waitForI2CBus() no longer waits forever, each port has a configurable timeout<br>
+ *         writeI2C() retries with an increasing back-off, see I2CsetTimeout()<br>
+ *         clearI2CError() only sends as many dummy packets as needed and now returns a bool<br>
+ *         Added I2CreadLastError(), I2CreadRecoveryTime() and I2CmaxLatency()
+ * - 0.17: Added I2C bus statistics per port and device, enable with __COMMON_H_I2C_STATS__<br>
+ *         Added I2CstatsReset(), I2CstatsDisplay() and I2CstatsSave()
+ * - 0.18: Added register snapshots, I2CreadSnapshot(), I2CinvalidateSnapshot() and I2CsetSnapshotTTL()
+ * - 0.19: Added I2C_DESC() request descriptors and I2CreadRegisters()<br>
+ *         HTSMUXreadPort() reads straight into the result array
+ * - 0.20: Added port capability registry, I2CconfigurePort(), I2CsetPortSpeed(), I2CsetPortMux()
+ *         and I2CreadPortCaps().  The sensor type check is now done once per port
+ * - 0.21: Added I2CnegotiateSpeed() to switch ports to fast I2C when the device copes with it<br>
+ *         Fast ports drop back to normal speed when too many transactions fail<br>
+ *         Added I2CreadPortRate()
+ * - 0.22: sensorLowSpeed and sensorLowSpeed9V are accepted as I2C ports<br>
+ *         Fixed HTSMUXreadSensorType() casting to the wrong type
+ * - 0.23: Tasks now take turns on a port by priority, see __COMMON_H_I2C_ARBITER__<br>
+ *         Added I2CreadQueueDelay() and I2CreadMaxQueueDelay()
+ * - 0.24: Added I2CscanPort() to find the devices on a port by their vendor and device IDs<br>
+ *         Added I2CfindDevice(), I2CreadDeviceType() and I2CbindAddress()
+ * - 0.25: Added __COMMON_H_I2C_ARENA__ to share the drivers' request and reply buffers<br>
+ *         mmuxData is now declared by the MMUX drivers, so it only costs RAM when they're used
+ * - 0.26: Added write combining, see I2CwriteRegister(), I2CholdWrites(), I2CsyncWrites() and I2CflushWrites()<br>
+ *         HTSMUXsetMode() uses it
+ * - 0.27: Added __COMMON_H_I2C_CAPTURE__ to record every transaction to a file, see I2CcaptureStart()
+ * - 0.28: Added HTSMUXscanStart(), HTSMUXscanStep(), HTSMUXscanState() and HTSMUXscanProgress() to scan
+ *         SMUXes in the background.  The channel types found are saved to HTSMUX_SCAN_FILE, so a
+ *         scan with unchanged wiring only needs a single read<br>
+ *         HTSMUXscanPorts() reads all channel types in one transaction
+ * - 0.29: Added HTSMUXbeginConfig() and HTSMUXcommitConfig() to change the modes of several SMUX
+ *         channels with a single halt and restart
+ * - 0.30: Added HTSMUXreadAllAnalogue() and HTSMUXreadSharedAnalogue() to read all four analogue
+ *         channels of an SMUX in a single transaction
+ * - 0.31: Added __COMMON_H_SMUX_POLLER__ to poll SMUX channels from a background task, see
+ *         HTSMUXstartPolling().  HTSMUXreadPort() and HTSMUXreadAnalogue() return the polled values
+ * - 0.32: Added HTSMUXsetWindow() to set the registers the SMUX copies from an I2C sensor
+ * - 0.33: Added __COMMON_H_MMUX_SHADOW__ to leave out MMUX motor commands that wouldn't change anything,
+ *         see MMUXcheckShadow()
+ * - 0.34: Added __COMMON_H_MMUX_REFRESH__ to refresh the HDMMUX status from a background task,
+ *         see HDMMUXstartRefresh()
+ * - 0.35: The arbiter records which task holds a port and only that task can give it up<br>
+ *         A reply that isn't read within I2C_ARB_REPLY_HOLD ms no longer keeps other tasks off the port
+ * - 0.36: I2CreadRegisters() and I2CscanPort() only build their request once the port is theirs
+ * - 0.37: I2CmaxLatency() includes the readI2C() of the reply, I2CreadLastError() is cleared by the next good transaction
+ * - 0.38: I2CreadPortRate() drops towards 0 on a port that has gone quiet
+ * - 0.39: Capture buffer is written to the file after releasing the CPU, clamp the record times in long
+ * - 0.40: Dropped HTSMUX_SCAN_FILE and the useFile argument of HTSMUXscanStart(), the SMUX only
+ *         reports what its last auto-detect found, so checking against the file proved nothing<br>
+ *         The SMUX readers and configuration functions refuse while a scan is in progress
+ * - 0.41: The SMUX poll task and reads from other tasks take turns, see _HTSMUXclaim(), and a copy is
+ *         only valid if no command was sent while it was read<br>
+ *         SPORT() and MPORT() put their argument in parentheses, the poll task read channel 1's buffer
+ *         for every channel<br>
+ *         HTSMUXsendCommand() only marks the SMUX as running once the RUN command has been sent
+ * - 0.42: I2CholdWrites() now lasts until I2CflushWrites(), reads and other writes on the port send
+ *         the pending writes without ending it, see _I2CsendPending()
+ * - 0.43: The I2C functions keep what has to survive giving up the CPU per task or per port, not in
+ *         locals, I2CreadRegisters(), I2CreadSnapshot(), I2Creap() and I2Ctransfer() are now macros<br>
+ *         The transaction queue waits its turn with the arbiter, see I2Cservice()
+ * - 0.44: A copy the poll task reads while HTSMUXstopPolling() is called is no longer marked valid
+ * - 0.45: HTSMUXcommitConfig() refuses while the SMUX is busy and keeps the collected modes until
+ *         they are written
+ * - 0.46: HTSMUX_SCAN_FILE is back behind __COMMON_H_SMUX_SCAN_FILE__, with a version and a CRC-8<br>
+ *         HTSMUXscanCached() takes the channel types from it without an auto-detect and checks them
+ *         with a single read when the SMUX is first started, see HTSMUX_SCAN_STALE
  *
  * \author Xander Soldaat (mightor_at_gmail.com)
  * \date 08 December 2010
- * \version 0.14
+ * \version 0.46
  */
 
 #pragma systemFile
@@ -66,13 +143,50 @@
 #warn "sensor checking disabled, I hope you know what you are doing!"
 #endif
 
+/*!< define this to keep statistics on every I2C transaction, costs RAM and time */
+//#define __COMMON_H_I2C_STATS__
+
+/*!< define this to be able to record every I2C transaction to a file, see I2CcaptureStart() */
+//#define __COMMON_H_I2C_CAPTURE__
+
+/*!< define this to be able to poll SMUX channels from a background task, see HTSMUXstartPolling() */
+//#define __COMMON_H_SMUX_POLLER__
+
+/*!< define this to save the channel types found by a full SMUX scan to a file, so HTSMUXscanCached()
+ * can skip the auto-detect when the wiring hasn't changed */
+//#define __COMMON_H_SMUX_SCAN_FILE__
+
+/*!< define this to make the MMUX drivers skip motor commands that are the same as the last one sent
+ * and only send the power when nothing else changed, see MMUXcheckShadow().  Call
+ * MMUXinvalidateShadow() if the MMUX may have lost power */
+//#define __COMMON_H_MMUX_SHADOW__
+
+/*!< define this to be able to refresh the HDMMUX status and tacho counts from a background task,
+ * see HDMMUXstartRefresh() */
+//#define __COMMON_H_MMUX_REFRESH__
+
+/*!< define this to let all drivers share one request and reply buffer instead
+ * of each keeping its own.  This saves 34 bytes for every driver after the first
+ * one, but the drivers must then all be used from the same task */
+//#define __COMMON_H_I2C_ARENA__
+
+/*!< define this as 0 to make waitForI2CBus() spin without giving up the CPU */
+#ifndef __COMMON_H_I2C_YIELD__
+#define __COMMON_H_I2C_YIELD__ 1
+#endif
+
+/*!< define this as 0 to let tasks use a port without waiting their turn */
+#ifndef __COMMON_H_I2C_ARBITER__
+#define __COMMON_H_I2C_ARBITER__ 1
+#endif
+
 #include "firmwareVersion.h"
 #if (kFirmwareVersion < 785)
 #error "These drivers are only supported on RobotC version 2.0 or higher"
 #endif
 
-#define SPORT(X)  X / 4         /*!< Convert tMUXSensor to sensor port number */
-#define MPORT(X)  X % 4         /*!< Convert tMUXSensor to MUX port number */
+#define SPORT(X)  ((X) / 4)     /*!< Convert tMUXSensor to sensor port number */
+#define MPORT(X)  ((X) % 4)     /*!< Convert tMUXSensor to MUX port number */
 
 #ifndef MAX_ARR_SIZE
 /**
@@ -83,6 +197,137 @@
 #define MAX_ARR_SIZE 17
 #endif
 
+#ifndef I2C_QUEUE_SIZE
+/**
+ * Number of transactions that can be queued per sensor port with I2Csubmit(),
+ * can be overridden in your own program.
+ */
+#define I2C_QUEUE_SIZE 2
+#endif
+
+#ifndef I2C_TIMEOUT
+/**
+ * Default time in ms waitForI2CBus() will wait for the bus, can be overridden in your
+ * own program or per port with I2CsetTimeout().
+ */
+#define I2C_TIMEOUT 50
+#endif
+
+#ifndef I2C_RETRIES
+#define I2C_RETRIES 1       /*!< Default number of times writeI2C() retries a failed transaction */
+#endif
+
+#ifndef I2C_BACKOFF
+#define I2C_BACKOFF 2       /*!< Default back-off in ms before the first retry, doubles on every retry */
+#endif
+
+#define I2C_MAX_BACKOFF         32    /*!< Upper limit for the retry back-off in ms */
+#define I2C_MAX_FLUSH           5     /*!< Maximum number of dummy packets sent by clearI2CError() */
+
+// I2C failure classes
+#define I2C_ERR_NONE            0     /*!< No error */
+#define I2C_ERR_BUSY            1     /*!< Bus stayed busy for longer than the port's timeout */
+#define I2C_ERR_NACK            2     /*!< Device did not respond, not even to the dummy packets */
+#define I2C_ERR_BUS             3     /*!< Bus error that cleared up after sending dummy packets */
+
+#ifdef __COMMON_H_I2C_STATS__
+#ifndef I2C_STATS_DEVICES
+#define I2C_STATS_DEVICES 4     /*!< Number of device addresses statistics are kept for, per port */
+#endif
+#define I2C_STATS_BUCKETS 8     /*!< Latency histogram buckets: 0, 1, 2-3, 4-7, 8-15, 16-31, 32-63, 64+ ms */
+#ifndef I2C_STATS_FILE
+#define I2C_STATS_FILE "i2cstats.dat"   /*!< File written by I2CstatsSave() */
+#endif
+#endif // __COMMON_H_I2C_STATS__
+
+#ifdef __COMMON_H_I2C_CAPTURE__
+#ifndef I2C_CAPTURE_FILE
+#define I2C_CAPTURE_FILE "i2ccap.dat"   /*!< File written by I2CcaptureStart() */
+#endif
+#ifndef I2C_CAPTURE_SIZE
+#define I2C_CAPTURE_SIZE 8000   /*!< Size of the capture file, recording stops when it's full */
+#endif
+#ifndef I2C_CAPTURE_BUFFER
+#define I2C_CAPTURE_BUFFER 64   /*!< Number of bytes collected before they're written to the file */
+#endif
+#define I2C_CAP_REQUEST         0x10  /*!< Capture record of a message sent to a device */
+#define I2C_CAP_REPLY           0x20  /*!< Capture record of a reply read from a device */
+#define I2C_CAP_FAILED          0x80  /*!< The transaction failed */
+#define I2C_CAP_RECORD          22    /*!< Size of the largest record, a 16 byte message and its header */
+#endif // __COMMON_H_I2C_CAPTURE__
+
+// Port capabilities, cached by the port registry
+#define I2C_PORT_I2C            0x01  /*!< Port is configured for I2C */
+#define I2C_PORT_FAST           0x02  /*!< Port uses one of the fast I2C types */
+#define I2C_PORT_9V             0x04  /*!< Port supplies 9V */
+#define I2C_PORT_SMUX           0x08  /*!< A sensor MUX is attached */
+#define I2C_PORT_MMUX           0x10  /*!< A motor MUX is attached */
+
+#ifndef I2C_FAST_PROBES
+#define I2C_FAST_PROBES 8       /*!< Number of reads a device must get right before its port is made fast */
+#endif
+#define I2C_FAST_PROBE_SIZE     8     /*!< Number of registers compared by I2CnegotiateSpeed() */
+
+#ifndef I2C_FAST_WINDOW
+#define I2C_FAST_WINDOW 50      /*!< Number of transactions over which the error rate of a fast port is measured */
+#endif
+#ifndef I2C_FAST_MAX_ERRORS
+#define I2C_FAST_MAX_ERRORS 5   /*!< Failed transactions per I2C_FAST_WINDOW that get a fast port demoted, 0 to never demote */
+#endif
+
+#define I2C_RATE_PERIOD         1000  /*!< Time in ms over which I2CreadPortRate() counts transactions */
+
+#define I2C_WC_MAX              14    /*!< Maximum number of registers I2CwriteRegister() combines into one message */
+
+#ifndef I2C_ARB_TASKS
+#define I2C_ARB_TASKS 10        /*!< Number of tasks RobotC can run, nCurrentTask is below this */
+#endif
+#define I2C_ARB_QUEUE (I2C_ARB_TASKS + 1)  /*!< Value of I2CArbTask while the transaction queue holds the port */
+#ifndef I2C_ARB_REPLY_HOLD
+#define I2C_ARB_REPLY_HOLD 20   /*!< Time in ms a task keeps a port for a reply it hasn't read yet */
+#endif
+
+#ifndef I2C_SCAN_DEVICES
+#define I2C_SCAN_DEVICES 4      /*!< Number of devices I2CscanPort() remembers per port */
+#endif
+
+#define I2C_SCAN_FIRST          0x02  /*!< First address probed by I2CscanPort() */
+#define I2C_SCAN_LAST           0xFE  /*!< Last address probed by I2CscanPort() */
+#define I2C_SCAN_VERSION        0x00  /*!< Standard version register */
+#define I2C_SCAN_VENDOR         0x08  /*!< Standard vendor ID register, followed by the device ID at 0x10 */
+
+// Device types reported by I2CscanPort()
+#define I2C_DEV_NONE            0x00  /*!< Nothing answered */
+#define I2C_DEV_UNKNOWN         0x01  /*!< Something answered, but its IDs aren't known */
+#define I2C_DEV_HTIRS           0x02  /*!< HiTechnic IR Seeker */
+#define I2C_DEV_HTIRS2          0x03  /*!< HiTechnic IR Seeker V2 */
+#define I2C_DEV_HTMC            0x04  /*!< HiTechnic Compass */
+#define I2C_DEV_HTAC            0x05  /*!< HiTechnic Accelerometer */
+#define I2C_DEV_HTCS            0x06  /*!< HiTechnic Color Sensor */
+#define I2C_DEV_HTCS2           0x07  /*!< HiTechnic Color Sensor V2 */
+#define I2C_DEV_HTIRL           0x08  /*!< HiTechnic IR Link */
+#define I2C_DEV_HTIRR           0x09  /*!< HiTechnic IR Receiver */
+#define I2C_DEV_LEGOUS          0x0A  /*!< LEGO Ultrasonic Sensor */
+#define I2C_DEV_MSDIST          0x0B  /*!< Mindsensors DIST-Nx */
+#define I2C_DEV_MSHID           0x0C  /*!< Mindsensors HID Sensor */
+#define I2C_DEV_MSLL            0x0D  /*!< Mindsensors Line Leader */
+#define I2C_DEV_MSMMUX          0x0E  /*!< Mindsensors Motor MUX */
+#define I2C_DEV_NXTCAM          0x0F  /*!< Mindsensors NXTCam */
+
+/*!< Build a request descriptor for reading from register reg of the device at address */
+#define I2C_DESC(address, reg)  (((address) << 8) + (reg))
+
+#ifndef I2C_SNAPSHOT_TTL
+#define I2C_SNAPSHOT_TTL 10     /*!< Default time in ms a register snapshot remains valid */
+#endif
+
+// I2C transaction states
+#define I2C_TX_FREE             0     /*!< Queue slot is not in use */
+#define I2C_TX_QUEUED           1     /*!< Transaction is waiting for the bus */
+#define I2C_TX_BUSY             2     /*!< Transaction is on the bus */
+#define I2C_TX_DONE             3     /*!< Transaction completed, reply can be reaped */
+#define I2C_TX_ERROR            4     /*!< Transaction failed */
+
 #define HTSMUX_I2C_ADDR         0x10  /*!< HTSMUX I2C device address */
 #define HTSMUX_COMMAND          0x20  /*!< Command register */
 #define HTSMUX_STATUS           0x21  /*!< Status register */
@@ -122,6 +367,33 @@
 #define HTSMUX_CHAN_DIG0_HIGH   0x04  /*!< Drive pin 0 high channel mode */
 #define HTSMUX_CHAN_DIG1_HIGH   0x08  /*!< Drive pin 1 high channel mode */
 #define HTSMUX_CHAN_I2C_SLOW    0x10  /*!< Set slow I2C rate channel mode */
+#define HTSMUX_MODE_NONE        0xFF  /*!< No mode change pending for the channel */
+
+// Scan states, see HTSMUXscanStart()
+#define HTSMUX_SCAN_IDLE        0     /*!< No scan has been started */
+#define HTSMUX_SCAN_HALT        1     /*!< Waiting for the SMUX to halt */
+#define HTSMUX_SCAN_DETECT      2     /*!< Waiting for the auto-detect to finish */
+#define HTSMUX_SCAN_READ        3     /*!< Reading the detected channel types */
+#define HTSMUX_SCAN_DONE        4     /*!< The channels are known */
+#define HTSMUX_SCAN_FAILED      5     /*!< The SMUX didn't respond */
+#define HTSMUX_SCAN_STALE       6     /*!< The saved channel types were wrong, HTSMUXscanStep() starts a full scan */
+
+#define HTSMUX_HALT_TIME        100   /*!< Time in ms the SMUX needs to halt */
+#define HTSMUX_DETECT_TIME      500   /*!< Time in ms the SMUX needs to auto-detect its channels */
+
+#ifdef __COMMON_H_SMUX_SCAN_FILE__
+#ifndef HTSMUX_SCAN_FILE
+#define HTSMUX_SCAN_FILE "smuxscan.dat"   /*!< File holding the channel types found by the last full scan */
+#endif
+#define HTSMUX_SCAN_FILE_VERSION  1       /*!< Format of HTSMUX_SCAN_FILE, a file in another format is ignored */
+#define HTSMUX_SCAN_FILE_SIZE     19      /*!< Version, port mask, 4 channel types per port and a CRC-8 */
+#endif // __COMMON_H_SMUX_SCAN_FILE__
+
+#ifdef __COMMON_H_SMUX_POLLER__
+#ifndef HTSMUX_POLL_IDLE
+#define HTSMUX_POLL_IDLE 20     /*!< Longest time in ms the poll task sleeps between rounds */
+#endif
+#endif // __COMMON_H_SMUX_POLLER__
 
 /**
  * Array of bytes as a struct, this is a work around for RobotC's inability to pass an array to
@@ -145,6 +417,39 @@ typedef struct {
   int arr[MAX_ARR_SIZE];
 } tIntArray;
 
+/*!< Struct to hold a queued I2C transaction */
+typedef struct {
+  tByteArray request;   /*!< The message to be sent, same layout as for writeI2C() */
+  tByteArray reply;     /*!< The reply, once the transaction is done */
+  int replylen;         /*!< The number of bytes expected in reply */
+  byte state;           /*!< One of the I2C_TX_* states */
+  long started;         /*!< Time at which the transaction was put on the bus */
+} tI2CTransaction;
+
+/*!< Struct to hold a cached window of contiguous device registers */
+typedef struct {
+  tByteArray data;      /*!< The register values, data.arr[0] holds register reg */
+  long timestamp;       /*!< Time at which the registers were read */
+  ubyte address;        /*!< I2C address of the device */
+  ubyte reg;            /*!< First register of the window */
+  ubyte size;           /*!< Number of registers in the window */
+  bool valid;           /*!< False if the snapshot must be read again */
+} tI2CSnapshot;
+
+#ifdef __COMMON_H_I2C_STATS__
+/*!< Struct to hold the bus statistics for a single device */
+typedef struct {
+  ubyte address;              /*!< I2C address of the device, 0 if the slot is unused */
+  long transactions;          /*!< Number of transactions sent */
+  long bytesOut;              /*!< Number of bytes sent, including address and register */
+  long bytesIn;               /*!< Number of bytes received */
+  long spins;                 /*!< Number of times the bus status was polled */
+  int retries;                /*!< Number of retries */
+  int busErrors;              /*!< Number of bus errors */
+  int latency[I2C_STATS_BUCKETS];  /*!< Transaction latency histogram */
+} tI2CStats;
+#endif // __COMMON_H_I2C_STATS__
+
 /*!< Sensor types as detected by SMUX */
 typedef enum
 {
@@ -192,8 +497,19 @@ typedef struct {
   bool brake[4];        /*!< Whether or not to use braking or floating to stop motor */
   bool pidcontrol[4];   /*!< Use constant speed or just power control */
   byte ramping[4];      /*!< Ramp the motors, can be up, down, both */
+#ifdef __COMMON_H_MMUX_SHADOW__
+  bool shadowValid[4];    /*!< Whether the shadow below holds what the motor is running with */
+  long shadowTarget[4];   /*!< Target of the last command sent */
+  byte shadowPower[4];    /*!< Power of the last command sent */
+  ubyte shadowExtra[4];   /*!< Time target or steering of the last command sent */
+  ubyte shadowCommand[4]; /*!< Command byte of the last command sent */
+#endif // __COMMON_H_MMUX_SHADOW__
 } mmuxDataT;
 
+#define MMUX_SHADOW_ALL     0   /*!< The command must be sent in full */
+#define MMUX_SHADOW_POWER   1   /*!< Only the power differs from the last command */
+#define MMUX_SHADOW_NONE    2   /*!< The command is the same as the last one */
+
 
 /*!< MUXmotor type, one for each permutation
  *
@@ -224,22 +540,187 @@ typedef struct {
   bool initialised;             /*!< Has the MMUX been initialised yet? */
   byte status;                  /*!< SMUX status */
   HTSMUXSensorType sensor[4];   /*!< What kind of sensor is attached to this port */
+  bool configuring;             /*!< Are mode changes being collected, see HTSMUXbeginConfig()? */
+  ubyte pendingMode[4];         /*!< Collected mode per channel, HTSMUX_MODE_NONE if unchanged */
 } smuxDataT;
 
-mmuxDataT mmuxData[4];  /*!< Holds all the MMUX info, one for each sensor port */
 smuxDataT smuxData[4];  /*!< Holds all the MMUX info, one for each sensor port */
-tByteArray HTSMUX_I2CRequest;    /*!< Array to hold I2C command data */
-tByteArray HTSMUX_I2CReply;      /*!< Array to hold I2C reply data */
-
-
-void clearI2CError(tSensors link, ubyte address);
+tByteArray HTSMUX_I2CRequest;       /*!< Array to hold I2C command data */
+tByteArray HTSMUX_I2CReply;         /*!< Array to hold I2C reply data */
+
+tI2CSnapshot HTSMUX_AnalogueSnapshot[4];  /*!< Cached analogue registers of all four channels */
+ubyte smuxCommands[4];              /*!< Number of commands sent to each SMUX, wraps around */
+
+#ifdef __COMMON_H_SMUX_POLLER__
+tByteArray smuxShadow[16];          /*!< Copy of every channel's buffer, indexed by tMUXSensor */
+long smuxShadowTime[16];            /*!< When each shadow was last read */
+int smuxShadowRate[16];             /*!< Poll interval in ms per channel, 0 if it isn't polled */
+ubyte smuxShadowSize[16];           /*!< Number of buffer registers polled per channel */
+bool smuxShadowValid[16];           /*!< False until the channel has been polled */
+int smuxAnalogueRate[4];            /*!< Poll interval in ms of the analogue values per SMUX, 0 if they aren't polled */
+bool smuxPolling = false;           /*!< Is the poll task running? */
+int smuxUser[4];                    /*!< Task talking to each SMUX + 1, 0 if none, see _HTSMUXclaim() */
+#endif // __COMMON_H_SMUX_POLLER__
+
+byte smuxScanState[4];              /*!< Scan progress per port, one of the HTSMUX_SCAN_* values */
+long smuxScanStarted[4];            /*!< When the current scan step started */
+#ifdef __COMMON_H_SMUX_SCAN_FILE__
+ubyte smuxScanFile[16];             /*!< Channel types read from HTSMUX_SCAN_FILE, 4 per port */
+ubyte smuxScanFilePorts = 0;        /*!< Ports with channel types in HTSMUX_SCAN_FILE, one bit per port */
+bool smuxScanFileLoaded = false;    /*!< Has HTSMUX_SCAN_FILE been read yet? */
+bool smuxScanTrusted[4];            /*!< Are the channel types taken from the file still to be checked? */
+#endif // __COMMON_H_SMUX_SCAN_FILE__
+
+#ifdef __COMMON_H_I2C_ARENA__
+tByteArray I2CArenaRequest;         /*!< Request buffer shared by all drivers */
+tByteArray I2CArenaReply;           /*!< Reply buffer shared by all drivers */
+#endif // __COMMON_H_I2C_ARENA__
+
+tI2CTransaction I2CQueue[4 * I2C_QUEUE_SIZE];   /*!< Transaction queues, I2C_QUEUE_SIZE slots per port */
+byte I2CQueueHead[4];   /*!< Slot of the oldest transaction that hasn't completed yet */
+byte I2CQueueTail[4];   /*!< Slot the next submitted transaction goes into */
+
+int I2CTimeout[4] = {I2C_TIMEOUT, I2C_TIMEOUT, I2C_TIMEOUT, I2C_TIMEOUT};   /*!< Per port bus timeout in ms */
+byte I2CRetries[4] = {I2C_RETRIES, I2C_RETRIES, I2C_RETRIES, I2C_RETRIES};  /*!< Per port number of retries */
+int I2CBackoff[4] = {I2C_BACKOFF, I2C_BACKOFF, I2C_BACKOFF, I2C_BACKOFF};   /*!< Per port initial back-off in ms */
+byte I2CFailures[4];      /*!< Consecutive failed transactions per port */
+byte I2CLastError[4];     /*!< Failure class of the last error per port */
+long I2CRecoveryTime[4];  /*!< Time in ms spent recovering from the last error per port */
+
+int I2CSnapshotTTL[4] = {I2C_SNAPSHOT_TTL, I2C_SNAPSHOT_TTL, I2C_SNAPSHOT_TTL, I2C_SNAPSHOT_TTL}; /*!< Per port snapshot TTL in ms */
+ubyte I2CPortCaps[4];   /*!< Cached capabilities per port, 0 until validated */
+int I2CFastCount[4];    /*!< Transactions in the current error rate window of a fast port */
+int I2CFastErrors[4];   /*!< Failed transactions in the current error rate window of a fast port */
+long I2CRateCount[4];   /*!< Successful transactions since I2CRateStart */
+long I2CRateStart[4];   /*!< Start of the current transaction rate period */
+int I2CRate[4];         /*!< Transactions per second over the last full period */
+
+int I2CArbOwner[4];     /*!< Priority + 1 of the task that holds the port, 0 if it's free */
+int I2CArbTask[4];      /*!< nCurrentTask + 1 of the task that holds the port, I2C_ARB_QUEUE for the queue, 0 if it's free */
+int I2CArbLost[4];      /*!< nCurrentTask + 1 of the last task the port was taken from, 0 if none */
+bool I2CArbReply[4];    /*!< The owner has sent its request and only waits to read the reply */
+long I2CArbGranted[4];  /*!< Time at which the port was handed to its current owner or its request was sent */
+long I2CArbDelay[4];    /*!< Time in ms the last owner had to wait for the port */
+long I2CArbMaxDelay[4]; /*!< Longest time in ms a task had to wait for the port */
+int I2CArbWaiting[4 * I2C_ARB_TASKS];   /*!< Priority + 1 of the tasks waiting for each port, by nCurrentTask, 0 if not waiting */
+long I2CArbSince[4 * I2C_ARB_TASKS];    /*!< Time at which the waiting tasks asked for the port */
+
+tByteArray I2CScanRequest[4];   /*!< Array to hold the probes sent by I2CscanPort() */
+ubyte I2CScanAddress[4 * I2C_SCAN_DEVICES];  /*!< Addresses found by I2CscanPort(), I2C_SCAN_DEVICES slots per port */
+ubyte I2CScanType[4 * I2C_SCAN_DEVICES];     /*!< Device types found by I2CscanPort(), one of the I2C_DEV_* values */
+byte I2CScanCount[4];   /*!< Number of devices found on each port */
+
+tByteArray I2CWCBuffer[4];  /*!< Register writes waiting to be combined, same layout as for writeI2C(), empty if arr[0] is 0 */
+bool I2CWCHold[4];          /*!< Don't send combined writes until I2CflushWrites() is called */
+
+tSensors I2CTaskPort[I2C_ARB_TASKS];        /*!< Port each task is using, by nCurrentTask */
+long I2CTaskDeadline[I2C_ARB_TASKS];        /*!< Time at which waitForI2CBus() gives up, by nCurrentTask */
+int I2CTaskCount[I2C_ARB_TASKS];            /*!< Messages clearI2CError() has left to send, by nCurrentTask */
+ubyte I2CTaskAddress[I2C_ARB_TASKS];        /*!< Address clearI2CError() sends to, by nCurrentTask */
+int I2CTaskReplyLen[I2C_ARB_TASKS];         /*!< Reply length of the message each task is sending, by nCurrentTask */
+int I2CTaskDesc[I2C_ARB_TASKS];             /*!< Descriptor of the registers each task is reading, -1 for a message in I2CTaskRequest */
+int I2CTaskTicket[I2C_ARB_TASKS];           /*!< Queue ticket each task is waiting for, by nCurrentTask */
+tByteArray I2CTaskRequest[I2C_ARB_TASKS];   /*!< Copy of the message each task is sending, by nCurrentTask */
+
+tByteArray I2CTxRequest[4];             /*!< Message being sent on each port by the task that holds it */
+int I2CDescLast[4] = {-1, -1, -1, -1};  /*!< Descriptor I2CTxRequest was built from, -1 if it holds something else */
+int I2CTxReplyLen[4];                   /*!< Reply length of the message in I2CTxRequest */
+int I2CTxAttempt[4];                    /*!< Number of the current attempt at sending I2CTxRequest */
+byte I2CTxFailure[4];                   /*!< Failure class being recovered from */
+long I2CTxRecover[4];                   /*!< Time at which the recovery started */
+#ifdef __COMMON_H_I2C_STATS__
+long I2CTxStart[4];                     /*!< Time at which the first attempt started */
+#endif // __COMMON_H_I2C_STATS__
+#ifdef __COMMON_H_I2C_CAPTURE__
+long I2CTxSent[4];                      /*!< Time at which the message went on the bus */
+#endif // __COMMON_H_I2C_CAPTURE__
+
+#ifdef __COMMON_H_I2C_STATS__
+tI2CStats I2CStats[4 * I2C_STATS_DEVICES];  /*!< Bus statistics, I2C_STATS_DEVICES slots per port */
+int I2CStatsCurrent[4];                     /*!< Slot of the device currently using the port */
+#endif // __COMMON_H_I2C_STATS__
+
+#ifdef __COMMON_H_I2C_CAPTURE__
+TFileHandle I2CCaptureFile;     /*!< Handle of the capture file */
+bool I2CCapturing = false;      /*!< Are transactions being recorded? */
+ubyte I2CCaptureBuf[I2C_CAPTURE_BUFFER];  /*!< Records waiting to be written to the file */
+int I2CCaptureFill = 0;         /*!< Number of bytes in I2CCaptureBuf */
+ubyte I2CCaptureOut[I2C_CAPTURE_BUFFER];  /*!< Full buffer being written to the file */
+int I2CCaptureOutFill = 0;      /*!< Number of bytes in I2CCaptureOut */
+int I2CCaptureWriter = 0;       /*!< Task writing I2CCaptureOut to the file + 1, 0 if none */
+long I2CCaptureSpace = 0;       /*!< Number of bytes left in the capture file */
+long I2CCaptureLast = 0;        /*!< Time of the previous record */
+int I2CCaptureDropped = 0;      /*!< Number of records that didn't fit in the file */
+ubyte I2CCaptureRecord[I2C_ARB_TASKS * I2C_CAP_RECORD];  /*!< Record each task is adding, by nCurrentTask */
+#endif // __COMMON_H_I2C_CAPTURE__
+
+
+bool clearI2CError(tSensors link, ubyte address);
 bool waitForI2CBus(tSensors link);
+void I2CsetTimeout(tSensors link, int timeout, int retries, int backoff);
+byte I2CreadLastError(tSensors link);
+long I2CreadRecoveryTime(tSensors link);
+long I2CmaxLatency(tSensors link);
+#ifdef __COMMON_H_I2C_STATS__
+void I2CstatsReset();
+void I2CstatsDisplay(tSensors link);
+bool I2CstatsSave();
+#endif // __COMMON_H_I2C_STATS__
+#ifdef __COMMON_H_I2C_CAPTURE__
+bool I2CcaptureStart();
+bool I2CcaptureStop();
+int I2CcaptureDropped();
+#endif // __COMMON_H_I2C_CAPTURE__
+ubyte I2CreadPortCaps(tSensors link);
+bool I2CconfigurePort(tSensors link, TSensorTypes type);
+bool I2CsetPortSpeed(tSensors link, bool fast);
+void I2CsetPortMux(tSensors link, ubyte mux);
+bool I2CnegotiateSpeed(tSensors link, ubyte address);
+int I2CreadPortRate(tSensors link);
+long I2CreadQueueDelay(tSensors link);
+long I2CreadMaxQueueDelay(tSensors link);
+int I2CscanPort(tSensors link);
+ubyte I2CfindDevice(tSensors link, ubyte type, int index);
+ubyte I2CreadDeviceType(tSensors link, ubyte address);
+ubyte I2CbindAddress(tSensors link, ubyte type, ubyte address);
+bool I2CwriteRegister(tSensors link, ubyte address, ubyte reg, ubyte value);
+void I2CholdWrites(tSensors link);
+bool I2CsyncWrites(tSensors link);
+bool I2CflushWrites(tSensors link);
+bool _I2CsendPending(tSensors link);
+bool _I2CtxPending(tSensors link);
 bool writeI2C(tSensors link, tByteArray &data, int replylen);
+bool _I2Csend(tSensors link, int replylen);
+bool _I2Ctransmit(tSensors link, int replylen);
 bool readI2C(tSensors link, tByteArray &data, int replylen);
+bool _readI2C(tSensors link, tByteArray &data, int replylen);
+bool _I2CrequestRegisters(tSensors link, int desc, int replylen);
+int I2Csubmit(tSensors link, tByteArray &data, int replylen);
+void I2Cservice(tSensors link);
+bool I2Cpoll(int ticket);
+bool I2Cwait(int ticket);
+bool _I2Ctake(int ticket, tByteArray &reply);
+bool _I2Cdrop(int ticket);
+int _I2Cenqueue(tSensors link, tByteArray &data, int replylen);
+bool _I2CsnapshotFresh(tSensors link, tI2CSnapshot &snapshot, ubyte address, ubyte reg, ubyte size);
+bool _I2CsnapshotFill(tSensors link, tI2CSnapshot &snapshot, ubyte address, ubyte reg, ubyte size);
+void I2CinvalidateSnapshot(tI2CSnapshot &snapshot);
+void I2CsetSnapshotTTL(tSensors link, int ttl);
 byte HTSMUXreadStatus(tSensors link);
 HTSMUXSensorType HTSMUXreadSensorType(tSensors link, byte channel);
 HTSMUXSensorType HTSMUXreadSensorType(tMUXSensor muxsensor);
 bool HTSMUXscanPorts(tSensors link);
+bool HTSMUXscanStart(tSensors link);
+bool HTSMUXscanStep(tSensors link);
+byte HTSMUXscanState(tSensors link);
+int HTSMUXscanProgress(tSensors link);
+#ifdef __COMMON_H_SMUX_SCAN_FILE__
+ubyte _HTSMUXscanCRC();
+void _HTSMUXscanLoad();
+bool HTSMUXscanSave();
+bool HTSMUXscanCached(tSensors link);
+bool _HTSMUXscanCheck(tSensors link);
+#endif // __COMMON_H_SMUX_SCAN_FILE__
 bool HTSMUXsendCommand(tSensors link, byte command);
 bool HTSMUXreadPort(tSensors link, byte channel, tByteArray &result, int numbytes, int offset);
 bool HTSMUXreadPort(tMUXSensor muxsensor, tByteArray &result, int numbytes, int offset);
@@ -247,51 +728,96 @@ bool HTSMUXreadPort(tSensors link, byte channel, tByteArray &result, int numbyte
 bool HTSMUXreadPort(tMUXSensor muxsensor, tByteArray &result, int numbytes);
 bool HTSMUXsetMode(tSensors link, byte channel, byte mode);
 bool HTSMUXsetMode(tMUXSensor muxsensor, byte mode);
+bool HTSMUXsetWindow(tSensors link, byte channel, ubyte address, ubyte reg, ubyte count);
+bool HTSMUXsetWindow(tMUXSensor muxsensor, ubyte address, ubyte reg, ubyte count);
+bool HTSMUXbeginConfig(tSensors link);
+bool HTSMUXcommitConfig(tSensors link);
 bool HTSMUXsetAnalogueActive(tMUXSensor muxsensor);
 bool HTSMUXsetAnalogueInactive(tMUXSensor muxsensor);
 int HTSMUXreadAnalogue(tSensors link, byte channel);
 int HTSMUXreadAnalogue(tMUXSensor muxsensor);
+bool HTSMUXreadAllAnalogue(tSensors link, int &ch0, int &ch1, int &ch2, int &ch3);
+int HTSMUXreadSharedAnalogue(tMUXSensor muxsensor);
+int _HTSMUXsnapshotAnalogue(tSensors link, byte channel);
+#ifdef __COMMON_H_SMUX_POLLER__
+bool _HTSMUXreadShadow(tSensors link, byte channel, tByteArray &result, int numbytes, int offset);
+void HTSMUXpollChannel(tMUXSensor muxsensor, int rate, int size);
+void HTSMUXpollAnalogue(tSensors link, int rate);
+void HTSMUXstartPolling();
+void HTSMUXstopPolling();
+long HTSMUXreadShadowAge(tMUXSensor muxsensor);
+#endif // __COMMON_H_SMUX_POLLER__
 bool HTSMUXreadPowerStatus(tSensors link);
+#ifdef __COMMON_H_MMUX_SHADOW__
+ubyte MMUXcheckShadow(mmuxDataT &data, ubyte channel, long target, byte power, ubyte extra, ubyte command, bool repeatable);
+void MMUXinvalidateShadow(mmuxDataT &data, ubyte channel);
+void MMUXinvalidateShadow(mmuxDataT &data);
+#endif // __COMMON_H_MMUX_SHADOW__
 int min(int x1, int x2);
 int max(int x1, int x2);
+int clip(int x, int min, int max);
 int ubyteToInt(byte byteVal);
 long uByteToLong(byte a1, byte a2, byte a3, byte a4);
 
 
 /**
  * Clear out the error state on I2C bus by sending a bunch of dummy
- * packets.
+ * packets.  The first time a port runs into trouble, a single packet is sent,
+ * every consecutive failure adds another one, up to I2C_MAX_FLUSH.  We stop as
+ * soon as the device acknowledges one of them.
  * @param link the port number
  * @param address the I2C address we're sending to
+ * @return true if the device responded, false if it did not
  */
-void clearI2CError(tSensors link, ubyte address) {
+bool clearI2CError(tSensors link, ubyte address) {
   ubyte error_array[2];
-  error_array[0] = 1;           // Message size
-  error_array[1] = address; // I2C Address
+
+  I2CTaskPort[nCurrentTask] = link;
+  I2CTaskAddress[nCurrentTask] = address;
+  I2CTaskCount[nCurrentTask] = min(I2CFailures[link] + 1, I2C_MAX_FLUSH);
 
 #ifdef __COMMON_H_DEBUG__
   eraseDisplay();
-  nxtDisplayTextLine(3, "rxmit: %d", ubyteToInt(error_array[1]));
+  nxtDisplayTextLine(3, "rxmit: %d", ubyteToInt(address));
   wait1Msec(2000);
 #endif // __COMMON_H_DEBUG__
 
-  for (int i = 0; i < 5; i++) {
+  while (I2CTaskCount[nCurrentTask] > 0) {
+    I2CTaskCount[nCurrentTask]--;
+    hogCPU();
+    link = I2CTaskPort[nCurrentTask];
+    error_array[0] = 1;           // Message size
+    error_array[1] = I2CTaskAddress[nCurrentTask]; // I2C Address
     sendI2CMsg(link, error_array[0], 0);
-    wait1Msec(5);
+    releaseCPU();
+    if (waitForI2CBus(link))
+      return true;
   }
+  return false;
 }
 
 
 /**
- * Wait for the I2C bus to be ready for the next message
+ * Wait for the I2C bus to be ready for the next message.  Gives up when the bus
+ * has been busy for longer than the port's timeout, see I2CsetTimeout().
+ *
+ * The port and deadline are kept per task in I2CTaskPort and I2CTaskDeadline,
+ * the other tasks run while the bus is busy and may call this too.
  * @param link the port number
  * @return true if no error occured, false if it did
  */
 bool waitForI2CBus(tSensors link)
 {
+  I2CTaskPort[nCurrentTask] = link;
+  I2CTaskDeadline[nCurrentTask] = nPgmTime + I2CTimeout[link];
+
   //TI2CStatus i2cstatus;
   while (true)
   {
+    link = I2CTaskPort[nCurrentTask];
+#ifdef __COMMON_H_I2C_STATS__
+    I2CStats[I2CStatsCurrent[link]].spins++;
+#endif // __COMMON_H_I2C_STATS__
     //i2cstatus = nI2CStatus[link];
     switch (nI2CStatus[link])
     //switch(i2cstatus)
@@ -300,12 +826,22 @@ bool waitForI2CBus(tSensors link)
       return true;
 
     case STAT_COMM_PENDING:
-      break;
-
     case ERR_COMM_CHAN_NOT_READY:
+      if (nPgmTime > I2CTaskDeadline[nCurrentTask]) {
+        I2CLastError[link] = I2C_ERR_BUSY;
+        return false;
+      }
+#if __COMMON_H_I2C_YIELD__ == 1
+      // Let the other tasks have a go while the bus is busy
+      EndTimeSlice();
+#endif
       break;
 
     case ERR_COMM_BUS_ERR:
+      I2CLastError[link] = I2C_ERR_BUS;
+#ifdef __COMMON_H_I2C_STATS__
+      I2CStats[I2CStatsCurrent[link]].busErrors++;
+#endif // __COMMON_H_I2C_STATS__
 #ifdef __COMMON_H_DEBUG__
       PlaySound(soundLowBuzz);
       while (bSoundActive) {}
@@ -316,315 +852,2587 @@ bool waitForI2CBus(tSensors link)
 }
 
 
+#ifdef __COMMON_H_I2C_STATS__
 /**
- * Write to the I2C bus. This function will clear the bus and wait for it be ready
- * before any bytes are sent.
+ * Find the statistics slot for a device, claiming a free one if it's new.
+ * Devices that don't fit share the last slot of the port.
+ *
+ * Note: this is an internal function and should not be called directly
  * @param link the port number
- * @param data the data to be sent
- * @param replylen the number of bytes (if any) expected in reply to this command
- * @return true if no error occured, false if it did
+ * @param address the I2C address of the device
+ * @return the slot in I2CStats
  */
-bool writeI2C(tSensors link, tByteArray &data, int replylen) {
-
-#if __COMMON_H_SENSOR_CHECK__ == 1
-  TSensorTypes type = SensorType[link];
-  if ((type != sensorI2CCustom) &&
-      (type != sensorI2CCustom9V) &&
-      (type != sensorI2CCustomFast) &&
-      (type != sensorI2CCustomFast9V) &&
-      (type != sensorI2CCustomFastSkipStates9V) &&
-      (type != sensorI2CCustomFastSkipStates)) {
-    hogCPU();
-    PlaySound(soundException);
-    eraseDisplay();
-    nxtDisplayCenteredTextLine(0, "3rd Party Driver");
-    nxtDisplayCenteredTextLine(1, "ERROR");
-    nxtDisplayCenteredTextLine(2, "You have not");
-    nxtDisplayCenteredTextLine(3, "setup the sensor");
-    nxtDisplayCenteredTextLine(4, "port correctly. ");
-    nxtDisplayCenteredTextLine(5, "Please refer to");
-    nxtDisplayCenteredTextLine(6, "one of the");
-    nxtDisplayCenteredTextLine(7, "examples.");
-    wait1Msec(10000);
-    StopAllTasks();
-  }
-#endif
-
-  if (!waitForI2CBus(link)) {
-    clearI2CError(link, data.arr[1]);
-
-    // Let's try the bus again, see if the above packets flushed it out
-    // clearI2CBus(link);
-    if (!waitForI2CBus(link))
-      return false;
+int _I2CstatsSlot(tSensors link, ubyte address) {
+  int slot = link * I2C_STATS_DEVICES;
+
+  for (int i = 0; i < I2C_STATS_DEVICES; i++, slot++) {
+    if (I2CStats[slot].address == address)
+      return slot;
+    if (I2CStats[slot].address == 0) {
+      I2CStats[slot].address = address;
+      return slot;
+    }
   }
+  return slot - 1;
+}
 
-  sendI2CMsg(link, data.arr[0], replylen);
 
-  if (!waitForI2CBus(link)) {
-    clearI2CError(link, data.arr[1]);
-    sendI2CMsg(link, data.arr[0], replylen);
-    if (!waitForI2CBus(link))
-      return false;
-  }
-  return true;
+/**
+ * Add a transaction's latency to the histogram of a device.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param slot the slot in I2CStats
+ * @param latency the latency in ms
+ */
+void _I2CstatsLatency(int slot, long latency) {
+  int bucket = 0;
+
+  while ((bucket < (I2C_STATS_BUCKETS - 1)) && (latency >= (1 << bucket)))
+    bucket++;
+  I2CStats[slot].latency[bucket]++;
 }
+#endif // __COMMON_H_I2C_STATS__
 
 
 /**
- * Read from the I2C bus.  This function will wait for the bus to be ready before reading
- * from it.
- * @param link the port number
- * @param data holds the data from the reply
- * @param replylen the number of bytes in the reply
- * @return true if no error occured, false if it did
+ * Recover from a failed transaction: flush the bus and back off.  Used by
+ * _I2Ctransmit() between retries of the message in I2CTxRequest, the back
+ * off doubles with every attempt in I2CTxAttempt.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the port number, held by the calling task
+ * @return true if the device responded, false if there's no point in retrying
  */
-bool readI2C(tSensors link, tByteArray &data, int replylen) {
-
-#if __COMMON_H_SENSOR_CHECK__ == 1
-  TSensorTypes type = SensorType[link];
-  if ((type != sensorI2CCustom) &&
-      (type != sensorI2CCustom9V) &&
-      (type != sensorI2CCustomFast) &&
-      (type != sensorI2CCustomFast9V) &&
-      (type != sensorI2CCustomFastSkipStates9V) &&
-      (type != sensorI2CCustomFastSkipStates)) {
-    hogCPU();
-    PlaySound(soundException);
-    eraseDisplay();
-    nxtDisplayCenteredTextLine(0, "3rd Party Driver");
-    nxtDisplayCenteredTextLine(1, "ERROR");
-    nxtDisplayCenteredTextLine(2, "You have not");
-    nxtDisplayCenteredTextLine(3, "setup the sensor");
-    nxtDisplayCenteredTextLine(4, "port correctly. ");
-    nxtDisplayCenteredTextLine(5, "Please refer to");
-    nxtDisplayCenteredTextLine(6, "one of the");
-    nxtDisplayCenteredTextLine(7, "examples.");
-    wait1Msec(10000);
-    StopAllTasks();
-  }
-#endif
+bool _I2Crecover(tSensors link) {
+  I2CTxRecover[link] = nPgmTime;
+  I2CTxFailure[link] = I2CLastError[link];
 
-  // clear the input data buffer
-  memset(data, 0, sizeof(tByteArray));
+  if (I2CFailures[link] < 255)
+    I2CFailures[link]++;
 
-  // wait for the bus to be done receiving data
-  if (!waitForI2CBus(link))
+  if (!clearI2CError(link, I2CTxRequest[link].arr[1])) {
+    link = I2CTaskPort[nCurrentTask];
+    I2CLastError[link] = I2C_ERR_NACK;
+    I2CRecoveryTime[link] = nPgmTime - I2CTxRecover[link];
     return false;
+  }
+  link = I2CTaskPort[nCurrentTask];
+  I2CLastError[link] = I2CTxFailure[link];
 
-  // ask for the input to put into the data array
-  readI2CReply(link, data.arr[0], replylen);
-
+  wait1Msec(min(I2CBackoff[link] << (I2CTxAttempt[link] - 1), I2C_MAX_BACKOFF));
+  link = I2CTaskPort[nCurrentTask];
+  I2CRecoveryTime[link] = nPgmTime - I2CTxRecover[link];
   return true;
 }
 
 
-/*
- * Initialise the smuxData array needed for keeping track of sensor settings
+/**
+ * Work out the capabilities that follow from a sensor type.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param type the sensor type
+ * @return the I2C_PORT_* flags for this type, 0 if it's not an I2C type
  */
-void HTSMUXinit(){
-  memset(smuxData, 0xFF, sizeof(smuxDataT)*4);
-  for (int i = 0; i < 4; i++) {
-    // memset(smuxData[i].sensor, 0xFF, sizeof(HTSMUXSensorType)*4);
-    smuxData[i].status = HTSMUX_STAT_NOTHING;
-    smuxData[i].initialised = true;
+ubyte _I2CtypeCaps(TSensorTypes type) {
+  switch (type) {
+    case sensorLowSpeed:                  return I2C_PORT_I2C;
+    case sensorLowSpeed9V:                return I2C_PORT_I2C | I2C_PORT_9V;
+    case sensorI2CCustom:                 return I2C_PORT_I2C;
+    case sensorI2CCustom9V:               return I2C_PORT_I2C | I2C_PORT_9V;
+    case sensorI2CCustomFast:             return I2C_PORT_I2C | I2C_PORT_FAST;
+    case sensorI2CCustomFast9V:           return I2C_PORT_I2C | I2C_PORT_FAST | I2C_PORT_9V;
+    case sensorI2CCustomFastSkipStates:   return I2C_PORT_I2C | I2C_PORT_FAST;
+    case sensorI2CCustomFastSkipStates9V: return I2C_PORT_I2C | I2C_PORT_FAST | I2C_PORT_9V;
   }
+  return 0;
 }
 
 
 /**
- * Read the status of the SMUX
- *
- * The status byte is made up of the following bits:
- *
- * | D7 | D6 | D4 | D3 | D2 | D1 | D1 |
- * -D1 - HTSMUX_STAT_BATT: No battery voltage detected
- * -D2 - HTSMUX_STAT_BUSY: Auto-dected in progress status
- * -D3 - HTSMUX_STAT_HALT: Multiplexer is halted
- * -D4 - HTSMUX_STAT_ERROR: Command error detected
- * @param link the SMUX port number
- * @return the status byte
+ * Read the capabilities of a port.  The first call validates the port's
+ * sensor type, after that the cached value is returned.
+ * @param link the port number
+ * @return the I2C_PORT_* flags of the port
  */
-byte HTSMUXreadStatus(tSensors link) {
-  memset(HTSMUX_I2CRequest, 0, sizeof(tByteArray));
-
-  HTSMUX_I2CRequest.arr[0] = 2;               // Message size
-  HTSMUX_I2CRequest.arr[1] = HTSMUX_I2C_ADDR; // I2C Address
-  HTSMUX_I2CRequest.arr[2] = HTSMUX_STATUS;
-
-  if (!writeI2C(link, HTSMUX_I2CRequest, 1))
-    return -1;
-
-  if (!readI2C(link, HTSMUX_I2CReply, 1))
-    return -1;
-
-  return HTSMUX_I2CReply.arr[0];
+ubyte I2CreadPortCaps(tSensors link) {
+  if ((I2CPortCaps[link] & I2C_PORT_I2C) == 0)
+    I2CPortCaps[link] = _I2CtypeCaps(SensorType[link]) | (I2CPortCaps[link] & (I2C_PORT_SMUX | I2C_PORT_MMUX));
+  return I2CPortCaps[link];
 }
 
 
 /**
- * Get the sensor type attached to specified SMUX port
- * @param link the SMUX port number
- * @param channel the SMUX channel number
- * @return the status byte
+ * Check the port's sensor type and cache its capabilities.  If the port
+ * has not been set up for I2C, tell the user and stop the program.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the port number
  */
-HTSMUXSensorType HTSMUXreadSensorType(tSensors link, byte channel) {
-  return smuxData[link].sensor[channel];
+void _I2CvalidatePort(tSensors link) {
+  if ((I2CreadPortCaps(link) & I2C_PORT_I2C) != 0)
+    return;
+
+  hogCPU();
+  PlaySound(soundException);
+  eraseDisplay();
+  nxtDisplayCenteredTextLine(0, "3rd Party Driver");
+  nxtDisplayCenteredTextLine(1, "ERROR");
+  nxtDisplayCenteredTextLine(2, "You have not");
+  nxtDisplayCenteredTextLine(3, "setup the sensor");
+  nxtDisplayCenteredTextLine(4, "port correctly. ");
+  nxtDisplayCenteredTextLine(5, "Please refer to");
+  nxtDisplayCenteredTextLine(6, "one of the");
+  nxtDisplayCenteredTextLine(7, "examples.");
+  wait1Msec(10000);
+  StopAllTasks();
 }
 
 
 /**
- * Get the sensor type attached to specified SMUX port
- * @param muxsensor the SMUX sensor port number
- * @return the status byte
+ * Change the sensor type of a port and its cached capabilities, without locking.
+ * The error rate window starts over, as it only applies to the old speed.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the port number
+ * @param type the new sensor type
  */
-HTSMUXSensorType HTSMUXreadSensorType(tMUXSensor muxsensor) {
-  return smuxData[SPORT(muxsensor)].sensor[MPORT(muxsensor)];
+void _I2CsetPortType(tSensors link, TSensorTypes type) {
+  SensorType[link] = type;
+  I2CPortCaps[link] = _I2CtypeCaps(type) | (I2CPortCaps[link] & (I2C_PORT_SMUX | I2C_PORT_MMUX));
+  I2CFastCount[link] = 0;
+  I2CFastErrors[link] = 0;
 }
 
 
 /**
- * Set the mode of a SMUX channel.
+ * Work out the I2C sensor type for a speed, keeping 9V as it is.
  *
- * Mode can be one or more of the following:
- * -HTSMUX_CHAN_I2C
- * -HTSMUX_CHAN_9V
- * -HTSMUX_CHAN_DIG0_HIGH
- * -HTSMUX_CHAN_DIG1_HIGH
- * -HTSMUX_CHAN_I2C_SLOW
- * @param link the SMUX port number
- * @param channel the SMUX channel number
- * @param mode the mode to set the channel to
- * @return true if no error occured, false if it did
+ * Note: this is an internal function and should not be called directly
+ * @param caps the current I2C_PORT_* flags of the port
+ * @param fast true for the fast I2C type, false for the normal one
+ * @return the sensor type
  */
-bool HTSMUXsetMode(tSensors link, byte channel, byte mode) {
-  // If we're in the middle of a scan, abort this call
-  if (smuxData[link].status == HTSMUX_STAT_BUSY) {
-    return false;
-  } else if (smuxData[link].status != HTSMUX_STAT_HALT) {
-	  // Always make sure the SMUX is in the halted state
-	  if (!HTSMUXsendCommand(link, HTSMUX_CMD_HALT))
-	    return false;
-	  wait1Msec(50);
-	}
-
-  memset(HTSMUX_I2CRequest, 0, sizeof(tByteArray));
-
-  HTSMUX_I2CRequest.arr[0] = 3;               // Message size
-  HTSMUX_I2CRequest.arr[1] = HTSMUX_I2C_ADDR; // I2C Address
-  HTSMUX_I2CRequest.arr[2] = HTSMUX_CH_OFFSET + HTSMUX_MODE + (HTSMUX_CH_ENTRY_SIZE * channel);
-  HTSMUX_I2CRequest.arr[3] = mode;
-
-  return writeI2C(link, HTSMUX_I2CRequest, 0);
+TSensorTypes _I2CspeedType(ubyte caps, bool fast) {
+  if ((caps & I2C_PORT_9V) != 0)
+    return fast ? sensorI2CCustomFast9V : sensorI2CCustom9V;
+  else
+    return fast ? sensorI2CCustomFast : sensorI2CCustom;
 }
 
 
 /**
- * Set the mode of a SMUX channel.
- *
- * Mode can be one or more of the following:
- * -HTSMUX_CHAN_I2C
- * -HTSMUX_CHAN_9V
- * -HTSMUX_CHAN_DIG0_HIGH
- * -HTSMUX_CHAN_DIG1_HIGH
- * -HTSMUX_CHAN_I2C_SLOW
- * @param muxsensor the SMUX sensor port number
- * @param mode the mode to set the channel to
- * @return true if no error occured, false if it did
+ * Change the sensor type of a port at runtime.  Always use this instead of
+ * assigning to SensorType[] directly, or the cached capabilities will be stale.
+ * @param link the port number
+ * @param type the new sensor type
+ * @return true if the new type is an I2C type, false if it is not
  */
-bool HTSMUXsetMode(tMUXSensor muxsensor, byte mode) {
-  return HTSMUXsetMode((tSensors)SPORT(muxsensor), MPORT(muxsensor), mode);
+bool I2CconfigurePort(tSensors link, TSensorTypes type) {
+  hogCPU();
+  _I2CsetPortType(link, type);
+  releaseCPU();
+  return (I2CPortCaps[link] & I2C_PORT_I2C) != 0;
 }
 
 
 /**
- * Set the mode of an analogue channel to Active (turn the light on)
- * @param muxsensor the SMUX sensor port number
- * @return true if no error occured, false if it did
+ * Switch a port between the normal and fast I2C types, keeping 9V as it is.
+ * @param link the port number
+ * @param fast true for the fast I2C type, false for the normal one
+ * @return true if no error occured, false if the port isn't an I2C port
  */
-bool HTSMUXsetAnalogueActive(tMUXSensor muxsensor) {
-  if (smuxData[SPORT(muxsensor)].sensor[MPORT(muxsensor)] != HTSMUXAnalogue)
-    return false;
+bool I2CsetPortSpeed(tSensors link, bool fast) {
+  ubyte caps = I2CreadPortCaps(link);
 
-  if (!HTSMUXsetMode((tSensors)SPORT(muxsensor), MPORT(muxsensor), HTSMUX_CHAN_DIG0_HIGH))
+  if ((caps & I2C_PORT_I2C) == 0)
     return false;
 
-  return HTSMUXsendCommand((tSensors)SPORT(muxsensor), HTSMUX_CMD_RUN);
+  return I2CconfigurePort(link, _I2CspeedType(caps, fast));
 }
 
 
 /**
- * Set the mode of an analogue channel to Inactive (turn the light off)
- * @param muxsensor the SMUX sensor port number
- * @return true if no error occured, false if it did
+ * Record which kind of MUX is attached to a port.
+ * @param link the port number
+ * @param mux I2C_PORT_SMUX, I2C_PORT_MMUX or 0 if there is none
  */
-bool HTSMUXsetAnalogueInactive(tMUXSensor muxsensor) {
-  if (smuxData[SPORT(muxsensor)].sensor[MPORT(muxsensor)] != HTSMUXAnalogue)
-	  return false;
+void I2CsetPortMux(tSensors link, ubyte mux) {
+  I2CPortCaps[link] = (I2CPortCaps[link] & ~(I2C_PORT_SMUX | I2C_PORT_MMUX)) | mux;
+}
 
-  if (!HTSMUXsetMode((tSensors)SPORT(muxsensor), MPORT(muxsensor), 0))
-    return false;
 
-  return HTSMUXsendCommand((tSensors)SPORT(muxsensor), HTSMUX_CMD_RUN);
+#if __COMMON_H_I2C_ARBITER__ == 1
+/**
+ * Take a port away from an owner that has held on to it for too long, see
+ * _I2CarbAcquire().
+ *
+ * Note: this is an internal function and should not be called directly,
+ * call it with the CPU hogged
+ * @param link the port number
+ */
+void _I2CarbExpire(tSensors link) {
+  if ((I2CArbTask[link] != 0) &&
+      ((I2CArbReply[link] && ((nPgmTime - I2CArbGranted[link]) > I2C_ARB_REPLY_HOLD)) ||
+       ((nPgmTime - I2CArbGranted[link]) > I2CmaxLatency(link)))) {
+    I2CArbLost[link] = I2CArbTask[link];
+    I2CArbOwner[link] = 0;
+    I2CArbTask[link] = 0;
+    I2CArbReply[link] = false;
+  }
 }
 
 
 /**
- * Scan the specified SMUX's channels and configure them.
+ * Wait until it's this task's turn to use a port.  When the port comes free,
+ * the waiting task with the highest priority gets it, tasks with the same
+ * priority get it in the order they asked for it.  A task that already holds
+ * the port keeps it.  A task that holds on to a port for longer than a
+ * transaction can possibly take, or that hasn't read its reply
+ * I2C_ARB_REPLY_HOLD ms after its request went out, loses it and its next
+ * readI2C() on the port fails.  While the transaction queue holds the port,
+ * the waiting tasks move it along, see I2Cservice().
  *
- * Note: this functions takes 500ms to return while the scan is
- * in progress.
- * @param link the SMUX port number
- * @return true if no error occured, false if it did
+ * Everything that has to survive giving up the CPU is kept per task in
+ * I2CTaskPort, I2CArbWaiting and I2CArbSince, as RobotC locals are shared by
+ * every task that calls the function.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the port number
  */
-bool HTSMUXscanPorts(tSensors link) {
-  // If we're in the middle of a scan, abort this call
-  if (smuxData[link].status == HTSMUX_STAT_BUSY) {
-    return false;
+void _I2CarbAcquire(tSensors link) {
+  int first = link * I2C_ARB_TASKS;
+  int best = 0;
+  int owner = 0;
+
+  hogCPU();
+  I2CTaskPort[nCurrentTask] = link;
+  if (I2CArbTask[link] == nCurrentTask + 1) {
+    I2CArbReply[link] = false;
+    I2CArbGranted[link] = nPgmTime;
+    releaseCPU();
+    return;
   }
+  I2CArbWaiting[first + nCurrentTask] = nSchedulePriority + 1;
+  I2CArbSince[first + nCurrentTask] = nPgmTime;
+  releaseCPU();
 
-  // Always make sure the SMUX is in the halted state
-  if (!HTSMUXsendCommand(link, HTSMUX_CMD_HALT))
-    return false;
-	wait1Msec(100);
+  while (true) {
+    hogCPU();
+    link = I2CTaskPort[nCurrentTask];
+    first = link * I2C_ARB_TASKS;
+    _I2CarbExpire(link);
+
+    if (I2CArbTask[link] == 0) {
+      best = first + nCurrentTask;
+      for (int i = first; i < first + I2C_ARB_TASKS; i++) {
+        if ((I2CArbWaiting[i] > I2CArbWaiting[best]) ||
+            ((I2CArbWaiting[i] == I2CArbWaiting[best]) && (I2CArbSince[i] < I2CArbSince[best])))
+          best = i;
+      }
+
+      if (best == first + nCurrentTask) {
+        I2CArbOwner[link] = I2CArbWaiting[best];
+        I2CArbTask[link] = nCurrentTask + 1;
+        I2CArbWaiting[best] = 0;
+        if (I2CArbLost[link] == nCurrentTask + 1)
+          I2CArbLost[link] = 0;
+        I2CArbGranted[link] = nPgmTime;
+        I2CArbDelay[link] = nPgmTime - I2CArbSince[best];
+        if (I2CArbDelay[link] > I2CArbMaxDelay[link])
+          I2CArbMaxDelay[link] = I2CArbDelay[link];
+        releaseCPU();
+        return;
+      }
+    }
+    owner = I2CArbOwner[link];
+    releaseCPU();
 
-  // Commence scanning the ports and allow up to 500ms to complete
-  if (!HTSMUXsendCommand(link, HTSMUX_CMD_AUTODETECT))
-    return false;
-  wait1Msec(500);
-  smuxData[link].status = HTSMUX_STAT_HALT;
+    if (I2CArbTask[link] == I2C_ARB_QUEUE)
+      I2Cservice(link);
 
-  for (int i = 0; i < 4; i++) {
-    memset(HTSMUX_I2CRequest, 0, sizeof(tByteArray));
+    // A lower priority owner won't get to run unless we go to sleep
+    if ((owner != 0) && (owner <= nSchedulePriority))
+      wait1Msec(1);
+    else
+      EndTimeSlice();
+  }
+}
 
-    HTSMUX_I2CRequest.arr[0] = 2;                 // Message size
-    HTSMUX_I2CRequest.arr[1] = HTSMUX_I2C_ADDR;   // I2C Address
-    HTSMUX_I2CRequest.arr[2] = HTSMUX_CH_OFFSET + HTSMUX_TYPE + (HTSMUX_CH_ENTRY_SIZE * i);
 
-    if (!writeI2C(link, HTSMUX_I2CRequest, 1))
-      smuxData[link].sensor[i] = HTSMUXSensorNone;
+/**
+ * Hand a port to the transaction queue, unless a task holds it or is waiting
+ * for it.  The queue keeps the port until its transaction is done, see
+ * I2Cservice().
+ *
+ * Note: this is an internal function and should not be called directly,
+ * call it with the CPU hogged
+ * @param link the port number
+ * @return true if the queue holds the port, false if it has to wait
+ */
+bool _I2CarbQueue(tSensors link) {
+  int first = link * I2C_ARB_TASKS;
+
+  if (I2CArbTask[link] == I2C_ARB_QUEUE)
+    return true;
 
-    if (!readI2C(link, HTSMUX_I2CReply, 1))
-      smuxData[link].sensor[i] = HTSMUXSensorNone;
+  _I2CarbExpire(link);
+  if (I2CArbTask[link] != 0)
+    return false;
 
-    smuxData[link].sensor[i] = (tMUXSensor)ubyteToInt(HTSMUX_I2CReply.arr[0]);
+  for (int i = first; i < first + I2C_ARB_TASKS; i++) {
+    if (I2CArbWaiting[i] != 0)
+      return false;
   }
 
-  // Work-around for galloping buffer problem, applies to the HTPBs only.
-  for (int i = 0; i < 4; i++) {
-    if (smuxData[link].sensor[i] == HTSMUXProto) {
-      HTSMUX_I2CRequest.arr[0] = 3;                 // Message size
-      HTSMUX_I2CRequest.arr[1] = HTSMUX_I2C_ADDR;   // I2C Address
-      HTSMUX_I2CRequest.arr[2] = HTSMUX_CH_OFFSET + HTSMUX_I2C_COUNT + (HTSMUX_CH_ENTRY_SIZE * i);
+  I2CArbOwner[link] = nSchedulePriority + 1;
+  I2CArbTask[link] = I2C_ARB_QUEUE;
+  I2CArbReply[link] = false;
+  I2CArbGranted[link] = nPgmTime;
+  return true;
+}
+
+
+/**
+ * Mark the request of the task that holds a port as sent, from now on
+ * it only keeps the port to read the reply.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the port number
+ */
+void _I2CarbSent(tSensors link) {
+  if (I2CArbTask[link] != nCurrentTask + 1)
+    return;
+  I2CArbGranted[link] = nPgmTime;
+  I2CArbReply[link] = true;
+}
+
+
+/**
+ * Give up a port so the next task can have a go.  Nothing happens when the
+ * calling task doesn't hold the port.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the port number
+ */
+void _I2CarbRelease(tSensors link) {
+  if (I2CArbTask[link] != nCurrentTask + 1)
+    return;
+  I2CArbOwner[link] = 0;
+  I2CArbTask[link] = 0;
+  I2CArbReply[link] = false;
+}
+
+
+/**
+ * Take a port back from the transaction queue.  Nothing happens when the
+ * queue doesn't hold the port.
+ *
+ * Note: this is an internal function and should not be called directly,
+ * call it with the CPU hogged
+ * @param link the port number
+ */
+void _I2CarbUnqueue(tSensors link) {
+  if (I2CArbTask[link] != I2C_ARB_QUEUE)
+    return;
+  I2CArbOwner[link] = 0;
+  I2CArbTask[link] = 0;
+}
+#endif // __COMMON_H_I2C_ARBITER__
+
+
+#ifdef __COMMON_H_I2C_CAPTURE__
+/**
+ * Hand the collected capture records over to the calling task, which must
+ * write them out with _I2CcaptureFlush() once it has released the CPU.
+ * Returns false if another task is still writing the previous buffer.
+ *
+ * Note: this is an internal function and should not be called directly,
+ * call it with the CPU hogged
+ * @return true if the records were handed over, false if the caller has to wait
+ */
+bool _I2CcaptureHandOver() {
+  if (I2CCaptureWriter != 0)
+    return false;
+
+  memcpy(I2CCaptureOut, I2CCaptureBuf, I2CCaptureFill);
+  I2CCaptureOutFill = I2CCaptureFill;
+  I2CCaptureSpace -= I2CCaptureFill;
+  I2CCaptureFill = 0;
+  I2CCaptureWriter = nCurrentTask + 1;
+  return true;
+}
+
+
+/**
+ * Write the records handed over by _I2CcaptureHandOver() to the file.  Does
+ * nothing unless the calling task was handed the records.  The other tasks keep
+ * collecting records in I2CCaptureBuf while the file is being written.
+ *
+ * Note: this is an internal function and should not be called directly,
+ * call it without the CPU hogged
+ */
+void _I2CcaptureFlush() {
+  TFileIOResult nIoResult;
+
+  if (I2CCaptureWriter != nCurrentTask + 1)
+    return;
+
+  for (int i = 0; i < I2CCaptureOutFill; i++)
+    WriteByte(I2CCaptureFile, nIoResult, I2CCaptureOut[i]);
+  I2CCaptureOutFill = 0;
+  I2CCaptureWriter = 0;
+}
+
+
+/**
+ * Record a transaction.  Every record starts with:
+ * - the kind of record, one of the I2C_CAP_* values, or'd with the port number (1 byte)
+ * - the time in ms since the previous record, clamped to 32767 (short)
+ * - the time in ms the bus took, clamped to 255, 0 for replies (1 byte)
+ * - the number of bytes that follow (1 byte)
+ * - the address and the bytes sent for requests, the bytes read for replies
+ *
+ * Requests are followed by the number of bytes expected in reply (1 byte).
+ *
+ * When the buffer is full, this task writes it to the file after releasing the
+ * CPU, so the other tasks aren't held up by the flash.  The record is put
+ * together in I2CCaptureRecord first, as the parameters don't survive waiting
+ * for the buffer.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the port number
+ * @param kind I2C_CAP_REQUEST or I2C_CAP_REPLY, optionally or'd with I2C_CAP_FAILED
+ * @param data the message or reply
+ * @param offset the index of the first byte in data to record
+ * @param len the number of bytes to record
+ * @param replylen the number of bytes expected in reply, only used for requests
+ * @param busy the time in ms the bus took
+ */
+void _I2Ccapture(tSensors link, ubyte kind, tByteArray &data, int offset, int len, int replylen, long busy) {
+  int record = nCurrentTask * I2C_CAP_RECORD;
+  int size = 5 + len + (((kind & I2C_CAP_REQUEST) != 0) ? 1 : 0);
+  long delta = 0;
+
+  if (!I2CCapturing)
+    return;
+
+  if (busy > 0xFF)
+    busy = 0xFF;
+  I2CCaptureRecord[record] = kind | link;
+  I2CCaptureRecord[record + 3] = busy;
+  I2CCaptureRecord[record + 4] = len;
+  for (int i = 0; i < len; i++)
+    I2CCaptureRecord[record + 5 + i] = data.arr[offset + i];
+  if ((kind & I2C_CAP_REQUEST) != 0)
+    I2CCaptureRecord[record + 5 + len] = replylen;
+
+  hogCPU();
+  while (true) {
+    record = nCurrentTask * I2C_CAP_RECORD;
+    size = 5 + I2CCaptureRecord[record + 4] + (((I2CCaptureRecord[record] & I2C_CAP_REQUEST) != 0) ? 1 : 0);
+    if ((I2CCaptureFill + size <= I2C_CAPTURE_BUFFER) || _I2CcaptureHandOver())
+      break;
+
+    // Another task is still writing the previous buffer
+    releaseCPU();
+    EndTimeSlice();
+    hogCPU();
+  }
+
+  if ((I2CCaptureSpace - I2CCaptureFill) < size) {
+    I2CCaptureDropped++;
+    releaseCPU();
+    _I2CcaptureFlush();
+    return;
+  }
+
+  delta = nPgmTime - I2CCaptureLast;
+  if (delta > 0x7FFF)
+    delta = 0x7FFF;
+  I2CCaptureLast = nPgmTime;
+
+  I2CCaptureRecord[record + 1] = delta & 0xFF;
+  I2CCaptureRecord[record + 2] = (delta >> 8) & 0xFF;
+  for (int i = 0; i < size; i++)
+    I2CCaptureBuf[I2CCaptureFill++] = I2CCaptureRecord[record + i];
+  releaseCPU();
+  _I2CcaptureFlush();
+}
+
+
+/**
+ * Start recording every transaction sent with writeI2C() and read with readI2C()
+ * to I2C_CAPTURE_FILE, which starts with "I2C" and a format version byte,
+ * followed by the records described at _I2Ccapture().  The records are
+ * collected in RAM and written out I2C_CAPTURE_BUFFER bytes at a time by the
+ * task that happens to fill the buffer, which stalls that task but not the
+ * others, they keep recording into a second buffer.  Queued transactions, see
+ * I2Csubmit(), are not recorded.
+ *
+ * Use host/replay.h to feed a capture back to the drivers on a PC.
+ * @return true if no error occured, false if it did
+ */
+bool I2CcaptureStart() {
+  TFileIOResult nIoResult;
+
+  if (I2CCapturing)
+    return true;
+
+  Delete(I2C_CAPTURE_FILE, nIoResult);
+  OpenWrite(I2CCaptureFile, nIoResult, I2C_CAPTURE_FILE, I2C_CAPTURE_SIZE);
+  if (nIoResult != ioRsltSuccess) {
+    Close(I2CCaptureFile, nIoResult);
+    return false;
+  }
+
+  WriteByte(I2CCaptureFile, nIoResult, 'I');
+  WriteByte(I2CCaptureFile, nIoResult, '2');
+  WriteByte(I2CCaptureFile, nIoResult, 'C');
+  WriteByte(I2CCaptureFile, nIoResult, 1);
+
+  I2CCaptureSpace = I2C_CAPTURE_SIZE - 4;
+  I2CCaptureFill = 0;
+  I2CCaptureOutFill = 0;
+  I2CCaptureWriter = 0;
+  I2CCaptureDropped = 0;
+  I2CCaptureLast = nPgmTime;
+  I2CCapturing = true;
+  return (nIoResult == ioRsltSuccess);
+}
+
+
+/**
+ * Stop recording and close the capture file.
+ * @return true if no error occured, false if it did
+ */
+bool I2CcaptureStop() {
+  TFileIOResult nIoResult;
+
+  if (!I2CCapturing)
+    return true;
+
+  hogCPU();
+  I2CCapturing = false;
+  while (!_I2CcaptureHandOver()) {
+    releaseCPU();
+    EndTimeSlice();
+    hogCPU();
+  }
+  releaseCPU();
+  _I2CcaptureFlush();
+
+  Close(I2CCaptureFile, nIoResult);
+  return (nIoResult == ioRsltSuccess);
+}
+
+
+/**
+ * Get the number of records that didn't fit in the capture file.
+ * @return the number of records dropped since I2CcaptureStart()
+ */
+int I2CcaptureDropped() {
+  return I2CCaptureDropped;
+}
+#endif // __COMMON_H_I2C_CAPTURE__
+
+
+/**
+ * Keep track of the outcome of a transaction.  Successful transactions count
+ * towards the port's transaction rate.  On a fast port, failed ones count
+ * towards its error rate and when I2C_FAST_MAX_ERRORS of them happen
+ * within I2C_FAST_WINDOW transactions, the port drops back to normal speed.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the port number
+ * @param success true if the transaction succeeded, false if it failed
+ */
+void _I2Caccount(tSensors link, bool success) {
+  if (success) {
+    I2CRateCount[link]++;
+    if ((nPgmTime - I2CRateStart[link]) >= I2C_RATE_PERIOD) {
+      I2CRate[link] = (I2CRateCount[link] * 1000) / (nPgmTime - I2CRateStart[link]);
+      I2CRateCount[link] = 0;
+      I2CRateStart[link] = nPgmTime;
+    }
+  }
+
+  if ((I2CPortCaps[link] & I2C_PORT_FAST) == 0)
+    return;
+
+  if (!success)
+    I2CFastErrors[link]++;
+
+  if ((I2C_FAST_MAX_ERRORS > 0) && (I2CFastErrors[link] >= I2C_FAST_MAX_ERRORS)) {
+#ifdef __COMMON_H_DEBUG__
+    PlaySound(soundDownwardTones);
+#endif // __COMMON_H_DEBUG__
+    _I2CsetPortType(link, _I2CspeedType(I2CPortCaps[link], false));
+  } else if (++I2CFastCount[link] >= I2C_FAST_WINDOW) {
+    I2CFastCount[link] = 0;
+    I2CFastErrors[link] = 0;
+  }
+}
+
+
+/**
+ * Write to the I2C bus. This function will clear the bus and wait for it be ready
+ * before any bytes are sent.  Register writes still waiting to be combined are
+ * sent first, see I2CwriteRegister().
+ * @param link the port number
+ * @param data the data to be sent
+ * @param replylen the number of bytes (if any) expected in reply to this command
+ * @return true if no error occured, false if it did
+ */
+bool writeI2C(tSensors link, tByteArray &data, int replylen) {
+  // data doesn't survive waiting for the port or the bus, send a copy of it
+  memcpy(I2CTaskRequest[nCurrentTask], data, data.arr[0] + 1);
+  I2CTaskDesc[nCurrentTask] = -1;
+
+  return _I2Csend(link, replylen);
+}
+
+
+/**
+ * Send the message a task has put in I2CTaskRequest, or the register read in
+ * I2CTaskDesc, once it holds the port.  The pending register writes go out
+ * first, see I2CwriteRegister().  A request for a descriptor is only rebuilt
+ * when I2CTxRequest holds something else.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the port number
+ * @param replylen the number of bytes (if any) expected in reply to this command
+ * @return true if no error occured, false if it did
+ */
+bool _I2Csend(tSensors link, int replylen) {
+  I2CTaskPort[nCurrentTask] = link;
+  I2CTaskReplyLen[nCurrentTask] = replylen;
+
+#if __COMMON_H_SENSOR_CHECK__ == 1
+  if ((I2CPortCaps[link] & I2C_PORT_I2C) == 0)
+    _I2CvalidatePort(link);
+#endif
+
+#if __COMMON_H_I2C_ARBITER__ == 1
+  // The port is held until the reply has been read
+  _I2CarbAcquire(link);
+  link = I2CTaskPort[nCurrentTask];
+#endif
+
+  if (!_I2CtxPending(link)) {
+#if __COMMON_H_I2C_ARBITER__ == 1
+    _I2CarbRelease(I2CTaskPort[nCurrentTask]);
+#endif
+    return false;
+  }
+  link = I2CTaskPort[nCurrentTask];
+
+  if (I2CTaskDesc[nCurrentTask] == -1) {
+    memcpy(I2CTxRequest[link], I2CTaskRequest[nCurrentTask], I2CTaskRequest[nCurrentTask].arr[0] + 1);
+    I2CDescLast[link] = -1;
+  } else if (I2CDescLast[link] != I2CTaskDesc[nCurrentTask]) {
+    I2CTxRequest[link].arr[0] = 2;                                      // Message size
+    I2CTxRequest[link].arr[1] = (I2CTaskDesc[nCurrentTask] >> 8) & 0xFF; // I2C Address
+    I2CTxRequest[link].arr[2] = I2CTaskDesc[nCurrentTask] & 0xFF;        // Start register
+    I2CDescLast[link] = I2CTaskDesc[nCurrentTask];
+  }
+
+  if (!_I2Ctransmit(link, I2CTaskReplyLen[nCurrentTask])) {
+#if __COMMON_H_I2C_ARBITER__ == 1
+    _I2CarbRelease(I2CTaskPort[nCurrentTask]);
+#endif
+    return false;
+  }
+
+#if __COMMON_H_I2C_ARBITER__ == 1
+  link = I2CTaskPort[nCurrentTask];
+  if (I2CTaskReplyLen[nCurrentTask] == 0)
+    _I2CarbRelease(link);
+  else
+    _I2CarbSent(link);
+#endif
+  return true;
+}
+
+
+/**
+ * Send the message in I2CTxRequest, retrying as often as I2CsetTimeout()
+ * allows.  The calling task must hold the port, so the state of the attempts
+ * can be kept per port in the I2CTx arrays.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the port number
+ * @param replylen the number of bytes (if any) expected in reply to this command
+ * @return true if no error occured, false if it did
+ */
+bool _I2Ctransmit(tSensors link, int replylen) {
+  I2CTaskPort[nCurrentTask] = link;
+  I2CTxReplyLen[link] = replylen;
+  I2CTxAttempt[link] = 0;
+
+#ifdef __COMMON_H_I2C_STATS__
+  I2CTxStart[link] = nPgmTime;
+  I2CStatsCurrent[link] = _I2CstatsSlot(link, I2CTxRequest[link].arr[1]);
+  I2CStats[I2CStatsCurrent[link]].transactions++;
+  I2CStats[I2CStatsCurrent[link]].bytesOut += I2CTxRequest[link].arr[0];
+#endif // __COMMON_H_I2C_STATS__
+
+  while (true) {
+    if (I2CTxAttempt[link] > 0) {
+#ifdef __COMMON_H_I2C_STATS__
+      I2CStats[I2CStatsCurrent[link]].retries++;
+#endif // __COMMON_H_I2C_STATS__
+      if (!_I2Crecover(link))
+        break;
+    }
+
+    // Make sure the bus is ready before we send anything
+    if (waitForI2CBus(link)) {
+      link = I2CTaskPort[nCurrentTask];
+#ifdef __COMMON_H_I2C_CAPTURE__
+      I2CTxSent[link] = nPgmTime;
+#endif // __COMMON_H_I2C_CAPTURE__
+      sendI2CMsg(link, I2CTxRequest[link].arr[0], I2CTxReplyLen[link]);
+
+      if (waitForI2CBus(link)) {
+#ifdef __COMMON_H_I2C_CAPTURE__
+        link = I2CTaskPort[nCurrentTask];
+        _I2Ccapture(link, I2C_CAP_REQUEST, I2CTxRequest[link], 1, I2CTxRequest[link].arr[0], I2CTxReplyLen[link], nPgmTime - I2CTxSent[link]);
+#endif // __COMMON_H_I2C_CAPTURE__
+        link = I2CTaskPort[nCurrentTask];
+        I2CFailures[link] = 0;
+        I2CLastError[link] = I2C_ERR_NONE;
+        _I2Caccount(link, true);
+#ifdef __COMMON_H_I2C_STATS__
+        _I2CstatsLatency(I2CStatsCurrent[link], nPgmTime - I2CTxStart[link]);
+#endif // __COMMON_H_I2C_STATS__
+        return true;
+      }
+#ifdef __COMMON_H_I2C_CAPTURE__
+      link = I2CTaskPort[nCurrentTask];
+      _I2Ccapture(link, I2C_CAP_REQUEST | I2C_CAP_FAILED, I2CTxRequest[link], 1, I2CTxRequest[link].arr[0], I2CTxReplyLen[link], nPgmTime - I2CTxSent[link]);
+#endif // __COMMON_H_I2C_CAPTURE__
+    }
+    link = I2CTaskPort[nCurrentTask];
+    _I2Caccount(link, false);
+
+    if (++I2CTxAttempt[link] > I2CRetries[link])
+      break;
+  }
+
+  link = I2CTaskPort[nCurrentTask];
+#ifdef __COMMON_H_I2C_STATS__
+  _I2CstatsLatency(I2CStatsCurrent[link], nPgmTime - I2CTxStart[link]);
+#endif // __COMMON_H_I2C_STATS__
+  return false;
+}
+
+
+/**
+ * Write a single register, combined with other register writes to the same
+ * device.  A write to the register after the last one pending is added to the
+ * same message, up to I2C_WC_MAX registers, and a write to a register that's
+ * already pending replaces its value.  Anything else sends the pending message
+ * first.  Pending writes go out before the next writeI2C() on the port, when
+ * I2CsyncWrites() is called outside of I2CholdWrites() or on I2CflushWrites().
+ *
+ * Note: queued transactions don't send the pending writes first, see I2Csubmit().
+ * @param link the port number
+ * @param address the I2C address of the device
+ * @param reg the register to write to
+ * @param value the value to write
+ * @return true if no error occured, false if pending writes had to be sent and failed
+ */
+bool I2CwriteRegister(tSensors link, ubyte address, ubyte reg, ubyte value) {
+  int count = 0;
+  int first = 0;
+
+  // Sending the pending message gives up the CPU, keep the write per task
+  I2CTaskPort[nCurrentTask] = link;
+  I2CTaskRequest[nCurrentTask].arr[1] = address;
+  I2CTaskRequest[nCurrentTask].arr[2] = reg;
+  I2CTaskRequest[nCurrentTask].arr[3] = value;
+
+  while (true) {
+    hogCPU();
+    link = I2CTaskPort[nCurrentTask];
+    address = I2CTaskRequest[nCurrentTask].arr[1];
+    reg = I2CTaskRequest[nCurrentTask].arr[2];
+    value = I2CTaskRequest[nCurrentTask].arr[3];
+    count = I2CWCBuffer[link].arr[0] - 2;
+    first = I2CWCBuffer[link].arr[2];
+
+    if (count <= 0) {
+      I2CWCBuffer[link].arr[0] = 3;         // Message size
+      I2CWCBuffer[link].arr[1] = address;   // I2C Address
+      I2CWCBuffer[link].arr[2] = reg;       // Start register
+      I2CWCBuffer[link].arr[3] = value;
+      releaseCPU();
+      return true;
+    }
+
+    if (I2CWCBuffer[link].arr[1] == address) {
+      if ((reg >= first) && (reg < (first + count))) {
+        I2CWCBuffer[link].arr[3 + reg - first] = value;
+        releaseCPU();
+        return true;
+      } else if ((reg == (first + count)) && (count < I2C_WC_MAX)) {
+        I2CWCBuffer[link].arr[3 + count] = value;
+        I2CWCBuffer[link].arr[0]++;
+        releaseCPU();
+        return true;
+      }
+    }
+    releaseCPU();
+
+    if (!_I2CsendPending(link))
+      return false;
+  }
+}
+
+
+/**
+ * Keep combining register writes on a port until I2CflushWrites() is called,
+ * even when drivers call I2CsyncWrites().  Use this around a reconfiguration
+ * that calls several driver functions.  Reads, other messages and writes that
+ * can't be combined still send what's pending first, as everything on the
+ * port has to go out in order, but the hold lasts until I2CflushWrites().
+ * @param link the port number
+ */
+void I2CholdWrites(tSensors link) {
+  I2CWCHold[link] = true;
+}
+
+
+/**
+ * Send the pending register writes, unless I2CholdWrites() was called.
+ * Drivers call this at the end of every function that uses I2CwriteRegister().
+ * @param link the port number
+ * @return true if no error occured, false if it did
+ */
+bool I2CsyncWrites(tSensors link) {
+  if (I2CWCHold[link])
+    return true;
+
+  return _I2CsendPending(link);
+}
+
+
+/**
+ * Send the pending register writes and stop holding them back.
+ * @param link the port number
+ * @return true if no error occured, false if it did
+ */
+bool I2CflushWrites(tSensors link) {
+  I2CWCHold[link] = false;
+  return _I2CsendPending(link);
+}
+
+
+/**
+ * Send the pending register writes, whether they're held back or not.
+ * Unlike I2CflushWrites(), this leaves I2CholdWrites() in effect.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the port number
+ * @return true if no error occured, false if it did
+ */
+bool _I2CsendPending(tSensors link) {
+  if (I2CWCBuffer[link].arr[0] == 0)
+    return true;
+
+  I2CTaskPort[nCurrentTask] = link;
+
+#if __COMMON_H_SENSOR_CHECK__ == 1
+  if ((I2CPortCaps[link] & I2C_PORT_I2C) == 0)
+    _I2CvalidatePort(link);
+#endif
+
+#if __COMMON_H_I2C_ARBITER__ == 1
+  _I2CarbAcquire(link);
+  link = I2CTaskPort[nCurrentTask];
+#endif
+
+  if (!_I2CtxPending(link)) {
+#if __COMMON_H_I2C_ARBITER__ == 1
+    _I2CarbRelease(I2CTaskPort[nCurrentTask]);
+#endif
+    return false;
+  }
+
+#if __COMMON_H_I2C_ARBITER__ == 1
+  _I2CarbRelease(I2CTaskPort[nCurrentTask]);
+#endif
+  return true;
+}
+
+
+/**
+ * Move the pending register writes to I2CTxRequest and send them.  The
+ * calling task must hold the port.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the port number
+ * @return true if no error occured, false if it did
+ */
+bool _I2CtxPending(tSensors link) {
+  hogCPU();
+  if (I2CWCBuffer[link].arr[0] == 0) {
+    releaseCPU();
+    return true;
+  }
+  memcpy(I2CTxRequest[link], I2CWCBuffer[link], I2CWCBuffer[link].arr[0] + 1);
+  I2CWCBuffer[link].arr[0] = 0;
+  I2CDescLast[link] = -1;
+  releaseCPU();
+
+  return _I2Ctransmit(link, 0);
+}
+
+
+/**
+ * Read from the I2C bus.  This function will wait for the bus to be ready before reading
+ * from it.
+ * @param link the port number
+ * @param data holds the data from the reply
+ * @param replylen the number of bytes in the reply
+ * @return true if no error occured, false if it did
+ */
+bool readI2C(tSensors link, tByteArray &data, int replylen) {
+
+#if __COMMON_H_SENSOR_CHECK__ == 1
+  if ((I2CPortCaps[link] & I2C_PORT_I2C) == 0)
+    _I2CvalidatePort(link);
+#endif
+
+  // clear the input data buffer
+  memset(data, 0, sizeof(tByteArray));
+
+  return _readI2C(link, data, replylen);
+}
+
+
+/**
+ * Read the reply from the I2C bus without clearing data first.  writeI2C()
+ * only returns once the bus is done, so this doesn't wait for it: data must
+ * be filled in before the CPU is given up, another task calling this could
+ * change what it refers to.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the port number
+ * @param data holds the data from the reply
+ * @param replylen the number of bytes in the reply
+ * @return true if no error occured, false if it did
+ */
+bool _readI2C(tSensors link, tByteArray &data, int replylen) {
+#if __COMMON_H_I2C_ARBITER__ == 1
+  // Another task has used the port since our request went out
+  if (I2CArbLost[link] == nCurrentTask + 1) {
+    I2CArbLost[link] = 0;
+    return false;
+  }
+#endif
+
+  if (nI2CStatus[link] != NO_ERR) {
+    I2CLastError[link] = (nI2CStatus[link] == ERR_COMM_BUS_ERR) ? I2C_ERR_BUS : I2C_ERR_BUSY;
+#if __COMMON_H_I2C_ARBITER__ == 1
+    _I2CarbRelease(link);
+#endif
+    return false;
+  }
+
+  // ask for the input to put into the data array
+  readI2CReply(link, data.arr[0], replylen);
+
+#ifdef __COMMON_H_I2C_STATS__
+  I2CStats[I2CStatsCurrent[link]].bytesIn += replylen;
+#endif // __COMMON_H_I2C_STATS__
+
+#ifdef __COMMON_H_I2C_CAPTURE__
+  I2CTaskPort[nCurrentTask] = link;
+  _I2Ccapture(link, I2C_CAP_REPLY, data, 0, replylen, 0, 0);
+  link = I2CTaskPort[nCurrentTask];
+#endif // __COMMON_H_I2C_CAPTURE__
+
+#if __COMMON_H_I2C_ARBITER__ == 1
+  _I2CarbRelease(link);
+#endif
+  return true;
+}
+
+
+/**
+ * Read a number of registers from a device.  The request is only rebuilt when
+ * the descriptor differs from the previous one on this port and the reply
+ * is not cleared, only the first replylen bytes of reply are valid.
+ * Use I2C_DESC() to build the descriptor, preferably as a #define.
+ *
+ * This is a macro, so reply is filled in by the caller rather than through a
+ * reference another task could change while the request is on the bus.
+ * @param link the port number
+ * @param desc the descriptor made with I2C_DESC()
+ * @param reply holds the data from the reply
+ * @param replylen the number of registers to read
+ * @return true if no error occured, false if it did
+ */
+#define I2CreadRegisters(link, desc, reply, replylen) (_I2CrequestRegisters(link, desc, replylen) && _readI2C(link, reply, replylen))
+
+
+/**
+ * Send the request of I2CreadRegisters().
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the port number
+ * @param desc the descriptor made with I2C_DESC()
+ * @param replylen the number of registers to read
+ * @return true if no error occured, false if it did
+ */
+bool _I2CrequestRegisters(tSensors link, int desc, int replylen) {
+  I2CTaskDesc[nCurrentTask] = desc;
+  return _I2Csend(link, replylen);
+}
+
+
+/**
+ * Find out if a device copes with fast I2C and switch its port over if it does.
+ * The first I2C_FAST_PROBE_SIZE registers of the device are read at normal speed
+ * and then I2C_FAST_PROBES times at fast speed, without retries.  The port is only
+ * left at fast speed if every read succeeded and returned the same values.
+ * Call this at startup for every port, after the sensor type has been set.
+ *
+ * Note: if there is more than one device on a port, probe all of them and
+ * only keep the port fast if they all pass.  Don't negotiate two ports from
+ * different tasks at the same time.
+ * @param link the port number
+ * @param address the I2C address of the device
+ * @return true if the port is now fast, false if it was left at normal speed
+ */
+bool I2CnegotiateSpeed(tSensors link, ubyte address) {
+  tByteArray reference;
+  tByteArray probe;
+  byte retries = I2CRetries[link];
+  bool fast = true;
+
+  if (!I2CsetPortSpeed(link, false))
+    return false;
+  wait1Msec(5);
+
+  if (!I2CreadRegisters(link, I2C_DESC(address, 0x00), reference, I2C_FAST_PROBE_SIZE))
+    return false;
+
+  I2CsetPortSpeed(link, true);
+  wait1Msec(5);
+
+  // A retry would hide exactly the errors we're looking for
+  I2CRetries[link] = 0;
+  for (int i = 0; (i < I2C_FAST_PROBES) && fast; i++) {
+    if (!I2CreadRegisters(link, I2C_DESC(address, 0x00), probe, I2C_FAST_PROBE_SIZE)) {
+      fast = false;
+    }
+    for (int j = 0; j < I2C_FAST_PROBE_SIZE; j++) {
+      if (probe.arr[j] != reference.arr[j])
+        fast = false;
+    }
+  }
+  I2CRetries[link] = retries;
+
+  if (!fast) {
+    I2CsetPortSpeed(link, false);
+    wait1Msec(5);
+    clearI2CError(link, address);
+  }
+  return fast;
+}
+
+
+/**
+ * Get the number of successful transactions per second on a port,
+ * measured over the last full I2C_RATE_PERIOD.  A period is only closed by
+ * a transaction, so once a port has been quiet for longer than that, the
+ * rate is worked out over the time since the last period ended instead and
+ * drops towards 0 the longer the port stays idle.
+ * @param link the port number
+ * @return transactions per second
+ */
+int I2CreadPortRate(tSensors link) {
+  long elapsed = nPgmTime - I2CRateStart[link];
+
+  if (elapsed >= I2C_RATE_PERIOD)
+    return (I2CRateCount[link] * 1000) / elapsed;
+  return I2CRate[link];
+}
+
+
+/**
+ * Get the time the last task to get hold of a port had to wait for it.
+ * Call this right after a transaction to find out how long it was queued.
+ * @param link the port number
+ * @return queueing delay in ms
+ */
+long I2CreadQueueDelay(tSensors link) {
+  return I2CArbDelay[link];
+}
+
+
+/**
+ * Get the longest time a task had to wait for a port.
+ * @param link the port number
+ * @return queueing delay in ms
+ */
+long I2CreadMaxQueueDelay(tSensors link) {
+  return I2CArbMaxDelay[link];
+}
+
+
+/**
+ * Read a number of registers from whatever answers on an address.  Unlike
+ * writeI2C(), there are no retries and the bus isn't cleared first, the error
+ * left behind by an address nobody answers on is cleared by the next message.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the port number
+ * @param address the I2C address to probe
+ * @param reg the first register to read
+ * @param reply holds the data from the reply
+ * @param replylen the number of registers to read
+ * @return true if a device answered, false if nothing did
+ */
+bool _I2Cprobe(tSensors link, ubyte address, ubyte reg, tByteArray &reply, int replylen) {
+  bool found = false;
+
+#if __COMMON_H_I2C_ARBITER__ == 1
+  _I2CarbAcquire(link);
+#endif
+  I2CScanRequest[link].arr[0] = 2;        // Message size
+  I2CScanRequest[link].arr[1] = address;  // I2C Address
+  I2CScanRequest[link].arr[2] = reg;      // Start register
+  sendI2CMsg(link, I2CScanRequest[link].arr[0], replylen);
+  if (waitForI2CBus(link)) {
+    readI2CReply(link, reply.arr[0], replylen);
+    found = true;
+  }
+#if __COMMON_H_I2C_ARBITER__ == 1
+  _I2CarbRelease(link);
+#endif
+  return found;
+}
+
+
+/**
+ * Check whether an ID string read from a device starts with name.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param ids the vendor ID followed by the device ID
+ * @param offset 0 to check the vendor ID, 8 to check the device ID
+ * @param name the ID to look for
+ * @return true if it matches, false if it doesn't
+ */
+bool _I2CidMatches(tByteArray &ids, int offset, string name) {
+  ubyte buffer[8];
+  int len = min(strlen(name), 8);
+
+  memcpy(buffer, name, len);
+  for (int i = 0; i < len; i++) {
+    if (ids.arr[offset + i] != buffer[i])
+      return false;
+  }
+  return true;
+}
+
+
+/**
+ * Work out the device type from the vendor and device IDs.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param ids the vendor ID followed by the device ID
+ * @return one of the I2C_DEV_* types
+ */
+ubyte _I2Cidentify(tByteArray &ids) {
+  if (_I2CidMatches(ids, 0, "HiTechnc")) {
+    if (_I2CidMatches(ids, 8, "NewIRDir")) return I2C_DEV_HTIRS2;
+    if (_I2CidMatches(ids, 8, "IRSeeker")) return I2C_DEV_HTIRS;
+    if (_I2CidMatches(ids, 8, "Compass"))  return I2C_DEV_HTMC;
+    if (_I2CidMatches(ids, 8, "Accel."))   return I2C_DEV_HTAC;
+    if (_I2CidMatches(ids, 8, "ColorPD"))  return I2C_DEV_HTCS2;
+    if (_I2CidMatches(ids, 8, "Color"))    return I2C_DEV_HTCS;
+    if (_I2CidMatches(ids, 8, "IRLink"))   return I2C_DEV_HTIRL;
+    if (_I2CidMatches(ids, 8, "IRRecv"))   return I2C_DEV_HTIRR;
+  } else if (_I2CidMatches(ids, 0, "LEGO")) {
+    if (_I2CidMatches(ids, 8, "Sonar"))    return I2C_DEV_LEGOUS;
+  } else if (_I2CidMatches(ids, 0, "mndsnsrs")) {
+    if (_I2CidMatches(ids, 8, "DIST"))     return I2C_DEV_MSDIST;
+    if (_I2CidMatches(ids, 8, "NXTHID"))   return I2C_DEV_MSHID;
+    if (_I2CidMatches(ids, 8, "LineLdr"))  return I2C_DEV_MSLL;
+    if (_I2CidMatches(ids, 8, "NXTMMX"))   return I2C_DEV_MSMMUX;
+    if (_I2CidMatches(ids, 8, "NXTCAM"))   return I2C_DEV_NXTCAM;
+  }
+  return I2C_DEV_UNKNOWN;
+}
+
+
+/**
+ * Find the devices on a port.  Every address from I2C_SCAN_FIRST to I2C_SCAN_LAST
+ * is probed by reading its version register and the ones that answer are
+ * identified by their vendor and device IDs.  The first I2C_SCAN_DEVICES are
+ * remembered, see I2CfindDevice() and I2CreadDeviceType().
+ * Call this at startup, after the sensor type has been set.  A full scan
+ * takes a while, so don't do it while other tasks rely on the port, and
+ * don't scan two ports from different tasks at the same time.
+ * @param link the port number
+ * @return the number of devices found
+ */
+int I2CscanPort(tSensors link) {
+  tByteArray reply;
+  int first = link * I2C_SCAN_DEVICES;
+  int address = I2C_SCAN_FIRST;
+
+#if __COMMON_H_SENSOR_CHECK__ == 1
+  if ((I2CPortCaps[link] & I2C_PORT_I2C) == 0)
+    _I2CvalidatePort(link);
+#endif
+
+  I2CScanCount[link] = 0;
+  for (int i = first; i < first + I2C_SCAN_DEVICES; i++) {
+    I2CScanAddress[i] = 0;
+    I2CScanType[i] = I2C_DEV_NONE;
+  }
+
+  // Let whatever was still on the bus finish
+  waitForI2CBus(link);
+
+  while ((address <= I2C_SCAN_LAST) && (I2CScanCount[link] < I2C_SCAN_DEVICES)) {
+    if (_I2Cprobe(link, address, I2C_SCAN_VERSION, reply, 8)) {
+      I2CScanAddress[first + I2CScanCount[link]] = address;
+      if (_I2Cprobe(link, address, I2C_SCAN_VENDOR, reply, 16))
+        I2CScanType[first + I2CScanCount[link]] = _I2Cidentify(reply);
+      else
+        I2CScanType[first + I2CScanCount[link]] = I2C_DEV_UNKNOWN;
+      I2CScanCount[link]++;
+    }
+    address += 2;
+  }
+
+  // Don't leave the last missing address' error behind for the next transaction
+  if ((nI2CStatus[link] == ERR_COMM_BUS_ERR) && (I2CScanCount[link] > 0))
+    clearI2CError(link, I2CScanAddress[first]);
+
+  return I2CScanCount[link];
+}
+
+
+/**
+ * Look up a device found by I2CscanPort().
+ * @param link the port number
+ * @param type the I2C_DEV_* type to look for
+ * @param index 0 for the first device of that type, 1 for the second, etc
+ * @return the device's I2C address or 0 if there is no such device
+ */
+ubyte I2CfindDevice(tSensors link, ubyte type, int index) {
+  int first = link * I2C_SCAN_DEVICES;
+
+  for (int i = first; i < first + I2CScanCount[link]; i++) {
+    if (I2CScanType[i] != type)
+      continue;
+    if (index-- == 0)
+      return I2CScanAddress[i];
+  }
+  return 0;
+}
+
+
+/**
+ * Get the type of the device I2CscanPort() found on an address.
+ * @param link the port number
+ * @param address the I2C address of the device
+ * @return one of the I2C_DEV_* types, I2C_DEV_NONE if nothing was found there
+ */
+ubyte I2CreadDeviceType(tSensors link, ubyte address) {
+  int first = link * I2C_SCAN_DEVICES;
+
+  for (int i = first; i < first + I2CScanCount[link]; i++) {
+    if (I2CScanAddress[i] == address)
+      return I2CScanType[i];
+  }
+  return I2C_DEV_NONE;
+}
+
+
+/**
+ * Work out the address a driver should use.  Drivers that take an optional
+ * address call this when it's left at 0, so devices found by I2CscanPort()
+ * are used without having to pass their address around.
+ * @param link the port number
+ * @param type the I2C_DEV_* type of the driver's device
+ * @param address the driver's default address
+ * @return the address of the first device of that type on the port, the default if there is none
+ */
+ubyte I2CbindAddress(tSensors link, ubyte type, ubyte address) {
+  ubyte found = I2CfindDevice(link, type, 0);
+  return (found != 0) ? found : address;
+}
+
+
+/**
+ * Configure how hard writeI2C() tries before giving up on a port.  The worst
+ * case time spent in writeI2C() and readI2C() follows from these, see I2CmaxLatency().
+ * @param link the port number
+ * @param timeout the maximum time in ms to wait for the bus to become ready
+ * @param retries the number of times a failed transaction is retried
+ * @param backoff the time in ms to wait before the first retry, doubles on every retry
+ */
+void I2CsetTimeout(tSensors link, int timeout, int retries, int backoff) {
+  I2CTimeout[link] = timeout;
+  I2CRetries[link] = retries;
+  I2CBackoff[link] = backoff;
+}
+
+
+/**
+ * Get the failure class of the last error that occurred on a port.  It goes
+ * back to I2C_ERR_NONE as soon as a transaction on the port succeeds.
+ *
+ * The failure class is one of:
+ * -I2C_ERR_NONE
+ * -I2C_ERR_BUSY
+ * -I2C_ERR_NACK
+ * -I2C_ERR_BUS
+ * @param link the port number
+ * @return the failure class
+ */
+byte I2CreadLastError(tSensors link) {
+  return I2CLastError[link];
+}
+
+
+/**
+ * Get the time spent recovering from the last error on a port.
+ * @param link the port number
+ * @return time in ms spent flushing the bus and backing off
+ */
+long I2CreadRecoveryTime(tSensors link) {
+  return I2CRecoveryTime[link];
+}
+
+
+/**
+ * Calculate the worst case time a writeI2C() and the readI2C() of its reply
+ * can take together on a port with its current timeout and retry settings.
+ * @param link the port number
+ * @return worst case latency in ms
+ */
+long I2CmaxLatency(tSensors link) {
+  long latency = 0;
+
+  for (int attempt = 0; attempt <= I2CRetries[link]; attempt++) {
+    // two bus waits per attempt
+    latency += 2 * I2CTimeout[link];
+    if (attempt > 0)
+      latency += (I2C_MAX_FLUSH * I2CTimeout[link]) + min(I2CBackoff[link] << (attempt - 1), I2C_MAX_BACKOFF);
+  }
+
+  // and one more for readI2C()
+  return latency + I2CTimeout[link];
+}
+
+
+#ifdef __COMMON_H_I2C_STATS__
+/**
+ * Clear all I2C bus statistics.
+ */
+void I2CstatsReset() {
+  memset(I2CStats, 0, sizeof(tI2CStats) * 4 * I2C_STATS_DEVICES);
+  memset(I2CStatsCurrent, 0, sizeof(int) * 4);
+}
+
+
+/**
+ * Show the I2C bus statistics of a port on the screen.  Each device
+ * takes up two lines: the address, number of transactions and errors
+ * followed by the number of bytes sent and received and bus polls.
+ * @param link the port number
+ */
+void I2CstatsDisplay(tSensors link) {
+  int slot = link * I2C_STATS_DEVICES;
+
+  eraseDisplay();
+  nxtDisplayTextLine(0, "I2C port S%d", link + 1);
+  for (int i = 0; i < I2C_STATS_DEVICES && i < 3; i++, slot++) {
+    if (I2CStats[slot].address == 0)
+      break;
+    nxtDisplayTextLine(1 + (i * 2), "%02X T%ld E%d", I2CStats[slot].address, I2CStats[slot].transactions, I2CStats[slot].busErrors + I2CStats[slot].retries);
+    nxtDisplayTextLine(2 + (i * 2), " %ld/%ld S%ld", I2CStats[slot].bytesOut, I2CStats[slot].bytesIn, I2CStats[slot].spins);
+  }
+}
+
+
+/**
+ * Save the I2C bus statistics of all ports to I2C_STATS_FILE.
+ * Every device that has been used gets a record of:
+ * - port and address (1 byte each)
+ * - transactions, bytes out, bytes in and spins (long)
+ * - retries and bus errors (short)
+ * - I2C_STATS_BUCKETS latency histogram counters (short)
+ * @return true if no error occured, false if it did
+ */
+bool I2CstatsSave() {
+  TFileHandle hFileHandle;
+  TFileIOResult nIoResult;
+  short nFileSize = 0;
+
+  for (int slot = 0; slot < 4 * I2C_STATS_DEVICES; slot++)
+    if (I2CStats[slot].address != 0)
+      nFileSize += 2 + (4 * 4) + (2 * 2) + (2 * I2C_STATS_BUCKETS);
+
+  Delete(I2C_STATS_FILE, nIoResult);
+  OpenWrite(hFileHandle, nIoResult, I2C_STATS_FILE, nFileSize);
+  if (nIoResult != ioRsltSuccess) {
+    Close(hFileHandle, nIoResult);
+    return false;
+  }
+
+  for (int slot = 0; slot < 4 * I2C_STATS_DEVICES; slot++) {
+    if (I2CStats[slot].address == 0)
+      continue;
+    WriteByte(hFileHandle, nIoResult, slot / I2C_STATS_DEVICES);
+    WriteByte(hFileHandle, nIoResult, I2CStats[slot].address);
+    WriteLong(hFileHandle, nIoResult, I2CStats[slot].transactions);
+    WriteLong(hFileHandle, nIoResult, I2CStats[slot].bytesOut);
+    WriteLong(hFileHandle, nIoResult, I2CStats[slot].bytesIn);
+    WriteLong(hFileHandle, nIoResult, I2CStats[slot].spins);
+    WriteShort(hFileHandle, nIoResult, I2CStats[slot].retries);
+    WriteShort(hFileHandle, nIoResult, I2CStats[slot].busErrors);
+    for (int i = 0; i < I2C_STATS_BUCKETS; i++)
+      WriteShort(hFileHandle, nIoResult, I2CStats[slot].latency[i]);
+    if (nIoResult != ioRsltSuccess)
+      break;
+  }
+
+  if (nIoResult != ioRsltSuccess) {
+    Close(hFileHandle, nIoResult);
+    return false;
+  }
+
+  Close(hFileHandle, nIoResult);
+  return (nIoResult == ioRsltSuccess);
+}
+#endif // __COMMON_H_I2C_STATS__
+
+
+/**
+ * Queue a transaction on the I2C bus without waiting for it.  The transaction
+ * is sent as soon as all transactions queued before it on the same port have
+ * completed.  Use I2Cpoll() or I2Cwait() to find out when it's done and
+ * I2Creap() to collect the reply and free up the queue slot.
+ *
+ * With __COMMON_H_I2C_ARBITER__, queued transactions and writeI2C()/readI2C()
+ * can share a port, the queue gets the port when no task is waiting for it.
+ * Without it, don't mix them on the same port.  Pending register writes are
+ * not sent first, call I2CsyncWrites() before queueing a transaction that
+ * depends on them.
+ * @param link the port number
+ * @param data the data to be sent, same layout as for writeI2C()
+ * @param replylen the number of bytes (if any) expected in reply to this command
+ * @return a ticket for the transaction or -1 if the port's queue is full
+ */
+int I2Csubmit(tSensors link, tByteArray &data, int replylen) {
+  int ticket = 0;
+
+  hogCPU();
+  ticket = (link * I2C_QUEUE_SIZE) + I2CQueueTail[link];
+  if (I2CQueue[ticket].state != I2C_TX_FREE) {
+    releaseCPU();
+    return -1;
+  }
+
+  memcpy(I2CQueue[ticket].request, data, sizeof(tByteArray));
+  I2CQueue[ticket].replylen = replylen;
+  I2CQueue[ticket].state = I2C_TX_QUEUED;
+  I2CQueueTail[link] = (I2CQueueTail[link] + 1) % I2C_QUEUE_SIZE;
+  I2CTaskTicket[nCurrentTask] = ticket;
+  releaseCPU();
+
+  // Put it on the bus straight away if nothing else is going on
+  I2Cservice(link);
+  return I2CTaskTicket[nCurrentTask];
+}
+
+
+/**
+ * Move the transaction queue of a port along without blocking.  Collects
+ * the reply of a completed transaction and sends the next queued one.
+ * With __COMMON_H_I2C_ARBITER__, the queue only gets the port when no task
+ * holds it or waits for it and gives it back after every transaction.  A
+ * transaction that holds the port for too long loses it and fails.
+ * This is called by I2Cpoll(), I2Cwait() and tasks waiting for the port,
+ * there's normally no need to call it directly.
+ * @param link the port number
+ */
+void I2Cservice(tSensors link) {
+  int slot = 0;
+
+  hogCPU();
+  while (true) {
+    slot = (link * I2C_QUEUE_SIZE) + I2CQueueHead[link];
+
+    if (I2CQueue[slot].state == I2C_TX_QUEUED) {
+#if __COMMON_H_I2C_ARBITER__ == 1
+      if (!_I2CarbQueue(link))
+        break;
+#else
+      if (nI2CStatus[link] == STAT_COMM_PENDING)
+        break;
+#endif
+      sendI2CMsg(link, I2CQueue[slot].request.arr[0], I2CQueue[slot].replylen);
+      I2CQueue[slot].state = I2C_TX_BUSY;
+      I2CQueue[slot].started = nPgmTime;
+#ifdef __COMMON_H_I2C_STATS__
+      I2CStatsCurrent[link] = _I2CstatsSlot(link, I2CQueue[slot].request.arr[1]);
+      I2CStats[I2CStatsCurrent[link]].transactions++;
+      I2CStats[I2CStatsCurrent[link]].bytesOut += I2CQueue[slot].request.arr[0];
+#endif // __COMMON_H_I2C_STATS__
+    }
+
+    if (I2CQueue[slot].state != I2C_TX_BUSY)
+      break;
+
+#if __COMMON_H_I2C_ARBITER__ == 1
+    // A task took the port away, whatever the bus says now isn't ours
+    if (I2CArbTask[link] != I2C_ARB_QUEUE) {
+      if (I2CArbLost[link] == I2C_ARB_QUEUE)
+        I2CArbLost[link] = 0;
+      I2CLastError[link] = I2C_ERR_BUSY;
+      I2CQueue[slot].state = I2C_TX_ERROR;
+      _I2Caccount(link, false);
+      I2CQueueHead[link] = (I2CQueueHead[link] + 1) % I2C_QUEUE_SIZE;
+      continue;
+    }
+#endif
+
+#ifdef __COMMON_H_I2C_STATS__
+    I2CStats[I2CStatsCurrent[link]].spins++;
+#endif // __COMMON_H_I2C_STATS__
+    switch (nI2CStatus[link]) {
+      case NO_ERR:
+#ifdef __COMMON_H_I2C_STATS__
+        I2CStats[I2CStatsCurrent[link]].bytesIn += I2CQueue[slot].replylen;
+        _I2CstatsLatency(I2CStatsCurrent[link], nPgmTime - I2CQueue[slot].started);
+#endif // __COMMON_H_I2C_STATS__
+        memset(I2CQueue[slot].reply, 0, sizeof(tByteArray));
+        if (I2CQueue[slot].replylen > 0)
+          readI2CReply(link, I2CQueue[slot].reply.arr[0], I2CQueue[slot].replylen);
+        I2CQueue[slot].state = I2C_TX_DONE;
+        I2CLastError[link] = I2C_ERR_NONE;
+        _I2Caccount(link, true);
+        break;
+
+      case STAT_COMM_PENDING:
+      case ERR_COMM_CHAN_NOT_READY:
+        if ((nPgmTime - I2CQueue[slot].started) <= I2CTimeout[link]) {
+          releaseCPU();
+          return;
+        }
+        I2CLastError[link] = I2C_ERR_BUSY;
+        I2CQueue[slot].state = I2C_TX_ERROR;
+        _I2Caccount(link, false);
+        break;
+
+      default:
+        I2CLastError[link] = I2C_ERR_BUS;
+        I2CQueue[slot].state = I2C_TX_ERROR;
+        _I2Caccount(link, false);
+#ifdef __COMMON_H_I2C_STATS__
+        I2CStats[I2CStatsCurrent[link]].busErrors++;
+#endif // __COMMON_H_I2C_STATS__
+        break;
+    }
+
+    // On to the next one in the queue, tasks waiting for the port go first
+    I2CQueueHead[link] = (I2CQueueHead[link] + 1) % I2C_QUEUE_SIZE;
+#if __COMMON_H_I2C_ARBITER__ == 1
+    _I2CarbUnqueue(link);
+#endif
+  }
+  releaseCPU();
+}
+
+
+/**
+ * Check if a queued transaction has finished, without blocking.
+ * @param ticket the ticket returned by I2Csubmit()
+ * @return true if the transaction has completed or failed, false if it is still in progress
+ */
+bool I2Cpoll(int ticket) {
+  if (ticket < 0)
+    return true;
+
+  I2Cservice((tSensors)(ticket / I2C_QUEUE_SIZE));
+  return (I2CQueue[ticket].state == I2C_TX_DONE) || (I2CQueue[ticket].state == I2C_TX_ERROR);
+}
+
+
+/**
+ * Wait for a queued transaction to finish.  Other tasks get the CPU
+ * while the transaction is in progress.
+ * @param ticket the ticket returned by I2Csubmit()
+ * @return true if no error occured, false if it did
+ */
+bool I2Cwait(int ticket) {
+  if (ticket < 0)
+    return false;
+
+  I2CTaskTicket[nCurrentTask] = ticket;
+  while (!I2Cpoll(I2CTaskTicket[nCurrentTask]))
+    EndTimeSlice();
+
+  return (I2CQueue[I2CTaskTicket[nCurrentTask]].state == I2C_TX_DONE);
+}
+
+
+/**
+ * Collect the reply of a completed transaction and free up its queue slot.
+ * If the transaction is still in progress, this will wait for it.
+ *
+ * This is a macro, so reply is filled in by the caller rather than through a
+ * reference another task could change while waiting.
+ * @param ticket the ticket returned by I2Csubmit()
+ * @param reply holds the data from the reply
+ * @return true if no error occured, false if it did
+ */
+#define I2Creap(ticket, reply) (I2Cwait(ticket) ? _I2Ctake(ticket, reply) : _I2Cdrop(ticket))
+
+
+/**
+ * Copy the reply of a completed transaction and free up its queue slot.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param ticket the ticket returned by I2Csubmit()
+ * @param reply holds the data from the reply
+ * @return true
+ */
+bool _I2Ctake(int ticket, tByteArray &reply) {
+  memcpy(reply, I2CQueue[ticket].reply, sizeof(tByteArray));
+  I2CQueue[ticket].state = I2C_TX_FREE;
+  return true;
+}
+
+
+/**
+ * Free up the queue slot of a failed transaction.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param ticket the ticket returned by I2Csubmit()
+ * @return false
+ */
+bool _I2Cdrop(int ticket) {
+  if (ticket >= 0)
+    I2CQueue[ticket].state = I2C_TX_FREE;
+  return false;
+}
+
+
+/**
+ * Send a message and read the reply in one go, giving up the CPU while the bus
+ * is busy.  This is the queued equivalent of a writeI2C()/readI2C() pair and
+ * can be used as a drop-in replacement for it.  It's a macro, like I2Creap().
+ * @param link the port number
+ * @param data the data to be sent
+ * @param reply holds the data from the reply
+ * @param replylen the number of bytes (if any) expected in reply to this command
+ * @return true if no error occured, false if it did
+ */
+#define I2Ctransfer(link, data, reply, replylen) (I2Cwait(_I2Cenqueue(link, data, replylen)) ? _I2Ctake(I2CTaskTicket[nCurrentTask], reply) : _I2Cdrop(I2CTaskTicket[nCurrentTask]))
+
+
+/**
+ * Queue the message of I2Ctransfer(), waiting for a free slot if the queue
+ * is full.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the port number
+ * @param data the data to be sent
+ * @param replylen the number of bytes (if any) expected in reply to this command
+ * @return the ticket, also kept in I2CTaskTicket
+ */
+int _I2Cenqueue(tSensors link, tByteArray &data, int replylen) {
+  // data doesn't survive waiting for a slot, queue a copy of it
+  memcpy(I2CTaskRequest[nCurrentTask], data, sizeof(tByteArray));
+  I2CTaskPort[nCurrentTask] = link;
+  I2CTaskReplyLen[nCurrentTask] = replylen;
+
+  // Queue is full, wait for a slot to free up
+  while (I2Csubmit(I2CTaskPort[nCurrentTask], I2CTaskRequest[nCurrentTask], I2CTaskReplyLen[nCurrentTask]) < 0)
+    EndTimeSlice();
+
+  return I2CTaskTicket[nCurrentTask];
+}
+
+
+/**
+ * Read a window of contiguous registers in a single transaction and keep it
+ * around.  As long as the snapshot is younger than the port's TTL and covers the
+ * same window, it is not read again, so several getters can share one transaction.
+ *
+ * This is a macro, like I2CreadRegisters().
+ * @param link the port number
+ * @param snapshot the snapshot to be refreshed
+ * @param address the I2C address of the device
+ * @param reg the first register of the window
+ * @param size the number of registers to read, 16 at most
+ * @return true if no error occured, false if it did
+ */
+#define I2CreadSnapshot(link, snapshot, address, reg, size) (_I2CsnapshotFresh(link, snapshot, address, reg, size) || (_I2CrequestRegisters(link, I2C_DESC(address, reg), size) && _I2CsnapshotFill(link, snapshot, address, reg, size)))
+
+
+/**
+ * Check whether a snapshot can be used as it is, invalidate it if it can't.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the port number
+ * @param snapshot the snapshot to be checked
+ * @param address the I2C address of the device
+ * @param reg the first register of the window
+ * @param size the number of registers in the window
+ * @return true if the snapshot is valid, false if it must be read
+ */
+bool _I2CsnapshotFresh(tSensors link, tI2CSnapshot &snapshot, ubyte address, ubyte reg, ubyte size) {
+  if (snapshot.valid && (snapshot.address == address) && (snapshot.reg == reg) && (snapshot.size == size) &&
+      ((nPgmTime - snapshot.timestamp) < I2CSnapshotTTL[link]))
+    return true;
+
+  snapshot.valid = false;
+  return false;
+}
+
+
+/**
+ * Read the reply to the request of I2CreadSnapshot() into the snapshot.
+ * Everything is filled in before _readI2C() is called, as it only gives up
+ * the CPU once it has read the reply, and only undone when it fails, which
+ * it does before giving up the CPU.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the port number
+ * @param snapshot the snapshot to be filled in
+ * @param address the I2C address of the device
+ * @param reg the first register of the window
+ * @param size the number of registers in the window
+ * @return true if no error occured, false if it did
+ */
+bool _I2CsnapshotFill(tSensors link, tI2CSnapshot &snapshot, ubyte address, ubyte reg, ubyte size) {
+  snapshot.timestamp = nPgmTime;
+  snapshot.address = address;
+  snapshot.reg = reg;
+  snapshot.size = size;
+  snapshot.valid = true;
+
+  if (!_readI2C(link, snapshot.data, size)) {
+    snapshot.valid = false;
+    return false;
+  }
+  return true;
+}
+
+
+/**
+ * Force the next I2CreadSnapshot() to read the registers from the device.
+ * Drivers should call this after writing to the device.
+ * @param snapshot the snapshot to be invalidated
+ */
+void I2CinvalidateSnapshot(tI2CSnapshot &snapshot) {
+  snapshot.valid = false;
+}
+
+
+/**
+ * Set how long register snapshots on a port remain valid.  A TTL of 0
+ * disables caching altogether.
+ * @param link the port number
+ * @param ttl the time in ms a snapshot remains valid
+ */
+void I2CsetSnapshotTTL(tSensors link, int ttl) {
+  I2CSnapshotTTL[link] = ttl;
+}
+
+
+#ifdef __COMMON_H_MMUX_SHADOW__
+/**
+ * Compare a motor command with the last one sent to the same MMUX channel and
+ * remember it.  Only commands that can be sent again without changing what the
+ * motor does should be marked as repeatable, a command with an encoder or time
+ * target restarts the move every time it is sent.
+ *
+ * Note: this is an internal function and shouldn't be used directly
+ * @param data the mmuxData entry of the MMUX
+ * @param channel the motor channel, 0-3
+ * @param target the setpoint or duration of the command
+ * @param power the power of the command
+ * @param extra any other byte the command carries, like the time target or steering
+ * @param command the command byte
+ * @param repeatable whether sending the command twice has the same effect as sending it once
+ * @return MMUX_SHADOW_NONE if the command doesn't have to be sent, MMUX_SHADOW_POWER if only
+ *         the power changed, MMUX_SHADOW_ALL otherwise
+ */
+ubyte MMUXcheckShadow(mmuxDataT &data, ubyte channel, long target, byte power, ubyte extra, ubyte command, bool repeatable) {
+  ubyte result = MMUX_SHADOW_ALL;
+
+  if (!repeatable) {
+    data.shadowValid[channel] = false;
+    return MMUX_SHADOW_ALL;
+  }
+
+  if (data.shadowValid[channel] &&
+      data.shadowTarget[channel] == target &&
+      data.shadowExtra[channel] == extra &&
+      data.shadowCommand[channel] == command)
+    result = (data.shadowPower[channel] == power) ? MMUX_SHADOW_NONE : MMUX_SHADOW_POWER;
+
+  data.shadowValid[channel] = true;
+  data.shadowTarget[channel] = target;
+  data.shadowPower[channel] = power;
+  data.shadowExtra[channel] = extra;
+  data.shadowCommand[channel] = command;
+  return result;
+}
+
+
+/**
+ * Make sure the next command to a motor is sent in full.  Drivers call this
+ * when a write fails or when they send a command that doesn't go through
+ * MMUXcheckShadow().
+ * @param data the mmuxData entry of the MMUX
+ * @param channel the motor channel, 0-3
+ */
+void MMUXinvalidateShadow(mmuxDataT &data, ubyte channel) {
+  data.shadowValid[channel] = false;
+}
+
+
+/**
+ * Make sure the next command to every motor of an MMUX is sent in full.
+ * @param data the mmuxData entry of the MMUX
+ */
+void MMUXinvalidateShadow(mmuxDataT &data) {
+  memset(data.shadowValid[0], false, 4);
+}
+#endif // __COMMON_H_MMUX_SHADOW__
+
+
+/*
+ * Initialise the smuxData array needed for keeping track of sensor settings
+ */
+void HTSMUXinit(){
+  memset(smuxData, 0xFF, sizeof(smuxDataT)*4);
+  for (int i = 0; i < 4; i++) {
+    // memset(smuxData[i].sensor, 0xFF, sizeof(HTSMUXSensorType)*4);
+    smuxData[i].status = HTSMUX_STAT_NOTHING;
+    smuxData[i].initialised = true;
+    smuxData[i].configuring = false;
+    smuxScanState[i] = HTSMUX_SCAN_IDLE;
+#ifdef __COMMON_H_SMUX_SCAN_FILE__
+    smuxScanTrusted[i] = false;
+#endif // __COMMON_H_SMUX_SCAN_FILE__
+  }
+}
+
+
+/**
+ * Check whether the SMUX is auto-detecting its channels, either by itself
+ * or as part of a scan started with HTSMUXscanStart().  Talking to it then,
+ * other than to move the scan along, would abort the auto-detect.  An SMUX
+ * whose saved channel types turned out wrong is left alone until it has been
+ * scanned again, see HTSMUXscanCached().
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the SMUX port number
+ * @return true if the SMUX must be left alone, false if not
+ */
+bool _HTSMUXbusy(tSensors link) {
+  return (smuxData[link].status == HTSMUX_STAT_BUSY) || (smuxScanState[link] == HTSMUX_SCAN_STALE) ||
+         ((smuxScanState[link] >= HTSMUX_SCAN_HALT) && (smuxScanState[link] <= HTSMUX_SCAN_READ));
+}
+
+
+/**
+ * Claim the SMUX for the calling task, so the poll task and a read from
+ * another task don't talk to it, or change its snapshots, at the same time.
+ * Without __COMMON_H_SMUX_POLLER__ there is nothing to claim.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the SMUX port number
+ * @param wait wait for the other task to finish when it's in use
+ * @return true if the SMUX was claimed, false if it's in use and wait is false
+ */
+bool _HTSMUXclaim(tSensors link, bool wait) {
+#ifdef __COMMON_H_SMUX_POLLER__
+  while (true) {
+    hogCPU();
+    if ((smuxUser[link] == 0) || (smuxUser[link] == nCurrentTask + 1)) {
+      smuxUser[link] = nCurrentTask + 1;
+      releaseCPU();
+      return true;
+    }
+    releaseCPU();
+    if (!wait)
+      return false;
+    EndTimeSlice();
+  }
+#endif // __COMMON_H_SMUX_POLLER__
+  return true;
+}
+
+
+/**
+ * Give up an SMUX claimed with _HTSMUXclaim().
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the SMUX port number
+ */
+void _HTSMUXrelease(tSensors link) {
+#ifdef __COMMON_H_SMUX_POLLER__
+  hogCPU();
+  if (smuxUser[link] == nCurrentTask + 1)
+    smuxUser[link] = 0;
+  releaseCPU();
+#endif // __COMMON_H_SMUX_POLLER__
+}
+
+
+/**
+ * Read the status of the SMUX
+ *
+ * The status byte is made up of the following bits:
+ *
+ * | D7 | D6 | D4 | D3 | D2 | D1 | D1 |
+ * -D1 - HTSMUX_STAT_BATT: No battery voltage detected
+ * -D2 - HTSMUX_STAT_BUSY: Auto-dected in progress status
+ * -D3 - HTSMUX_STAT_HALT: Multiplexer is halted
+ * -D4 - HTSMUX_STAT_ERROR: Command error detected
+ * @param link the SMUX port number
+ * @return the status byte
+ */
+byte HTSMUXreadStatus(tSensors link) {
+  memset(HTSMUX_I2CRequest, 0, sizeof(tByteArray));
+
+  HTSMUX_I2CRequest.arr[0] = 2;               // Message size
+  HTSMUX_I2CRequest.arr[1] = HTSMUX_I2C_ADDR; // I2C Address
+  HTSMUX_I2CRequest.arr[2] = HTSMUX_STATUS;
+
+  if (!writeI2C(link, HTSMUX_I2CRequest, 1))
+    return -1;
+
+  if (!readI2C(link, HTSMUX_I2CReply, 1))
+    return -1;
+
+  return HTSMUX_I2CReply.arr[0];
+}
+
+
+/**
+ * Get the sensor type attached to specified SMUX port
+ * @param link the SMUX port number
+ * @param channel the SMUX channel number
+ * @return the status byte
+ */
+HTSMUXSensorType HTSMUXreadSensorType(tSensors link, byte channel) {
+  return smuxData[link].sensor[channel];
+}
+
+
+/**
+ * Get the sensor type attached to specified SMUX port
+ * @param muxsensor the SMUX sensor port number
+ * @return the status byte
+ */
+HTSMUXSensorType HTSMUXreadSensorType(tMUXSensor muxsensor) {
+  return smuxData[SPORT(muxsensor)].sensor[MPORT(muxsensor)];
+}
+
+
+/**
+ * Set the mode of a SMUX channel.
+ *
+ * Mode can be one or more of the following:
+ * -HTSMUX_CHAN_I2C
+ * -HTSMUX_CHAN_9V
+ * -HTSMUX_CHAN_DIG0_HIGH
+ * -HTSMUX_CHAN_DIG1_HIGH
+ * -HTSMUX_CHAN_I2C_SLOW
+ *
+ * Between HTSMUXbeginConfig() and HTSMUXcommitConfig() the mode is only
+ * collected.
+ * @param link the SMUX port number
+ * @param channel the SMUX channel number
+ * @param mode the mode to set the channel to
+ * @return true if no error occured, false if it did
+ */
+bool HTSMUXsetMode(tSensors link, byte channel, byte mode) {
+  // If we're in the middle of a scan, abort this call
+  if (_HTSMUXbusy(link)) {
+    return false;
+  } else if (smuxData[link].configuring) {
+    // Applied by HTSMUXcommitConfig()
+    smuxData[link].pendingMode[channel] = mode;
+    return true;
+  } else if (smuxData[link].status != HTSMUX_STAT_HALT) {
+	  // Always make sure the SMUX is in the halted state
+	  if (!HTSMUXsendCommand(link, HTSMUX_CMD_HALT))
+	    return false;
+	  wait1Msec(50);
+	}
+
+  if (!I2CwriteRegister(link, HTSMUX_I2C_ADDR, HTSMUX_CH_OFFSET + HTSMUX_MODE + (HTSMUX_CH_ENTRY_SIZE * channel), mode))
+    return false;
+
+  return I2CsyncWrites(link);
+}
+
+
+/**
+ * Set the mode of a SMUX channel.
+ *
+ * Mode can be one or more of the following:
+ * -HTSMUX_CHAN_I2C
+ * -HTSMUX_CHAN_9V
+ * -HTSMUX_CHAN_DIG0_HIGH
+ * -HTSMUX_CHAN_DIG1_HIGH
+ * -HTSMUX_CHAN_I2C_SLOW
+ * @param muxsensor the SMUX sensor port number
+ * @param mode the mode to set the channel to
+ * @return true if no error occured, false if it did
+ */
+bool HTSMUXsetMode(tMUXSensor muxsensor, byte mode) {
+  return HTSMUXsetMode((tSensors)SPORT(muxsensor), MPORT(muxsensor), mode);
+}
+
+
+/**
+ * Set which registers the SMUX copies from the I2C sensor on a channel into
+ * the channel's buffer.  The SMUX keeps refreshing the buffers of all its I2C
+ * channels in turn, so the fewer registers a channel copies, the more often
+ * every channel is refreshed.  Drivers provide the window they need, see
+ * HTACsetSMUXWindow() for example.
+ *
+ * The SMUX is halted to change the window and started again by the next read
+ * or by HTSMUXcommitConfig().  The window is lost on the next auto-detect.
+ * @param link the SMUX port number
+ * @param channel the SMUX channel number
+ * @param address the I2C address of the sensor
+ * @param reg the first register to copy, it ends up at offset 0 of the buffer
+ * @param count the number of registers to copy, HTSMUX_BF_ENTRY_SIZE at most
+ * @return true if no error occured, false if it did
+ */
+bool HTSMUXsetWindow(tSensors link, byte channel, ubyte address, ubyte reg, ubyte count) {
+  // If we're in the middle of a scan, abort this call
+  if (_HTSMUXbusy(link)) {
+    return false;
+  } else if (smuxData[link].status != HTSMUX_STAT_HALT) {
+    // Always make sure the SMUX is in the halted state
+    if (!HTSMUXsendCommand(link, HTSMUX_CMD_HALT))
+      return false;
+    wait1Msec(50);
+  }
+
+  // Count, device address and memory address are adjacent
+  HTSMUX_I2CRequest.arr[0] = 5;                 // Message size
+  HTSMUX_I2CRequest.arr[1] = HTSMUX_I2C_ADDR;   // I2C Address
+  HTSMUX_I2CRequest.arr[2] = HTSMUX_CH_OFFSET + HTSMUX_I2C_COUNT + (HTSMUX_CH_ENTRY_SIZE * channel);
+  HTSMUX_I2CRequest.arr[3] = min(count, HTSMUX_BF_ENTRY_SIZE);
+  HTSMUX_I2CRequest.arr[4] = address;
+  HTSMUX_I2CRequest.arr[5] = reg;
+
+  return writeI2C(link, HTSMUX_I2CRequest, 0);
+}
+
+
+/**
+ * Set which registers the SMUX copies from the I2C sensor on a channel into
+ * the channel's buffer.
+ * @param muxsensor the SMUX sensor port number
+ * @param address the I2C address of the sensor
+ * @param reg the first register to copy, it ends up at offset 0 of the buffer
+ * @param count the number of registers to copy, HTSMUX_BF_ENTRY_SIZE at most
+ * @return true if no error occured, false if it did
+ */
+bool HTSMUXsetWindow(tMUXSensor muxsensor, ubyte address, ubyte reg, ubyte count) {
+  return HTSMUXsetWindow((tSensors)SPORT(muxsensor), MPORT(muxsensor), address, reg, count);
+}
+
+
+/**
+ * Start collecting mode changes for the specified SMUX.  Until
+ * HTSMUXcommitConfig() is called, HTSMUXsetMode(), HTSMUXsetAnalogueActive()
+ * and HTSMUXsetAnalogueInactive() only remember the new modes, so changing
+ * several channels costs one halt and one restart instead of one of each per
+ * channel.
+ * @param link the SMUX port number
+ * @return true if no error occured, false if it did
+ */
+bool HTSMUXbeginConfig(tSensors link) {
+  if (_HTSMUXbusy(link))
+    return false;
+
+  memset(smuxData[link].pendingMode, HTSMUX_MODE_NONE, 4);
+  smuxData[link].configuring = true;
+  return true;
+}
+
+
+/**
+ * Apply the mode changes collected since HTSMUXbeginConfig(): halt the
+ * SMUX once, write the changed mode registers and start it again.  If the
+ * SMUX is busy or the halt or a mode write fails, the changes are kept and
+ * the SMUX is still being configured, so the call can be repeated.
+ *
+ * Note: the mode registers are HTSMUX_CH_ENTRY_SIZE apart, so they can't be
+ * written in one message without also rewriting the registers in between,
+ * which costs more bus time than writing them one by one.
+ * @param link the SMUX port number
+ * @return true if no error occured, false if it did
+ */
+bool HTSMUXcommitConfig(tSensors link) {
+  bool changed = false;
+  bool ok = true;
+  byte status = smuxData[link].status;
+
+  if (!smuxData[link].configuring)
+    return true;
+
+  // If we're in the middle of a scan, abort this call
+  if (_HTSMUXbusy(link))
+    return false;
+
+  // Nothing to do if no channel changed, HTSMUXsetWindow() leaves the SMUX halted
+  for (int i = 0; i < 4; i++) {
+    if (smuxData[link].pendingMode[i] != HTSMUX_MODE_NONE)
+      changed = true;
+  }
+  if (!changed && status != HTSMUX_STAT_HALT) {
+    smuxData[link].configuring = false;
+    return true;
+  }
+
+  if (status != HTSMUX_STAT_HALT) {
+    if (!HTSMUXsendCommand(link, HTSMUX_CMD_HALT)) {
+      // Halt it again next time
+      smuxData[link].status = status;
+      return false;
+    }
+    wait1Msec(50);
+  }
+
+  for (int i = 0; i < 4; i++) {
+    if (smuxData[link].pendingMode[i] == HTSMUX_MODE_NONE)
+      continue;
+    if (!I2CwriteRegister(link, HTSMUX_I2C_ADDR, HTSMUX_CH_OFFSET + HTSMUX_MODE + (HTSMUX_CH_ENTRY_SIZE * i), smuxData[link].pendingMode[i]))
+      ok = false;
+  }
+
+  if (!_I2CsendPending(link) || !ok)
+    return false;
+
+  // The modes are in, a failed RUN leaves the SMUX to be started by the next read
+  memset(smuxData[link].pendingMode, HTSMUX_MODE_NONE, 4);
+  smuxData[link].configuring = false;
+  return HTSMUXsendCommand(link, HTSMUX_CMD_RUN);
+}
+
+
+/**
+ * Set the mode of an analogue channel to Active (turn the light on)
+ * @param muxsensor the SMUX sensor port number
+ * @return true if no error occured, false if it did
+ */
+bool HTSMUXsetAnalogueActive(tMUXSensor muxsensor) {
+  if (smuxData[SPORT(muxsensor)].sensor[MPORT(muxsensor)] != HTSMUXAnalogue)
+    return false;
+
+  if (!HTSMUXsetMode((tSensors)SPORT(muxsensor), MPORT(muxsensor), HTSMUX_CHAN_DIG0_HIGH))
+    return false;
+
+  // HTSMUXcommitConfig() will start the SMUX
+  if (smuxData[SPORT(muxsensor)].configuring)
+    return true;
+
+  return HTSMUXsendCommand((tSensors)SPORT(muxsensor), HTSMUX_CMD_RUN);
+}
+
+
+/**
+ * Set the mode of an analogue channel to Inactive (turn the light off)
+ * @param muxsensor the SMUX sensor port number
+ * @return true if no error occured, false if it did
+ */
+bool HTSMUXsetAnalogueInactive(tMUXSensor muxsensor) {
+  if (smuxData[SPORT(muxsensor)].sensor[MPORT(muxsensor)] != HTSMUXAnalogue)
+	  return false;
+
+  if (!HTSMUXsetMode((tSensors)SPORT(muxsensor), MPORT(muxsensor), 0))
+    return false;
+
+  // HTSMUXcommitConfig() will start the SMUX
+  if (smuxData[SPORT(muxsensor)].configuring)
+    return true;
+
+  return HTSMUXsendCommand((tSensors)SPORT(muxsensor), HTSMUX_CMD_RUN);
+}
+
+
+/**
+ * Scan the specified SMUX's channels and configure them.
+ *
+ * Note: this functions takes 600ms to return while the scan is
+ * in progress, use HTSMUXscanStart() to scan in the background.
+ * @param link the SMUX port number
+ * @return true if no error occured, false if it did
+ */
+bool HTSMUXscanPorts(tSensors link) {
+  if (!HTSMUXscanStart(link))
+    return false;
+
+  while (HTSMUXscanStep(link)) {
+    if (smuxScanState[link] == HTSMUX_SCAN_HALT)
+      wait1Msec(max(1, HTSMUX_HALT_TIME - (nPgmTime - smuxScanStarted[link])));
+    else if (smuxScanState[link] == HTSMUX_SCAN_DETECT)
+      wait1Msec(max(1, HTSMUX_DETECT_TIME - (nPgmTime - smuxScanStarted[link])));
+  }
+  return (smuxScanState[link] == HTSMUX_SCAN_DONE);
+}
+
+
+/**
+ * Read the types of all four channels in one go and store them in smuxData.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the SMUX port number
+ * @return true if no error occured, false if it did
+ */
+bool _HTSMUXreadChannelTypes(tSensors link) {
+  // The type registers are HTSMUX_CH_ENTRY_SIZE apart, so all four fit in a single 16 byte read
+  if (!I2CreadRegisters(link, I2C_DESC(HTSMUX_I2C_ADDR, HTSMUX_CH_OFFSET + HTSMUX_TYPE), HTSMUX_I2CReply, 16))
+    return false;
+
+  for (int i = 0; i < 4; i++)
+    smuxData[link].sensor[i] = (HTSMUXSensorType)ubyteToInt(HTSMUX_I2CReply.arr[HTSMUX_CH_ENTRY_SIZE * i]);
+  return true;
+}
+
+
+/**
+ * Finish a scan: apply the HTPB work-around and tell the port registry
+ * there's an SMUX on the port.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the SMUX port number
+ */
+void _HTSMUXscanFinish(tSensors link) {
+  // Work-around for galloping buffer problem, applies to the HTPBs only.
+  for (int i = 0; i < 4; i++) {
+    if (smuxData[link].sensor[i] == HTSMUXProto) {
+      HTSMUX_I2CRequest.arr[0] = 3;                 // Message size
+      HTSMUX_I2CRequest.arr[1] = HTSMUX_I2C_ADDR;   // I2C Address
+      HTSMUX_I2CRequest.arr[2] = HTSMUX_CH_OFFSET + HTSMUX_I2C_COUNT + (HTSMUX_CH_ENTRY_SIZE * i);
       HTSMUX_I2CRequest.arr[3] = 14;
       if (!writeI2C(link, HTSMUX_I2CRequest, 0))
         smuxData[link].sensor[i] = HTSMUXSensorNone;
     }
   }
+
+  I2CsetPortMux(link, I2C_PORT_SMUX);
+  smuxScanState[link] = HTSMUX_SCAN_DONE;
+}
+
+
+/**
+ * Start scanning the specified SMUX's channels in the background.  Call
+ * HTSMUXscanStep() regularly until it returns false, HTSMUXscanState()
+ * and HTSMUXscanProgress() tell how far along it is.  Several SMUXes can
+ * be scanned at the same time.
+ *
+ * Until the scan is done, the functions that read from or configure the SMUX
+ * return an error rather than start it and abort the auto-detect.
+ * @param link the SMUX port number
+ * @return true if no error occured, false if it did
+ */
+bool HTSMUXscanStart(tSensors link) {
+  // If we're in the middle of a scan, abort this call
+  if (_HTSMUXbusy(link) && (smuxScanState[link] != HTSMUX_SCAN_STALE))
+    return false;
+
+#ifdef __COMMON_H_SMUX_SCAN_FILE__
+  smuxScanTrusted[link] = false;
+#endif // __COMMON_H_SMUX_SCAN_FILE__
+
+  // Always make sure the SMUX is in the halted state
+  if (!HTSMUXsendCommand(link, HTSMUX_CMD_HALT)) {
+    smuxScanState[link] = HTSMUX_SCAN_FAILED;
+    return false;
+  }
+  smuxScanState[link] = HTSMUX_SCAN_HALT;
+  smuxScanStarted[link] = nPgmTime;
+  return true;
+}
+
+
+/**
+ * Move a scan started with HTSMUXscanStart() along.  This never waits for
+ * the SMUX, it only sends what's due, so it can be called from a loop that
+ * does other work.
+ * It also starts the full scan of an SMUX whose saved channel types turned
+ * out wrong, see HTSMUXscanCached().
+ * @param link the SMUX port number
+ * @return true if the scan is still in progress, false if it is done or failed
+ */
+bool HTSMUXscanStep(tSensors link) {
+#ifdef __COMMON_H_SMUX_SCAN_FILE__
+  bool changed = false;
+#endif // __COMMON_H_SMUX_SCAN_FILE__
+
+  switch (smuxScanState[link]) {
+    case HTSMUX_SCAN_STALE:
+      return HTSMUXscanStart(link);
+
+    case HTSMUX_SCAN_HALT:
+      if (nPgmTime - smuxScanStarted[link] < HTSMUX_HALT_TIME)
+        return true;
+      // Commence scanning the ports and allow up to 500ms to complete
+      if (!HTSMUXsendCommand(link, HTSMUX_CMD_AUTODETECT)) {
+        smuxScanState[link] = HTSMUX_SCAN_FAILED;
+        return false;
+      }
+      smuxScanState[link] = HTSMUX_SCAN_DETECT;
+      smuxScanStarted[link] = nPgmTime;
+      return true;
+
+    case HTSMUX_SCAN_DETECT:
+      if (nPgmTime - smuxScanStarted[link] < HTSMUX_DETECT_TIME)
+        return true;
+      smuxData[link].status = HTSMUX_STAT_HALT;
+      smuxScanState[link] = HTSMUX_SCAN_READ;
+      return true;
+
+    case HTSMUX_SCAN_READ:
+      if (!_HTSMUXreadChannelTypes(link)) {
+        for (int i = 0; i < 4; i++)
+          smuxData[link].sensor[i] = HTSMUXSensorNone;
+      }
+      _HTSMUXscanFinish(link);
+
+#ifdef __COMMON_H_SMUX_SCAN_FILE__
+      // Only touch the flash when the wiring changed
+      _HTSMUXscanLoad();
+      for (int i = 0; i < 4; i++) {
+        if ((ubyte)smuxData[link].sensor[i] != smuxScanFile[(link * 4) + i])
+          changed = true;
+      }
+      if (changed || ((smuxScanFilePorts & (1 << link)) == 0))
+        HTSMUXscanSave();
+#endif // __COMMON_H_SMUX_SCAN_FILE__
+      return false;
+  }
+  return false;
+}
+
+
+#ifdef __COMMON_H_SMUX_SCAN_FILE__
+/**
+ * Work out the CRC-8 of the version, the port mask and the channel types, as
+ * stored at the end of HTSMUX_SCAN_FILE.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @return the CRC
+ */
+ubyte _HTSMUXscanCRC() {
+  int crc = 0;
+
+  for (int i = 0; i < 18; i++) {
+    if (i == 0)
+      crc ^= HTSMUX_SCAN_FILE_VERSION;
+    else if (i == 1)
+      crc ^= smuxScanFilePorts;
+    else
+      crc ^= smuxScanFile[i - 2];
+    for (int j = 0; j < 8; j++)
+      crc = ((crc & 0x80) != 0) ? (((crc << 1) ^ 0x07) & 0xFF) : ((crc << 1) & 0xFF);
+  }
+  return (ubyte)crc;
+}
+
+
+/**
+ * Read HTSMUX_SCAN_FILE into smuxScanFile, once.  A file that is cut short,
+ * damaged or in another format is ignored, the next full scan replaces it.
+ *
+ * Note: this is an internal function and should not be called directly
+ */
+void _HTSMUXscanLoad() {
+  TFileIOResult nIoResult;
+  TFileHandle hFileHandle;
+  int fileSize = 0;
+  ubyte version = 0;
+  ubyte crc = 0;
+
+  if (smuxScanFileLoaded)
+    return;
+
+  smuxScanFileLoaded = true;
+  smuxScanFilePorts = 0;
+  memset(smuxScanFile, 0xFF, sizeof(smuxScanFile));
+
+  OpenRead(hFileHandle, nIoResult, HTSMUX_SCAN_FILE, fileSize);
+  if (nIoResult != ioRsltSuccess)
+    return;
+
+  if (fileSize == HTSMUX_SCAN_FILE_SIZE) {
+    ReadByte(hFileHandle, nIoResult, version);
+    ReadByte(hFileHandle, nIoResult, smuxScanFilePorts);
+    for (int i = 0; i < 16; i++)
+      ReadByte(hFileHandle, nIoResult, smuxScanFile[i]);
+    ReadByte(hFileHandle, nIoResult, crc);
+  }
+  if ((fileSize != HTSMUX_SCAN_FILE_SIZE) || (nIoResult != ioRsltSuccess) ||
+      (version != HTSMUX_SCAN_FILE_VERSION) || (crc != _HTSMUXscanCRC())) {
+    smuxScanFilePorts = 0;
+    memset(smuxScanFile, 0xFF, sizeof(smuxScanFile));
+  }
+  Close(hFileHandle, nIoResult);
+}
+
+
+/**
+ * Write the channel types of all the scanned SMUXes to HTSMUX_SCAN_FILE, so
+ * the next HTSMUXscanCached() can use them.  HTSMUXscanStep() does this after
+ * every full scan that found something new.
+ * @return true if no error occured, false if it did
+ */
+bool HTSMUXscanSave() {
+  TFileIOResult nIoResult;
+  TFileHandle hFileHandle;
+  int fileSize = HTSMUX_SCAN_FILE_SIZE;
+
+  _HTSMUXscanLoad();
+  for (int i = 0; i < 4; i++) {
+    if (smuxScanState[i] != HTSMUX_SCAN_DONE)
+      continue;
+    for (int j = 0; j < 4; j++)
+      smuxScanFile[(i * 4) + j] = (ubyte)smuxData[i].sensor[j];
+    smuxScanFilePorts |= (1 << i);
+  }
+
+  Delete(HTSMUX_SCAN_FILE, nIoResult);
+  OpenWrite(hFileHandle, nIoResult, HTSMUX_SCAN_FILE, fileSize);
+  if (nIoResult != ioRsltSuccess) {
+    Close(hFileHandle, nIoResult);
+    return false;
+  }
+
+  WriteByte(hFileHandle, nIoResult, HTSMUX_SCAN_FILE_VERSION);
+  WriteByte(hFileHandle, nIoResult, smuxScanFilePorts);
+  for (int i = 0; i < 16; i++)
+    WriteByte(hFileHandle, nIoResult, smuxScanFile[i]);
+  WriteByte(hFileHandle, nIoResult, _HTSMUXscanCRC());
+
+  Close(hFileHandle, nIoResult);
+  return (nIoResult == ioRsltSuccess);
+}
+
+
+/**
+ * Use the channel types the last full scan saved to HTSMUX_SCAN_FILE instead
+ * of scanning the SMUX, so a boot with unchanged wiring skips the 600 ms
+ * auto-detect.  The scan is done at once.  The types are checked against
+ * the ones the SMUX reports when it's first started, which costs a single
+ * read.  If they differ, that start fails, HTSMUXscanState() returns
+ * HTSMUX_SCAN_STALE and the readers refuse until HTSMUXscanStep() or
+ * HTSMUXscanPorts() has done a full scan.  Without a valid file entry for the
+ * port, this starts a full scan like HTSMUXscanStart().
+ *
+ * The SMUX reports what it found the last time it was told to auto-detect,
+ * so sensors swapped with the power off go unnoticed until the next full scan.
+ * @param link the SMUX port number
+ * @return true if no error occured, false if it did
+ */
+bool HTSMUXscanCached(tSensors link) {
+  // If we're in the middle of a scan, abort this call
+  if (_HTSMUXbusy(link))
+    return false;
+
+  _HTSMUXscanLoad();
+  if ((smuxScanFilePorts & (1 << link)) == 0)
+    return HTSMUXscanStart(link);
+
+  for (int i = 0; i < 4; i++)
+    smuxData[link].sensor[i] = (HTSMUXSensorType)smuxScanFile[(link * 4) + i];
+  smuxData[link].status = HTSMUX_STAT_NOTHING;
+  smuxScanTrusted[link] = true;
+  _HTSMUXscanFinish(link);
   return true;
 }
 
 
+/**
+ * Check the channel types HTSMUXscanCached() took from HTSMUX_SCAN_FILE
+ * against the ones the SMUX reports, in a single read.  If they differ, the
+ * entry for the port is dropped and the scan is marked HTSMUX_SCAN_STALE.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the SMUX port number
+ * @return true if the types match, false if they don't or couldn't be read
+ */
+bool _HTSMUXscanCheck(tSensors link) {
+  bool changed = false;
+
+  // The type registers are HTSMUX_CH_ENTRY_SIZE apart, so all four fit in a single 16 byte read
+  if (!I2CreadRegisters(link, I2C_DESC(HTSMUX_I2C_ADDR, HTSMUX_CH_OFFSET + HTSMUX_TYPE), HTSMUX_I2CReply, 16))
+    return false;
+
+  smuxScanTrusted[link] = false;
+  for (int i = 0; i < 4; i++) {
+    if (ubyteToInt(HTSMUX_I2CReply.arr[HTSMUX_CH_ENTRY_SIZE * i]) != (ubyte)smuxData[link].sensor[i])
+      changed = true;
+  }
+  if (!changed)
+    return true;
+
+  // The full scan saves what it finds
+  smuxScanFilePorts &= ~(1 << link);
+  for (int i = 0; i < 4; i++)
+    smuxData[link].sensor[i] = HTSMUXSensorNone;
+  smuxScanState[link] = HTSMUX_SCAN_STALE;
+  return false;
+}
+#endif // __COMMON_H_SMUX_SCAN_FILE__
+
+
+/**
+ * Get the state of the scan on the specified SMUX.
+ * @param link the SMUX port number
+ * @return one of the HTSMUX_SCAN_* values
+ */
+byte HTSMUXscanState(tSensors link) {
+  return smuxScanState[link];
+}
+
+
+/**
+ * Get how far along the scan on the specified SMUX is.
+ * @param link the SMUX port number
+ * @return the progress in percent, 100 once the scan is done or has failed
+ */
+int HTSMUXscanProgress(tSensors link) {
+  switch (smuxScanState[link]) {
+    case HTSMUX_SCAN_HALT:
+      return min(nPgmTime - smuxScanStarted[link], HTSMUX_HALT_TIME) / ((HTSMUX_HALT_TIME + HTSMUX_DETECT_TIME) / 100);
+    case HTSMUX_SCAN_DETECT:
+      return (HTSMUX_HALT_TIME + min(nPgmTime - smuxScanStarted[link], HTSMUX_DETECT_TIME)) / ((HTSMUX_HALT_TIME + HTSMUX_DETECT_TIME) / 100);
+    case HTSMUX_SCAN_READ:
+      return 99;
+    case HTSMUX_SCAN_IDLE:
+    case HTSMUX_SCAN_STALE:
+      return 0;
+  }
+  return 100;
+}
+
+
 /**
  * Send a command to the SMUX.
  *
@@ -639,6 +3447,12 @@ bool HTSMUXscanPorts(tSensors link) {
  * @return true if no error occured, false if it did
  */
 bool HTSMUXsendCommand(tSensors link, byte command) {
+#ifdef __COMMON_H_SMUX_SCAN_FILE__
+  // The first start after HTSMUXscanCached() checks the channel types it took from the file
+  if ((command == HTSMUX_CMD_RUN) && smuxScanTrusted[link] && !_HTSMUXscanCheck(link))
+    return false;
+#endif // __COMMON_H_SMUX_SCAN_FILE__
+
   memset(HTSMUX_I2CRequest, 0, sizeof(tByteArray));
 
   HTSMUX_I2CRequest.arr[0] = 3;               // Message size
@@ -646,6 +3460,17 @@ bool HTSMUXsendCommand(tSensors link, byte command) {
   HTSMUX_I2CRequest.arr[2] = HTSMUX_COMMAND;
   HTSMUX_I2CRequest.arr[3] = command;
 
+  // Analogue values and buffers read before the SMUX stopped or started are stale,
+  // the count tells the poll task about the ones still on their way
+  hogCPU();
+  smuxCommands[link]++;
+  I2CinvalidateSnapshot(HTSMUX_AnalogueSnapshot[link]);
+#ifdef __COMMON_H_SMUX_POLLER__
+  for (int i = 0; i < 4; i++)
+    smuxShadowValid[(link * 4) + i] = false;
+#endif // __COMMON_H_SMUX_POLLER__
+  releaseCPU();
+
   switch(command) {
     case HTSMUX_CMD_HALT:
         smuxData[link].status = HTSMUX_STAT_HALT;
@@ -653,12 +3478,15 @@ bool HTSMUXsendCommand(tSensors link, byte command) {
     case HTSMUX_CMD_AUTODETECT:
         smuxData[link].status = HTSMUX_STAT_BUSY;
         break;
-    case HTSMUX_CMD_RUN:
-        smuxData[link].status = HTSMUX_STAT_NORMAL;
-        break;
   }
 
-  return writeI2C(link, HTSMUX_I2CRequest, 0);
+  if (!writeI2C(link, HTSMUX_I2CRequest, 0))
+    return false;
+
+  // Only once the SMUX has been told, so the poll task doesn't read it too soon
+  if (command == HTSMUX_CMD_RUN)
+    smuxData[link].status = HTSMUX_STAT_NORMAL;
+  return true;
 }
 
 
@@ -674,23 +3502,31 @@ bool HTSMUXsendCommand(tSensors link, byte command) {
  * @return true if no error occured, false if it did
  */
 bool HTSMUXreadPort(tSensors link, byte channel, tByteArray &result, int numbytes, int offset) {
-  memset(HTSMUX_I2CRequest, 0, sizeof(tByteArray));
-  if (smuxData[link].status != HTSMUX_STAT_NORMAL)
-    HTSMUXsendCommand(link, HTSMUX_CMD_RUN);
+  bool success = false;
 
-  HTSMUX_I2CRequest.arr[0] = 2;                 // Message size
-  HTSMUX_I2CRequest.arr[1] = HTSMUX_I2C_ADDR;   // I2C Address
-  HTSMUX_I2CRequest.arr[2] = HTSMUX_I2C_BUF + (HTSMUX_BF_ENTRY_SIZE * channel) + offset;
+#ifdef __COMMON_H_SMUX_POLLER__
+  if (_HTSMUXreadShadow(link, channel, result, numbytes, offset))
+    return true;
+#endif // __COMMON_H_SMUX_POLLER__
 
-  if (!writeI2C(link, HTSMUX_I2CRequest, numbytes))
+  // If we're in the middle of a scan, abort this call
+  if (_HTSMUXbusy(link))
     return false;
 
-  if (!readI2C(link, HTSMUX_I2CReply, numbytes))
+  _HTSMUXclaim(link, true);
+  if (smuxData[link].status != HTSMUX_STAT_NORMAL)
+    HTSMUXsendCommand(link, HTSMUX_CMD_RUN);
+#ifdef __COMMON_H_SMUX_SCAN_FILE__
+  // The channel types HTSMUXscanCached() took from the file turned out wrong
+  if (_HTSMUXbusy(link)) {
+    _HTSMUXrelease(link);
     return false;
+  }
+#endif // __COMMON_H_SMUX_SCAN_FILE__
 
-  memcpy(result, HTSMUX_I2CReply, sizeof(tByteArray));
-
-  return true;
+  success = I2CreadRegisters(link, I2C_DESC(HTSMUX_I2C_ADDR, HTSMUX_I2C_BUF + (HTSMUX_BF_ENTRY_SIZE * channel) + offset), result, numbytes);
+  _HTSMUXrelease(link);
+  return success;
 }
 
 
@@ -743,24 +3579,48 @@ bool HTSMUXreadPort(tMUXSensor muxsensor, tByteArray &result, int numbytes) {
  * @return the value of the sensor or -1 if an error occurred.
  */
 int HTSMUXreadAnalogue(tSensors link, byte channel) {
+  int value = -1;
+
+  if (smuxData[link].sensor[channel] != HTSMUXAnalogue)
+    return -1;
+
+#ifdef __COMMON_H_SMUX_POLLER__
+  if (smuxAnalogueRate[link] > 0) {
+    // Both bytes have to come from the same poll
+    hogCPU();
+    if (smuxPolling && HTSMUX_AnalogueSnapshot[link].valid)
+      value = _HTSMUXsnapshotAnalogue(link, channel);
+    releaseCPU();
+    if (value >= 0)
+      return value;
+  }
+#endif // __COMMON_H_SMUX_POLLER__
+
+  // If we're in the middle of a scan, abort this call
+  if (_HTSMUXbusy(link))
+    return -1;
+
+  _HTSMUXclaim(link, true);
   memset(HTSMUX_I2CRequest, 0, sizeof(tByteArray));
   if (smuxData[link].status != HTSMUX_STAT_NORMAL)
     HTSMUXsendCommand(link, HTSMUX_CMD_RUN);
-
-  if (smuxData[link].sensor[channel] != HTSMUXAnalogue)
+#ifdef __COMMON_H_SMUX_SCAN_FILE__
+  // The channel types HTSMUXscanCached() took from the file turned out wrong
+  if (_HTSMUXbusy(link)) {
+    _HTSMUXrelease(link);
     return -1;
+  }
+#endif // __COMMON_H_SMUX_SCAN_FILE__
 
   HTSMUX_I2CRequest.arr[0] = 2;               // Message size
   HTSMUX_I2CRequest.arr[1] = HTSMUX_I2C_ADDR;   // I2C Address
   HTSMUX_I2CRequest.arr[2] = HTSMUX_ANALOG + (HTSMUX_AN_ENTRY_SIZE * channel);
 
-  if (!writeI2C(link, HTSMUX_I2CRequest, 2))
-    return -1;
-
-  if (!readI2C(link, HTSMUX_I2CReply, 2))
-    return -1;
+  if (writeI2C(link, HTSMUX_I2CRequest, 2) && readI2C(link, HTSMUX_I2CReply, 2))
+    value = (ubyteToInt(HTSMUX_I2CReply.arr[0]) * 4) + ubyteToInt(HTSMUX_I2CReply.arr[1]);
+  _HTSMUXrelease(link);
 
-  return (ubyteToInt(HTSMUX_I2CReply.arr[0]) * 4) + ubyteToInt(HTSMUX_I2CReply.arr[1]);
+  return value;
 }
 
 
@@ -778,6 +3638,318 @@ int HTSMUXreadAnalogue(tMUXSensor muxsensor) {
 }
 
 
+/**
+ * Work out the value of an analogue channel from the snapshot of the
+ * analogue registers.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the SMUX port number
+ * @param channel the SMUX channel number
+ * @return the value of the channel
+ */
+int _HTSMUXsnapshotAnalogue(tSensors link, byte channel) {
+  return (ubyteToInt(HTSMUX_AnalogueSnapshot[link].data.arr[HTSMUX_AN_ENTRY_SIZE * channel]) * 4) +
+          ubyteToInt(HTSMUX_AnalogueSnapshot[link].data.arr[(HTSMUX_AN_ENTRY_SIZE * channel) + 1]);
+}
+
+
+/**
+ * Refresh the snapshot of the analogue registers of all four channels.
+ *
+ * Note: this is an internal function and should not be called directly,
+ * call it with the SMUX claimed, see _HTSMUXclaim()
+ * @param link the SMUX port number
+ * @return true if no error occured, false if it did
+ */
+bool _HTSMUXreadAnalogueSnapshot(tSensors link) {
+  // If we're in the middle of a scan, abort this call
+  if (_HTSMUXbusy(link))
+    return false;
+
+  if (smuxData[link].status != HTSMUX_STAT_NORMAL)
+    HTSMUXsendCommand(link, HTSMUX_CMD_RUN);
+#ifdef __COMMON_H_SMUX_SCAN_FILE__
+  // The channel types HTSMUXscanCached() took from the file turned out wrong
+  if (_HTSMUXbusy(link))
+    return false;
+#endif // __COMMON_H_SMUX_SCAN_FILE__
+
+  return I2CreadSnapshot(link, HTSMUX_AnalogueSnapshot[link], HTSMUX_I2C_ADDR, HTSMUX_ANALOG, HTSMUX_AN_ENTRY_SIZE * 4);
+}
+
+
+/**
+ * Read the values of all four analogue channels of the SMUX in a single
+ * transaction.  Channels without an analogue sensor are set to -1.
+ * @param link the SMUX port number
+ * @param ch0 value of channel 1
+ * @param ch1 value of channel 2
+ * @param ch2 value of channel 3
+ * @param ch3 value of channel 4
+ * @return true if no error occured, false if it did
+ */
+bool HTSMUXreadAllAnalogue(tSensors link, int &ch0, int &ch1, int &ch2, int &ch3) {
+  ch0 = -1;
+  ch1 = -1;
+  ch2 = -1;
+  ch3 = -1;
+
+  // The poll task keeps the snapshot up to date, leave it alone
+  _HTSMUXclaim(link, true);
+#ifdef __COMMON_H_SMUX_POLLER__
+  if ((smuxAnalogueRate[link] == 0) || !smuxPolling || !HTSMUX_AnalogueSnapshot[link].valid)
+#endif // __COMMON_H_SMUX_POLLER__
+    I2CinvalidateSnapshot(HTSMUX_AnalogueSnapshot[link]);
+  if (!_HTSMUXreadAnalogueSnapshot(link)) {
+    _HTSMUXrelease(link);
+    return false;
+  }
+
+  if (smuxData[link].sensor[0] == HTSMUXAnalogue)
+    ch0 = _HTSMUXsnapshotAnalogue(link, 0);
+  if (smuxData[link].sensor[1] == HTSMUXAnalogue)
+    ch1 = _HTSMUXsnapshotAnalogue(link, 1);
+  if (smuxData[link].sensor[2] == HTSMUXAnalogue)
+    ch2 = _HTSMUXsnapshotAnalogue(link, 2);
+  if (smuxData[link].sensor[3] == HTSMUXAnalogue)
+    ch3 = _HTSMUXsnapshotAnalogue(link, 3);
+  _HTSMUXrelease(link);
+  return true;
+}
+
+
+/**
+ * Read the value of an analogue sensor attached to the SMUX.  When more than
+ * one analogue sensor is attached to the same SMUX, all four channels are
+ * read in one go and the result is kept for the port's snapshot TTL, see
+ * I2CsetSnapshotTTL(), so the other sensors' drivers get their values
+ * without another transaction.  With a single analogue sensor this is the
+ * same as HTSMUXreadAnalogue().
+ * @param muxsensor the SMUX sensor port number
+ * @return the value of the sensor or -1 if an error occurred.
+ */
+int HTSMUXreadSharedAnalogue(tMUXSensor muxsensor) {
+  tSensors link = (tSensors)SPORT(muxsensor);
+  byte channel = MPORT(muxsensor);
+  int analogue = 0;
+
+  if (smuxData[link].sensor[channel] != HTSMUXAnalogue)
+    return -1;
+
+  for (int i = 0; i < 4; i++) {
+    if (smuxData[link].sensor[i] == HTSMUXAnalogue)
+      analogue++;
+  }
+
+#ifdef __COMMON_H_SMUX_POLLER__
+  if (smuxAnalogueRate[link] > 0)
+    analogue = 0;
+#endif // __COMMON_H_SMUX_POLLER__
+
+  if (analogue < 2)
+    return HTSMUXreadAnalogue(link, channel);
+
+  _HTSMUXclaim(link, true);
+  if (_HTSMUXreadAnalogueSnapshot(link))
+    analogue = _HTSMUXsnapshotAnalogue(link, channel);
+  else
+    analogue = -1;
+  _HTSMUXrelease(link);
+  return analogue;
+}
+
+
+#ifdef __COMMON_H_SMUX_POLLER__
+/**
+ * Copy registers from a channel's shadow, if it's polled and holds them.
+ *
+ * Note: this is an internal function and should not be called directly
+ * @param link the SMUX port number
+ * @param channel the SMUX channel number
+ * @param result array to hold values returned from SMUX
+ * @param numbytes the size of the I2C reply
+ * @param offset the offset used to start reading from
+ * @return true if the registers were copied, false if they must be read from the SMUX
+ */
+bool _HTSMUXreadShadow(tSensors link, byte channel, tByteArray &result, int numbytes, int offset) {
+  int index = (link * 4) + channel;
+
+  if ((smuxShadowRate[index] == 0) || (offset + numbytes > smuxShadowSize[index]))
+    return false;
+
+  // A copy left over from a stopped poll task is never served
+  hogCPU();
+  if (!smuxPolling || !smuxShadowValid[index]) {
+    releaseCPU();
+    return false;
+  }
+  for (int i = 0; i < numbytes; i++)
+    result.arr[i] = smuxShadow[index].arr[offset + i];
+  releaseCPU();
+  return true;
+}
+
+
+/**
+ * Poll the channel buffers and analogue values that are due.  The task
+ * claims an SMUX for every read, see _HTSMUXclaim(), and leaves it for the
+ * next round when another task is reading from it.  It reads into its own
+ * buffer, never into HTSMUX_I2CRequest or HTSMUX_I2CReply.  A copy is only
+ * marked valid if no command was sent to the SMUX while it was being read
+ * and HTSMUXstopPolling() wasn't called in the meantime.
+ *
+ * Note: this task is started by HTSMUXstartPolling() and should not be started directly
+ */
+task _HTSMUXpollTask() {
+  tByteArray buffer;
+  tSensors link;
+  ubyte commands = 0;
+  long due = 0;
+  long next = 0;
+
+  while (smuxPolling) {
+    next = nPgmTime + HTSMUX_POLL_IDLE;
+
+    for (int i = 0; i < 16; i++) {
+      link = (tSensors)SPORT(i);
+
+      // Leave SMUXes alone while they're scanning or being configured
+      if ((smuxShadowRate[i] == 0) || (smuxData[link].status != HTSMUX_STAT_NORMAL) || smuxData[link].configuring)
+        continue;
+
+      due = smuxShadowTime[i] + smuxShadowRate[i];
+      if ((!smuxShadowValid[i] || (nPgmTime >= due)) && _HTSMUXclaim(link, false)) {
+        commands = smuxCommands[link];
+        if ((smuxData[link].status == HTSMUX_STAT_NORMAL) &&
+            I2CreadRegisters(link, I2C_DESC(HTSMUX_I2C_ADDR, HTSMUX_I2C_BUF + (HTSMUX_BF_ENTRY_SIZE * MPORT(i))), buffer, smuxShadowSize[i])) {
+          hogCPU();
+          memcpy(smuxShadow[i], buffer, sizeof(tByteArray));
+          smuxShadowTime[i] = nPgmTime;
+          smuxShadowValid[i] = smuxPolling && (smuxCommands[link] == commands);
+          releaseCPU();
+        }
+        _HTSMUXrelease(link);
+        due = nPgmTime + smuxShadowRate[i];
+      } else if (!smuxShadowValid[i] || (nPgmTime >= due)) {
+        // In use, try again shortly
+        due = nPgmTime + 1;
+      }
+      if (due < next)
+        next = due;
+    }
+
+    for (int i = 0; i < 4; i++) {
+      link = (tSensors)i;
+      if ((smuxAnalogueRate[i] == 0) || (smuxData[link].status != HTSMUX_STAT_NORMAL) || smuxData[link].configuring)
+        continue;
+
+      due = HTSMUX_AnalogueSnapshot[i].timestamp + smuxAnalogueRate[i];
+      if ((!HTSMUX_AnalogueSnapshot[i].valid || (nPgmTime >= due)) && _HTSMUXclaim(link, false)) {
+        commands = smuxCommands[link];
+        if ((smuxData[link].status == HTSMUX_STAT_NORMAL) &&
+            I2CreadRegisters(link, I2C_DESC(HTSMUX_I2C_ADDR, HTSMUX_ANALOG), buffer, HTSMUX_AN_ENTRY_SIZE * 4)) {
+          hogCPU();
+          memcpy(HTSMUX_AnalogueSnapshot[i].data, buffer, sizeof(tByteArray));
+          HTSMUX_AnalogueSnapshot[i].timestamp = nPgmTime;
+          HTSMUX_AnalogueSnapshot[i].address = HTSMUX_I2C_ADDR;
+          HTSMUX_AnalogueSnapshot[i].reg = HTSMUX_ANALOG;
+          HTSMUX_AnalogueSnapshot[i].size = HTSMUX_AN_ENTRY_SIZE * 4;
+          HTSMUX_AnalogueSnapshot[i].valid = smuxPolling && (smuxCommands[link] == commands);
+          releaseCPU();
+        }
+        _HTSMUXrelease(link);
+        due = nPgmTime + smuxAnalogueRate[i];
+      } else if (!HTSMUX_AnalogueSnapshot[i].valid || (nPgmTime >= due)) {
+        // In use, try again shortly
+        due = nPgmTime + 1;
+      }
+      if (due < next)
+        next = due;
+    }
+
+    wait1Msec(max(1, next - nPgmTime));
+  }
+}
+
+
+/**
+ * Have the poll task keep a copy of a channel's buffer, see
+ * HTSMUXstartPolling().  While the copy is valid, HTSMUXreadPort() returns
+ * from it without touching the bus, as long as the registers asked for are
+ * among the first size ones.
+ * @param muxsensor the SMUX sensor port number
+ * @param rate the poll interval in ms, 0 to stop polling the channel
+ * @param size the number of buffer registers to poll, 16 at most
+ */
+void HTSMUXpollChannel(tMUXSensor muxsensor, int rate, int size) {
+  hogCPU();
+  smuxShadowRate[muxsensor] = rate;
+  smuxShadowSize[muxsensor] = clip(size, 1, HTSMUX_BF_ENTRY_SIZE);
+  smuxShadowValid[muxsensor] = false;
+  releaseCPU();
+}
+
+
+/**
+ * Have the poll task keep a copy of the analogue values of all four channels
+ * of an SMUX, which it reads in a single transaction.  While the copy is
+ * valid, HTSMUXreadAnalogue() and HTSMUXreadSharedAnalogue() return from it.
+ * @param link the SMUX port number
+ * @param rate the poll interval in ms, 0 to stop polling the analogue values
+ */
+void HTSMUXpollAnalogue(tSensors link, int rate) {
+  hogCPU();
+  smuxAnalogueRate[link] = rate;
+  I2CinvalidateSnapshot(HTSMUX_AnalogueSnapshot[link]);
+  releaseCPU();
+}
+
+
+/**
+ * Start the task that polls the channels set up with HTSMUXpollChannel() and
+ * HTSMUXpollAnalogue().  An SMUX is only polled while it's running, so it
+ * has to be started once by reading one of its channels or with
+ * HTSMUXsendCommand().  Until a channel has been polled, or after the SMUX
+ * was halted, reads go to the bus as usual.
+ */
+void HTSMUXstartPolling() {
+  if (smuxPolling)
+    return;
+
+  smuxPolling = true;
+  StartTask(_HTSMUXpollTask);
+}
+
+
+/**
+ * Stop the poll task once it's done with the current round.  The copies are
+ * no longer refreshed, so reads go to the bus again.  A read the task still
+ * has in flight is not marked valid once it completes.
+ */
+void HTSMUXstopPolling() {
+  hogCPU();
+  smuxPolling = false;
+  for (int i = 0; i < 16; i++)
+    smuxShadowValid[i] = false;
+  for (int i = 0; i < 4; i++)
+    I2CinvalidateSnapshot(HTSMUX_AnalogueSnapshot[i]);
+  releaseCPU();
+}
+
+
+/**
+ * Get the age of the copy of a channel's buffer.
+ * @param muxsensor the SMUX sensor port number
+ * @return the time in ms since the channel was last polled, -1 if there's no valid copy
+ */
+long HTSMUXreadShadowAge(tMUXSensor muxsensor) {
+  if ((smuxShadowRate[muxsensor] == 0) || !smuxPolling || !smuxShadowValid[muxsensor])
+    return -1;
+  return nPgmTime - smuxShadowTime[muxsensor];
+}
+#endif // __COMMON_H_SMUX_POLLER__
+
+
 /**
  * Return a string for the sensor type.
  *
@@ -0,0 +1,1716 @@
+/*!@addtogroup host
+ * @{
+ */
+
+/** \file bench.c
+ * \brief I2C efficiency scorecard for the drivers
+ *
+ * bench.c runs a number of public driver functions against simulated devices
+ * and reports, per logical reading, the number of I2C transactions, the
+ * number of bytes on the bus and the modelled time the call took, see the
+ * timing model in simbus.h.  The readings are spaced BENCH_INTERVAL ms apart
+ * so cached register snapshots have expired, the interval itself is not
+ * counted.
+ *
+ * A second section models how long the SMUX takes to refresh the buffers of
+ * its I2C channels, once with the windows the auto-detect sets up and once
+ * with the ones the drivers ask for, see HTSMUXsetWindow().  A third one
+ * measures how far apart the two motors of a Mindsensors MMUX start, a
+ * fourth how closely two simulated motors follow the profiles of
+ * MMUXPROF-driver.h and how busy that keeps the bus, and a fifth what a
+ * control loop driving eight motors costs when it calls the drivers directly
+ * and when it goes through MOTOR-driver.h.  A sixth counts the VM operations
+ * that go into building a register read request, see benchRequestOps().
+ *
+ * The results are compared with bench-baseline.txt and any figure that got
+ * more than BENCH_TOLERANCE percent worse is flagged.  The last section runs
+ * checks of behaviour the figures can't show, like several tasks sharing a
+ * port.  The program exits with status 1 on a regression or a failed check.  Set HOST_BENCH_SAVE to write the current
+ * results as the new baseline, HOST_BENCH_BASELINE to use another file.
+ *
+ * Usage: ant hostbench
+ *
+ * License: You may use this code as you wish, provided you give credit where its due.
+ */
+
+#define __COMMON_H_I2C_CAPTURE__  // Costs nothing until a capture is started, see benchCheckCapture()
+#define __COMMON_H_SMUX_POLLER__  // Costs nothing until polling is started, see benchCheckSMUXPoller()
+#define __COMMON_H_MMUX_REFRESH__ // Costs nothing until a refresh is started, see benchCheckHDMMUXRefresh()
+#define __COMMON_H_SMUX_SCAN_FILE__ // Only used by HTSMUXscanCached(), see benchCheckSMUXScanFile()
+#define HTSMUX_SCAN_FILE "bench-smuxscan.dat"
+#define I2C_CAPTURE_FILE "bench-capture.dat"
+#define I2C_CAPTURE_SIZE 32000
+
+#include "drivers/DGPS-driver.h"
+#include "drivers/HDMMUX-driver.h"
+#include "drivers/HTAC-driver.h"
+#include "drivers/HTCS2-driver.h"
+#include "drivers/HTGYRO-driver.h"
+#include "drivers/HTIRL-driver.h"
+#include "drivers/HTIRS2-driver.h"
+#include "drivers/HTMAG-driver.h"
+#include "drivers/HTMC-driver.h"
+#include "drivers/LEGOLS-driver.h"
+#include "drivers/LEGOUS-driver.h"
+#include "drivers/MSDIST-driver.h"
+#include "drivers/MSLL-driver.h"
+#include "drivers/MSMMUX-driver.h"
+#include "drivers/MMUXPROF-driver.h"
+#include "drivers/MSPFM-driver.h"
+#include "drivers/MOTOR-driver.h"
+#include "drivers/NXTCAM-driver.h"
+
+#define BENCH_READINGS    20      /*!< Number of readings per function */
+#define BENCH_INTERVAL    20      /*!< Time in ms between two readings */
+#define BENCH_TOLERANCE   5       /*!< Percentage a figure may get worse before it's flagged */
+#define BENCH_MAX_CASES   32
+
+#ifndef BENCH_SMUX_SETUP_US
+#define BENCH_SMUX_SETUP_US 1000  /*!< Time the SMUX takes to start a transaction with one of its sensors */
+#endif
+
+#ifndef BENCH_SMUX_BYTE_US
+#define BENCH_SMUX_BYTE_US  100   /*!< Time it takes to clock one byte between the SMUX and a sensor */
+#endif
+
+#ifndef BENCH_MOTOR_TAU
+#define BENCH_MOTOR_TAU     0.08  /*!< Time constant in s of a simulated motor speeding up */
+#endif
+
+#ifndef BENCH_MOTOR_KP
+#define BENCH_MOTOR_KP      15.0  /*!< Gain in 1/s of the simulated MMUX position control */
+#endif
+
+#define BENCH_MOTOR_TICKS   20    /*!< Control loop ticks in the motor command benchmark */
+#define BENCH_RUN_MSEC      600000  /*!< Virtual time the whole run may take */
+
+#ifndef BENCH_BASELINE
+#define BENCH_BASELINE "host/bench-baseline.txt"
+#endif
+
+typedef void (*benchFn)();
+
+/*!< A single driver function to be measured */
+struct benchCaseT {
+  const char *name;
+  tSensors link;
+  ubyte address;
+  TSensorTypes type;
+  benchFn reading;
+};
+
+/*!< Figures per logical reading */
+struct benchResultT {
+  char name[40];
+  float transactions;
+  float bytes;
+  float ms;
+};
+
+hostI2CDevice *benchDevice = 0;
+tByteArray benchBytes;
+blob_array benchBlobs;
+int benchX, benchY, benchZ, benchA, benchB;
+
+void benchIRS2ACDir()       { HTIRS2readACDir(S1); }
+void benchIRS2AllAC()       { HTIRS2readAllACStrength(S1, benchX, benchY, benchZ, benchA, benchB); }
+void benchIRS2AllDC()       { HTIRS2readAllDCStrength(S1, benchX, benchY, benchZ, benchA, benchB); }
+void benchACAllAxes()       { HTACreadAllAxes(S1, benchX, benchY, benchZ); }
+void benchCS2RGB()          { HTCS2readRGB(S1, benchX, benchY, benchZ); }
+void benchMCHeading()       { HTMCreadHeading(S1); }
+void benchUSDist()          { USreadDist(S1); }
+void benchUSDistances()     { USreadDistances(S1, benchBytes); }
+void benchLLSteering()      { LLreadSteering(S1); }
+void benchCAMBlobs()        { NXTCAMgetBlobs(S2, benchBlobs); }
+void benchGPSLatitude()     { DGPSreadLatitude(S2); }
+void benchMSMEncoder()      { MSMMotorEncoder(mmotor_S3_1); }
+void benchHDMEncoder()      { HDMMotorEncoder(mmotor_S3_1); }
+void benchHDMOdometry()     { HDMMotorEncoder(mmotor_S3_1); HDMMotorEncoder(mmotor_S3_2); HDMMotorEncoder(mmotor_S3_3); HDMMotorBusy(mmotor_S3_1); }
+void benchSMUXreadPort()    { HTSMUXreadPort(S4, 0, benchBytes, 6); }
+void benchSMUXAnalogue()    { HTSMUXreadAnalogue(S4, 1); }
+void benchSMUXACAllAxes()   { HTACreadAllAxes(msensor_S4_1, benchX, benchY, benchZ); }
+
+/*!< Turn the lights on three analogue SMUX channels, one by one or as one configuration change */
+void benchSMUXLights() {
+  HTSMUXsetAnalogueActive(msensor_S4_2);
+  HTSMUXsetAnalogueActive(msensor_S4_3);
+  HTSMUXsetAnalogueActive(msensor_S4_4);
+}
+
+void benchSMUXLightsBatch() {
+  HTSMUXbeginConfig(S4);
+  benchSMUXLights();
+  HTSMUXcommitConfig(S4);
+}
+
+/*!< Read three analogue sensors on the same SMUX, channel by channel or through their drivers */
+void benchSMUXAnalogue3()   { HTSMUXreadAnalogue(S4, 1); HTSMUXreadAnalogue(S4, 2); HTSMUXreadAnalogue(S4, 3); }
+void benchSMUXDrivers3()    { LSvalRaw(msensor_S4_2); HTGYROreadRot(msensor_S4_3); HTMAGreadRaw(msensor_S4_4); }
+
+benchCaseT benchCases[] = {
+  {"HTIRS2readACDir",         S1, HTIRS2_I2C_ADDR, sensorI2CCustom,    benchIRS2ACDir},
+  {"HTIRS2readAllACStrength", S1, HTIRS2_I2C_ADDR, sensorI2CCustom,    benchIRS2AllAC},
+  {"HTIRS2readAllDCStrength", S1, HTIRS2_I2C_ADDR, sensorI2CCustom,    benchIRS2AllDC},
+  {"HTACreadAllAxes",         S1, HTAC_I2C_ADDR,   sensorI2CCustom,    benchACAllAxes},
+  {"HTCS2readRGB",            S1, HTCS2_I2C_ADDR,  sensorI2CCustom,    benchCS2RGB},
+  {"HTMCreadHeading",         S1, HTMC_I2C_ADDR,   sensorI2CCustom,    benchMCHeading},
+  {"USreadDist",              S1, LEGOUS_I2C_ADDR, sensorI2CCustom9V,  benchUSDist},
+  {"USreadDistances",         S1, LEGOUS_I2C_ADDR, sensorI2CCustom9V,  benchUSDistances},
+  {"LLreadSteering",          S1, LL_I2C_ADDR,     sensorI2CCustom9V,  benchLLSteering},
+  {"NXTCAMgetBlobs",          S2, NXTCAM_I2C_ADDR, sensorI2CCustom,    benchCAMBlobs},
+  {"DGPSreadLatitude",        S2, DGPS_I2C_ADDR,   sensorI2CCustom,    benchGPSLatitude},
+  {"MSMMotorEncoder",         S3, MSMMUX_I2C_ADDR, sensorI2CCustom9V,  benchMSMEncoder},
+  {"HDMMotorEncoder",         S3, HDMMUX_I2C_ADDR, sensorI2CCustom9V,  benchHDMEncoder},
+  {"HDMMotorEncoderx3+Busy",  S3, HDMMUX_I2C_ADDR, sensorI2CCustom9V,  benchHDMOdometry},
+  {"HTSMUXreadPort",          S4, HTSMUX_I2C_ADDR, sensorI2CCustom9V,  benchSMUXreadPort},
+  {"HTSMUXreadAnalogue",      S4, HTSMUX_I2C_ADDR, sensorI2CCustom9V,  benchSMUXAnalogue},
+  {"HTACreadAllAxes(SMUX)",   S4, HTSMUX_I2C_ADDR, sensorI2CCustom9V,  benchSMUXACAllAxes},
+  {"HTSMUXsetAnalogueActivex3", S4, HTSMUX_I2C_ADDR, sensorI2CCustom9V,  benchSMUXLights},
+  {"HTSMUXcommitConfig(x3)",  S4, HTSMUX_I2C_ADDR, sensorI2CCustom9V,  benchSMUXLightsBatch},
+  {"HTSMUXreadAnaloguex3",    S4, HTSMUX_I2C_ADDR, sensorI2CCustom9V,  benchSMUXAnalogue3},
+  {"LS+GYRO+MAG(SMUX)",       S4, HTSMUX_I2C_ADDR, sensorI2CCustom9V,  benchSMUXDrivers3},
+};
+
+benchResultT benchResults[BENCH_MAX_CASES];
+benchResultT benchBaseline[BENCH_MAX_CASES];
+int benchBaselineSize = 0;
+
+
+/**
+ * Plug a fresh register file device into the port of a case and set up
+ * the registers some of the drivers look at.
+ * @param bc the case
+ */
+void benchPlug(benchCaseT &bc) {
+  hostI2CDetach(bc.link);
+  delete benchDevice;
+  benchDevice = new hostI2CDevice(bc.address);
+  for (int i = 0; i < 256; i++)
+    benchDevice->regs[i] = i;
+  benchDevice->regs[NXTCAM_COUNT_REG] = 3;
+  hostI2CAttach(bc.link, benchDevice);
+  I2CconfigurePort(bc.link, bc.type);
+
+  smuxData[S4].status = HTSMUX_STAT_NORMAL;
+  smuxData[S4].sensor[0] = HTSMUXAccel;
+  smuxData[S4].sensor[1] = HTSMUXAnalogue;
+  smuxData[S4].sensor[2] = HTSMUXAnalogue;
+  smuxData[S4].sensor[3] = HTSMUXAnalogue;
+}
+
+
+/**
+ * Run a case and work out its figures per reading.
+ * @param bc the case
+ * @param result holds the figures
+ */
+void benchRun(benchCaseT &bc, benchResultT &result) {
+  long long busy = 0;
+  long transactions = 0;
+  long bytes = 0;
+
+  benchPlug(bc);
+  bc.reading();         // the first reading pays for any set-up
+  wait1Msec(BENCH_INTERVAL);
+
+  hostI2CResetCounters();
+  for (int i = 0; i < BENCH_READINGS; i++) {
+    long long start = hostNowUs;
+    bc.reading();
+    busy += hostNowUs - start;
+    wait1Msec(BENCH_INTERVAL);
+  }
+
+  for (int i = 0; i < 4; i++) {
+    transactions += hostI2CPort[i].transactions;
+    bytes += hostI2CPort[i].bytes;
+  }
+  snprintf(result.name, sizeof(result.name), "%s", bc.name);
+  result.transactions = (float)transactions / BENCH_READINGS;
+  result.bytes = (float)bytes / BENCH_READINGS;
+  result.ms = (float)busy / BENCH_READINGS / 1000;
+}
+
+
+/**
+ * Modelled time the SMUX takes to refresh the buffers of all its I2C
+ * channels once: a transaction per channel that sends the address and
+ * register and reads the window back.
+ * @param smux the simulated SMUX
+ * @return the time in us
+ */
+long long benchSMUXRound(hostI2CDevice &smux) {
+  long long us = 0;
+  for (int i = 0; i < 4; i++) {
+    int entry = HTSMUX_CH_OFFSET + (HTSMUX_CH_ENTRY_SIZE * i);
+    if (smux.regs[entry + HTSMUX_MODE] & HTSMUX_CHAN_I2C)
+      us += BENCH_SMUX_SETUP_US + (3 + smux.regs[entry + HTSMUX_I2C_COUNT]) * BENCH_SMUX_BYTE_US;
+  }
+  return us;
+}
+
+
+/**
+ * Compare the SMUX refresh round with the auto-detected windows against the
+ * one with the windows the HTAC, HTIRS2 and HTMC drivers ask for.
+ */
+void benchSMUXWindows() {
+  hostI2CDevice smux(HTSMUX_I2C_ADDR);
+  const HTSMUXSensorType types[3] = {HTSMUXAccel, HTSMUXIRSeekerNew, HTSMUXCompass};
+  const ubyte addresses[3] = {HTAC_I2C_ADDR, HTIRS2_I2C_ADDR, HTMC_I2C_ADDR};
+
+  hostI2CDetach(S4);
+  hostI2CAttach(S4, &smux);
+  I2CconfigurePort(S4, sensorI2CCustom9V);
+
+  // What the auto-detect leaves behind: every I2C channel copies a full buffer
+  for (int i = 0; i < 3; i++) {
+    int entry = HTSMUX_CH_OFFSET + (HTSMUX_CH_ENTRY_SIZE * i);
+    smux.regs[entry + HTSMUX_MODE] = HTSMUX_CHAN_I2C;
+    smux.regs[entry + HTSMUX_TYPE] = types[i];
+    smux.regs[entry + HTSMUX_I2C_COUNT] = HTSMUX_BF_ENTRY_SIZE;
+    smux.regs[entry + HTSMUX_I2C_DADDR] = addresses[i];
+    smux.regs[entry + HTSMUX_I2C_MADDR] = 0x42;
+    smuxData[S4].sensor[i] = types[i];
+  }
+  smuxData[S4].sensor[3] = HTSMUXSensorNone;
+  smuxData[S4].status = HTSMUX_STAT_NORMAL;
+  long long before = benchSMUXRound(smux);
+
+  long long start = hostNowUs;
+  HTSMUXbeginConfig(S4);
+  HTACsetSMUXWindow(msensor_S4_1);
+  HTIRS2setSMUXWindow(msensor_S4_2);
+  HTMCsetSMUXWindow(msensor_S4_3);
+  HTSMUXcommitConfig(S4);
+  long long cost = hostNowUs - start;
+  long long after = benchSMUXRound(smux);
+
+  printf("\nSMUX refresh round, HTAC + HTIRS2 + HTMC\n");
+  printf("%-26s %8.2f ms, every channel %6.1f times/s\n", "auto-detected windows", before / 1000.0, 1000000.0 / before);
+  printf("%-26s %8.2f ms, every channel %6.1f times/s\n", "tuned windows", after / 1000.0, 1000000.0 / after);
+  printf("%-26s %8.2f ms, once\n", "setting the windows", cost / 1000.0);
+  hostI2CDetach(S4);
+}
+
+
+/*!< A Mindsensors MMUX that notes when each motor was started */
+struct benchMMUX : hostI2CDevice {
+  tSensors link;
+  long long startedUs[2];         /*!< When the transaction that started the motor completed */
+
+  benchMMUX(tSensors l) : hostI2CDevice(MSMMUX_I2C_ADDR), link(l) { startedUs[0] = startedUs[1] = -1; }
+
+  void regWrite(ubyte reg, ubyte val) override {
+    hostI2CDevice::regWrite(reg, val);
+    for (int i = 0; i < 2; i++) {
+      if (reg == MSMMUX_MOT_OFFSET + (MSMMUX_ENTRY_SIZE * i) + MSMMUX_CMD_A && (val & MSMMUX_CMD_GO))
+        startedUs[i] = hostI2CPort[link].doneUs;
+    }
+    if (reg == MSMMUX_REG_CMD && val == MSMMUX_CMD_START_BOTH)
+      startedUs[0] = startedUs[1] = hostI2CPort[link].doneUs;
+  }
+};
+
+
+/*!< Start both motors of an MMUX one by one, as a group or as a pair and print how far apart they got going */
+void benchMMUXStart(const char *name, int how) {
+  benchMMUX mmux(S3);
+  hostI2CDetach(S3);
+  hostI2CAttach(S3, &mmux);
+  I2CconfigurePort(S3, sensorI2CCustom9V);
+
+  long long start = hostNowUs;
+  if (how == 2) {
+    MSMMotorPair(S3, 50, 50);
+  } else if (how == 1) {
+    MSMMotorGroup(S3, 50, 50);
+  } else {
+    MSMMotor(mmotor_S3_1, 50);
+    MSMMotor(mmotor_S3_2, 50);
+  }
+  printf("%-26s %8.2f ms skew, %8.2f ms until both run\n", name,
+         llabs(mmux.startedUs[1] - mmux.startedUs[0]) / 1000.0,
+         (std::max(mmux.startedUs[0], mmux.startedUs[1]) - start) / 1000.0);
+  hostI2CDetach(S3);
+}
+
+
+/*!< A Mindsensors MMUX whose motors take time to speed up and slow down */
+struct benchMotorMMUX : hostI2CDevice {
+  tSensors link;
+  double pos[2];                  /*!< Encoder counts */
+  double vel[2];                  /*!< Counts/s */
+  double limit[2];                /*!< Speed the position control may use, counts/s */
+  long target[2];
+  long long lastUs;               /*!< Time up to which the motors have been simulated */
+
+  benchMotorMMUX(tSensors l) : hostI2CDevice(MSMMUX_I2C_ADDR), link(l), lastUs(hostNowUs) {
+    for (int i = 0; i < 2; i++) {
+      pos[i] = vel[i] = limit[i] = 0;
+      target[i] = 0;
+    }
+  }
+
+  /*!< Run the motors up to a point in time, 1 ms at a time */
+  void advance(long long now) {
+    for (; lastUs + 1000 <= now; lastUs += 1000) {
+      for (int i = 0; i < 2; i++) {
+        double want = std::max(-limit[i], std::min(limit[i], BENCH_MOTOR_KP * (target[i] - pos[i])));
+        vel[i] += (want - vel[i]) * 0.001 / BENCH_MOTOR_TAU;
+        pos[i] += vel[i] * 0.001;
+      }
+    }
+  }
+
+  /*!< Take on the target and speed in a motor's registers */
+  void start(int i) {
+    int entry = MSMMUX_MOT_OFFSET + (MSMMUX_ENTRY_SIZE * i);
+    advance(hostI2CPort[link].doneUs);
+    target[i] = (long)(regs[entry] | (regs[entry + 1] << 8) | (regs[entry + 2] << 16) | (regs[entry + 3] << 24));
+    limit[i] = abs((byte)regs[entry + MSMMUX_POWER]) * MMUXPROF_FULL_SPEED / 100.0;
+  }
+
+  void regWrite(ubyte reg, ubyte val) override {
+    hostI2CDevice::regWrite(reg, val);
+    for (int i = 0; i < 2; i++) {
+      if (reg == MSMMUX_MOT_OFFSET + (MSMMUX_ENTRY_SIZE * i) + MSMMUX_CMD_A && (val & MSMMUX_CMD_GO))
+        start(i);
+    }
+    if (reg == MSMMUX_REG_CMD && val == MSMMUX_CMD_START_BOTH) {
+      start(0);
+      start(1);
+    }
+  }
+
+  ubyte regRead(ubyte reg) override {
+    advance(hostNowUs);
+    if (reg >= MSMMUX_TACHO_MOT1 && reg < MSMMUX_TACHO_MOT1 + 8) {
+      long count = (long)pos[(reg - MSMMUX_TACHO_MOT1) / 4];
+      return (count >> (8 * ((reg - MSMMUX_TACHO_MOT1) % 4))) & 0xFF;
+    }
+    return hostI2CDevice::regRead(reg);
+  }
+};
+
+
+/*!< Drive two motors along profiles and print how closely they followed them */
+void benchProfile(const char *name, byte shape, int rate) {
+  benchMotorMMUX mmux(S3);
+  const tMUXmotor motors[2] = {mmotor_S3_1, mmotor_S3_2};
+  double worst = 0;
+  double squares = 0;
+  long samples = 0;
+
+  hostI2CDetach(S3);
+  hostI2CAttach(S3, &mmux);
+  I2CconfigurePort(S3, sensorI2CCustom9V);
+  MMUXprofileAttach(S3, MSMMUX_I2C_ADDR);
+  MMUXprofileMove(mmotor_S3_1, 1800, 600, 1500, shape);
+  MMUXprofileMove(mmotor_S3_2, -900, 300, 750, shape);
+
+  hostI2CResetCounters();
+  long long start = hostNowUs;
+  MMUXprofileStart(rate);
+
+  while (!MMUXprofileDone(mmotor_S3_1) || !MMUXprofileDone(mmotor_S3_2)) {
+    wait1Msec(5);
+    mmux.advance(hostNowUs);
+    for (int i = 0; i < 2; i++) {
+      if (mmuxProfStarted[motors[i]] < 0)
+        continue;
+      double error = fabs(mmux.pos[i] - MMUXprofilePosition(motors[i], nPgmTime - mmuxProfStarted[motors[i]]));
+      worst = std::max(worst, error);
+      squares += error * error;
+      samples++;
+    }
+  }
+  MMUXprofileStop();
+  long long elapsed = hostNowUs - start;
+
+  printf("%-26s %8.1f max %7.1f rms counts, %5.1f transactions/s, bus %3.0f%% busy\n", name,
+         worst, sqrt(squares / samples), hostI2CPort[S3].transactions * 1000000.0 / elapsed,
+         hostI2CPort[S3].busyUs * 100.0 / elapsed);
+  wait1Msec(rate);
+  hostI2CDetach(S3);
+}
+
+
+/*!< Power of the left or right motors during a tick, changes every other tick */
+int benchTickPower(int tick, int side) {
+  return (side == 0) ? (30 + 5 * (tick / 2)) : -(20 + 5 * (tick / 2));
+}
+
+
+/*!< Power turned into a Combo PWM command for the IR Link */
+eCPMMotorCommand benchPFCommand(int power) {
+  byte step = _MOTORstep(MOTOR_PF, power);
+  return (eCPMMotorCommand)((step < 0) ? (16 + step) : step);
+}
+
+
+/*!< Power turned into a PFMate operation */
+byte benchPFMateOp(int power) {
+  return (power > 0) ? MSPFM_FORWARD : ((power < 0) ? MSPFM_REVERSE : MSPFM_FLOAT);
+}
+
+
+/**
+ * Drive two motors on each of an MSMMUX, an HDMMUX, a PF receiver behind an
+ * IR Link and one behind a PFMate for a number of ticks and print what it
+ * cost per tick.  A loop that sets one motor at a time has to send a Combo
+ * PWM command, which carries both outputs, for each of them.
+ * @param name the label
+ * @param batched true to go through MOTORset() and MOTORflush(), false to call the drivers
+ */
+void benchMotors(const char *name, bool batched) {
+  hostI2CDevice msmmux(MSMMUX_I2C_ADDR);
+  hostI2CDevice hdmmux(HDMMUX_I2C_ADDR);
+  hostI2CDevice irlink(0x02);
+  hostI2CDevice pfmate(MSPFM_I2C_ADDR);
+  int handles[8];
+  long transactions = 0;
+  long bytes = 0;
+  long long busy = 0;
+  int left = 0;
+  int right = 0;
+
+  for (int i = 0; i < 4; i++)
+    hostI2CDetach((tSensors)i);
+  hostI2CAttach(S1, &msmmux);
+  hostI2CAttach(S2, &hdmmux);
+  hostI2CAttach(S3, &irlink);
+  hostI2CAttach(S4, &pfmate);
+  I2CconfigurePort(S1, sensorI2CCustom9V);
+  I2CconfigurePort(S2, sensorI2CCustom9V);
+  I2CconfigurePort(S3, sensorI2CCustom);
+  I2CconfigurePort(S4, sensorI2CCustom);
+
+  if (batched) {
+    motorHandles = 0;
+    handles[0] = MOTORattachMUX(MOTOR_MSMMUX, mmotor_S1_1);
+    handles[1] = MOTORattachMUX(MOTOR_MSMMUX, mmotor_S1_2);
+    handles[2] = MOTORattachMUX(MOTOR_HDMMUX, mmotor_S2_1);
+    handles[3] = MOTORattachMUX(MOTOR_HDMMUX, mmotor_S2_2);
+    handles[4] = MOTORattach(MOTOR_PF, S3, 0, 0);
+    handles[5] = MOTORattach(MOTOR_PF, S3, 0, 1);
+    handles[6] = MOTORattach(MOTOR_PFMATE, S4, 0, 0);
+    handles[7] = MOTORattach(MOTOR_PFMATE, S4, 0, 1);
+  }
+
+  hostI2CResetCounters();
+  long long start = hostNowUs;
+  for (int tick = 0; tick < BENCH_MOTOR_TICKS; tick++) {
+    left = benchTickPower(tick, 0);
+    right = benchTickPower(tick, 1);
+    if (batched) {
+      for (int i = 0; i < 8; i++)
+        MOTORset(handles[i], (i % 2 == 0) ? left : right);
+      MOTORflush();
+    } else {
+      MSMMotor(mmotor_S1_1, left);
+      MSMMotor(mmotor_S1_2, right);
+      HDMMotor(mmotor_S2_1, left);
+      HDMMotor(mmotor_S2_2, right);
+      PFcomboPwmMode(S3, 0, benchPFCommand(benchTickPower(tick - 1, 1)), benchPFCommand(left));
+      PFcomboPwmMode(S3, 0, benchPFCommand(right), benchPFCommand(left));
+      MSPFMcontrolMotorA(S4, 1, benchPFMateOp(left), abs(_MOTORstep(MOTOR_PFMATE, left)));
+      MSPFMcontrolMotorB(S4, 1, benchPFMateOp(right), abs(_MOTORstep(MOTOR_PFMATE, right)));
+    }
+  }
+  long long elapsed = hostNowUs - start;
+
+  for (int i = 0; i < 4; i++) {
+    transactions += hostI2CPort[i].transactions;
+    bytes += hostI2CPort[i].bytes;
+    busy += hostI2CPort[i].busyUs;
+    hostI2CDetach((tSensors)i);
+  }
+  printf("%-26s %8.2f trans %8.2f bytes %8.2f ms bus %9.2f ms per tick\n", name,
+         (float)transactions / BENCH_MOTOR_TICKS, (float)bytes / BENCH_MOTOR_TICKS,
+         busy / 1000.0 / BENCH_MOTOR_TICKS, elapsed / 1000.0 / BENCH_MOTOR_TICKS);
+}
+
+
+/*!< A register file whose registers hold their own number plus an offset */
+struct benchRegs : hostI2CDevice {
+  benchRegs(ubyte addr, int offset) : hostI2CDevice(addr) {
+    for (int i = 0; i < 256; i++)
+      regs[i] = i + offset;
+  }
+};
+
+#define BENCH_VM_READS 100        /*!< Register reads per case in the request building benchmark */
+
+tByteArray benchOldRequest;
+
+/*!< A register read the way the drivers did it before I2C_DESC(): clear and fill the request, clear the reply */
+bool benchReadOld(ubyte address, ubyte reg, int replylen) {
+  memset(benchOldRequest, 0, sizeof(tByteArray));
+  benchOldRequest.arr[0] = 2;
+  benchOldRequest.arr[1] = address;
+  benchOldRequest.arr[2] = reg;
+  if (!writeI2C(S1, benchOldRequest, replylen))
+    return false;
+  return readI2C(S1, benchBytes, replylen);
+}
+
+
+/**
+ * Count the VM operations that go into building the request and clearing the
+ * buffers of a register read: one for every byte memset() or memcpy() touch
+ * and one for every request byte that's assigned.  The bus part of the read is
+ * the same either way and isn't counted.
+ * @param name the name of the case
+ * @param regs the number of different registers read in turn
+ */
+void benchRequestOps(const char *name, int regs) {
+  benchRegs dev(0x02, 0);
+  long ops[2];
+
+  hostI2CDetach(S1);
+  hostI2CAttach(S1, &dev);
+  I2CconfigurePort(S1, sensorI2CCustom);
+
+  for (int how = 0; how < 2; how++) {
+    hostMemBytes = 0;
+    long stores = 0;
+    for (int i = 0; i < BENCH_VM_READS; i++) {
+      ubyte reg = 0x42 + (i % regs);
+      if (how == 0) {
+        benchReadOld(0x02, reg, 6);
+        stores += 3;
+      } else {
+        int last = I2CDescLast[S1];
+        I2CreadRegisters(S1, I2C_DESC(0x02, reg), benchBytes, 6);
+        if (I2CDescLast[S1] != last)
+          stores += 3;
+      }
+    }
+    ops[how] = hostMemBytes + stores;
+  }
+  printf("%-26s %8.1f ops before, %5.1f ops with I2CreadRegisters()\n", name,
+         (float)ops[0] / BENCH_VM_READS, (float)ops[1] / BENCH_VM_READS);
+  hostI2CDetach(S1);
+}
+
+
+int benchFailures = 0;
+
+/*!< Print the outcome of a check and count it when it failed */
+void benchCheck(const char *name, bool ok) {
+  printf("%-64s %s\n", name, ok ? "ok" : "FAILED");
+  if (!ok)
+    benchFailures++;
+}
+
+
+/*!< Wait for a task started by a check to end */
+void benchJoin(hostTaskFn fn) {
+  while (getTaskState(fn) == taskStateRunning)
+    wait1Msec(1);
+}
+
+
+#define BENCH_ARB_READS 500       /*!< Register reads per task in the arbiter checks */
+
+tByteArray benchArbRequest[2];
+tByteArray benchArbReply[2];
+int benchArbBad[2];
+bool benchArbLostRead;
+
+/*!< Read registers of the device at 0x02 (task 0) or 0x04 (task 1) on S1 and count the wrong replies */
+void benchArbReads(int t) {
+  for (int i = 0; i < BENCH_ARB_READS; i++) {
+    ubyte reg = i % 200;
+    benchArbRequest[t].arr[0] = 2;
+    benchArbRequest[t].arr[1] = 0x02 + 2 * t;
+    benchArbRequest[t].arr[2] = reg;
+    if (!writeI2C(S1, benchArbRequest[t], 2) || !readI2C(S1, benchArbReply[t], 2) ||
+        (benchArbReply[t].arr[0] != (ubyte)(reg + 100 * t)) || (benchArbReply[t].arr[1] != (ubyte)(reg + 1 + 100 * t)))
+      benchArbBad[t]++;
+  }
+}
+
+/*!< The same reads as benchArbReads(), through I2CreadRegisters() */
+void benchDescReads(int t) {
+  for (int i = 0; i < BENCH_ARB_READS; i++) {
+    ubyte reg = i % 200;
+    if (!I2CreadRegisters(S1, I2C_DESC(0x02 + 2 * t, reg), benchArbReply[t], 2) ||
+        (benchArbReply[t].arr[0] != (ubyte)(reg + 100 * t)) || (benchArbReply[t].arr[1] != (ubyte)(reg + 1 + 100 * t)))
+      benchArbBad[t]++;
+  }
+}
+
+task benchDescTask0() { benchDescReads(0); }
+task benchDescTask1() { benchDescReads(1); }
+task benchArbTask0() { benchArbReads(0); }
+task benchArbTask1() { benchArbReads(1); }
+
+/*!< Send a request that expects a reply, only try to read it much later */
+task benchArbForgetful() {
+  benchArbRequest[1].arr[0] = 2;
+  benchArbRequest[1].arr[1] = 0x04;
+  benchArbRequest[1].arr[2] = 0;
+  writeI2C(S1, benchArbRequest[1], 2);
+  wait1Msec(200);
+  benchArbLostRead = readI2C(S1, benchArbReply[1], 2);
+}
+
+/*!< Send a request that expects a reply and read it after a while */
+task benchArbSlowReader() {
+  benchArbRequest[1].arr[0] = 2;
+  benchArbRequest[1].arr[1] = 0x04;
+  benchArbRequest[1].arr[2] = 10;
+  writeI2C(S1, benchArbRequest[1], 2);
+  wait1Msec(5);
+  benchArbLostRead = readI2C(S1, benchArbReply[1], 2) && (benchArbReply[1].arr[0] == 110);
+}
+
+
+/**
+ * Check that the arbiter keeps the write/read pairs of several tasks on one
+ * port apart and that only the task holding a port can give it up.
+ */
+void benchCheckArbiter() {
+  benchRegs dev0(0x02, 0);
+  benchRegs dev1(0x04, 100);
+
+  hostI2CDetach(S1);
+  hostI2CAttach(S1, &dev0);
+  hostI2CAttach(S1, &dev1);
+  I2CconfigurePort(S1, sensorI2CCustom);
+
+  benchArbBad[0] = benchArbBad[1] = 0;
+  StartTask(benchArbTask0);
+  StartTask(benchArbTask1);
+  benchJoin(benchArbTask0);
+  benchJoin(benchArbTask1);
+  benchCheck("arbiter: two tasks reading on S1, no wrong replies", (benchArbBad[0] + benchArbBad[1]) == 0);
+
+  // Two tasks sharing the request buffer of I2CreadRegisters()
+  benchArbBad[0] = benchArbBad[1] = 0;
+  StartTask(benchDescTask0);
+  StartTask(benchDescTask1);
+  benchJoin(benchDescTask0);
+  benchJoin(benchDescTask1);
+  benchCheck("I2CreadRegisters(): two tasks on S1, no wrong replies", (benchArbBad[0] + benchArbBad[1]) == 0);
+
+  // A read by a task that never sent anything mustn't free the port
+  StartTask(benchArbSlowReader);
+  wait1Msec(2);
+  readI2C(S1, benchBytes, 2);
+  bool held = I2CArbTask[S1] != 0;
+  benchJoin(benchArbSlowReader);
+  benchCheck("arbiter: a stray readI2C() leaves the owner's port alone", held && benchArbLostRead);
+
+  // A reply that is never read only holds the port for I2C_ARB_REPLY_HOLD ms, not
+  // until the owner times out, the other 20 ms cover both transactions
+  StartTask(benchArbForgetful);
+  wait1Msec(1);
+  long start = nPgmTime;
+  bool read = I2CreadRegisters(S1, I2C_DESC(0x02, 20), benchBytes, 2) && (benchBytes.arr[0] == 20);
+  long waited = nPgmTime - start;
+  benchJoin(benchArbForgetful);
+  benchCheck("arbiter: an unread reply holds the port for a short while only", read && (waited < I2C_ARB_REPLY_HOLD + 20));
+  benchCheck("arbiter: reading a reply after losing the port fails", !benchArbLostRead);
+
+  hostI2CDetach(S1);
+}
+
+
+long benchQueueSpins;
+
+/*!< Count how often it gets the CPU until it's stopped */
+task benchQueueSpinner() {
+  while (true) {
+    benchQueueSpins++;
+    EndTimeSlice();
+  }
+}
+
+
+/*!< The reads of benchArbReads(1), queued with I2Ctransfer() */
+task benchQueueMixTask() {
+  for (int i = 0; i < BENCH_ARB_READS; i++) {
+    ubyte reg = i % 200;
+    benchArbRequest[1].arr[0] = 2;
+    benchArbRequest[1].arr[1] = 0x04;
+    benchArbRequest[1].arr[2] = reg;
+    if (!I2Ctransfer(S1, benchArbRequest[1], benchArbReply[1], 2) ||
+        (benchArbReply[1].arr[0] != (ubyte)(reg + 100)) || (benchArbReply[1].arr[1] != (ubyte)(reg + 101)))
+      benchArbBad[1]++;
+  }
+}
+
+
+/**
+ * Check the transaction queue: I2Csubmit() returns before the bus is done,
+ * a full queue refuses more, replies come back in order, I2Cwait() lets other
+ * tasks run, a failed transaction is reported as one and queued transactions
+ * share a port with writeI2C()/readI2C() from another task.
+ */
+void benchCheckQueue() {
+  benchRegs dev0(0x02, 0);
+  benchRegs dev1(0x04, 100);
+  tByteArray request;
+  tByteArray reply;
+  int tickets[3];
+
+  hostI2CDetach(S1);
+  hostI2CAttach(S1, &dev0);
+  hostI2CAttach(S1, &dev1);
+  I2CconfigurePort(S1, sensorI2CCustom);
+
+  long long start = hostNowUs;
+  for (int i = 0; i < 3; i++) {
+    request.arr[0] = 2;
+    request.arr[1] = 0x02 + 2 * (i % 2);
+    request.arr[2] = 0x10 + i;
+    tickets[i] = I2Csubmit(S1, request, 4);
+  }
+  long long submitted = hostNowUs - start;
+  benchCheck("queue: I2Csubmit() doesn't wait for the bus", submitted < hostI2CDuration(S1, 2, 4));
+  benchCheck("queue: a full queue refuses the next transaction", (tickets[0] >= 0) && (tickets[1] >= 0) && (tickets[2] < 0));
+
+  bool first = I2Creap(tickets[0], reply) && (reply.arr[0] == 0x10) && (reply.arr[3] == 0x13);
+  bool second = I2Creap(tickets[1], reply) && (reply.arr[0] == 100 + 0x11) && (reply.arr[3] == 100 + 0x14);
+  benchCheck("queue: I2Creap() returns each transaction's own reply", first && second);
+
+  benchQueueSpins = 0;
+  StartTask(benchQueueSpinner);
+  request.arr[1] = 0x02;
+  bool ok = I2Ctransfer(S1, request, reply, 16);
+  StopTask(benchQueueSpinner);
+  benchJoin(benchQueueSpinner);
+  benchCheck("queue: I2Ctransfer() lets other tasks run while the bus is busy", ok && (benchQueueSpins > 10));
+
+  dev1.failNext = 1;
+  request.arr[1] = 0x04;
+  tickets[0] = I2Csubmit(S1, request, 2);
+  ok = I2Creap(tickets[0], reply);
+  benchCheck("queue: a failed transaction is reported", !ok && (I2CreadLastError(S1) == I2C_ERR_BUS));
+
+  // Every slot has been reaped by now, so both must be free again
+  tickets[0] = I2Csubmit(S1, request, 2);
+  tickets[1] = I2Csubmit(S1, request, 2);
+  benchCheck("queue: I2Creap() frees the slots", (tickets[0] >= 0) && (tickets[1] >= 0));
+  I2Creap(tickets[0], reply);
+  I2Creap(tickets[1], reply);
+
+  benchArbBad[0] = benchArbBad[1] = 0;
+  StartTask(benchArbTask0);
+  StartTask(benchQueueMixTask);
+  benchJoin(benchArbTask0);
+  benchJoin(benchQueueMixTask);
+  benchCheck("queue: queued and direct reads on S1 from two tasks, no wrong replies", (benchArbBad[0] + benchArbBad[1]) == 0);
+
+  hostI2CDetach(S1);
+}
+
+
+/*!< A register file that keeps the bus busy for longer than any timeout */
+struct benchStuck : benchRegs {
+  benchStuck(ubyte addr) : benchRegs(addr, 0) {}
+  long long durationUs(tSensors link, const ubyte *out, int outlen, int replylen) override { return 10000000; }
+};
+
+
+/**
+ * Read four registers from the device at 0x02 on S1 and print how long it
+ * took, how much of that went into recovering and the failure class.
+ * @param name the name of the fault
+ * @param took holds the time in ms the read took
+ * @return true if the read succeeded and returned the right values
+ */
+bool benchFaultRead(const char *name, long &took) {
+  long start = nPgmTime;
+  bool ok = I2CreadRegisters(S1, I2C_DESC(0x02, 0x10), benchBytes, 4) && (benchBytes.arr[0] == 0x10);
+  took = nPgmTime - start;
+  printf("%-26s %5ld ms, %3ld ms recovering, error class %d, worst case %ld ms\n", name, took,
+         I2CreadRecoveryTime(S1), I2CreadLastError(S1), I2CmaxLatency(S1));
+  return ok;
+}
+
+
+/**
+ * Inject faults on the simulated bus and check that recovery is quick when
+ * the device comes back and bounded by I2CmaxLatency() when it doesn't.
+ */
+void benchCheckRecovery() {
+  benchRegs dev(0x02, 0);
+  benchStuck stuck(0x02);
+  long took = 0;
+
+  hostI2CDetach(S1);
+  hostI2CAttach(S1, &dev);
+  I2CconfigurePort(S1, sensorI2CCustom);
+  I2CsetTimeout(S1, I2C_TIMEOUT, 2, I2C_BACKOFF);
+
+  printf("\nError recovery, S1 with 2 retries\n");
+  bool ok = benchFaultRead("no fault", took);
+  dev.failNext = 1;
+  ok = benchFaultRead("one bus error", took);
+  benchCheck("recovery: one bus error costs a dummy packet and a back-off",
+             ok && (I2CreadLastError(S1) == I2C_ERR_NONE) && (I2CreadRecoveryTime(S1) <= I2C_BACKOFF + 5));
+  dev.failNext = 2;
+  ok = benchFaultRead("two bus errors", took);
+  benchCheck("recovery: a second dummy packet gets a device back",
+             ok && (I2CreadLastError(S1) == I2C_ERR_NONE) && (took <= I2CmaxLatency(S1)));
+
+  hostI2CDetach(S1);
+  ok = benchFaultRead("nothing at the address", took);
+  benchCheck("recovery: a missing device gives up within I2CmaxLatency()",
+             !ok && (I2CreadLastError(S1) == I2C_ERR_NACK) && (took <= I2CmaxLatency(S1)));
+
+  hostI2CAttach(S1, &stuck);
+  ok = benchFaultRead("bus stuck busy", took);
+  benchCheck("recovery: a stuck bus gives up within I2CmaxLatency()", !ok && (took <= I2CmaxLatency(S1)));
+
+  hostI2CDetach(S1);
+  hostI2CAttach(S1, &dev);
+  ok = benchFaultRead("device back", took);
+  benchCheck("recovery: the error class is cleared by the next good read", ok && (I2CreadLastError(S1) == I2C_ERR_NONE));
+
+  I2CsetTimeout(S1, I2C_TIMEOUT, I2C_RETRIES, I2C_BACKOFF);
+  hostI2CDetach(S1);
+}
+
+
+/*!< A register file that fails one in every `every` transactions at fast speed, or all of them when it's 1 */
+struct benchSlowOnly : benchRegs {
+  int every;
+  int count;
+
+  benchSlowOnly(ubyte addr, int e) : benchRegs(addr, 0), every(e), count(0) {}
+  bool accept(tSensors link) override {
+    if ((I2CreadPortCaps(link) & I2C_PORT_FAST) && ((++count % every) == 0))
+      return false;
+    return benchRegs::accept(link);
+  }
+};
+
+
+/**
+ * Check fast I2C negotiation and demotion against devices that only
+ * misbehave at fast speed, and that the transaction rate of a port that
+ * goes quiet drops back.
+ */
+void benchCheckSpeed() {
+  benchRegs good(0x02, 0);
+  benchSlowOnly never(0x02, 1);
+  benchSlowOnly flaky(0x02, 10);
+
+  hostI2CDetach(S1);
+  hostI2CAttach(S1, &good);
+  I2CconfigurePort(S1, sensorI2CCustom9V);
+  bool fast = I2CnegotiateSpeed(S1, 0x02);
+  benchCheck("speed: a device that copes is switched to fast I2C",
+             fast && (SensorType[S1] == sensorI2CCustomFast9V));
+
+  hostI2CDetach(S1);
+  hostI2CAttach(S1, &never);
+  fast = I2CnegotiateSpeed(S1, 0x02);
+  benchCheck("speed: a device that fails at fast speed stays at normal speed",
+             !fast && (SensorType[S1] == sensorI2CCustom9V) &&
+             I2CreadRegisters(S1, I2C_DESC(0x02, 0x10), benchBytes, 4) && (benchBytes.arr[0] == 0x10));
+
+  // Fails one read in ten once it's fast, which the probes don't catch
+  hostI2CDetach(S1);
+  hostI2CAttach(S1, &flaky);
+  fast = I2CnegotiateSpeed(S1, 0x02);
+  int reads = 0;
+  while ((reads < 200) && (I2CreadPortCaps(S1) & I2C_PORT_FAST)) {
+    I2CreadRegisters(S1, I2C_DESC(0x02, 0x10), benchBytes, 4);
+    reads++;
+  }
+  benchCheck("speed: a fast port that keeps failing drops back to normal speed",
+             fast && (SensorType[S1] == sensorI2CCustom9V) && (reads < I2C_FAST_WINDOW));
+
+  for (int i = 0; i < 50; i++) {
+    I2CreadRegisters(S1, I2C_DESC(0x02, 0x10), benchBytes, 4);
+    wait1Msec(10);
+  }
+  int busy = I2CreadPortRate(S1);
+  wait1Msec(3 * I2C_RATE_PERIOD);
+  int idle = I2CreadPortRate(S1);
+  benchCheck("speed: the transaction rate drops when the port goes quiet", (busy > 20) && (idle < busy / 2));
+
+  I2CconfigurePort(S1, sensorI2CCustom);
+  hostI2CDetach(S1);
+}
+
+
+/*!< A device with the standard version, vendor and device ID registers */
+struct benchIdent : hostI2CDevice {
+  benchIdent(ubyte addr, const char *vendor, const char *device) : hostI2CDevice(addr) {
+    strncpy((char *)&regs[I2C_SCAN_VERSION], "V1.0", 8);
+    strncpy((char *)&regs[I2C_SCAN_VENDOR], vendor, 8);
+    strncpy((char *)&regs[I2C_SCAN_VENDOR + 8], device, 8);
+    regs[MSDIST_DIST] = addr;
+  }
+};
+
+
+/**
+ * Check I2CscanPort() with several devices on a port: three DIST-Nx sensors
+ * at non-default addresses, a colour sensor and a device it doesn't know,
+ * plus a port with nothing on it.
+ */
+void benchCheckScan() {
+  benchIdent dist0(0x10, "mndsnsrs", "DIST");
+  benchIdent dist1(0x20, "mndsnsrs", "DIST");
+  benchIdent dist2(0x30, "mndsnsrs", "DIST");
+  benchIdent colour(0x02, "HiTechnc", "ColorPD");
+  benchIdent other(0x40, "Nobody", "Nothing");
+
+  hostI2CDetach(S1);
+  hostI2CDetach(S2);
+  hostI2CAttach(S1, &dist0);
+  hostI2CAttach(S1, &dist1);
+  hostI2CAttach(S1, &dist2);
+  hostI2CAttach(S1, &colour);
+  I2CconfigurePort(S1, sensorI2CCustom9V);
+  I2CconfigurePort(S2, sensorI2CCustom);
+
+  long start = nPgmTime;
+  int found = I2CscanPort(S1);
+  printf("\nScanning S1 with 4 devices took %ld ms\n", nPgmTime - start);
+  benchCheck("scan: finds every device on the port", found == 4);
+  benchCheck("scan: identifies the devices by their IDs",
+             (I2CreadDeviceType(S1, 0x02) == I2C_DEV_HTCS2) && (I2CreadDeviceType(S1, 0x20) == I2C_DEV_MSDIST) &&
+             (I2CreadDeviceType(S1, 0x50) == I2C_DEV_NONE));
+  benchCheck("scan: several devices of one type are found in address order",
+             (I2CfindDevice(S1, I2C_DEV_MSDIST, 0) == 0x10) && (I2CfindDevice(S1, I2C_DEV_MSDIST, 1) == 0x20) &&
+             (I2CfindDevice(S1, I2C_DEV_MSDIST, 2) == 0x30) && (I2CfindDevice(S1, I2C_DEV_MSDIST, 3) == 0));
+  benchCheck("scan: a driver binds to the scanned address",
+             (MSDISTreadDist(S1) & 0xFF) == 0x10);
+  benchCheck("scan: an address passed in is used as it is",
+             (MSDISTreadDist(S1, 0x30) & 0xFF) == 0x30);
+
+  // Only I2C_SCAN_DEVICES devices are kept, the ones at the lowest addresses
+  hostI2CAttach(S1, &other);
+  found = I2CscanPort(S1);
+  benchCheck("scan: stops after I2C_SCAN_DEVICES devices", (found == I2C_SCAN_DEVICES) && (I2CreadDeviceType(S1, 0x40) == I2C_DEV_NONE));
+
+  found = I2CscanPort(S2);
+  benchCheck("scan: an empty port has no devices, drivers keep their default",
+             (found == 0) && (I2CbindAddress(S2, I2C_DEV_MSDIST, MSDIST_I2C_ADDR) == MSDIST_I2C_ADDR));
+
+  // An unknown device is still listed
+  hostI2CAttach(S2, &other);
+  found = I2CscanPort(S2);
+  benchCheck("scan: a device with unknown IDs is listed as unknown", (found == 1) && (I2CreadDeviceType(S2, 0x40) == I2C_DEV_UNKNOWN));
+
+  hostI2CDetach(S1);
+  hostI2CDetach(S2);
+  I2CconfigurePort(S1, sensorI2CCustom);
+}
+
+
+/*!< An SMUX whose auto-detect is aborted by any command sent while it runs */
+struct benchScanSMUX : hostI2CDevice {
+  long long detectUs = -1;        /*!< When the auto-detect was started, -1 if it isn't running */
+  int aborted = 0;                /*!< Number of auto-detects that were cut short */
+
+  benchScanSMUX() : hostI2CDevice(HTSMUX_I2C_ADDR) {}
+
+  void regWrite(ubyte reg, ubyte val) override {
+    hostI2CDevice::regWrite(reg, val);
+    if (reg != HTSMUX_COMMAND)
+      return;
+    if ((detectUs >= 0) && (hostNowUs - detectUs < HTSMUX_DETECT_TIME * 1000LL))
+      aborted++;
+    detectUs = -1;
+    if (val == HTSMUX_CMD_AUTODETECT) {
+      detectUs = hostNowUs;
+      regs[HTSMUX_CH_OFFSET + HTSMUX_TYPE] = HTSMUXAccel;
+      regs[HTSMUX_CH_OFFSET + HTSMUX_CH_ENTRY_SIZE + HTSMUX_TYPE] = HTSMUXAnalogue;
+    }
+  }
+};
+
+
+/**
+ * Check a background scan: while it runs, the SMUX readers and HTSMUXscanPorts()
+ * refuse rather than abort the auto-detect.
+ */
+void benchCheckSMUXScan() {
+  benchScanSMUX smux;
+  bool refused = true;
+
+  hostI2CDetach(S2);
+  hostI2CAttach(S2, &smux);
+  I2CconfigurePort(S2, sensorI2CCustom9V);
+
+  bool started = HTSMUXscanStart(S2);
+  while (HTSMUXscanStep(S2)) {
+    if (!HTSMUXreadPort(S2, 0, benchBytes, 2) && (HTSMUXreadAnalogue(S2, 1) == -1) &&
+        !HTSMUXscanPorts(S2) && !HTSMUXsetMode(S2, 1, HTSMUX_CHAN_DIG0_HIGH))
+      wait1Msec(10);
+    else
+      refused = false;
+  }
+  benchCheck("SMUX scan: readers refuse while a background scan runs", started && refused);
+  benchCheck("SMUX scan: the auto-detect runs to the end", smux.aborted == 0);
+  benchCheck("SMUX scan: finds the channel types",
+             (HTSMUXscanState(S2) == HTSMUX_SCAN_DONE) && (HTSMUXreadSensorType(S2, 0) == HTSMUXAccel) &&
+             (HTSMUXreadSensorType(S2, 1) == HTSMUXAnalogue));
+  benchCheck("SMUX scan: readers work again once it's done", HTSMUXreadPort(S2, 0, benchBytes, 2) && (HTSMUXreadAnalogue(S2, 1) >= 0));
+
+  hostI2CDetach(S2);
+  I2CconfigurePort(S2, sensorI2CCustom);
+}
+
+
+/*!< Start over as after a reboot: the scan file has to be read again */
+void benchSMUXReboot() {
+  HTSMUXinit();
+  smuxScanFileLoaded = false;
+}
+
+
+/**
+ * Check HTSMUXscanCached(): with unchanged wiring it takes the channel types
+ * from the file without an auto-detect and checks them with one read on the
+ * first start, wrong types or a damaged file lead to a full scan.
+ */
+void benchCheckSMUXScanFile() {
+  benchScanSMUX smux;
+  TFileIOResult nIoResult;
+
+  Delete(HTSMUX_SCAN_FILE, nIoResult);
+  hostI2CDetach(S2);
+  hostI2CAttach(S2, &smux);
+  I2CconfigurePort(S2, sensorI2CCustom9V);
+
+  benchSMUXReboot();
+  bool full = HTSMUXscanCached(S2) && (HTSMUXscanState(S2) == HTSMUX_SCAN_HALT);
+  while (HTSMUXscanStep(S2))
+    wait1Msec(10);
+  benchCheck("SMUX scan file: without a file the scan is a full one",
+             full && (HTSMUXscanState(S2) == HTSMUX_SCAN_DONE) && ((smuxScanFilePorts & (1 << S2)) != 0));
+
+  benchSMUXReboot();
+  long before = smux.transactions;
+  bool cached = HTSMUXscanCached(S2) && (HTSMUXscanState(S2) == HTSMUX_SCAN_DONE) &&
+                (HTSMUXreadSensorType(S2, 0) == HTSMUXAccel) && (HTSMUXreadSensorType(S2, 1) == HTSMUXAnalogue);
+  benchCheck("SMUX scan file: unchanged wiring skips the auto-detect", cached && (smux.transactions == before));
+  bool read = HTSMUXreadPort(S2, 0, benchBytes, 2);
+  benchCheck("SMUX scan file: the first start checks the types with one read",
+             read && !smuxScanTrusted[S2] && (smux.transactions == before + 3));
+
+  // The SMUX was scanned with other sensors since the file was written
+  benchSMUXReboot();
+  smux.regs[HTSMUX_CH_OFFSET + HTSMUX_TYPE] = HTSMUXCompass;
+  bool stale = HTSMUXscanCached(S2) && !HTSMUXreadPort(S2, 0, benchBytes, 2) && (HTSMUXscanState(S2) == HTSMUX_SCAN_STALE);
+  while (HTSMUXscanStep(S2))
+    wait1Msec(10);
+  benchCheck("SMUX scan file: wrong types lead to a full scan",
+             stale && (HTSMUXscanState(S2) == HTSMUX_SCAN_DONE) && (HTSMUXreadSensorType(S2, 0) == HTSMUXAccel) &&
+             (smux.aborted == 0) && HTSMUXreadPort(S2, 0, benchBytes, 2));
+
+  // Flip a channel type in the file
+  TFileHandle hFileHandle;
+  int fileSize = 0;
+  ubyte bytes[HTSMUX_SCAN_FILE_SIZE];
+  OpenRead(hFileHandle, nIoResult, HTSMUX_SCAN_FILE, fileSize);
+  for (int i = 0; i < HTSMUX_SCAN_FILE_SIZE; i++)
+    ReadByte(hFileHandle, nIoResult, bytes[i]);
+  Close(hFileHandle, nIoResult);
+  bytes[2 + (4 * S2) + 1] = HTSMUXAccel;
+  Delete(HTSMUX_SCAN_FILE, nIoResult);
+  OpenWrite(hFileHandle, nIoResult, HTSMUX_SCAN_FILE, fileSize);
+  for (int i = 0; i < HTSMUX_SCAN_FILE_SIZE; i++)
+    WriteByte(hFileHandle, nIoResult, bytes[i]);
+  Close(hFileHandle, nIoResult);
+
+  benchSMUXReboot();
+  bool damaged = HTSMUXscanCached(S2) && (HTSMUXscanState(S2) == HTSMUX_SCAN_HALT);
+  while (HTSMUXscanStep(S2))
+    wait1Msec(10);
+  benchCheck("SMUX scan file: a damaged file is ignored",
+             damaged && (HTSMUXscanState(S2) == HTSMUX_SCAN_DONE) && (HTSMUXreadSensorType(S2, 1) == HTSMUXAnalogue));
+
+  Delete(HTSMUX_SCAN_FILE, nIoResult);
+  benchSMUXReboot();
+  hostI2CDetach(S2);
+  I2CconfigurePort(S2, sensorI2CCustom);
+}
+
+
+/**
+ * Check HTSMUXcommitConfig() when it can't finish: while the SMUX is busy or
+ * when the halt fails, the collected modes are kept for the next call.
+ */
+void benchCheckSMUXConfig() {
+  hostI2CDevice smux(HTSMUX_I2C_ADDR);
+  int mode = HTSMUX_CH_OFFSET + HTSMUX_MODE + HTSMUX_CH_ENTRY_SIZE;
+
+  hostI2CDetach(S2);
+  hostI2CAttach(S2, &smux);
+  I2CconfigurePort(S2, sensorI2CCustom9V);
+  smuxData[S2].sensor[1] = HTSMUXAnalogue;
+  smuxData[S2].status = HTSMUX_STAT_NORMAL;
+
+  HTSMUXbeginConfig(S2);
+  HTSMUXsetAnalogueActive(msensor_S2_2);
+  smuxData[S2].status = HTSMUX_STAT_BUSY;
+  bool busy = !HTSMUXcommitConfig(S2) && smuxData[S2].configuring && (smux.transactions == 0);
+  smuxData[S2].status = HTSMUX_STAT_NORMAL;
+  benchCheck("SMUX config: a commit while the SMUX is busy keeps the changes", busy);
+
+  smux.failNext = 100;
+  bool failed = !HTSMUXcommitConfig(S2) && smuxData[S2].configuring &&
+                (smuxData[S2].pendingMode[1] == HTSMUX_CHAN_DIG0_HIGH) && (smux.regs[mode] == 0);
+  smux.failNext = 0;
+  benchCheck("SMUX config: a commit whose halt fails keeps the changes", failed);
+
+  bool done = HTSMUXcommitConfig(S2) && !smuxData[S2].configuring &&
+              (smux.regs[mode] == HTSMUX_CHAN_DIG0_HIGH) && (smux.regs[HTSMUX_COMMAND] == HTSMUX_CMD_RUN) &&
+              (smuxData[S2].status == HTSMUX_STAT_NORMAL);
+  benchCheck("SMUX config: the next commit halts the SMUX and applies them", done);
+
+  smuxData[S2].sensor[1] = HTSMUXSensorNone;
+  hostI2CDetach(S2);
+  I2CconfigurePort(S2, sensorI2CCustom);
+}
+
+
+/*!< An SMUX whose channel buffers hold 0x10 * channel + register, and 0xEE while it's halted */
+struct benchPollSMUX : hostI2CDevice {
+  bool halted = false;
+
+  benchPollSMUX() : hostI2CDevice(HTSMUX_I2C_ADDR) {
+    for (int i = 0; i < 4 * HTSMUX_BF_ENTRY_SIZE; i++)
+      regs[HTSMUX_I2C_BUF + i] = (0x10 * (i / HTSMUX_BF_ENTRY_SIZE)) + (i % HTSMUX_BF_ENTRY_SIZE);
+    for (int i = 0; i < 4; i++)
+      regs[HTSMUX_ANALOG + (HTSMUX_AN_ENTRY_SIZE * i) + 1] = i;
+  }
+
+  void regWrite(ubyte reg, ubyte val) override {
+    hostI2CDevice::regWrite(reg, val);
+    if (reg == HTSMUX_COMMAND)
+      halted = (val == HTSMUX_CMD_HALT);
+  }
+
+  ubyte regRead(ubyte reg) override {
+    if (halted && (reg >= HTSMUX_I2C_BUF))
+      return 0xEE;
+    return hostI2CDevice::regRead(reg);
+  }
+};
+
+int benchPollBad;
+bool benchPollRunning;
+
+/*!< Read channels 2 and 3 and the analogue values while the poll task runs */
+task benchPollReader() {
+  int ch0, ch1, ch2, ch3;
+
+  while (benchPollRunning) {
+    for (int c = 2; c < 4; c++) {
+      if (!HTSMUXreadPort(S2, c, benchArbReply[1], 4) || (benchArbReply[1].arr[3] != 0x10 * c + 3))
+        benchPollBad++;
+    }
+    if (!HTSMUXreadAllAnalogue(S2, ch0, ch1, ch2, ch3) || (ch0 != 0) || (ch1 != 1))
+      benchPollBad++;
+  }
+}
+
+/*!< Keep halting and restarting the SMUX */
+task benchPollToggler() {
+  while (benchPollRunning) {
+    HTSMUXsendCommand(S2, HTSMUX_CMD_HALT);
+    HTSMUXsendCommand(S2, HTSMUX_CMD_RUN);
+    wait1Msec(3);
+  }
+}
+
+
+/**
+ * Check the SMUX poll task against reads from other tasks: the copies only
+ * hold their own channel's bytes and a copy read while the SMUX was halted
+ * and restarted is never marked valid.
+ */
+void benchCheckSMUXPoller() {
+  benchPollSMUX smux;
+  int mixed = 0, stale = 0, polled = 0;
+
+  hostI2CDetach(S2);
+  hostI2CAttach(S2, &smux);
+  I2CconfigurePort(S2, sensorI2CCustom9V);
+  HTSMUXinit();
+  smuxData[S2].sensor[0] = HTSMUXAnalogue;
+  smuxData[S2].sensor[1] = HTSMUXAnalogue;
+  smuxData[S2].sensor[2] = HTSMUXAccel;
+  smuxData[S2].sensor[3] = HTSMUXAccel;
+  HTSMUXsendCommand(S2, HTSMUX_CMD_RUN);
+
+  HTSMUXpollChannel(msensor_S2_1, 2, 4);
+  HTSMUXpollChannel(msensor_S2_2, 2, 4);
+  HTSMUXpollAnalogue(S2, 5);
+  HTSMUXstartPolling();
+
+  // Without the toggler, to check the channels stay apart
+  benchPollBad = 0;
+  benchPollRunning = true;
+  StartTask(benchPollReader);
+  for (int i = 0; i < 2000; i++) {
+    wait1Msec(1);
+    hogCPU();
+    for (int c = 0; c < 2; c++) {
+      if (smuxShadowValid[c + 4 * S2]) {
+        polled++;
+        if (smuxShadow[c + 4 * S2].arr[3] != 0x10 * c + 3)
+          mixed++;
+      }
+    }
+    releaseCPU();
+  }
+  benchPollRunning = false;
+  benchJoin(benchPollReader);
+  benchCheck("SMUX poller: copies and other tasks' reads hold the right channel",
+             (polled > 0) && (mixed == 0) && (benchPollBad == 0));
+
+  // The toggler halts the SMUX under the poll task's feet
+  benchPollRunning = true;
+  StartTask(benchPollToggler);
+  for (int i = 0; i < 5000; i++) {
+    wait1Msec(1);
+    hogCPU();
+    for (int c = 0; c < 2; c++) {
+      if (smuxShadowValid[c + 4 * S2] && (smuxShadow[c + 4 * S2].arr[0] == 0xEE))
+        stale++;
+    }
+    releaseCPU();
+  }
+  benchPollRunning = false;
+  benchJoin(benchPollToggler);
+  benchCheck("SMUX poller: a copy read around a halt is never valid", stale == 0);
+
+  // Stop the task at every point of its round, a read still in flight must
+  // not bring back a copy nobody refreshes any more
+  HTSMUXstopPolling();
+  wait1Msec(50);
+  stale = 0;
+  for (int i = 0; i < 200; i++) {
+    HTSMUXstartPolling();
+    wait1Msec(1 + (i % 7));
+    HTSMUXstopPolling();
+    wait1Msec(20);
+    for (int c = 0; c < 2; c++) {
+      if (smuxShadowValid[c + 4 * S2] || (HTSMUXreadShadowAge((tMUXSensor)(c + 4 * S2)) >= 0))
+        stale++;
+    }
+    if (HTSMUX_AnalogueSnapshot[S2].valid)
+      stale++;
+  }
+  benchCheck("SMUX poller: no copy is valid after HTSMUXstopPolling()", stale == 0);
+
+  HTSMUXpollChannel(msensor_S2_1, 0, 4);
+  HTSMUXpollChannel(msensor_S2_2, 0, 4);
+  HTSMUXpollAnalogue(S2, 0);
+  hostI2CDetach(S2);
+  I2CconfigurePort(S2, sensorI2CCustom);
+}
+
+
+/**
+ * Check HDMMUXreadStatus() while the refresh task reads the MMUX: it leaves
+ * the bus to the task and doesn't trust a status the task failed to refresh.
+ */
+void benchCheckHDMMUXRefresh() {
+  hostI2CDevice hdmmux(HDMMUX_I2C_ADDR);
+  byte status;
+  long tachoA, tachoB, tachoC;
+  int failed = 0;
+
+  hostI2CDetach(S3);
+  hostI2CAttach(S3, &hdmmux);
+  I2CconfigurePort(S3, sensorI2CCustom9V);
+  hdmmux.regs[12] = 42;          // Low byte of tacho A, the status request itself writes registers 0 to 7
+
+  HDMMUXstartRefresh(S3, 10);
+  wait1Msec(20);
+  hdmmux.transactions = 0;
+  long start = nPgmTime;
+  for (int i = 0; i < 500; i++) {
+    if (!HDMMUXreadStatus(S3, status, tachoA, tachoB, tachoC) || (tachoA != 42))
+      failed++;
+    wait1Msec(2);
+  }
+  long reads = ((nPgmTime - start) / 10) + 2;
+  benchCheck("HDMMUX refresh: reads leave the bus to the refresh task", (failed == 0) && (hdmmux.transactions <= reads));
+
+  // The task keeps failing, the last good status gets too old
+  hdmmux.failNext = 1000000;
+  wait1Msec(100);
+  start = nPgmTime;
+  bool read = HDMMUXreadStatus(S3, status, tachoA, tachoB, tachoC);
+  benchCheck("HDMMUX refresh: a status the task couldn't refresh isn't used",
+             !read && ((nPgmTime - start) <= 10 + HDMMUX_REFRESH_SLACK + 1));
+
+  HDMMUXstopRefresh();
+  wait1Msec(50);
+  hdmmux.failNext = 0;
+  benchCheck("HDMMUX refresh: reads go to the bus again once it's stopped", HDMMUXreadStatus(S3, status, tachoA, tachoB, tachoC));
+  HDMMUXstartRefresh(S3, 0);
+  hostI2CDetach(S3);
+}
+
+
+/*!< An HDMMUX whose motors only cover half of every relative move, and that can fail just its status reads */
+struct benchProfHDMMUX : hostI2CDevice {
+  long tacho[3];
+  long reported[3];               /*!< Encoder count in the last status read */
+  int readsSince;                 /*!< Status reads since the last motor command */
+  int unread;                     /*!< Motor commands sent without a status read before them */
+  int commands;
+  long commanded;                 /*!< Count the last command for motor A was meant to end at */
+  int failReads;                  /*!< Number of upcoming status reads that will fail */
+  bool reading;
+
+  benchProfHDMMUX() : hostI2CDevice(HDMMUX_I2C_ADDR), readsSince(0), unread(0), commands(0), commanded(0), failReads(0), reading(false) {
+    for (int i = 0; i < 3; i++)
+      tacho[i] = reported[i] = 0;
+  }
+
+  long long durationUs(tSensors link, const ubyte *out, int outlen, int replylen) override {
+    reading = (replylen > 0);
+    return -1;
+  }
+
+  bool accept(tSensors link) override {
+    if (reading && (failReads > 0)) {
+      failReads--;
+      return false;
+    }
+    return hostI2CDevice::accept(link);
+  }
+
+  void transact(const ubyte *out, int outlen, ubyte *in, int replylen) override {
+    if ((replylen > 0) && (outlen > 0) && (out[0] == 0)) {
+      in[0] = 0;
+      for (int i = 0; i < 3; i++) {
+        reported[i] = tacho[i];
+        for (int b = 0; b < 4; b++)
+          in[1 + (4 * i) + b] = (tacho[i] >> (8 * (3 - b))) & 0xFF;
+      }
+      readsSince++;
+    } else if ((outlen >= 8) && (out[0] == HDMMUX_CMD_MOTOR) && (out[1] >= HDMMUX_MOTOR_A) && (out[1] <= HDMMUX_MOTOR_C)) {
+      int i = out[1] - 1;
+      long step = ((long)out[3] << 24) | ((long)out[4] << 16) | ((long)out[5] << 8) | out[6];
+      if ((out[2] & HDMMUX_ROT_STOP) == HDMMUX_ROT_REVERSE)
+        step = -step;
+      if (readsSince == 0)
+        unread++;
+      if (i == 0)
+        commanded = reported[0] + step;
+      tacho[i] += step / 2;
+      readsSince = 0;
+      commands++;
+    }
+  }
+};
+
+
+/**
+ * Check MMUXprofileMove(): queueing a move doesn't touch the bus, the task
+ * reads where the motor starts from and drops the move if it can't, and a
+ * target that can't be sent is kept until the next tick.  An HDMMUX move is
+ * sent relative to an encoder count read in the same tick, and a tick whose
+ * read fails leaves the motor alone.
+ */
+void benchCheckMMUXProfile() {
+  benchMotorMMUX mmux(S3);
+
+  hostI2CDetach(S3);
+  hostI2CAttach(S3, &mmux);
+  I2CconfigurePort(S3, sensorI2CCustom9V);
+  MMUXprofileAttach(S3, MSMMUX_I2C_ADDR);
+  wait1Msec(50);
+
+  mmux.transactions = 0;
+  bool queued = MMUXprofileMove(mmotor_S3_1, 200, 600, 1500, MMUXPROF_TRAPEZOID);
+  benchCheck("MMUX profile: queueing a move leaves the bus alone", queued && (mmux.transactions == 0));
+
+  // The origin can't be read when the task picks the move up
+  mmux.failNext = 1000000;
+  MMUXprofileStart(20);
+  wait1Msec(100);
+  benchCheck("MMUX profile: a move from an unknown origin is dropped",
+             MMUXprofileDone(mmotor_S3_1) && MMUXprofileFailed(mmotor_S3_1) && (mmux.target[0] == 0));
+
+  mmux.failNext = 0;
+  mmux.pos[0] = 500;
+  MMUXprofileMove(mmotor_S3_1, 200, 600, 1500, MMUXPROF_TRAPEZOID);
+  for (int i = 0; (i < 200) && !MMUXprofileDone(mmotor_S3_1); i++)
+    wait1Msec(10);
+  benchCheck("MMUX profile: the next move starts from where the motor is",
+             MMUXprofileDone(mmotor_S3_1) && !MMUXprofileFailed(mmotor_S3_1) && (mmux.target[0] == 700));
+
+  // Both motors, the MMUX stops answering halfway and comes back later
+  MMUXprofileMove(mmotor_S3_1, 200, 600, 1500, MMUXPROF_TRAPEZOID);
+  MMUXprofileMove(mmotor_S3_2, 200, 600, 1500, MMUXPROF_TRAPEZOID);
+  wait1Msec(150);
+  mmux.failNext = 1000000;
+  wait1Msec(1000);
+  bool held = !MMUXprofileDone(mmotor_S3_1) && !MMUXprofileDone(mmotor_S3_2) &&
+              MMUXprofileFailed(mmotor_S3_1) && MMUXprofileFailed(mmotor_S3_2) &&
+              (mmux.target[0] < mmuxProfOrigin[mmotor_S3_1] + 200);
+  mmux.failNext = 0;
+  for (int i = 0; (i < 200) && !(MMUXprofileDone(mmotor_S3_1) && MMUXprofileDone(mmotor_S3_2)); i++)
+    wait1Msec(10);
+  benchCheck("MMUX profile: targets that can't be sent are kept and sent again",
+             held && MMUXprofileDone(mmotor_S3_1) && MMUXprofileDone(mmotor_S3_2) &&
+             (mmux.target[0] == mmuxProfOrigin[mmotor_S3_1] + 200) && (mmux.target[1] == 200));
+  MMUXprofileStop();
+  wait1Msec(50);
+  MMUXprofileAttach(S3, 0);
+  hostI2CDetach(S3);
+
+  benchProfHDMMUX hdmmux;
+  hostI2CAttach(S3, &hdmmux);
+  MMUXprofileAttach(S3, HDMMUX_I2C_ADDR);
+  hdmmux.tacho[0] = 100;
+  MMUXprofileMove(mmotor_S3_1, 200, 600, 1500, MMUXPROF_TRAPEZOID);
+  MMUXprofileStart(20);
+  wait1Msec(150);
+
+  // Status reads fail for a while, the motor must not be sent anywhere
+  hdmmux.failReads = 1000000;
+  int commands = hdmmux.commands;
+  wait1Msec(200);
+  bool skipped = (hdmmux.commands == commands) && !MMUXprofileDone(mmotor_S3_1) && !MMUXprofileFailed(mmotor_S3_1);
+  hdmmux.failReads = 0;
+  for (int i = 0; (i < 200) && !MMUXprofileDone(mmotor_S3_1); i++)
+    wait1Msec(10);
+  benchCheck("MMUX profile: HDMMUX moves start from the count read that tick",
+             MMUXprofileDone(mmotor_S3_1) && (hdmmux.commands > 2) && (hdmmux.unread == 0) && (hdmmux.commanded == 300));
+  benchCheck("MMUX profile: a failed HDMMUX encoder read skips the tick", skipped);
+  MMUXprofileStop();
+  wait1Msec(50);
+  MMUXprofileAttach(S3, 0);
+  hostI2CDetach(S3);
+}
+
+
+/**
+ * Check I2CholdWrites(): a read, a write that can't be combined and a driver
+ * calling I2CsyncWrites() send what's pending but leave the hold in place,
+ * only I2CflushWrites() ends it.
+ */
+void benchCheckWriteHold() {
+  hostI2CDevice dev(0x02);
+  tByteArray msg;
+  tByteArray reply;
+
+  hostI2CDetach(S3);
+  hostI2CAttach(S3, &dev);
+  I2CconfigurePort(S3, sensorI2CCustom);
+
+  I2CholdWrites(S3);
+  I2CwriteRegister(S3, 0x02, 0x40, 1);
+  msg.arr[0] = 2;
+  msg.arr[1] = 0x02;
+  msg.arr[2] = 0x40;
+  bool read = writeI2C(S3, msg, 1) && readI2C(S3, reply, 1);
+  benchCheck("write hold: a read sends the pending write first",
+             read && (reply.arr[0] == 1) && (dev.transactions == 2) && I2CWCHold[S3]);
+
+  I2CwriteRegister(S3, 0x02, 0x45, 2);
+  I2CsyncWrites(S3);
+  benchCheck("write hold: I2CsyncWrites() doesn't end it after a read", (dev.transactions == 2) && (dev.regs[0x45] == 0));
+
+  I2CwriteRegister(S3, 0x02, 0x49, 3);
+  benchCheck("write hold: a write that can't be combined sends the pending one and keeps it",
+             (dev.transactions == 3) && (dev.regs[0x45] == 2) && (dev.regs[0x49] == 0) && I2CWCHold[S3]);
+
+  I2CflushWrites(S3);
+  benchCheck("write hold: I2CflushWrites() sends the rest and ends it",
+             (dev.transactions == 4) && (dev.regs[0x49] == 3) && !I2CWCHold[S3]);
+  hostI2CDetach(S3);
+}
+
+
+/**
+ * Check I2CcaptureStart(): two tasks reading on one port are recorded without
+ * losing or mixing up records, the buffer is written to the file while the
+ * other tasks run and a long gap is clamped rather than wrapped.
+ */
+void benchCheckCapture() {
+  benchRegs dev0(0x02, 0);
+  benchRegs dev1(0x04, 100);
+  TFileIOResult nIoResult;
+
+  hostI2CDetach(S1);
+  hostI2CAttach(S1, &dev0);
+  hostI2CAttach(S1, &dev1);
+  I2CconfigurePort(S1, sensorI2CCustom);
+
+  hostHogWrites = 0;
+  benchCheck("capture: starts", I2CcaptureStart());
+  wait1Msec(40000);
+  benchArbBad[0] = benchArbBad[1] = 0;
+  StartTask(benchArbTask0);
+  StartTask(benchArbTask1);
+  benchJoin(benchArbTask0);
+  benchJoin(benchArbTask1);
+  bool stopped = I2CcaptureStop();
+  benchCheck("capture: stops, nothing dropped", stopped && (I2CcaptureDropped() == 0) && ((benchArbBad[0] + benchArbBad[1]) == 0));
+  benchCheck("capture: the file isn't written with the CPU hogged", hostHogWrites == 0);
+
+  // Walk the records, each must be complete and well formed
+  int requests = 0, replies = 0, firstDelta = -1;
+  bool wellFormed = false;
+  FILE *f = fopen(I2C_CAPTURE_FILE, "rb");
+  if ((f != 0) && (fgetc(f) == 'I') && (fgetc(f) == '2') && (fgetc(f) == 'C') && (fgetc(f) == 1)) {
+    int kind;
+    wellFormed = true;
+    while (wellFormed && ((kind = fgetc(f)) != EOF)) {
+      int delta = fgetc(f);
+      delta |= fgetc(f) << 8;
+      fgetc(f);
+      int len = fgetc(f);
+      if (firstDelta < 0)
+        firstDelta = delta;
+      if ((kind & 0x0F) != S1)
+        wellFormed = false;
+      else if ((kind & I2C_CAP_REQUEST) != 0)
+        requests++;
+      else if ((kind & I2C_CAP_REPLY) != 0)
+        replies++;
+      else
+        wellFormed = false;
+      for (int i = 0; i < len + (((kind & I2C_CAP_REQUEST) != 0) ? 1 : 0); i++)
+        if (fgetc(f) == EOF)
+          wellFormed = false;
+    }
+  }
+  if (f != 0)
+    fclose(f);
+  Delete(I2C_CAPTURE_FILE, nIoResult);
+  benchCheck("capture: every transaction is recorded, records intact",
+             wellFormed && (requests == 2 * BENCH_ARB_READS) && (replies == 2 * BENCH_ARB_READS));
+  benchCheck("capture: a 40 s gap is clamped to 32767 ms", firstDelta == 0x7FFF);
+
+  hostI2CDetach(S1);
+}
+
+
+/**
+ * Read the baseline file.
+ * @param path the file name
+ */
+void benchLoadBaseline(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (f == 0)
+    return;
+  while (benchBaselineSize < BENCH_MAX_CASES) {
+    benchResultT &b = benchBaseline[benchBaselineSize];
+    if (fscanf(f, "%39s %f %f %f", b.name, &b.transactions, &b.bytes, &b.ms) != 4)
+      break;
+    benchBaselineSize++;
+  }
+  fclose(f);
+}
+
+
+/**
+ * Check a figure against its baseline value.
+ * @return true if it got worse by more than BENCH_TOLERANCE percent
+ */
+bool benchWorse(float now, float then) {
+  return now > (then * (100 + BENCH_TOLERANCE) / 100) + 0.01;
+}
+
+
+task main() {
+  const char *path = getenv("HOST_BENCH_BASELINE") ? getenv("HOST_BENCH_BASELINE") : BENCH_BASELINE;
+  int cases = sizeof(benchCases) / sizeof(benchCases[0]);
+  int regressions = 0;
+
+  // The checks at the end mustn't be cut short by the emulation's run limit
+  hostRunLimitUs = (long long)BENCH_RUN_MSEC * 1000;
+  benchLoadBaseline(path);
+
+  printf("%-26s %8s %8s %9s\n", "function", "trans", "bytes", "ms");
+  for (int i = 0; i < cases; i++) {
+    benchResultT &r = benchResults[i];
+    benchRun(benchCases[i], r);
+    printf("%-26s %8.2f %8.2f %9.3f", r.name, r.transactions, r.bytes, r.ms);
+
+    for (int j = 0; j < benchBaselineSize; j++) {
+      benchResultT &b = benchBaseline[j];
+      if (strcmp(b.name, r.name) != 0)
+        continue;
+      if (benchWorse(r.transactions, b.transactions) || benchWorse(r.bytes, b.bytes) || benchWorse(r.ms, b.ms)) {
+        printf("   REGRESSION, was %.2f %.2f %.3f", b.transactions, b.bytes, b.ms);
+        regressions++;
+      } else if (r.ms < b.ms) {
+        printf("   (was %.3f ms)", b.ms);
+      }
+    }
+    printf("\n");
+  }
+
+  benchSMUXWindows();
+
+  printf("\nMMUX motor start\n");
+  MSMMUXinit();
+  benchMMUXStart("MSMMotor() twice", 0);
+  benchMMUXStart("MSMMotorGroup()", 1);
+  benchMMUXStart("MSMMotorPair()", 2);
+
+  printf("\nMMUX motion profiles, 1800 and -900 counts\n");
+  benchProfile("trapezoid, 50 ms", MMUXPROF_TRAPEZOID, 50);
+  benchProfile("S-curve, 50 ms", MMUXPROF_SCURVE, 50);
+  benchProfile("trapezoid, 100 ms", MMUXPROF_TRAPEZOID, 100);
+
+  printf("\nMotor commands, 8 motors on MSMMUX, HDMMUX, IR Link and PFMate\n");
+  benchMotors("driver calls", false);
+  benchMotors("MOTORset() + MOTORflush()", true);
+
+  printf("\nRequest building, VM operations per register read\n");
+  benchRequestOps("same register", 1);
+  benchRequestOps("two registers in turn", 2);
+
+  printf("\nChecks\n");
+  benchCheckArbiter();
+  benchCheckQueue();
+  benchCheckRecovery();
+  benchCheckSpeed();
+  benchCheckScan();
+  benchCheckCapture();
+  benchCheckSMUXScan();
+  benchCheckSMUXScanFile();
+  benchCheckSMUXConfig();
+  benchCheckSMUXPoller();
+  benchCheckHDMMUXRefresh();
+  benchCheckMMUXProfile();
+  benchCheckWriteHold();
+
+  if (getenv("HOST_BENCH_SAVE") != 0) {
+    FILE *f = fopen(path, "w");
+    if (f != 0) {
+      for (int i = 0; i < cases; i++)
+        fprintf(f, "%s %.2f %.2f %.3f\n", benchResults[i].name, benchResults[i].transactions, benchResults[i].bytes, benchResults[i].ms);
+      fclose(f);
+      printf("baseline written to %s\n", path);
+    }
+  }
+
+  fflush(stdout);
+  if (regressions > 0)
+    printf("%d regression(s)\n", regressions);
+  if (benchFailures > 0)
+    printf("%d failed check(s)\n", benchFailures);
+  if ((regressions > 0) || (benchFailures > 0)) {
+    fflush(stdout);
+    std::_Exit(1);
+  }
+  StopAllTasks();
+}
+
+/* @} */
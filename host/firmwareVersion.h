@@ -0,0 +1,6 @@
+/** \file firmwareVersion.h
+ * \brief Firmware version of the emulated NXT, see robotc.h
+ */
+#ifndef kFirmwareVersion
+#define kFirmwareVersion 785
+#endif
@@ -0,0 +1,82 @@
+#!/bin/sh
+#
+# footprint.sh: list the global variables each driver header costs
+#
+# Every driver is compiled on its own against the host emulation and the
+# sizes of its global variables are taken from the object file.  What
+# common.h declares is counted once, on its own line, and left out of the
+# drivers' figures.  The sizes are host sizes: ints take 4 bytes and longs 8
+# here, where the NXT uses 2 and 4, so they overstate the real cost, but
+# they're fine for comparing drivers and build options.  RobotC allocates
+# locals statically too, those aren't counted.
+#
+# Usage: host/footprint.sh [-v] [compiler flags]
+#   -v               also list the variables of every driver
+#   compiler flags   e.g. -D__COMMON_H_I2C_ARENA__ to see what the arena saves
+#
+# Or: ant footprint
+#
+# License: You may use this code as you wish, provided you give credit where its due.
+#
+
+CXX=${CXX:-g++}
+CXXFLAGS="-std=c++17 -w -Ihost -I. -include host/robotc.h -x c++"
+TMP=${FOOTPRINT_TMP:-build/host/footprint}
+
+VERBOSE=0
+if [ "$1" = "-v" ]; then
+  VERBOSE=1
+  shift
+fi
+EXTRA="$*"
+
+mkdir -p "$TMP" || exit 1
+
+# globals <header> <output>: write "name bytes" for every global, sorted by name
+globals() {
+  if [ -n "$1" ]; then
+    printf '#include "%s"\n' "$1" > "$TMP/fp.c"
+  else
+    : > "$TMP/fp.c"
+  fi
+  $CXX $CXXFLAGS $EXTRA -c "$TMP/fp.c" -o "$TMP/fp.o" || return 1
+  nm -S "$TMP/fp.o" | awk '
+    function hex(s,   i, n) {
+      n = 0
+      for (i = 1; i <= length(s); i++)
+        n = n * 16 + index("0123456789abcdef", tolower(substr(s, i, 1))) - 1
+      return n
+    }
+    NF == 4 && $3 ~ /^[bBdDrR]$/ { print $4, hex($2) }' | sort > "$2"
+}
+
+# report <name> <globals> <baseline>: print what's in globals but not in baseline
+report() {
+  join -v 1 "$2" "$3" > "$TMP/own.txt"
+  awk -v name="$1" -v verbose=$VERBOSE '
+    { total += $2; count++; vars[count] = sprintf("    %-32s %6d", $1, $2) }
+    END {
+      printf("%-24s %8d %6d\n", name, total, count)
+      if (verbose)
+        for (i = 1; i <= count; i++)
+          print vars[i]
+    }' "$TMP/own.txt"
+}
+
+globals "" "$TMP/emulation.txt" || exit 1
+globals "drivers/common.h" "$TMP/common.txt" || exit 1
+
+printf "%-24s %8s %6s\n" "header" "bytes" "vars"
+report "common.h" "$TMP/common.txt" "$TMP/emulation.txt"
+
+for f in drivers/*.h; do
+  name=$(basename "$f")
+  case "$name" in
+    common.h|"Driver Template.h") continue ;;
+  esac
+  if ! globals "$f" "$TMP/driver.txt"; then
+    echo "$name: doesn't compile" >&2
+    continue
+  fi
+  report "$name" "$TMP/driver.txt" "$TMP/common.txt"
+done
@@ -0,0 +1,177 @@
+/*!@addtogroup host
+ * @{
+ */
+
+/** \file replay.h
+ * \brief Replays an I2C capture on the simulated bus
+ *
+ * replay.h reads a file recorded with I2CcaptureStart() (see common.h) and
+ * plugs a device into every port and address found in it.  Each device hands
+ * the recorded replies back to the drivers in the order they were captured,
+ * and every transaction takes as long on the simulated bus as it took on the
+ * brick.  Recorded failures fail again.  The programs run their own code, so
+ * the time between transactions is theirs, hostReplayReport() shows how far
+ * the replay drifted from the recording.
+ *
+ * Messages made of just an address, which clearI2CError() sends, aren't
+ * recorded and are always acknowledged.  A request that doesn't match the one
+ * that was recorded still gets the recorded reply, but is counted as a
+ * mismatch.  Once a device runs out of records it keeps repeating the last
+ * reply.
+ *
+ * Usage: set HOST_REPLAY to the capture file, main() in robotc.h loads it
+ * after hostSetup(), or "ant hostreplay", which replays host.replay against
+ * theodore.c.
+ *
+ * License: You may use this code as you wish, provided you give credit where its due.
+ */
+
+#ifndef __HOST_REPLAY_H__
+#define __HOST_REPLAY_H__
+
+#include <vector>
+
+#define HOST_CAP_REQUEST  0x10    /*!< Same as I2C_CAP_REQUEST in common.h */
+#define HOST_CAP_REPLY    0x20    /*!< Same as I2C_CAP_REPLY in common.h */
+#define HOST_CAP_FAILED   0x80    /*!< Same as I2C_CAP_FAILED in common.h */
+
+/*!< A single recorded transaction */
+struct hostReplayEntry {
+  long long atUs;                 /*!< When the request was sent, relative to the start of the capture */
+  long long busyUs;               /*!< How long the bus took, 0 if not known */
+  bool failed;
+  std::vector<ubyte> request;     /*!< Address and bytes sent */
+  int replylen;
+  std::vector<ubyte> reply;
+};
+
+/*!< Totals kept while replaying */
+struct hostReplayStatsT {
+  long entries;                   /*!< Transactions loaded from the capture */
+  long replayed;
+  long mismatches;                /*!< Requests that differed from the recording */
+  long overruns;                  /*!< Requests made after the recording ran out */
+  long long maxDriftUs;           /*!< Largest difference between recorded and replayed time */
+  long long offsetUs;             /*!< Replay time minus recorded time of the first transaction */
+};
+
+inline hostReplayStatsT hostReplayStats;
+
+/*!< A device that plays back what was recorded for one address on one port */
+struct hostReplayDevice : hostI2CDevice {
+  std::vector<hostReplayEntry> entries;
+  size_t next;
+  hostReplayEntry *current;       /*!< Entry for the transaction in progress, 0 for address-only messages */
+
+  hostReplayDevice(ubyte addr) : hostI2CDevice(addr), next(0), current(0) {}
+
+  long long durationUs(tSensors link, const ubyte *out, int outlen, int replylen) override {
+    current = 0;
+    if (outlen <= 1 || entries.empty())
+      return -1;
+
+    if (next < entries.size()) {
+      current = &entries[next++];
+      if (hostReplayStats.replayed++ == 0)
+        hostReplayStats.offsetUs = hostNowUs - current->atUs;
+      long long drift = llabs(hostNowUs - current->atUs - hostReplayStats.offsetUs);
+      if (drift > hostReplayStats.maxDriftUs)
+        hostReplayStats.maxDriftUs = drift;
+    } else {
+      current = &entries.back();
+      hostReplayStats.overruns++;
+    }
+
+    if ((int)current->request.size() != outlen || current->replylen != replylen ||
+        ::memcmp(&current->request[0], out, outlen) != 0)
+      hostReplayStats.mismatches++;
+
+    return (current->busyUs > 0) ? current->busyUs : -1;
+  }
+
+  bool accept(tSensors link) override {
+    if (current != 0 && current->failed)
+      return false;
+    return hostI2CDevice::accept(link);
+  }
+
+  void transact(const ubyte *out, int outlen, ubyte *in, int replylen) override {
+    if (current == 0)
+      return;
+    for (int i = 0; i < replylen && i < (int)current->reply.size(); i++)
+      in[i] = current->reply[i];
+  }
+};
+
+/*!
+ * Load a capture and plug a replay device into every port and address in it.
+ * Devices already attached to those addresses are replaced.
+ * @return false if the file couldn't be read or isn't a capture
+ */
+inline bool hostReplayLoad(const char *name) {
+  FILE *f = fopen(name, "rb");
+  if (f == 0) {
+    fprintf(stderr, "host: can't open replay file %s\n", name);
+    return false;
+  }
+
+  ubyte magic[4];
+  if (fread(magic, 1, 4, f) != 4 || magic[0] != 'I' || magic[1] != '2' || magic[2] != 'C' || magic[3] != 1) {
+    fprintf(stderr, "host: %s is not an I2C capture\n", name);
+    fclose(f);
+    return false;
+  }
+
+  std::map<int, hostReplayDevice *> devices;   // keyed by port * 256 + address
+  hostReplayEntry *last[4] = {0, 0, 0, 0};     // latest request on each port
+  long long now = 0;
+  int c;
+
+  while ((c = fgetc(f)) != EOF) {
+    ubyte head[4];
+    if (fread(head, 1, 4, f) != 4)
+      break;
+    int link = c & 0x03;
+    now += (long long)(head[0] | (head[1] << 8)) * 1000;
+
+    std::vector<ubyte> bytes(head[3]);
+    if (head[3] > 0 && fread(&bytes[0], 1, head[3], f) != head[3])
+      break;
+
+    if (c & HOST_CAP_REQUEST) {
+      int replylen = fgetc(f);
+      if (replylen == EOF || bytes.empty())
+        break;
+      int key = link * 256 + (bytes[0] & 0xFE);
+      if (devices.count(key) == 0)
+        devices[key] = new hostReplayDevice(bytes[0]);
+      hostReplayEntry entry;
+      entry.busyUs = (long long)head[2] * 1000;
+      entry.atUs = now - entry.busyUs;
+      entry.failed = (c & HOST_CAP_FAILED) != 0;
+      entry.request = bytes;
+      entry.replylen = replylen;
+      devices[key]->entries.push_back(entry);
+      last[link] = &devices[key]->entries.back();
+      hostReplayStats.entries++;
+    } else if ((c & HOST_CAP_REPLY) && last[link] != 0) {
+      last[link]->reply = bytes;
+      last[link] = 0;
+    }
+  }
+  fclose(f);
+
+  for (std::map<int, hostReplayDevice *>::iterator it = devices.begin(); it != devices.end(); ++it)
+    hostI2CAttach((tSensors)(it->first / 256), it->second);
+  return true;
+}
+
+/*!< Print how the replay went */
+inline void hostReplayReport() {
+  printf("host: replayed %ld of %ld transactions, %ld mismatched, %ld past the end, drifted up to %lld ms\n",
+         hostReplayStats.replayed, hostReplayStats.entries, hostReplayStats.mismatches,
+         hostReplayStats.overruns, hostReplayStats.maxDriftUs / 1000);
+}
+
+#endif // __HOST_REPLAY_H__
+/* @} */
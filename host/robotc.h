@@ -0,0 +1,734 @@
+/*!@addtogroup host
+ * @{
+ */
+
+/** \file robotc.h
+ * \brief Host emulation of the RobotC/NXT runtime
+ *
+ * robotc.h lets the drivers in drivers/ and programs like theodore.c be
+ * compiled with a C++ compiler on a regular PC.  It provides stand-ins for the
+ * RobotC types and intrinsics used by the drivers (sendI2CMsg, nI2CStatus,
+ * wait1Msec, nPgmTime, motor[], nMotorEncoder[], SensorValue, tasks, hogCPU,
+ * the LCD and flash file I/O) on top of a deterministic, virtual clock.
+ *
+ * Tasks run as threads, but only one of them is ever allowed to run at a time,
+ * just like on the brick.  Time only moves forward when a task waits or when
+ * the simulated I2C bus is polled, so every run is repeatable.
+ *
+ * Simulated I2C devices are registered per port, keyed by their I2C address,
+ * see simbus.h.
+ *
+ * RobotC's "#pragma config" lines are ignored by the compiler, the names and
+ * sensor types they set up go in a separate config header that defines
+ * hostConfig(), see theodore-config.h.  Test programs can define hostSetup()
+ * to plug in simulated devices, it runs after hostConfig().  Setting
+ * HOST_REPLAY to a file recorded with I2CcaptureStart() replays it on the
+ * simulated bus, see replay.h.
+ *
+ * Usage:
+ * g++ -std=c++17 -Ihost -include host/robotc.h -include host/theodore-config.h -x c++ theodore.c -lpthread
+ *
+ * or "ant host", which also checks that every driver compiles.  "ant hostbench"
+ * runs the I2C efficiency scorecard in bench.c.
+ *
+ * License: You may use this code as you wish, provided you give credit where its due.
+ */
+
+#ifndef __HOST_ROBOTC_H__
+#define __HOST_ROBOTC_H__
+
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * ---------------------------------------------------------------------------
+ * Types
+ * ---------------------------------------------------------------------------
+ */
+
+#define byte char     /*!< a macro rather than a typedef, RobotC allows "unsigned byte" */
+typedef unsigned char ubyte;
+typedef signed char sbyte;
+typedef unsigned short word;
+
+/*!< RobotC's string type, a fixed size 20 character buffer */
+struct string {
+  char buf[20];
+  string() { buf[0] = 0; }
+  string(const char *s) { assign(s); }
+  string &operator=(const char *s) { assign(s); return *this; }
+  bool operator==(const char *s) const { return strcmp(buf, s) == 0; }
+  bool operator==(const string &s) const { return strcmp(buf, s.buf) == 0; }
+  bool operator!=(const char *s) const { return !(*this == s); }
+  string operator+(const char *s) const { string r(*this); strncat(r.buf, s, sizeof(buf) - strlen(r.buf) - 1); return r; }
+  string &operator+=(const char *s) { strncat(buf, s, sizeof(buf) - strlen(buf) - 1); return *this; }
+  operator const char *() const { return buf; }
+  void assign(const char *s) { strncpy(buf, s, sizeof(buf) - 1); buf[sizeof(buf) - 1] = 0; }
+};
+
+/*!
+ * Sensor port.  RobotC converts freely between ports and ints, so this is a
+ * class with implicit conversions both ways rather than an enum.
+ */
+struct tSensors {
+  int v;
+  constexpr tSensors(int x = 0) : v(x) {}
+  constexpr operator int() const { return v; }
+};
+
+constexpr tSensors S1(0);
+constexpr tSensors S2(1);
+constexpr tSensors S3(2);
+constexpr tSensors S4(3);
+
+typedef enum {
+  motorA = 0,
+  motorB = 1,
+  motorC = 2
+} tMotor;
+
+typedef enum {
+  sensorNone,
+  sensorTouch,
+  sensorLightActive,
+  sensorLightInactive,
+  sensorSoundDB,
+  sensorSoundDBA,
+  sensorRawValue,
+  sensorAnalogActive,
+  sensorAnalogInactive,
+  sensorSONAR,
+  sensorLowSpeed,
+  sensorLowSpeed9V,
+  sensorI2CCustom,
+  sensorI2CCustom9V,
+  sensorI2CCustomFast,
+  sensorI2CCustomFast9V,
+  sensorI2CCustomFastSkipStates,
+  sensorI2CCustomFastSkipStates9V,
+  sensorCOLORFULL
+} TSensorTypes;
+
+typedef enum {
+  modeRaw,
+  modeBoolean,
+  modeEdge,
+  modePulse,
+  modePercentage
+} TSensorModes;
+
+typedef enum {
+  mtrNoReg,
+  mtrSpeedReg,
+  mtrSyncRegMaster,
+  mtrSyncRegSlave
+} TMotorRegulation;
+
+typedef enum {
+  NO_ERR = 0,
+  STAT_COMM_PENDING = 32,
+  ERR_COMM_CHAN_NOT_READY = -32,
+  ERR_COMM_BUS_ERR = -35
+} TI2CStatus;
+
+typedef enum {
+  soundBlip,
+  soundBeepBeep,
+  soundDownwardTones,
+  soundUpwardTones,
+  soundLowBuzz,
+  soundFastUpwardTones,
+  soundShortBlip,
+  soundException
+} TSounds;
+
+typedef enum {
+  taskStateStopped,
+  taskStateRunning
+} TTaskStates;
+
+typedef short TFileHandle;
+
+typedef enum {
+  ioRsltSuccess = 0,
+  ioRsltFileNotFound = 0x8700,
+  ioRsltNoSpace = 0x8900,
+  ioRsltEndOfFile = 0x8600,
+  ioRsltIllegalHandle = 0x8500
+} TFileIOResult;
+
+#define kDefaultTaskPriority  7
+#define kLowPriority          0
+#define kHighPriority         255
+
+#define PI 3.14159265358979
+
+/*
+ * ---------------------------------------------------------------------------
+ * Scheduler and virtual clock
+ * ---------------------------------------------------------------------------
+ */
+
+#ifndef HOST_TIMESLICE_US
+#define HOST_TIMESLICE_US 1000    /*!< Run time after which an equal priority task gets preempted */
+#endif
+
+#ifndef HOST_YIELD_US
+#define HOST_YIELD_US 10          /*!< Time it takes to hand the CPU to another task */
+#endif
+
+#ifndef HOST_RUN_MSEC
+#define HOST_RUN_MSEC 60000       /*!< Virtual run time after which the program is ended */
+#endif
+
+struct hostTaskT;
+typedef void (*hostTaskFn)();
+
+/*!< Bookkeeping for a single RobotC task */
+struct hostTaskT {
+  const char *name;
+  hostTaskFn fn;
+  int number;                     /*!< nCurrentTask, the order in which the task was first started */
+  int priority;
+  TTaskStates state;
+  bool kill;
+  long long wakeUs;
+  long long sliceStartUs;
+  std::condition_variable cv;
+};
+
+/*!< Thrown into a task that has been stopped with StopTask() */
+struct hostTaskKilled {};
+
+inline std::mutex hostVm;                       /*!< Only the task holding hostCurrent may run */
+inline std::condition_variable hostDone;        /*!< Signalled when the program ends */
+inline bool hostFinished = false;
+inline hostTaskT *hostCurrent = 0;
+inline std::vector<hostTaskT *> hostTasks;
+inline long long hostNowUs = 0;                 /*!< The virtual clock, in microseconds */
+inline long long hostRunLimitUs = (long long)HOST_RUN_MSEC * 1000;
+inline bool hostHog = false;
+inline thread_local hostTaskT *hostSelf = 0;
+
+inline void hostClockTick(long long us);
+
+/*
+ * Pick the next task to run.  Highest priority ready task wins, ties are
+ * broken round-robin.  If no task is ready, move the clock forward to the
+ * first sleeper.  Must be called with hostVm held.
+ */
+inline hostTaskT *hostPickNext(hostTaskT *after) {
+  while (true) {
+    hostTaskT *best = 0;
+    size_t start = 0;
+    for (size_t i = 0; i < hostTasks.size(); i++)
+      if (hostTasks[i] == after) start = i + 1;
+    for (size_t n = 0; n < hostTasks.size(); n++) {
+      hostTaskT *t = hostTasks[(start + n) % hostTasks.size()];
+      if (t->state != taskStateRunning || t->wakeUs > hostNowUs)
+        continue;
+      if (best == 0 || t->priority > best->priority)
+        best = t;
+    }
+    if (best != 0)
+      return best;
+
+    long long wake = -1;
+    for (size_t i = 0; i < hostTasks.size(); i++) {
+      hostTaskT *t = hostTasks[i];
+      if (t->state == taskStateRunning && (wake < 0 || t->wakeUs < wake))
+        wake = t->wakeUs;
+    }
+    if (wake < 0)
+      return 0;
+    hostClockTick(wake - hostNowUs);
+  }
+}
+
+/*
+ * Hand the CPU to the next task and block until it is our turn again.
+ * Must be called with hostVm held through lock.
+ */
+inline void hostSwitch(std::unique_lock<std::mutex> &lock) {
+  hostTaskT *me = hostSelf;
+  hostTaskT *next = hostPickNext(me);
+
+  if (next == 0 || hostNowUs >= hostRunLimitUs) {
+    hostFinished = true;
+    hostDone.notify_all();
+    hostCurrent = 0;
+  } else {
+    hostCurrent = next;
+    next->sliceStartUs = hostNowUs;
+    next->cv.notify_one();
+  }
+
+  if (me == 0 || me->state != taskStateRunning)
+    return;
+
+  me->cv.wait(lock, [me] { return hostCurrent == me || hostFinished; });
+  if (hostFinished)
+    me->cv.wait(lock, [] { return false; });
+  if (me->kill)
+    throw hostTaskKilled();
+}
+
+/*
+ * Advance the virtual clock while the current task is busy.  Equal or
+ * higher priority tasks get a go once the current task's slice is used up.
+ */
+inline void hostBusy(long long us) {
+  std::unique_lock<std::mutex> lock(hostVm);
+  hostClockTick(us);
+  hostTaskT *me = hostSelf;
+  if (me == 0 || hostHog)
+    return;
+  if (hostNowUs - me->sliceStartUs >= HOST_TIMESLICE_US || hostNowUs >= hostRunLimitUs)
+    hostSwitch(lock);
+}
+
+inline void hostTaskEntry(hostTaskT *t) {
+  hostSelf = t;
+  {
+    std::unique_lock<std::mutex> lock(hostVm);
+    t->cv.wait(lock, [t] { return hostCurrent == t || hostFinished; });
+    if (hostFinished)
+      t->cv.wait(lock, [] { return false; });
+  }
+  try {
+    if (!t->kill)
+      t->fn();
+  } catch (hostTaskKilled &) {
+  }
+  std::unique_lock<std::mutex> lock(hostVm);
+  t->state = taskStateStopped;
+  hostHog = false;
+  hostSwitch(lock);
+}
+
+inline hostTaskT *hostFindTask(hostTaskFn fn) {
+  for (size_t i = 0; i < hostTasks.size(); i++)
+    if (hostTasks[i]->fn == fn)
+      return hostTasks[i];
+  return 0;
+}
+
+inline void hostStartTask(hostTaskFn fn, const char *name, int priority) {
+  std::unique_lock<std::mutex> lock(hostVm);
+  hostTaskT *t = hostFindTask(fn);
+  if (t != 0 && t->state == taskStateRunning)
+    return;
+  if (t == 0) {
+    t = new hostTaskT();
+    t->number = hostTasks.size();
+    hostTasks.push_back(t);
+  }
+  t->name = name;
+  t->fn = fn;
+  t->priority = priority;
+  t->state = taskStateRunning;
+  t->kill = false;
+  t->wakeUs = hostNowUs;
+  std::thread(hostTaskEntry, t).detach();
+}
+
+inline void hostStopTask(hostTaskFn fn) {
+  std::unique_lock<std::mutex> lock(hostVm);
+  hostTaskT *t = hostFindTask(fn);
+  if (t == 0 || t->state != taskStateRunning)
+    return;
+  t->kill = true;
+  if (t == hostSelf)
+    throw hostTaskKilled();
+}
+
+#define task void
+#define StartTask(T)                    hostStartTask(T, #T, kDefaultTaskPriority)
+#define StartTaskWithPriority(T, P)     hostStartTask(T, #T, P)
+#define StopTask(T)                     hostStopTask(T)
+#define getTaskState(T)                 (hostFindTask(T) ? hostFindTask(T)->state : taskStateStopped)
+
+inline void StopAllTasks() {
+  std::unique_lock<std::mutex> lock(hostVm);
+  hostFinished = true;
+  hostDone.notify_all();
+  hostCurrent = 0;
+  if (hostSelf != 0)
+    hostSelf->cv.wait(lock, [] { return false; });
+}
+
+inline void wait1Msec(long ms) {
+  std::unique_lock<std::mutex> lock(hostVm);
+  if (hostSelf == 0) {
+    hostClockTick(ms * 1000);
+    return;
+  }
+  hostSelf->wakeUs = hostNowUs + (ms > 0 ? ms : 0) * 1000;
+  hostSwitch(lock);
+}
+
+inline void wait10Msec(long ms) { wait1Msec(ms * 10); }
+
+inline void EndTimeSlice() {
+  std::unique_lock<std::mutex> lock(hostVm);
+  if (hostSelf == 0)
+    return;
+  hostClockTick(HOST_YIELD_US);
+  hostSelf->wakeUs = hostNowUs;
+  hostSwitch(lock);
+}
+
+inline void abortTimeslice() { EndTimeSlice(); }
+
+/*!< nSchedulePriority, the priority of the task that reads or assigns it */
+struct hostSchedulePriorityT {
+  operator int() const { return hostSelf ? hostSelf->priority : kDefaultTaskPriority; }
+  hostSchedulePriorityT &operator=(int p) {
+    if (hostSelf != 0)
+      hostSelf->priority = p;
+    return *this;
+  }
+};
+inline hostSchedulePriorityT nSchedulePriority;
+
+/*!< nCurrentTask, the number of the task that reads it */
+struct hostCurrentTaskT {
+  operator int() const { return hostSelf ? hostSelf->number : 0; }
+};
+inline hostCurrentTaskT nCurrentTask;
+inline void hogCPU() { hostHog = true; }
+inline void releaseCPU() { hostHog = false; }
+
+/*!< Read-only view of the virtual clock in milliseconds */
+struct hostClockMsT {
+  operator long() const { return (long)(hostNowUs / 1000); }
+};
+inline hostClockMsT nPgmTime;
+inline hostClockMsT nSysTime;
+
+/*
+ * ---------------------------------------------------------------------------
+ * Motors
+ * ---------------------------------------------------------------------------
+ */
+
+#ifndef HOST_MOTOR_DEG_PER_SEC
+#define HOST_MOTOR_DEG_PER_SEC 900  /*!< Encoder degrees per second at full power */
+#endif
+
+inline int motor[3];
+inline long nMotorEncoder[3];
+inline long nMotorEncoderTarget[3];
+inline TMotorRegulation nMotorPIDSpeedCtrl[3];
+inline bool bMotorReflected[3];
+inline long long hostMotorResidue[3];
+
+/*
+ * ---------------------------------------------------------------------------
+ * Sensors
+ * ---------------------------------------------------------------------------
+ */
+
+inline int SensorRaw[4];
+inline int nNxtButtonPressed = -1;
+
+/*!< Sensor arrays can be used both as SensorValue[x] and SensorValue(x) */
+template<typename T> struct hostSensorArrayT {
+  T val[4];
+  T &operator[](int i) { return val[i]; }
+  T &operator()(int i) { return val[i]; }
+};
+inline hostSensorArrayT<TSensorTypes> SensorType;
+inline hostSensorArrayT<TSensorModes> SensorMode;
+inline hostSensorArrayT<int> SensorValue;
+
+inline void SetSensorType(tSensors link, TSensorTypes type) { SensorType[link] = type; }
+inline void SetSensorMode(tSensors link, TSensorModes mode) { SensorMode[link] = mode; }
+
+/*
+ * ---------------------------------------------------------------------------
+ * Sound, buttons and LCD
+ * ---------------------------------------------------------------------------
+ */
+
+inline bool bSoundActive = false;
+inline int hostSoundsPlayed = 0;
+inline void PlaySound(TSounds sound) { hostSoundsPlayed++; }
+inline void PlayTone(int freq, int duration) { hostSoundsPlayed++; }
+
+inline char hostLCD[8][24];                     /*!< Contents of the 8 text lines */
+inline bool hostLCDEcho = false;                /*!< Echo every LCD line to stdout */
+
+template<typename T> inline T hostArg(T a) { return a; }
+inline const char *hostArg(const string &s) { return s.buf; }
+
+inline void hostLCDLine(int line, const char *text) {
+  if (line < 0 || line > 7)
+    return;
+  strncpy(hostLCD[line], text, sizeof(hostLCD[line]) - 1);
+  if (hostLCDEcho)
+    printf("LCD[%d] %s\n", line, text);
+}
+
+#define HOST_FORMAT(buf, fmt, args) \
+  char buf[64]; \
+  snprintf(buf, sizeof(buf), fmt, hostArg(args)...)
+
+template<typename... A> inline void nxtDisplayTextLine(int line, const char *fmt, A... args) {
+  HOST_FORMAT(b, fmt, args);
+  hostLCDLine(line, b);
+}
+
+template<typename... A> inline void nxtDisplayCenteredTextLine(int line, const char *fmt, A... args) {
+  HOST_FORMAT(b, fmt, args);
+  hostLCDLine(line, b);
+}
+
+template<typename... A> inline void nxtDisplayBigTextLine(int line, const char *fmt, A... args) {
+  HOST_FORMAT(b, fmt, args);
+  hostLCDLine(line, b);
+}
+
+template<typename... A> inline void nxtDisplayCenteredBigTextLine(int line, const char *fmt, A... args) {
+  HOST_FORMAT(b, fmt, args);
+  hostLCDLine(line, b);
+}
+
+template<typename... A> inline void nxtDisplayString(int line, const char *fmt, A... args) {
+  HOST_FORMAT(b, fmt, args);
+  hostLCDLine(line, b);
+}
+
+inline void nxtDisplayClearTextLine(int line) { hostLCDLine(line, ""); }
+inline void eraseDisplay() { memset(hostLCD, 0, sizeof(hostLCD)); }
+
+template<typename... A> inline void StringFormat(string &dest, const char *fmt, A... args) {
+  HOST_FORMAT(b, fmt, args);
+  dest = b;
+}
+
+inline void strcpy(string &dest, const char *src) { dest = src; }
+inline int strlen(const string &s) { return (int)::strlen(s.buf); }
+
+/*
+ * ---------------------------------------------------------------------------
+ * Maths
+ * ---------------------------------------------------------------------------
+ */
+
+inline int sgn(float x) { return (x > 0) - (x < 0); }
+inline float radiansToDegrees(float r) { return r * 180.0 / PI; }
+inline float degreesToRadians(float d) { return d * PI / 180.0; }
+inline int random(int range) { return rand() % (range + 1); }
+
+/*
+ * ---------------------------------------------------------------------------
+ * Flash file system, backed by files in the current directory
+ * ---------------------------------------------------------------------------
+ */
+
+inline std::map<int, FILE *> hostFiles;
+inline int hostNextHandle = 1;
+inline long hostHogWrites = 0;  /*!< Bytes written to files while a task hogged the CPU */
+
+inline void OpenWrite(TFileHandle &handle, TFileIOResult &result, const char *name, int size) {
+  FILE *f = fopen(name, "wb");
+  if (f == 0) {
+    result = ioRsltNoSpace;
+    return;
+  }
+  handle = hostNextHandle++;
+  hostFiles[handle] = f;
+  result = ioRsltSuccess;
+}
+
+template<typename T> inline void OpenRead(TFileHandle &handle, TFileIOResult &result, const char *name, T &size) {
+  FILE *f = fopen(name, "rb");
+  if (f == 0) {
+    result = ioRsltFileNotFound;
+    return;
+  }
+  fseek(f, 0, SEEK_END);
+  size = (T)ftell(f);
+  fseek(f, 0, SEEK_SET);
+  handle = hostNextHandle++;
+  hostFiles[handle] = f;
+  result = ioRsltSuccess;
+}
+
+inline void Close(TFileHandle handle, TFileIOResult &result) {
+  if (hostFiles.count(handle) == 0) {
+    result = ioRsltIllegalHandle;
+    return;
+  }
+  fclose(hostFiles[handle]);
+  hostFiles.erase(handle);
+  result = ioRsltSuccess;
+}
+
+inline void Delete(const char *name, TFileIOResult &result) {
+  result = (remove(name) == 0) ? ioRsltSuccess : ioRsltFileNotFound;
+}
+
+template<typename T> inline void hostWrite(TFileHandle handle, TFileIOResult &result, T val, int n) {
+  if (hostFiles.count(handle) == 0) {
+    result = ioRsltIllegalHandle;
+    return;
+  }
+  if (hostHog)
+    hostHogWrites += n;
+  for (int i = 0; i < n; i++)
+    fputc((int)(((long long)val >> (8 * i)) & 0xFF), hostFiles[handle]);
+  result = ioRsltSuccess;
+}
+
+template<typename T> inline void hostRead(TFileHandle handle, TFileIOResult &result, T &val, int n) {
+  if (hostFiles.count(handle) == 0) {
+    result = ioRsltIllegalHandle;
+    return;
+  }
+  long long v = 0;
+  for (int i = 0; i < n; i++) {
+    int c = fgetc(hostFiles[handle]);
+    if (c == EOF) {
+      result = ioRsltEndOfFile;
+      return;
+    }
+    v |= (long long)c << (8 * i);
+  }
+  if (n == 2) v = (short)v;
+  if (n == 4) v = (int)v;
+  val = (T)v;
+  result = ioRsltSuccess;
+}
+
+inline void WriteByte(TFileHandle h, TFileIOResult &r, char v) { hostWrite(h, r, v, 1); }
+inline void WriteShort(TFileHandle h, TFileIOResult &r, short v) { hostWrite(h, r, v, 2); }
+inline void WriteLong(TFileHandle h, TFileIOResult &r, long v) { hostWrite(h, r, v, 4); }
+inline void WriteText(TFileHandle h, TFileIOResult &r, const char *s) {
+  for (; *s; s++) hostWrite(h, r, *s, 1);
+}
+inline void WriteFloat(TFileHandle h, TFileIOResult &r, float v) {
+  int bits;
+  ::memcpy(&bits, &v, 4);
+  hostWrite(h, r, bits, 4);
+}
+template<typename T> inline void ReadByte(TFileHandle h, TFileIOResult &r, T &v) { hostRead(h, r, v, 1); }
+template<typename T> inline void ReadShort(TFileHandle h, TFileIOResult &r, T &v) { hostRead(h, r, v, 2); }
+template<typename T> inline void ReadLong(TFileHandle h, TFileIOResult &r, T &v) { hostRead(h, r, v, 4); }
+inline void ReadFloat(TFileHandle h, TFileIOResult &r, float &v) {
+  int bits = 0;
+  hostRead(h, r, bits, 4);
+  ::memcpy(&v, &bits, 4);
+}
+
+/*!< The datalog, appended to nxtdatalog.txt when saved */
+inline std::vector<long> hostDatalog;
+inline void AddToDatalog(long val) { hostDatalog.push_back(val); }
+inline void SaveNxtDatalog() {
+  FILE *f = fopen("nxtdatalog.txt", "a");
+  if (f == 0)
+    return;
+  for (size_t i = 0; i < hostDatalog.size(); i++)
+    fprintf(f, "%ld\n", hostDatalog[i]);
+  fclose(f);
+  hostDatalog.clear();
+}
+
+/*
+ * ---------------------------------------------------------------------------
+ * The I2C bus, see simbus.h for the device models
+ * ---------------------------------------------------------------------------
+ */
+
+#include "simbus.h"
+#include "replay.h"
+
+/*
+ * ---------------------------------------------------------------------------
+ * Memory helpers, RobotC's memset/memcpy take their arguments by reference
+ * ---------------------------------------------------------------------------
+ */
+
+inline long hostMemBytes = 0;   /*!< Bytes cleared or copied by memset() and memcpy(), see the request building section of bench.c */
+
+template<typename T> inline void hostMemset(T &dest, int val, size_t n) {
+  hostMemBytes += n;
+  ::memset((void *)&dest, val, n);
+}
+
+template<typename T, typename U> inline void hostMemcpy(T &dest, const U &src, size_t n) {
+  hostMemBytes += n;
+  ::memcpy((void *)&dest, (const void *)&src, n);
+}
+
+#define memset(D, V, N) hostMemset(D, V, N)
+#define memcpy(D, S, N) hostMemcpy(D, S, N)
+
+/*
+ * Advance everything that depends on time: motors and the I2C bus.
+ */
+inline void hostClockTick(long long us) {
+  if (us <= 0)
+    return;
+  hostNowUs += us;
+  for (int i = 0; i < 3; i++) {
+    hostMotorResidue[i] += (long long)motor[i] * HOST_MOTOR_DEG_PER_SEC * us / 100;
+    nMotorEncoder[i] += (long)(hostMotorResidue[i] / 1000000);
+    hostMotorResidue[i] %= 1000000;
+  }
+}
+
+/*
+ * ---------------------------------------------------------------------------
+ * Program entry point.  The RobotC "task main()" is renamed to hostTaskMain()
+ * and started as the first task.
+ * ---------------------------------------------------------------------------
+ */
+
+void hostTaskMain();
+void hostConfig() __attribute__((weak));
+void hostSetup() __attribute__((weak));
+
+#ifndef HOST_NO_MAIN
+int main(int argc, char **argv) {
+  if (getenv("HOST_RUN_MSEC") != 0)
+    hostRunLimitUs = atoll(getenv("HOST_RUN_MSEC")) * 1000;
+  hostLCDEcho = (getenv("HOST_LCD") != 0);
+
+  if (hostConfig)
+    hostConfig();
+  if (hostSetup)
+    hostSetup();
+  if (getenv("HOST_REPLAY") != 0 && !hostReplayLoad(getenv("HOST_REPLAY")))
+    return 1;
+
+  hostStartTask(hostTaskMain, "main", kDefaultTaskPriority);
+  std::unique_lock<std::mutex> lock(hostVm);
+  hostCurrent = hostTasks[0];
+  hostCurrent->sliceStartUs = hostNowUs;
+  hostCurrent->cv.notify_one();
+  hostDone.wait(lock, [] { return hostFinished; });
+
+  printf("host: program ended at %lld ms\n", hostNowUs / 1000);
+  if (getenv("HOST_REPLAY") != 0)
+    hostReplayReport();
+  fflush(stdout);
+  std::_Exit(0);
+}
+#endif
+
+#define main hostTaskMain
+
+#endif // __HOST_ROBOTC_H__
+/* @} */
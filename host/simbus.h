@@ -0,0 +1,253 @@
+/*!@addtogroup host
+ * @{
+ */
+
+/** \file simbus.h
+ * \brief Simulated NXT I2C bus for the host emulation
+ *
+ * simbus.h provides sendI2CMsg(), readI2CReply(), nI2CStatus[] and
+ * nI2CBytesReady[] for the host build.  Devices are plugged into a sensor port
+ * and keyed by their 8 bit I2C address.  The default device is a plain
+ * 256 byte register file with an auto-incrementing register pointer, which is
+ * how nearly all NXT I2C sensors behave.  Devices with side effects override
+ * regWrite() and regRead().
+ *
+ * Each device can be told to fail transactions, which is used for fault
+ * injection.  Devices can also set their own timing with durationUs(), see
+ * replay.h.
+ *
+ * Timing model: a transaction takes a fixed set-up time, plus the time to
+ * clock every byte out and in, plus a turnaround for the repeated start when
+ * a reply is expected.  All three depend on the port's sensor type.  Reading
+ * nI2CStatus costs HOST_I2C_POLL_US.  The defaults are rough figures for
+ * the NXT firmware, override them with -D to model something else.
+ *
+ * License: You may use this code as you wish, provided you give credit where its due.
+ */
+
+#ifndef __HOST_SIMBUS_H__
+#define __HOST_SIMBUS_H__
+
+#ifndef HOST_I2C_POLL_US
+#define HOST_I2C_POLL_US    20    /*!< Time it takes to read nI2CStatus once */
+#endif
+
+#ifndef HOST_I2C_BYTE_US
+#define HOST_I2C_BYTE_US    1000  /*!< Time it takes to clock one byte over the bus */
+#endif
+
+#ifndef HOST_I2C_FAST_BYTE_US
+#define HOST_I2C_FAST_BYTE_US 400 /*!< Time it takes to clock one byte over a port set to one of the fast types */
+#endif
+
+#ifndef HOST_I2C_SETUP_US
+#define HOST_I2C_SETUP_US   1000  /*!< Time before the first byte, the firmware starts transactions on its 1 ms tick */
+#endif
+
+#ifndef HOST_I2C_FAST_SETUP_US
+#define HOST_I2C_FAST_SETUP_US 500  /*!< Set-up time on a fast port */
+#endif
+
+#ifndef HOST_I2C_SKIP_SETUP_US
+#define HOST_I2C_SKIP_SETUP_US 250  /*!< Set-up time on a port that skips the firmware's intermediate states */
+#endif
+
+#ifndef HOST_I2C_TURNAROUND_US
+#define HOST_I2C_TURNAROUND_US 500  /*!< Repeated start between the write and the read part of a transaction */
+#endif
+
+#ifndef HOST_I2C_FAST_TURNAROUND_US
+#define HOST_I2C_FAST_TURNAROUND_US 200 /*!< Turnaround on a fast port */
+#endif
+
+/*!< A simulated I2C device */
+struct hostI2CDevice {
+  ubyte address;
+  ubyte regs[256];
+  ubyte ptr;                      /*!< Current register pointer */
+  int failNext;                   /*!< Number of upcoming transactions that will fail */
+  TI2CStatus failWith;            /*!< Status reported for failed transactions */
+  long transactions;              /*!< Number of transactions addressed to this device */
+
+  hostI2CDevice(ubyte addr) : address(addr), ptr(0), failNext(0), failWith(ERR_COMM_BUS_ERR), transactions(0) {
+    ::memset(regs, 0, sizeof(regs));
+  }
+  virtual ~hostI2CDevice() {}
+
+  /*!< Called for every register written by the NXT */
+  virtual void regWrite(ubyte reg, ubyte val) { regs[reg] = val; }
+
+  /*!< Called for every register read by the NXT */
+  virtual ubyte regRead(ubyte reg) { return regs[reg]; }
+
+  /*!< Called at the start of every transaction, return false to fail it */
+  virtual bool accept(tSensors link) {
+    if (failNext > 0) {
+      failNext--;
+      return false;
+    }
+    return true;
+  }
+
+  /*!
+   * Called first for every transaction, out holds the address and the bytes
+   * after it.  Return how long the transaction takes in us, or -1 to use the
+   * timing model.
+   */
+  virtual long long durationUs(tSensors link, const ubyte *out, int outlen, int replylen) { return -1; }
+
+  /*!
+   * Handle one complete transaction.  out holds everything after the
+   * address byte, in receives replylen bytes.
+   */
+  virtual void transact(const ubyte *out, int outlen, ubyte *in, int replylen) {
+    if (outlen > 0)
+      ptr = out[0];
+    for (int i = 1; i < outlen; i++)
+      regWrite(ptr++, out[i]);
+    for (int i = 0; i < replylen; i++)
+      in[i] = regRead(ptr++);
+  }
+};
+
+/*!< State of a single sensor port's I2C channel */
+struct hostI2CPortT {
+  std::map<int, hostI2CDevice *> devices;
+  long long doneUs;               /*!< When the transaction in flight completes */
+  TI2CStatus result;              /*!< Status once the transaction completes */
+  ubyte reply[16];
+  int replyLen;
+  long transactions;
+  long bytes;
+  long polls;
+  long long busyUs;               /*!< Total time the bus spent on transactions */
+};
+
+inline hostI2CPortT hostI2CPort[4];
+
+/*!< Plug a device into a sensor port and configure the port for I2C */
+inline void hostI2CAttach(tSensors link, hostI2CDevice *dev) {
+  hostI2CPort[link].devices[dev->address & 0xFE] = dev;
+  if (SensorType[link] == sensorNone)
+    SensorType[link] = sensorI2CCustom;
+}
+
+/*!< Unplug all devices from a sensor port */
+inline void hostI2CDetach(tSensors link) {
+  hostI2CPort[link].devices.clear();
+}
+
+/*!< Modelled time a transaction takes on a port, see the timing model above */
+inline long long hostI2CDuration(tSensors link, int outlen, int replylen) {
+  long long setup = HOST_I2C_SETUP_US;
+  long long perbyte = HOST_I2C_BYTE_US;
+  long long turnaround = HOST_I2C_TURNAROUND_US;
+
+  switch (SensorType[link]) {
+    case sensorI2CCustomFastSkipStates:
+    case sensorI2CCustomFastSkipStates9V:
+      setup = HOST_I2C_SKIP_SETUP_US;
+      perbyte = HOST_I2C_FAST_BYTE_US;
+      turnaround = HOST_I2C_FAST_TURNAROUND_US;
+      break;
+    case sensorI2CCustomFast:
+    case sensorI2CCustomFast9V:
+      setup = HOST_I2C_FAST_SETUP_US;
+      perbyte = HOST_I2C_FAST_BYTE_US;
+      turnaround = HOST_I2C_FAST_TURNAROUND_US;
+      break;
+    default:
+      break;
+  }
+  return setup + (long long)(outlen + replylen) * perbyte + ((replylen > 0) ? turnaround : 0);
+}
+
+/*!< Clear the bus counters of all ports */
+inline void hostI2CResetCounters() {
+  for (int i = 0; i < 4; i++) {
+    hostI2CPort[i].transactions = 0;
+    hostI2CPort[i].bytes = 0;
+    hostI2CPort[i].polls = 0;
+    hostI2CPort[i].busyUs = 0;
+  }
+}
+
+inline void sendI2CMsg(tSensors link, const ubyte &msg, int replylen) {
+  const ubyte *buf = &msg;
+  hostI2CPortT &port = hostI2CPort[link];
+  int outlen = buf[0];
+
+  if (replylen > 16) replylen = 16;
+  if (replylen < 0) replylen = 0;
+
+  port.transactions++;
+  port.bytes += outlen + replylen;
+  port.replyLen = replylen;
+  ::memset(port.reply, 0, sizeof(port.reply));
+
+  hostI2CDevice *dev = 0;
+  if (outlen > 0 && port.devices.count(buf[1] & 0xFE))
+    dev = port.devices[buf[1] & 0xFE];
+
+  long long duration = (dev != 0) ? dev->durationUs(link, buf + 1, outlen, replylen) : -1;
+  if (duration < 0)
+    duration = hostI2CDuration(link, outlen, replylen);
+  port.doneUs = hostNowUs + duration;
+  port.busyUs += duration;
+
+  if (dev == 0) {
+    port.result = ERR_COMM_BUS_ERR;
+    return;
+  }
+  dev->transactions++;
+  if (!dev->accept(link)) {
+    port.result = dev->failWith;
+    return;
+  }
+  dev->transact(buf + 2, outlen - 1, port.reply, replylen);
+  port.result = NO_ERR;
+}
+
+inline void readI2CReply(tSensors link, ubyte &reply, int replylen) {
+  ubyte *buf = &reply;
+  for (int i = 0; i < replylen && i < 16; i++)
+    buf[i] = hostI2CPort[link].reply[i];
+}
+
+/*!< nI2CStatus[link], every read costs HOST_I2C_POLL_US of bus polling */
+struct hostI2CStatusT {
+  TI2CStatus operator[](int link) const {
+    hostBusy(HOST_I2C_POLL_US);
+    hostI2CPortT &port = hostI2CPort[link];
+    port.polls++;
+    if (hostNowUs < port.doneUs)
+      return STAT_COMM_PENDING;
+    return port.result;
+  }
+};
+inline hostI2CStatusT nI2CStatus;
+
+/*!< A single nI2CBytesReady[link], assigning to it discards the reply */
+struct hostI2CBytesReadyRefT {
+  int link;
+  operator int() const {
+    hostI2CPortT &port = hostI2CPort[link];
+    return (hostNowUs < port.doneUs) ? 0 : port.replyLen;
+  }
+  hostI2CBytesReadyRefT &operator=(int n) {
+    hostI2CPort[link].replyLen = n;
+    return *this;
+  }
+};
+
+/*!< nI2CBytesReady[link] */
+struct hostI2CBytesReadyT {
+  hostI2CBytesReadyRefT operator[](int link) const {
+    hostI2CBytesReadyRefT ref = {link};
+    return ref;
+  }
+};
+inline hostI2CBytesReadyT nI2CBytesReady;
+
+#endif // __HOST_SIMBUS_H__
+/* @} */
@@ -0,0 +1,38 @@
+/*!@addtogroup host
+ * @{
+ */
+
+/** \file theodore-config.h
+ * \brief Host equivalent of the "#pragma config" lines of theodore.c
+ *
+ * Keep this in sync with the top of theodore.c.  The GPS is a plain register
+ * file, the sonar always sees a clear path.
+ *
+ * License: You may use this code as you wish, provided you give credit where its due.
+ */
+
+#ifndef __HOST_THEODORE_CONFIG_H__
+#define __HOST_THEODORE_CONFIG_H__
+
+const tSensors sonarSensor = S1;
+const tSensors gpsSensor = S2;
+
+const tMotor right = motorA;
+const tMotor sensorMotor = motorB;
+const tMotor left = motorC;
+
+inline hostI2CDevice hostGPS(0x06);
+
+void hostConfig() {
+  SensorType[sonarSensor] = sensorSONAR;
+  SensorValue[sonarSensor] = 255;
+  SensorType[gpsSensor] = sensorLowSpeed;
+  hostI2CAttach(gpsSensor, &hostGPS);
+
+  nMotorPIDSpeedCtrl[right] = mtrSpeedReg;
+  nMotorPIDSpeedCtrl[sensorMotor] = mtrSpeedReg;
+  nMotorPIDSpeedCtrl[left] = mtrSpeedReg;
+}
+
+#endif // __HOST_THEODORE_CONFIG_H__
+/* @} */
@@ -20,6 +20,9 @@ void backup();
 
 
 task main() {
+  // Run the GPS at fast I2C if it copes with it
+  I2CnegotiateSpeed(gpsSensor, DGPS_I2C_ADDR);
+
   // Setup for precision control of sensor motor
   nMotorEncoder[sensorMotor] = 0;
   nMotorEncoderTarget[sensorMotor] = 0;